@@ -31,6 +31,7 @@ int main() {
     };
     ds3231_t ds3231;
 
+#if DS3231_CONFIG_ALARMS
     /* Set the desired alarm time */
     ds3231_alarm_1_t alarm = {
         .seconds = 7,
@@ -40,6 +41,7 @@ int main() {
         .day = 0,
         .am_pm = false
     };
+#endif
 
     /* Initiliaze ds3231 struct. */
     ds3231_init(&ds3231, i2c_default, DS3231_DEVICE_ADRESS, AT24C32_EEPROM_ADRESS_0);
@@ -64,7 +66,9 @@ int main() {
 
     /* Update the DS3231 time registers with the desired time and set alarm 1 to send interrupt signal. */
     ds3231_configure_time(&ds3231, &ds3231_data);
+#if DS3231_CONFIG_ALARMS
     ds3231_set_alarm_1(&ds3231, &alarm, ON_MATCHING_SECOND_AND_MINUTE);
+#endif
     ds3231_set_interrupt_callback_function(int_pin, &ds3231_interrupt_callback);
 
     sleep_ms(1000);
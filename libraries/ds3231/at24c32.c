@@ -11,6 +11,8 @@
  */
 
  #include "ds3231.h"
+ #include "ds3231_storage.h"
+ #include "hardware/timer.h"
 
 /**
  * @brief                   Library function to write to a page of an I2C EEPROM.
@@ -20,24 +22,29 @@
  * @param[in] dev_addr      Adress of the I2C device.
  * @param[in] page_addr     Register adress to be written.
  * @param[in] starting_byte Which byte the page write must start from. Max value = 31;
- * @param[in] length        Length of the data to be written in bytes.
+ * @param[in] length        Length of the data to be written in bytes. starting_byte + length must not exceed 32.
  * @param[in] data          Pointer to the data buffer.
  * @return                  0 if succesful, -1 if i2c failure.
  */
 int at24c32_i2c_write_page(i2c_inst_t * i2c, uint8_t dev_addr, 
     uint8_t page_addr, uint8_t starting_byte, size_t length, uint8_t * data)
 {
+    DS3231_CRUMB_API(DS3231_CRUMB_AT24C32_WRITE_PAGE);
     if(!length)
         return -1;
-    if(starting_byte >= AT24C32_PAGE_SIZE)
+    if(page_addr >= AT24C32_PAGE_COUNT)
         return -1;
+    /* Page writes roll over within the page, so the data must not pass the end of it. */
+    if((starting_byte + length) > AT24C32_PAGE_SIZE)
+        return -1;
+    uint16_t word_addr = ((uint16_t)page_addr * AT24C32_PAGE_SIZE) + starting_byte;
     uint8_t messeage[length + 2];
-    messeage[0] = page_addr;
-    messeage[1] = starting_byte;
+    messeage[0] = (uint8_t)(word_addr >> 8);
+    messeage[1] = (uint8_t)(word_addr & 0xFF);
     for(int i = 0; i < length; i++) {
         messeage[i + 2] = data[i];
     }
-    if(i2c_write_blocking(i2c, dev_addr, messeage, (length + 2), false) == PICO_ERROR_GENERIC)
+    if(ds3231_bus_write(i2c, dev_addr, messeage, (length + 2), false) == PICO_ERROR_GENERIC)
         return -1;
     return 0;
 }
@@ -49,26 +56,51 @@ int at24c32_i2c_write_page(i2c_inst_t * i2c, uint8_t dev_addr,
  * @param[in] dev_addr      Adress of the I2C device.
  * @param[in] page_addr     Register adress to be written.
  * @param[in] starting_byte Which byte the page read must start from. Max value = 31;
- * @param[in] length        Length of the data to be written in bytes.
+ * @param[in] length        Length of the data to be read in bytes. Reads continue into the following pages.
  * @param[out] data         Pointer to the data buffer.
  * @return                  0 if succesful, -1 if i2c failure.
  */
 int at24c32_i2c_read_page(i2c_inst_t * i2c, uint8_t dev_addr, 
     uint8_t page_addr, uint8_t starting_byte, size_t length, uint8_t * data)
 {
+    DS3231_CRUMB_API(DS3231_CRUMB_AT24C32_READ_PAGE);
     if(!length)
         return -1;
+    if(page_addr >= AT24C32_PAGE_COUNT || starting_byte >= AT24C32_PAGE_SIZE)
+        return -1;
+    uint16_t word_addr = ((uint16_t)page_addr * AT24C32_PAGE_SIZE) + starting_byte;
     uint8_t messeage[2];
-    messeage[0] = page_addr;
-    messeage[1] = starting_byte;
-    if(i2c_write_blocking(i2c, dev_addr, messeage, 2, true) == PICO_ERROR_GENERIC)
+    messeage[0] = (uint8_t)(word_addr >> 8);
+    messeage[1] = (uint8_t)(word_addr & 0xFF);
+    if(ds3231_bus_write(i2c, dev_addr, messeage, 2, true) == PICO_ERROR_GENERIC)
         return -1;
-    if(i2c_read_blocking(i2c, dev_addr, data, length, false) == PICO_ERROR_GENERIC)
+    if(ds3231_bus_read(i2c, dev_addr, data, length, false) == PICO_ERROR_GENERIC)
         return -1;
     
     return 0;
 }
 
+/**
+ * @brief               Wait until the EEPROM finishes its internal write cycle.
+ * The AT24C32 does not acknowledge its adress for up to 10 ms after a write, so it is polled
+ * with single byte reads until it does. The read moves the internal adress counter.
+ * 
+ * @param[in] i2c           I2C instance used.
+ * @param[in] dev_addr      Device adress.
+ * @param[in] timeout_us    Maximum time to wait in microseconds.
+ * @return                  0 if the EEPROM is ready, -1 if it did not respond in time.
+ */
+int at24c32_wait_write_cycle(i2c_inst_t * i2c, uint8_t dev_addr, uint32_t timeout_us) {
+    DS3231_CRUMB_API(DS3231_CRUMB_AT24C32_WAIT_WRITE_CYCLE);
+    uint32_t start = time_us_32();
+    uint8_t dummy;
+    while(ds3231_bus_read(i2c, dev_addr, &dummy, 1, false) == PICO_ERROR_GENERIC) {
+        if((time_us_32() - start) > timeout_us)
+            return -1;
+    }
+    return 0;
+}
+
 /**
  * @brief               Read from the last written adress in EEPROM. 
  * The internal data word address counter maintains the last address 
@@ -84,9 +116,10 @@ int at24c32_i2c_read_page(i2c_inst_t * i2c, uint8_t dev_addr,
 int at24c32_read_current_adress(i2c_inst_t * i2c, uint8_t dev_addr,
     size_t length, uint8_t * data) 
 {
+    DS3231_CRUMB_API(DS3231_CRUMB_AT24C32_READ_CURRENT_ADRESS);
     if(!length)
         return -1;
-    if(i2c_read_blocking(i2c, dev_addr, data, length, false) == PICO_ERROR_GENERIC)
+    if(ds3231_bus_read(i2c, dev_addr, data, length, false) == PICO_ERROR_GENERIC)
         return -1;
     return 0;
 }
@@ -99,12 +132,13 @@ int at24c32_read_current_adress(i2c_inst_t * i2c, uint8_t dev_addr,
  * @return                  0 if succesful.
  */
 int at24c32_write_current_time(ds3231_t * rtc, uint8_t page_addr) {
+    DS3231_CRUMB_API(DS3231_CRUMB_AT24C32_WRITE_CURRENT_TIME);
     ds3231_data_t current_time;
     if(ds3231_read_current_time(rtc, &current_time)) {
         return -1;
     }
     uint8_t data[8] = {0};
-    if(rtc->am_pm_mode) {
+    if(DS3231_AM_PM_MODE(rtc)) {
         data[0] = current_time.seconds;
         data[1] = current_time.minutes;
         data[2] = current_time.hours;
@@ -128,3 +162,71 @@ int at24c32_write_current_time(ds3231_t * rtc, uint8_t page_addr) {
     return 0;
 }
 
+
+/*--------------------------------------------------------------------------------------------------------*/
+
+/* AT24C32 backend of the storage interface. */
+
+static int at24c32_storage_ready(ds3231_at24c32_storage_t * eeprom) {
+    if(eeprom->write_pending) {
+        if(at24c32_wait_write_cycle(eeprom->i2c, eeprom->dev_addr, AT24C32_WRITE_CYCLE_US))
+            return -1;
+        eeprom->write_pending = false;
+    }
+    return 0;
+}
+
+static int at24c32_storage_read(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data) {
+    ds3231_at24c32_storage_t * eeprom = (ds3231_at24c32_storage_t *)storage;
+    if(at24c32_storage_ready(eeprom))
+        return -1;
+    return at24c32_i2c_read_page(eeprom->i2c, eeprom->dev_addr, page, offset, length, data);
+}
+
+static int at24c32_storage_program(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data) {
+    ds3231_at24c32_storage_t * eeprom = (ds3231_at24c32_storage_t *)storage;
+    if(at24c32_storage_ready(eeprom))
+        return -1;
+    if(at24c32_i2c_write_page(eeprom->i2c, eeprom->dev_addr, page, offset, length, (uint8_t *)data))
+        return -1;
+    eeprom->write_pending = true;
+    return 0;
+}
+
+static int at24c32_storage_busy(ds3231_storage_t * storage) {
+    ds3231_at24c32_storage_t * eeprom = (ds3231_at24c32_storage_t *)storage;
+    if(!eeprom->write_pending)
+        return 0;
+    /* A single adress poll, the EEPROM does not acknowledge while it is writing. */
+    uint8_t dummy;
+    if(ds3231_bus_read(eeprom->i2c, eeprom->dev_addr, &dummy, 1, false) == PICO_ERROR_GENERIC)
+        return 1;
+    eeprom->write_pending = false;
+    return 0;
+}
+
+static const ds3231_storage_ops_t at24c32_storage_ops = {
+    .read = &at24c32_storage_read,
+    .program = &at24c32_storage_program,
+    .busy = &at24c32_storage_busy
+};
+
+/**
+ * @brief               Use the AT24C32 EEPROM of a DS3231 module as a storage device.
+ * Reads and programs wait for the previous write cycle to finish by polling the EEPROM.
+ * 
+ * @param[out] eeprom   AT24C32 storage struct.
+ * @param[in] rtc       DS3231 struct that holds the I2C instance and the EEPROM adress.
+ * @return              0 if succesful.
+ */
+int ds3231_at24c32_storage_init(ds3231_at24c32_storage_t * eeprom, ds3231_t * rtc) {
+    eeprom->storage.ops = &at24c32_storage_ops;
+    eeprom->storage.page_size = AT24C32_PAGE_SIZE;
+    eeprom->storage.page_count = AT24C32_PAGE_COUNT;
+    eeprom->storage.erase_pages = 1;
+    eeprom->storage.write_cycle_us = AT24C32_WRITE_CYCLE_US;
+    eeprom->i2c = rtc->i2c;
+    eeprom->dev_addr = rtc->at24c32_addr;
+    eeprom->write_pending = false;
+    return 0;
+}
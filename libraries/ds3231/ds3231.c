@@ -11,6 +11,81 @@
  */
 
 #include "ds3231.h"
+#include "hardware/timer.h"
+#if DS3231_CONFIG_TRACE
+#include "ds3231_trace.h"
+#endif
+#if DS3231_CONFIG_METRICS
+#include "ds3231_metrics.h"
+#endif
+
+/**
+ * @brief               Library function that every I2C write of the driver goes through.
+ * Same as i2c_write_blocking, except that the transaction is captured or replayed
+ * if a trace is active and counted if metrics are active. Leaves breadcrumbs of the transfer.
+ * 
+ * @param[in] i2c       I2C instance used.
+ * @param[in] dev_addr  Adress of the I2C device.
+ * @param[in] src       Data to be written.
+ * @param[in] length    Length of the data in bytes.
+ * @param[in] nostop    If true, the bus is not released after the transfer.
+ * @return              Number of bytes written, PICO_ERROR_GENERIC if i2c failure.
+ */
+int ds3231_bus_write(i2c_inst_t * i2c, uint8_t dev_addr, 
+    const uint8_t * src, size_t length, bool nostop)
+{
+#if DS3231_CONFIG_METRICS
+    uint32_t start = time_us_32();
+#endif
+    int result;
+    DS3231_CRUMB_WRITE_START(dev_addr, length ? src[0] : 0, length);
+#if DS3231_CONFIG_TRACE
+    if(ds3231_trace_active)
+        result = ds3231_trace_transfer(ds3231_trace_active, i2c, dev_addr, (uint8_t *)src, length, nostop, false);
+    else
+#endif
+        result = i2c_write_blocking(i2c, dev_addr, src, length, nostop);
+    DS3231_CRUMB_END(result < 0);
+#if DS3231_CONFIG_METRICS
+    if(ds3231_metrics_active)
+        ds3231_metrics_transfer(ds3231_metrics_active, start, result);
+#endif
+    return result;
+}
+
+/**
+ * @brief               Library function that every I2C read of the driver goes through.
+ * Same as i2c_read_blocking, except that the transaction is captured or replayed
+ * if a trace is active and counted if metrics are active. Leaves breadcrumbs of the transfer.
+ * 
+ * @param[in] i2c       I2C instance used.
+ * @param[in] dev_addr  Adress of the I2C device.
+ * @param[out] dst      Buffer to store the read data.
+ * @param[in] length    Length of the data in bytes.
+ * @param[in] nostop    If true, the bus is not released after the transfer.
+ * @return              Number of bytes read, PICO_ERROR_GENERIC if i2c failure.
+ */
+int ds3231_bus_read(i2c_inst_t * i2c, uint8_t dev_addr, 
+    uint8_t * dst, size_t length, bool nostop)
+{
+#if DS3231_CONFIG_METRICS
+    uint32_t start = time_us_32();
+#endif
+    int result;
+    DS3231_CRUMB_READ_START(dev_addr, length);
+#if DS3231_CONFIG_TRACE
+    if(ds3231_trace_active)
+        result = ds3231_trace_transfer(ds3231_trace_active, i2c, dev_addr, dst, length, nostop, true);
+    else
+#endif
+        result = i2c_read_blocking(i2c, dev_addr, dst, length, nostop);
+    DS3231_CRUMB_END(result < 0);
+#if DS3231_CONFIG_METRICS
+    if(ds3231_metrics_active)
+        ds3231_metrics_transfer(ds3231_metrics_active, start, result);
+#endif
+    return result;
+}
 
 /**
  * @brief               Library function to read a specific I2C register adress.
@@ -28,10 +103,10 @@ int i2c_read_reg(i2c_inst_t * i2c, uint8_t dev_addr,
     if(!length) 
         return -1;
     uint8_t reg = reg_addr; 
-    if(i2c_write_blocking(i2c, dev_addr, &reg, 1, true) == PICO_ERROR_GENERIC) {
+    if(ds3231_bus_write(i2c, dev_addr, &reg, 1, true) == PICO_ERROR_GENERIC) {
         return -1;
     }
-    if(i2c_read_blocking(i2c, dev_addr, data, length, false) == PICO_ERROR_GENERIC) {
+    if(ds3231_bus_read(i2c, dev_addr, data, length, false) == PICO_ERROR_GENERIC) {
         return -1;
     }
     return 0;
@@ -57,7 +132,7 @@ int i2c_write_reg(i2c_inst_t * i2c, uint8_t dev_addr,
     for(int i = 0; i < length; i++) {
         messeage[i + 1] = data[i];
     }
-    if(i2c_write_blocking(i2c, dev_addr, messeage, (length + 1), false) == PICO_ERROR_GENERIC)
+    if(ds3231_bus_write(i2c, dev_addr, messeage, (length + 1), false) == PICO_ERROR_GENERIC)
         return -1;
     return 0;
 }
@@ -75,6 +150,7 @@ uint8_t bin_to_bcd(const uint8_t data) {
     return ((twos_digit << 4) + ones_digit);
 }
 
+#if DS3231_CONFIG_AM_PM
 /**
  * @brief           Library function that takes an 8 bit unsigned integer and converts it into
  * Binary Coded Decimal number where bit 5 and 6 represent the AM/PM characteristics.
@@ -92,6 +168,32 @@ uint8_t bin_to_bcd_am_pm(uint8_t data) {
     temp |= (am_pm << 5);
     return temp;
 }
+#endif
+
+/* Limit hours to the range of the current mode. */
+static uint8_t ds3231_clamp_hours(ds3231_t * rtc, uint8_t hours) {
+    if(DS3231_AM_PM_MODE(rtc)) {
+        if(hours > 12)
+            return 12;
+        if(hours < 1)
+            return 1;
+        return hours;
+    }
+    return hours > 23 ? 23 : hours;
+}
+
+/* Encode hours for the time and alarm hour registers. Bit 6 selects 12-hour mode and bit 5 is PM. */
+static uint8_t ds3231_encode_hours(ds3231_t * rtc, uint8_t hours, bool am_pm) {
+#if DS3231_CONFIG_AM_PM
+    if(DS3231_AM_PM_MODE(rtc)) {
+        uint8_t temp = bin_to_bcd_am_pm(hours) | (0x01 << 6);
+        if(am_pm)
+            temp |= (0x01 << 5);
+        return temp;
+    }
+#endif
+    return bin_to_bcd(hours);
+}
 
 /**
  * @brief                   Initiliaze ds3231 struct and specify which I2C instance is going to be used.
@@ -103,7 +205,9 @@ uint8_t bin_to_bcd_am_pm(uint8_t data) {
  * @return                  0 if succesful. 
  */
 int ds3231_init(ds3231_t * rtc, i2c_inst_t * i2c, uint8_t dev_addr, uint8_t eeprom_addr) {
+    DS3231_CRUMB_API(DS3231_CRUMB_INIT);
     rtc->am_pm_mode = false;
+    rtc->int_owner = DS3231_INT_FREE;
     rtc->i2c = i2c;
     if(dev_addr)
         rtc->ds3231_addr = dev_addr;
@@ -143,6 +247,7 @@ int ds3231_init(ds3231_t * rtc, i2c_inst_t * i2c, uint8_t dev_addr, uint8_t eepr
     return 0;
 }
 
+#if DS3231_CONFIG_AM_PM
 /**
  * @brief               Enable or disable AM/PM mode of DS3231. By default, it is disabled
  * 
@@ -151,6 +256,7 @@ int ds3231_init(ds3231_t * rtc, i2c_inst_t * i2c, uint8_t dev_addr, uint8_t eepr
  * @return              0 if succeful.
  */
 int ds3231_enable_am_pm_mode(ds3231_t * rtc, bool enable) {
+    DS3231_CRUMB_API(DS3231_CRUMB_ENABLE_AM_PM_MODE);
     uint8_t temp = 0;
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_HOURS_REG, 1, &temp))
         return -1;
@@ -165,6 +271,7 @@ int ds3231_enable_am_pm_mode(ds3231_t * rtc, bool enable) {
         return -1;
     return 0;
 }
+#endif
 
 /**
  * @brief               Configure the current time in DS3231.
@@ -174,6 +281,7 @@ int ds3231_enable_am_pm_mode(ds3231_t * rtc, bool enable) {
  * @return              0 if succesful.
  */
 int ds3231_configure_time(ds3231_t * rtc, ds3231_data_t * data) {
+    DS3231_CRUMB_API(DS3231_CRUMB_CONFIGURE_TIME);
     uint8_t temp[7] = {0, 0, 0, 0, 0, 0, 0};
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_SECONDS_REG, 7, temp)) 
         return -1;
@@ -185,15 +293,7 @@ int ds3231_configure_time(ds3231_t * rtc, ds3231_data_t * data) {
     if(data->minutes > 59) 
         data->minutes = 59;
 
-    if(rtc->am_pm_mode) {
-        if(data->hours > 12)
-            data->hours = 12;
-        else if(data->hours < 1)
-            data->hours = 1;
-    } else {
-        if(data->hours > 23) 
-            data->hours = 23;
-    }
+    data->hours = ds3231_clamp_hours(rtc, data->hours);
 
     if(data->day > 7) 
         data->day = 7;
@@ -218,13 +318,7 @@ int ds3231_configure_time(ds3231_t * rtc, ds3231_data_t * data) {
 
     temp[1] = bin_to_bcd(data->minutes);
 
-    if(rtc->am_pm_mode) {
-        temp[2] = bin_to_bcd_am_pm(data->hours);
-        temp[2] |= (0x01 << 6);
-    } else {
-        temp[2] = bin_to_bcd(data->hours);
-        temp[2] &= ~(0x01 << 6);
-    }
+    temp[2] = ds3231_encode_hours(rtc, data->hours, data->am_pm);
 
     temp[3] = bin_to_bcd(data->day);
 
@@ -250,34 +344,278 @@ int ds3231_configure_time(ds3231_t * rtc, ds3231_data_t * data) {
  * @return              0 if succesful. 
  */
 int ds3231_read_current_time(ds3231_t * rtc, ds3231_data_t * data) {
+    DS3231_CRUMB_API(DS3231_CRUMB_READ_CURRENT_TIME);
     uint8_t raw_data[7];
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_SECONDS_REG, 7, raw_data)) 
         return -1;
-    
-    data->seconds = 10 * ((raw_data[0] & 0x70) >> 4) + (raw_data[0] & 0x0F);
+    ds3231_decode_time(rtc, raw_data, data);
+    return 0;
+}
 
-    data->minutes = 10 * ((raw_data[1] & 0x70) >> 4) + (raw_data[1] & 0x0F);
-    
-    if(rtc->am_pm_mode) {
-        data->hours   = 10 * ((raw_data[2] & 0x10) >> 4) + (raw_data[2] & 0x0F);
-        data->am_pm = ((raw_data[2] & 0x20) >> 5);
-    } else {
-        data->hours   = 10 * ((raw_data[2] & 0x30) >> 4) + (raw_data[2] & 0x0F);
+/**
+ * @brief               Convert the raw contents of the timekeeping registers (0x00 - 0x06) to real units.
+ * Used by ds3231_read_current_time and by any caller that fetched the registers itself,
+ * e.g. as part of a merged burst read.
+ * 
+ * @param[in]   rtc         ds3231 struct.
+ * @param[in]   raw_data    7 bytes read starting from DS3231_SECONDS_REG.
+ * @param[out]  data        data struct to save converted time units.
+ */
+void ds3231_decode_time(ds3231_t * rtc, const uint8_t * raw_data, ds3231_data_t * data) {
+    ds3231_decode_time_fields(rtc, raw_data, DS3231_SECONDS_REG, DS3231_FIELD_ALL, data);
+}
+
+/**
+ * @brief               Convert only the selected timekeeping registers to real units.
+ * Fields that are not selected are left untouched in data. Century is decoded with the month.
+ * 
+ * @param[in]   rtc         ds3231 struct.
+ * @param[in]   raw_data    Raw register bytes, raw_data[0] holding register first_reg.
+ * @param[in]   first_reg   Register adress of raw_data[0].
+ * @param[in]   fields      Bitmask of DS3231_TIME_FIELDS to decode. All of them must be inside raw_data.
+ * @param[out]  data        data struct to save converted time units.
+ */
+void ds3231_decode_time_fields(ds3231_t * rtc, const uint8_t * raw_data, uint8_t first_reg,
+    uint8_t fields, ds3231_data_t * data)
+{
+    const uint8_t * raw;
+    if(fields & DS3231_FIELD_SECONDS) {
+        raw = &raw_data[DS3231_SECONDS_REG - first_reg];
+        data->seconds = 10 * ((*raw & 0x70) >> 4) + (*raw & 0x0F);
+    }
+    if(fields & DS3231_FIELD_MINUTES) {
+        raw = &raw_data[DS3231_MINUTES_REG - first_reg];
+        data->minutes = 10 * ((*raw & 0x70) >> 4) + (*raw & 0x0F);
+    }
+    if(fields & DS3231_FIELD_HOURS) {
+        raw = &raw_data[DS3231_HOURS_REG - first_reg];
+        if(DS3231_AM_PM_MODE(rtc)) {
+            data->hours   = 10 * ((*raw & 0x10) >> 4) + (*raw & 0x0F);
+            data->am_pm = ((*raw & 0x20) >> 5);
+        } else {
+            data->hours   = 10 * ((*raw & 0x30) >> 4) + (*raw & 0x0F);
+        }
+    }
+    if(fields & DS3231_FIELD_DAY) {
+        raw = &raw_data[DS3231_DAY_REG - first_reg];
+        data->day     = (*raw & (0x07));
+    }
+    if(fields & DS3231_FIELD_DATE) {
+        raw = &raw_data[DS3231_DATE_REG - first_reg];
+        data->date    = 10 * ((*raw & 0x30) >> 4) + (*raw & 0x0F);
+    }
+    if(fields & DS3231_FIELD_MONTH) {
+        raw = &raw_data[DS3231_MONTH_REG - first_reg];
+        data->month   = 10 * ((*raw & 0x10) >> 4) + (*raw & 0x0F);
+        data->century = (*raw & (0x01 << 7)) >> 7;
+    }
+    if(fields & DS3231_FIELD_YEAR) {
+        raw = &raw_data[DS3231_YEAR_REG - first_reg];
+        data->year    = 10 * ((*raw & 0xF0) >> 4) + (*raw & 0x0F);
+    }
+}
+
+/**
+ * @brief               Read only the timekeeping registers needed for the selected fields.
+ * A single burst read covering the lowest to the highest selected register is issued, e.g.
+ * DS3231_FIELD_SECONDS reads 1 byte instead of 7. Fields that are not selected are left untouched.
+ * 
+ * @param[in]   rtc     ds3231 struct.
+ * @param[in]   fields  Bitmask of DS3231_TIME_FIELDS.
+ * @param[out]  data    data struct to save converted time units.
+ * @return              0 if succesful, -1 if i2c failure or no field is selected.
+ */
+int ds3231_read_time_fields(ds3231_t * rtc, uint8_t fields, ds3231_data_t * data) {
+    DS3231_CRUMB_API(DS3231_CRUMB_READ_TIME_FIELDS);
+    fields &= DS3231_FIELD_ALL;
+    if(!fields)
+        return -1;
+    uint8_t first_reg = 0;
+    while(!(fields & (0x01 << first_reg)))
+        first_reg++;
+    uint8_t last_reg = DS3231_YEAR_REG;
+    while(!(fields & (0x01 << last_reg)))
+        last_reg--;
+
+    uint8_t raw_data[7];
+    if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, first_reg, (last_reg - first_reg + 1), raw_data))
+        return -1;
+    ds3231_decode_time_fields(rtc, raw_data, first_reg, fields, data);
+    return 0;
+}
+
+/**
+ * @brief               Initiliaze a read-on-change watch over the timekeeping registers.
+ * DS3231_FIELD_SECONDS polls only the seconds register and fetches the full time when it rolls
+ * over into a new minute. DS3231_FIELD_MINUTES polls seconds and minutes, and fetches the full
+ * time when the hour changes.
+ * 
+ * @param[out]  watch       Watch struct.
+ * @param[in]   poll_fields DS3231_FIELD_SECONDS or DS3231_FIELD_SECONDS | DS3231_FIELD_MINUTES.
+ * @return                  0 if succesful, -1 if poll_fields is not valid.
+ */
+int ds3231_time_watch_init(ds3231_time_watch_t * watch, uint8_t poll_fields) {
+    if(poll_fields != DS3231_FIELD_SECONDS && poll_fields != (DS3231_FIELD_SECONDS | DS3231_FIELD_MINUTES))
+        return -1;
+    watch->time = (ds3231_data_t){0};
+    watch->poll_fields = poll_fields;
+    watch->valid = false;
+    watch->refresh_us = 0;
+    watch->bus_bytes = 0;
+    return 0;
+}
+
+/**
+ * @brief               Poll the DS3231 through a watch and keep watch->time up to date.
+ * The first call and every rollover of the highest polled field fetch all timekeeping registers,
+ * every other call reads only the polled registers. A rollover is seen when the polled field goes
+ * backwards, or when the local timer says the minute (or hour) of the last full read is over, so
+ * polls a minute or more apart and time changes in between never report stale fields.
+ * Each read costs 3 + N bytes on the bus (adress write, register, adress read, N data bytes),
+ * which is accumulated in watch->bus_bytes. Polling at 10 Hz, a full read every poll costs
+ * 360000 bytes per hour, seconds-only polling costs 144600 bytes per hour including the 60 refreshes.
+ * 
+ * @param[in]   rtc     ds3231 struct.
+ * @param[in]   watch   Watch struct.
+ * @return              Bitmask of DS3231_TIME_FIELDS that changed since the last poll,
+ *                      0 if nothing changed, -1 if i2c failure.
+ */
+int ds3231_time_watch_poll(ds3231_t * rtc, ds3231_time_watch_t * watch) {
+    DS3231_CRUMB_API(DS3231_CRUMB_TIME_WATCH_POLL);
+    ds3231_data_t previous = watch->time;
+    bool refresh = !watch->valid || time_us_64() >= watch->refresh_us;
+
+    if(!refresh) {
+        uint8_t length = (watch->poll_fields & DS3231_FIELD_MINUTES) ? 2 : 1;
+        if(ds3231_read_time_fields(rtc, watch->poll_fields, &watch->time))
+            return -1;
+        watch->bus_bytes += 3 + length;
+        /* Highest polled field went backwards, so the fields above it changed. */
+        if(watch->poll_fields & DS3231_FIELD_MINUTES)
+            refresh = (watch->time.minutes < previous.minutes);
+        else
+            refresh = (watch->time.seconds < previous.seconds);
+    }
+    if(refresh) {
+        if(ds3231_read_current_time(rtc, &watch->time))
+            return -1;
+        watch->bus_bytes += 3 + 7;
+        /* The seconds read are at most a fraction of a second behind, so this is never early. */
+        uint32_t left = 60 - watch->time.seconds;
+        if(watch->poll_fields & DS3231_FIELD_MINUTES)
+            left += (59 - watch->time.minutes) * 60;
+        watch->refresh_us = time_us_64() + (uint64_t)left * 1000000;
+        if(!watch->valid) {
+            watch->valid = true;
+            return DS3231_FIELD_ALL;
+        }
     }
 
-    data->day     = (raw_data[3] & (0x07));
+    int changed = 0;
+    if(watch->time.seconds != previous.seconds)
+        changed |= DS3231_FIELD_SECONDS;
+    if(watch->time.minutes != previous.minutes)
+        changed |= DS3231_FIELD_MINUTES;
+    if(watch->time.hours != previous.hours || watch->time.am_pm != previous.am_pm)
+        changed |= DS3231_FIELD_HOURS;
+    if(watch->time.day != previous.day)
+        changed |= DS3231_FIELD_DAY;
+    if(watch->time.date != previous.date)
+        changed |= DS3231_FIELD_DATE;
+    if(watch->time.month != previous.month || watch->time.century != previous.century)
+        changed |= DS3231_FIELD_MONTH;
+    if(watch->time.year != previous.year)
+        changed |= DS3231_FIELD_YEAR;
+    return changed;
+}
 
-    data->date    = 10 * ((raw_data[4] & 0x30) >> 4) + (raw_data[4] & 0x0F);
+static const uint16_t ds3231_days_before_month[12] = {
+    0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
 
-    data->month   = 10 * ((raw_data[5] & 0x10) >> 4) + (raw_data[5] & 0x0F);
+static bool ds3231_is_leap_year(uint16_t year) {
+    return ((year % 4 == 0) && (year % 100 != 0)) || (year % 400 == 0);
+}
 
-    data->century = (raw_data[5] & (0x01 << 7)) >> 7;
+/**
+ * @brief               Convert a time read from DS3231 to seconds since 2000-01-01 00:00:00.
+ * Century bit selects 2100-2199.
+ * 
+ * @param[in] rtc       DS3231 struct, used to tell if hours are in AM/PM mode.
+ * @param[in] data      Time to be converted.
+ * @return              Seconds since 2000-01-01 00:00:00.
+ */
+uint32_t ds3231_time_to_epoch(ds3231_t * rtc, const ds3231_data_t * data) {
+    uint16_t year = 2000 + (data->century ? 100 : 0) + data->year;
+    uint8_t month = (data->month >= 1 && data->month <= 12) ? data->month : 1;
+    uint8_t hours = data->hours;
+    if(DS3231_AM_PM_MODE(rtc)) {
+        hours %= 12;
+        if(data->am_pm)
+            hours += 12;
+    }
 
-    data->year    = 10 * ((raw_data[6] & 0xF0) >> 4) + (raw_data[6] & 0x0F);
+    uint32_t days = 0;
+    for(uint16_t y = 2000; y < year; y++)
+        days += ds3231_is_leap_year(y) ? 366 : 365;
+    days += ds3231_days_before_month[month - 1];
+    if(month > 2 && ds3231_is_leap_year(year))
+        days++;
+    days += (data->date ? data->date : 1) - 1;
 
-    return 0;
+    return ((days * 24 + hours) * 60 + data->minutes) * 60 + data->seconds;
+}
+
+/**
+ * @brief               Convert seconds since 2000-01-01 00:00:00 to a time that can be written to DS3231.
+ * 
+ * @param[in] rtc       DS3231 struct, used to tell if hours must be in AM/PM mode.
+ * @param[in] epoch     Seconds since 2000-01-01 00:00:00.
+ * @param[out] data     Converted time, including day of the week.
+ */
+void ds3231_epoch_to_time(ds3231_t * rtc, uint32_t epoch, ds3231_data_t * data) {
+    data->seconds = epoch % 60;
+    epoch /= 60;
+    data->minutes = epoch % 60;
+    epoch /= 60;
+    uint8_t hours = epoch % 24;
+    uint32_t days = epoch / 24;
+
+    /* 2000-01-01 was a Saturday. */
+    data->day = ((days + 5) % 7) + MONDAY;
+
+    uint16_t year = 2000;
+    while(days >= (ds3231_is_leap_year(year) ? 366u : 365u)) {
+        days -= ds3231_is_leap_year(year) ? 366 : 365;
+        year++;
+    }
+    uint8_t month = 12;
+    while(month > 1) {
+        uint16_t first = ds3231_days_before_month[month - 1];
+        if(month > 2 && ds3231_is_leap_year(year))
+            first++;
+        if(days >= first) {
+            days -= first;
+            break;
+        }
+        month--;
+    }
+    data->month = month;
+    data->date = days + 1;
+    data->century = (year >= 2100);
+    data->year = year % 100;
+
+    if(DS3231_AM_PM_MODE(rtc)) {
+        data->am_pm = (hours >= 12);
+        hours %= 12;
+        data->hours = hours ? hours : 12;
+    } else {
+        data->am_pm = false;
+        data->hours = hours;
+    }
 }
 
+#if DS3231_CONFIG_ALARMS
 /**
  * @brief                   Enable alarm on DS3231 alarm 1. Valid alarm triggers enums are:
  *\n ON_EVERY_SECOND,
@@ -293,6 +631,7 @@ int ds3231_read_current_time(ds3231_t * rtc, ds3231_data_t * data) {
  * @return                  0 if succesful.
  */
 int ds3231_set_alarm_1(ds3231_t * rtc, ds3231_alarm_1_t * alarm_time, enum ALARM_1_MASKS mask) {
+    DS3231_CRUMB_API(DS3231_CRUMB_SET_ALARM_1);
     uint8_t temp[4] = {0, 0 , 0, 0};
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_SECONDS_ALARM_1_REG, 4, temp))
         return -1;
@@ -304,15 +643,7 @@ int ds3231_set_alarm_1(ds3231_t * rtc, ds3231_alarm_1_t * alarm_time, enum ALARM
     if(alarm_time->minutes > 59) 
         alarm_time->minutes = 59;
 
-    if(rtc->am_pm_mode) {
-        if(alarm_time->hours > 12)
-            alarm_time->hours = 12;
-        else if(alarm_time->hours < 1)
-            alarm_time->hours = 1;
-    } else {
-        if(alarm_time->hours > 23) 
-            alarm_time->hours = 23;
-    }
+    alarm_time->hours = ds3231_clamp_hours(rtc, alarm_time->hours);
 
     if(alarm_time->day > 7) 
         alarm_time->day = 7;
@@ -350,13 +681,7 @@ int ds3231_set_alarm_1(ds3231_t * rtc, ds3231_alarm_1_t * alarm_time, enum ALARM
         case ON_MATCHING_SECOND_MINUTE_AND_HOUR:
             temp[0] = bin_to_bcd(alarm_time->seconds);
             temp[1] = bin_to_bcd(alarm_time->minutes);
-            if(rtc->am_pm_mode) {
-                temp[2] = bin_to_bcd_am_pm(alarm_time->hours);
-                temp[2] |= (0x01 << 6);        
-            } else {
-                temp[2] = bin_to_bcd(alarm_time->hours);
-                temp[2] &= ~(0x01 << 6);        
-            }     
+            temp[2] = ds3231_encode_hours(rtc, alarm_time->hours, alarm_time->am_pm);
             for(int i = 0; i < 3; i++)
                 temp[i] &= ~(0x01 << 7);            
             temp[3] |= (0x01 << 7);
@@ -365,35 +690,23 @@ int ds3231_set_alarm_1(ds3231_t * rtc, ds3231_alarm_1_t * alarm_time, enum ALARM
         case ON_MATCHING_SECOND_MINUTE_HOUR_AND_DATE:
             temp[0] = bin_to_bcd(alarm_time->seconds);
             temp[1] = bin_to_bcd(alarm_time->minutes);
-            if(rtc->am_pm_mode) {
-                temp[2] = bin_to_bcd_am_pm(alarm_time->hours);
-                temp[2] |= (0x01 << 6);        
-            } else {
-                temp[2] = bin_to_bcd(alarm_time->hours);
-                temp[2] &= ~(0x01 << 6);        
-            }     
+            temp[2] = ds3231_encode_hours(rtc, alarm_time->hours, alarm_time->am_pm);
             temp[3] = bin_to_bcd(alarm_time->date);
             temp[3] &= ~(0x01 << 6);
             for(int i = 0; i < 3; i++)
                 temp[i] &= ~(0x01 << 7);            
-            temp[3] |= (0x01 << 7);
+            temp[3] &= ~(0x01 << 7);
         break;
 
         case ON_MATCHING_SECOND_MINUTE_HOUR_AND_DAY:
             temp[0] = bin_to_bcd(alarm_time->seconds);
             temp[1] = bin_to_bcd(alarm_time->minutes);
-            if(rtc->am_pm_mode) {
-                temp[2] = bin_to_bcd_am_pm(alarm_time->hours);
-                temp[2] |= (0x01 << 6);        
-            } else {
-                temp[2] = bin_to_bcd(alarm_time->hours);
-                temp[2] &= ~(0x01 << 6);        
-            }     
+            temp[2] = ds3231_encode_hours(rtc, alarm_time->hours, alarm_time->am_pm);
             temp[3] = bin_to_bcd(alarm_time->day);
             temp[3] |= (0x01 << 6);
             for(int i = 0; i < 3; i++)
                 temp[i] &= ~(0x01 << 7);            
-            temp[3] |= (0x01 << 7);
+            temp[3] &= ~(0x01 << 7);
         break;
 
         default:
@@ -427,6 +740,7 @@ int ds3231_set_alarm_1(ds3231_t * rtc, ds3231_alarm_1_t * alarm_time, enum ALARM
  * @return                  0 if succesful.
  */
 int ds3231_set_alarm_2(ds3231_t * rtc, ds3231_alarm_2_t * alarm_time, enum ALARM_2_MASKS mask) {
+    DS3231_CRUMB_API(DS3231_CRUMB_SET_ALARM_2);
     uint8_t temp[3] = {0, 0 , 0};
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_MINUTES_ALARM_2_REG, 3, temp))
         return -1;
@@ -434,15 +748,7 @@ int ds3231_set_alarm_2(ds3231_t * rtc, ds3231_alarm_2_t * alarm_time, enum ALARM
     if(alarm_time->minutes > 59) 
         alarm_time->minutes = 59;
 
-    if(rtc->am_pm_mode) {
-        if(alarm_time->hours > 12)
-            alarm_time->hours = 12;
-        else if(alarm_time->hours < 1)
-            alarm_time->hours = 1;
-    } else {
-        if(alarm_time->hours > 23) 
-            alarm_time->hours = 23;
-    }
+    alarm_time->hours = ds3231_clamp_hours(rtc, alarm_time->hours);
 
     if(alarm_time->day > 7) 
         alarm_time->day = 7;
@@ -469,13 +775,7 @@ int ds3231_set_alarm_2(ds3231_t * rtc, ds3231_alarm_2_t * alarm_time, enum ALARM
 
         case ON_MATCHING_MINUTE_AND_HOUR:
             temp[0] = bin_to_bcd(alarm_time->minutes);
-            if(rtc->am_pm_mode) {
-                temp[1] = bin_to_bcd_am_pm(alarm_time->hours);
-                temp[1] |= (0x01 << 6);
-            } else {
-                temp[1] = bin_to_bcd(alarm_time->hours);
-                temp[1] &= ~(0x01 << 6);
-            }
+            temp[1] = ds3231_encode_hours(rtc, alarm_time->hours, alarm_time->am_pm);
             for(int i = 0; i < 2; i++)
                 temp[i] &= ~(0x01 << 7);
             temp[2] |= (0x01 << 7);
@@ -483,13 +783,7 @@ int ds3231_set_alarm_2(ds3231_t * rtc, ds3231_alarm_2_t * alarm_time, enum ALARM
 
         case ON_MATCHING_MINUTE_HOUR_AND_DATE:
             temp[0] = bin_to_bcd(alarm_time->minutes);
-            if(rtc->am_pm_mode) {
-                temp[1] = bin_to_bcd_am_pm(alarm_time->hours);
-                temp[1] |= (0x01 << 6);
-            } else {
-                temp[1] = bin_to_bcd(alarm_time->hours);
-                temp[1] &= ~(0x01 << 6);
-            }
+            temp[1] = ds3231_encode_hours(rtc, alarm_time->hours, alarm_time->am_pm);
             temp[2] = bin_to_bcd(alarm_time->date);
             temp[2] &= ~(0x01 << 6);
             for(int i = 0; i < 3; i++)
@@ -498,13 +792,7 @@ int ds3231_set_alarm_2(ds3231_t * rtc, ds3231_alarm_2_t * alarm_time, enum ALARM
 
         case ON_MATCHING_MINUTE_HOUR_AND_DAY:
             temp[0] = bin_to_bcd(alarm_time->minutes);
-            if(rtc->am_pm_mode) {
-                temp[1] = bin_to_bcd_am_pm(alarm_time->hours);
-                temp[1] |= (0x01 << 6);
-            } else {
-                temp[1] = bin_to_bcd(alarm_time->hours);
-                temp[1] &= ~(0x01 << 6);
-            }
+            temp[1] = ds3231_encode_hours(rtc, alarm_time->hours, alarm_time->am_pm);
             temp[2] = bin_to_bcd(alarm_time->date);
             temp[2] |= (0x01 << 6);
             for(int i = 0; i < 3; i++)
@@ -539,6 +827,7 @@ int ds3231_set_alarm_2(ds3231_t * rtc, ds3231_alarm_2_t * alarm_time, enum ALARM
  * @return int 
  */
 int ds3231_enable_alarm_interrupt(ds3231_t * rtc, bool enable) {
+    DS3231_CRUMB_API(DS3231_CRUMB_ENABLE_ALARM_INTERRUPT);
     uint8_t interrupt_enable = 0;
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_REG, 1, &interrupt_enable))
         return -1;    
@@ -550,6 +839,7 @@ int ds3231_enable_alarm_interrupt(ds3231_t * rtc, bool enable) {
         return -1;
     return 0;
 } 
+#endif
 
 /**
  * @brief               Enable or disable the 32.768kHZ square wave output of DS3231 from the 32K pin. 
@@ -560,6 +850,7 @@ int ds3231_enable_alarm_interrupt(ds3231_t * rtc, bool enable) {
  * @return              0 if succesful.
  */
 int ds3231_enable_32khz_square_wave(ds3231_t * rtc, bool enable) {
+    DS3231_CRUMB_API(DS3231_CRUMB_ENABLE_32KHZ_SQUARE_WAVE);
     uint8_t status = 0;
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
         return -1;
@@ -581,6 +872,7 @@ int ds3231_enable_32khz_square_wave(ds3231_t * rtc, bool enable) {
  * @return              0 if succesful. 
  */
 int ds3231_enable_oscillator(ds3231_t * rtc, bool enable) {
+    DS3231_CRUMB_API(DS3231_CRUMB_ENABLE_OSCILLATOR);
     uint8_t enable_byte = 0;
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_REG, 1, &enable_byte))
         return -1;    
@@ -602,6 +894,7 @@ int ds3231_enable_oscillator(ds3231_t * rtc, bool enable) {
  * @return              0 if succesful.
  */
 int ds3231_enable_battery_backed_square_wave(ds3231_t * rtc, bool enable) {
+    DS3231_CRUMB_API(DS3231_CRUMB_ENABLE_BATTERY_BACKED_SQUARE_WAVE);
     uint8_t enable_byte = 0;
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_REG, 1, &enable_byte))
         return -1;    
@@ -629,6 +922,7 @@ int ds3231_enable_battery_backed_square_wave(ds3231_t * rtc, bool enable) {
  * @return              0 if succesful.
  */
 int ds3231_set_square_wave_frequency(ds3231_t * rtc, enum SQUARE_WAVE_FREQUENCY sqr_frq) {
+    DS3231_CRUMB_API(DS3231_CRUMB_SET_SQUARE_WAVE_FREQUENCY);
     uint8_t enable_byte = 0;
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_REG, 1, &enable_byte))
         return -1;    
@@ -670,6 +964,7 @@ int ds3231_set_square_wave_frequency(ds3231_t * rtc, enum SQUARE_WAVE_FREQUENCY
  * @return          0 if succesful.
  */
 int ds3231_force_convert_temperature(ds3231_t * rtc) {
+    DS3231_CRUMB_API(DS3231_CRUMB_FORCE_CONVERT_TEMPERATURE);
     uint8_t status = 0;
     /* Read the status register to check the BSY bit. */
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status)) 
@@ -686,6 +981,23 @@ int ds3231_force_convert_temperature(ds3231_t * rtc) {
     return 0;
 }
 
+/**
+ * @brief                   Read the temperature data from DS3231 without floating point.
+ * 
+ * @param[in] rtc           DS3231 struct.
+ * @param[out] quarters     Temperature in quarter degrees Celsius.
+ * @return                  0 if succesful.
+ */
+int ds3231_read_temperature_quarters(ds3231_t * rtc, int16_t * quarters) {
+    DS3231_CRUMB_API(DS3231_CRUMB_READ_TEMPERATURE_QUARTERS);
+    uint8_t temp[2] = {0, 0};
+    if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_TEMPERATURE_MSB_REG, 2, temp))
+        return -1;
+    *quarters = ds3231_decode_temperature_quarters(temp);
+    return 0;
+}
+
+#if DS3231_CONFIG_FLOAT
 /**
  * @brief                   Read the temperature data from DS3231.
  * 
@@ -694,14 +1006,36 @@ int ds3231_force_convert_temperature(ds3231_t * rtc) {
  * @return                  0 if succesful.
  */ 
 int ds3231_read_temperature(ds3231_t * rtc, float * temperature) {
+    DS3231_CRUMB_API(DS3231_CRUMB_READ_TEMPERATURE);
     uint8_t temp[2] = {0, 0};
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_TEMPERATURE_MSB_REG, 2, temp))
         return -1;
-    
-    *temperature = temp[0] + (float)(1 / (temp[1] >> 6));
+    ds3231_decode_temperature(temp, temperature);
     return 0;
 }
 
+/**
+ * @brief                   Convert the raw temperature registers (0x11 - 0x12) to degrees Celsius.
+ * The MSB is the two's complement integer part and the upper two bits of the LSB are the fraction.
+ * 
+ * @param[in] raw_data      2 bytes read starting from DS3231_TEMPERATURE_MSB_REG.
+ * @param[out] temperature  Temperature data with 0.25 resolution.
+ */
+void ds3231_decode_temperature(const uint8_t * raw_data, float * temperature) {
+    *temperature = (int8_t)raw_data[0] + (float)(raw_data[1] >> 6) * 0.25f;
+}
+#endif
+
+/**
+ * @brief                   Convert the raw temperature registers (0x11 - 0x12) to quarter degrees.
+ * 
+ * @param[in] raw_data      2 bytes read starting from DS3231_TEMPERATURE_MSB_REG.
+ * @return                  Temperature in quarter degrees Celsius.
+ */
+int16_t ds3231_decode_temperature_quarters(const uint8_t * raw_data) {
+    return (int16_t)((int8_t)raw_data[0] * 4 + (raw_data[1] >> 6));
+}
+
 /**
  * @brief           Check the DS3231 status register to see if the oscillator is working.
  * 
@@ -709,6 +1043,7 @@ int ds3231_read_temperature(ds3231_t * rtc, float * temperature) {
  * @return          0 if oscillator is working, 1 if oscillator stopped, -1 if an I2C error occurs.
  */
 int ds3231_check_oscillator_stop_flag(ds3231_t * rtc) {
+    DS3231_CRUMB_API(DS3231_CRUMB_CHECK_OSCILLATOR_STOP_FLAG);
     uint8_t status = 0;
     if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
         return -1;
@@ -727,6 +1062,7 @@ int ds3231_check_oscillator_stop_flag(ds3231_t * rtc) {
  * @return              0 if succesful.
  */
 int ds3231_set_aging_offset(ds3231_t * rtc, int8_t offset) {
+    DS3231_CRUMB_API(DS3231_CRUMB_SET_AGING_OFFSET);
     int8_t temp = offset;
     uint8_t aging_offset = *((uint8_t *)(&temp));
     if(i2c_write_reg(rtc->i2c, rtc->ds3231_addr, DS3231_AGING_OFFSET_REG, 1, &aging_offset))
@@ -13,6 +13,8 @@
 
 #include "hardware/i2c.h"
 #include "hardware/gpio.h"
+#include "ds3231_config.h"
+#include "ds3231_crumb.h"
 
 #ifndef DS_3231
 #define DS_3231
@@ -31,7 +33,8 @@ adress can be changed by soldering jumpers to A0, A1 and A2 inputs on the module
 #define AT24C32_EEPROM_ADRESS_6         0x51    // A2 A1
 #define AT24C32_EEPROM_ADRESS_7         0x50    // A2 A1 A0
 
-#define AT24C32_PAGE_COUNT              256     
+#define AT24C32_PAGE_COUNT              128
+#define AT24C32_WRITE_CYCLE_US          10000   // Maximum self-timed write cycle.
 #define AT24C32_PAGE_SIZE               32      // Bytes
 
 /* Timekeeping Registers */
@@ -96,6 +99,26 @@ enum SQUARE_WAVE_FREQUENCY {
     FREQUENCY_8192_HZ = 0x3
 };
 
+/* Bit positions match the register adresses of the fields. */
+enum DS3231_TIME_FIELDS {
+    DS3231_FIELD_SECONDS = (0x01 << DS3231_SECONDS_REG),
+    DS3231_FIELD_MINUTES = (0x01 << DS3231_MINUTES_REG),
+    DS3231_FIELD_HOURS   = (0x01 << DS3231_HOURS_REG),
+    DS3231_FIELD_DAY     = (0x01 << DS3231_DAY_REG),
+    DS3231_FIELD_DATE    = (0x01 << DS3231_DATE_REG),
+    DS3231_FIELD_MONTH   = (0x01 << DS3231_MONTH_REG),  // Includes century.
+    DS3231_FIELD_YEAR    = (0x01 << DS3231_YEAR_REG),
+    DS3231_FIELD_ALL     = 0x7F
+};
+
+/* Modules that program alarm 1, the control register and the GPIO callback of INT/SQW themselves.
+Only one of them can run on a DS3231 at a time. */
+enum DS3231_INT_OWNERS {
+    DS3231_INT_FREE = 0,
+    DS3231_INT_PIN,         // ds3231_pin arbiter.
+    DS3231_INT_HYBRID       // ds3231_hybrid alarm engine.
+};
+
 /**
  * @brief Struct to hold hardware information about DS3231 and AT23C32 EEPROM.
  * 
@@ -105,6 +128,7 @@ typedef struct ds3231_t {
     uint8_t ds3231_addr;
     uint8_t at24c32_addr;
     bool am_pm_mode;
+    uint8_t int_owner;      // DS3231_INT_OWNERS, set while a module owns INT/SQW and alarm 1.
 } ds3231_t;
 
 /**
@@ -148,19 +172,39 @@ typedef struct ds3231_alarm_2_t {
     uint8_t date;
 } ds3231_alarm_2_t;
 
+/**
+ * @brief Struct to hold the state of a read-on-change time watch.
+ * 
+ */
+typedef struct ds3231_time_watch_t {
+    ds3231_data_t time;     // Last known time.
+    uint8_t poll_fields;
+    bool valid;
+    uint64_t refresh_us;    // Local time the field above the polled ones changes by the latest.
+    uint32_t bus_bytes;     // Bytes transferred on the bus by this watch.
+} ds3231_time_watch_t;
+
 /* DS3231 Functions: */
 
 int ds3231_init(ds3231_t * rtc, i2c_inst_t * i2c, uint8_t dev_addr, uint8_t eeprom_addr);
 int ds3231_configure_time(ds3231_t * rtc, ds3231_data_t * data);
 
 int ds3231_read_current_time(ds3231_t * rtc, ds3231_data_t * data);
+int ds3231_read_time_fields(ds3231_t * rtc, uint8_t fields, ds3231_data_t * data);
+int ds3231_read_temperature_quarters(ds3231_t * rtc, int16_t * quarters);
+#if DS3231_CONFIG_FLOAT
 int ds3231_read_temperature(ds3231_t * rtc, float * resolution);
+#endif
 
+#if DS3231_CONFIG_ALARMS
 int ds3231_set_alarm_1(ds3231_t * rtc, ds3231_alarm_1_t * alarm_time, enum ALARM_1_MASKS mask);
 int ds3231_set_alarm_2(ds3231_t * rtc, ds3231_alarm_2_t * alarm_time, enum ALARM_2_MASKS mask);
+int ds3231_enable_alarm_interrupt(ds3231_t * rtc, bool enable);
+#endif
 
+#if DS3231_CONFIG_AM_PM
 int ds3231_enable_am_pm_mode(ds3231_t * rtc, bool enable);
-int ds3231_enable_alarm_interrupt(ds3231_t * rtc, bool enable);
+#endif
 int ds3231_enable_oscillator(ds3231_t * rtc, bool enable);
 int ds3231_enable_32khz_square_wave(ds3231_t * rtc, bool enable);
 int ds3231_enable_battery_backed_square_wave(ds3231_t * rtc, bool enable);
@@ -173,8 +217,38 @@ int ds3231_set_aging_offset(ds3231_t * rtc, int8_t offset);
 
 int ds3231_set_interrupt_callback_function(uint gpio, gpio_irq_callback_t callback);
 
+int ds3231_time_watch_init(ds3231_time_watch_t * watch, uint8_t poll_fields);
+int ds3231_time_watch_poll(ds3231_t * rtc, ds3231_time_watch_t * watch);
+
+uint32_t ds3231_time_to_epoch(ds3231_t * rtc, const ds3231_data_t * data);
+void ds3231_epoch_to_time(ds3231_t * rtc, uint32_t epoch, ds3231_data_t * data);
+
+void ds3231_decode_time(ds3231_t * rtc, const uint8_t * raw_data, ds3231_data_t * data);
+void ds3231_decode_time_fields(ds3231_t * rtc, const uint8_t * raw_data, uint8_t first_reg,
+    uint8_t fields, ds3231_data_t * data);
+int16_t ds3231_decode_temperature_quarters(const uint8_t * raw_data);
+#if DS3231_CONFIG_FLOAT
+void ds3231_decode_temperature(const uint8_t * raw_data, float * temperature);
+#endif
+
+/* Library functions shared between driver modules: */
+
+int ds3231_bus_write(i2c_inst_t * i2c, uint8_t dev_addr, 
+    const uint8_t * src, size_t length, bool nostop);
+
+int ds3231_bus_read(i2c_inst_t * i2c, uint8_t dev_addr, 
+    uint8_t * dst, size_t length, bool nostop);
+
+int i2c_read_reg(i2c_inst_t * i2c, uint8_t dev_addr, 
+    uint8_t reg_addr, size_t length, uint8_t * data);
+
+int i2c_write_reg(i2c_inst_t * i2c, uint8_t dev_addr, 
+    uint8_t reg_addr, size_t length, uint8_t * data);
+
 /*--------------------------------------------------------------------------------------------------------*/
 
+#if DS3231_CONFIG_EEPROM
+
 /* AT24C32 Functions: */
 
 int at24c32_i2c_write_page(i2c_inst_t * i2c, uint8_t dev_addr, 
@@ -186,6 +260,10 @@ int at24c32_i2c_read_page(i2c_inst_t * i2c, uint8_t dev_addr,
 int at24c32_read_current_adress(i2c_inst_t * i2c, uint8_t dev_addr,
     size_t length, uint8_t * data);
 
+int at24c32_wait_write_cycle(i2c_inst_t * i2c, uint8_t dev_addr, uint32_t timeout_us);
+
 int at24c32_write_current_time(ds3231_t * rtc, uint8_t page_addr);
 
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,213 @@
+/**
+ * @file    ds3231_clock.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Monotonic clock disciplined by DS3231 that slews corrections instead of stepping.
+ * The clock runs from the RP2040 timer. When it is corrected against DS3231, the error is not
+ * applied at once. Instead the clock rate is changed by at most max_slew_ppm until the error is
+ * gone, the same way adjtime works. The clock therefore never goes backwards and rate
+ * calculations over a correction stay within max_slew_ppm.
+ * The raw view steps to the reference on every correction and is exposed next to the corrected view.
+ * ds3231_clock_correct, ds3231_clock_raw_at and ds3231_clock_corrected_at take the local time as an
+ * argument so the clock can be driven with virtual time.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_clock.h"
+#include "hardware/timer.h"
+
+/**
+ * @brief                   Initiliaze a slewing clock. It is not valid until the first correction.
+ *
+ * @param[out] clock        Clock struct.
+ * @param[in] rtc           DS3231 struct used by ds3231_clock_sync. Can be NULL if only
+ *                          ds3231_clock_correct is used.
+ * @param[in] max_slew_ppm  Maximum rate change while slewing, must be between 1 and 999999.
+ * @param[in] window_ms     Window to spread a correction over if max_slew_ppm allows it.
+ * @return                  0 if succesful, -1 if parameters are invalid.
+ */
+int ds3231_clock_init(ds3231_clock_t * clock, ds3231_t * rtc, int32_t max_slew_ppm, uint32_t window_ms) {
+    if(max_slew_ppm < 1 || max_slew_ppm >= 1000000)
+        return -1;
+    if(!window_ms)
+        return -1;
+    clock->rtc = rtc;
+    clock->max_slew_ppm = max_slew_ppm;
+    clock->window_us = window_ms * 1000;
+    clock->synced = false;
+    clock->raw_local_us = 0;
+    clock->raw_reference_us = 0;
+    clock->anchor_local_us = 0;
+    clock->anchor_corrected_us = 0;
+    clock->slew_ppm = 0;
+    clock->slew_end_us = 0;
+    clock->last_corrected_us = INT64_MIN;
+    return 0;
+}
+
+/**
+ * @brief               Raw view of the clock: last reference plus elapsed local time.
+ *
+ * @param[in] clock     Clock struct.
+ * @param[in] local_us  Local timer value.
+ * @return              Reference time in microseconds, 0 if the clock was never corrected.
+ */
+int64_t ds3231_clock_raw_at(ds3231_clock_t * clock, uint64_t local_us) {
+    if(!clock->synced)
+        return 0;
+    return clock->raw_reference_us + (int64_t)(local_us - clock->raw_local_us);
+}
+
+/**
+ * @brief               Corrected view of the clock at the given local time.
+ * Does not apply the monotonic guard, see ds3231_clock_now_us.
+ *
+ * @param[in] clock     Clock struct.
+ * @param[in] local_us  Local timer value, not earlier than the last correction.
+ * @return              Corrected time in microseconds, 0 if the clock was never corrected.
+ */
+int64_t ds3231_clock_corrected_at(ds3231_clock_t * clock, uint64_t local_us) {
+    if(!clock->synced)
+        return 0;
+    int64_t elapsed = (int64_t)(local_us - clock->anchor_local_us);
+    int64_t slewing = elapsed;
+    if(local_us > clock->slew_end_us)
+        slewing = (int64_t)(clock->slew_end_us - clock->anchor_local_us);
+    if(slewing < 0)
+        slewing = 0;
+    return clock->anchor_corrected_us + elapsed + (slewing * clock->slew_ppm) / 1000000;
+}
+
+/**
+ * @brief               Corrected view of the clock at the given local time, never smaller than
+ * the value returned by the previous call.
+ *
+ * @param[in] clock     Clock struct.
+ * @param[in] local_us  Local timer value.
+ * @return              Corrected time in microseconds, 0 if the clock was never corrected.
+ */
+int64_t ds3231_clock_monotonic_at(ds3231_clock_t * clock, uint64_t local_us) {
+    if(!clock->synced)
+        return 0;
+    int64_t now = ds3231_clock_corrected_at(clock, local_us);
+    if(now < clock->last_corrected_us)
+        now = clock->last_corrected_us;
+    clock->last_corrected_us = now;
+    return now;
+}
+
+/**
+ * @brief                   Correct the clock against a reference sample.
+ * The first correction sets the clock. Later corrections re-anchor the corrected view at its
+ * current value and slew the remaining error at the rate needed to remove it within the window,
+ * bounded by max_slew_ppm. Large errors therefore take error / max_slew_ppm to be removed.
+ *
+ * @param[in] clock         Clock struct.
+ * @param[in] reference_us  Reference time in microseconds since 2000-01-01 00:00:00.
+ * @param[in] local_us      Local timer value at which the reference was valid.
+ * @return                  0 if succesful, -1 if local_us is earlier than the last correction.
+ */
+int ds3231_clock_correct(ds3231_clock_t * clock, int64_t reference_us, uint64_t local_us) {
+    if(!clock->synced) {
+        clock->raw_local_us = local_us;
+        clock->raw_reference_us = reference_us;
+        clock->anchor_local_us = local_us;
+        clock->anchor_corrected_us = reference_us;
+        clock->slew_ppm = 0;
+        clock->slew_end_us = local_us;
+        clock->synced = true;
+        return 0;
+    }
+    if(local_us < clock->anchor_local_us)
+        return -1;
+
+    int64_t corrected = ds3231_clock_corrected_at(clock, local_us);
+    if(corrected < clock->last_corrected_us)
+        corrected = clock->last_corrected_us;
+    int64_t error = reference_us - corrected;
+
+    clock->raw_local_us = local_us;
+    clock->raw_reference_us = reference_us;
+    clock->anchor_local_us = local_us;
+    clock->anchor_corrected_us = corrected;
+
+    int64_t rate = (error * 1000000) / (int64_t)clock->window_us;
+    if(rate > clock->max_slew_ppm)
+        rate = clock->max_slew_ppm;
+    else if(rate < -clock->max_slew_ppm)
+        rate = -clock->max_slew_ppm;
+    else if(rate == 0 && error)
+        rate = (error > 0) ? 1 : -1;
+
+    clock->slew_ppm = (int32_t)rate;
+    if(rate)
+        clock->slew_end_us = local_us + (uint64_t)((error * 1000000) / rate);
+    else
+        clock->slew_end_us = local_us;
+    return 0;
+}
+
+/**
+ * @brief               Correct the clock against DS3231. Blocks until the seconds register
+ * changes so the sample is taken at a seconds boundary, which takes up to one second.
+ *
+ * @param[in] clock     Clock struct.
+ * @return              0 if succesful, -1 if i2c failure or the seconds do not advance within 1.1 s,
+ *                      e.g. with a stopped oscillator.
+ */
+int ds3231_clock_sync(ds3231_clock_t * clock) {
+    ds3231_data_t time;
+    if(ds3231_read_time_fields(clock->rtc, DS3231_FIELD_SECONDS, &time))
+        return -1;
+    uint8_t previous = time.seconds;
+    uint64_t deadline = time_us_64() + 1100000;
+    uint64_t local_us;
+    do {
+        local_us = time_us_64();
+        if(local_us > deadline)
+            return -1;
+        if(ds3231_read_time_fields(clock->rtc, DS3231_FIELD_SECONDS, &time))
+            return -1;
+    } while(time.seconds == previous);
+    /* The boundary is between the last two polls, take the middle. */
+    local_us += (time_us_64() - local_us) / 2;
+
+    if(ds3231_read_current_time(clock->rtc, &time))
+        return -1;
+    int64_t reference_us = (int64_t)ds3231_time_to_epoch(clock->rtc, &time) * 1000000;
+    return ds3231_clock_correct(clock, reference_us, local_us);
+}
+
+/**
+ * @brief                   Read the raw and the corrected views of the clock at the same instant.
+ *
+ * @param[in] clock         Clock struct.
+ * @param[out] raw_us       Raw view, steps on every correction. Can be NULL.
+ * @param[out] corrected_us Corrected view, never goes backwards. Can be NULL.
+ * @return                  0 if succesful, -1 if the clock was never corrected.
+ */
+int ds3231_clock_read(ds3231_clock_t * clock, int64_t * raw_us, int64_t * corrected_us) {
+    if(!clock->synced)
+        return -1;
+    uint64_t local_us = time_us_64();
+    if(raw_us)
+        *raw_us = ds3231_clock_raw_at(clock, local_us);
+    int64_t corrected = ds3231_clock_monotonic_at(clock, local_us);
+    if(corrected_us)
+        *corrected_us = corrected;
+    return 0;
+}
+
+/**
+ * @brief               Current corrected time. Consecutive calls never return a smaller value.
+ *
+ * @param[in] clock     Clock struct.
+ * @return              Corrected time in microseconds since 2000-01-01 00:00:00, 0 if the clock
+ *                      was never corrected. ds3231_clock_read tells the two apart.
+ */
+int64_t ds3231_clock_now_us(ds3231_clock_t * clock) {
+    return ds3231_clock_monotonic_at(clock, time_us_64());
+}
@@ -0,0 +1,55 @@
+/**
+ * @file    ds3231_clock.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Monotonic clock disciplined by DS3231 that slews corrections instead of stepping.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231.h"
+
+#ifndef DS_3231_CLOCK
+#define DS_3231_CLOCK
+
+#define DS3231_CLOCK_DEFAULT_MAX_SLEW_PPM   500
+#define DS3231_CLOCK_DEFAULT_WINDOW_MS      10000
+
+/**
+ * @brief Struct to hold the state of a slewing clock. Times are in microseconds,
+ * local times are from the RP2040 timer and reference times are since 2000-01-01 00:00:00.
+ *
+ */
+typedef struct ds3231_clock_t {
+    ds3231_t * rtc;
+    int32_t max_slew_ppm;       // Bound on the rate change while slewing.
+    uint32_t window_us;         // Corrections are spread over this window when the bound allows it.
+    bool synced;
+
+    /* Raw view: reference time at last correction, stepped on every correction. */
+    uint64_t raw_local_us;
+    int64_t raw_reference_us;
+
+    /* Corrected view: anchored at the last correction, runs at (1 + slew_ppm) until slew_end_us. */
+    uint64_t anchor_local_us;
+    int64_t anchor_corrected_us;
+    int32_t slew_ppm;
+    uint64_t slew_end_us;
+    int64_t last_corrected_us;  // Guards against rounding going backwards.
+} ds3231_clock_t;
+
+int ds3231_clock_init(ds3231_clock_t * clock, ds3231_t * rtc, int32_t max_slew_ppm, uint32_t window_ms);
+
+int ds3231_clock_correct(ds3231_clock_t * clock, int64_t reference_us, uint64_t local_us);
+int ds3231_clock_sync(ds3231_clock_t * clock);
+
+int64_t ds3231_clock_raw_at(ds3231_clock_t * clock, uint64_t local_us);
+int64_t ds3231_clock_corrected_at(ds3231_clock_t * clock, uint64_t local_us);
+int64_t ds3231_clock_monotonic_at(ds3231_clock_t * clock, uint64_t local_us);
+
+int ds3231_clock_read(ds3231_clock_t * clock, int64_t * raw_us, int64_t * corrected_us);
+int64_t ds3231_clock_now_us(ds3231_clock_t * clock);
+
+#endif
@@ -0,0 +1,148 @@
+/**
+ * @file    ds3231_command.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Device side of the host commands that read and set the time and write the configuration.
+ * A time request is answered with the DS3231 time and status register, so the host can see the
+ * offset and a stopped oscillator before it decides to set the time. The host sends a time set
+ * right at the start of the second it carries, the seconds register restarts the countdown of
+ * the DS3231 when written, so the second boundaries of both line up. Configuration writes go
+ * into the configuration partition of the superblock, split at page boundaries.
+ * Mount the superblock on a ds3231_sync device so the next harvest picks the written pages up.
+ * See tools/ds3231_fleet.c for the host side.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_command.h"
+
+static int ds3231_command_ack(ds3231_link_write_t write, void * ctx, const ds3231_link_frame_t * request, int result) {
+    uint8_t ack[2] = {request->type, result ? 1 : 0};
+    return ds3231_link_send(write, ctx, DS3231_LINK_ACK, request->seq, ack, sizeof(ack), NULL, 0);
+}
+
+static int ds3231_command_time(ds3231_command_t * command, const ds3231_link_frame_t * request,
+    ds3231_link_write_t write, void * ctx)
+{
+    ds3231_data_t data;
+    uint8_t status = 0;
+    uint32_t epoch = 0;
+    int result = ds3231_read_current_time(command->rtc, &data);
+    DS3231_CRUMB_API(DS3231_CRUMB_COMMAND);
+    if(!result)
+        result = i2c_read_reg(command->rtc->i2c, command->rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status);
+    if(!result)
+        epoch = ds3231_time_to_epoch(command->rtc, &data);
+    uint8_t payload[6] = {epoch & 0xFF, (epoch >> 8) & 0xFF, (epoch >> 16) & 0xFF, epoch >> 24,
+        status, result ? 1 : 0};
+    return ds3231_link_send(write, ctx, DS3231_LINK_TIME, request->seq, payload, sizeof(payload), NULL, 0);
+}
+
+static int ds3231_command_time_set(ds3231_command_t * command, const ds3231_link_frame_t * request) {
+    if(request->length != 4)
+        return -1;
+    const uint8_t * payload = request->payload;
+    uint32_t epoch = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24);
+    ds3231_data_t data;
+    ds3231_epoch_to_time(command->rtc, epoch, &data);
+    if(ds3231_configure_time(command->rtc, &data))
+        return -1;
+
+    /* The time is valid again. */
+    DS3231_CRUMB_API(DS3231_CRUMB_COMMAND);
+    uint8_t status;
+    if(i2c_read_reg(command->rtc->i2c, command->rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
+        return -1;
+    /* Flags only clear when written 0, keep the alarm flags by writing them 1. */
+    status = (status & ~(0x01 << 7)) | 0x03;
+    if(i2c_write_reg(command->rtc->i2c, command->rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
+        return -1;
+    command->time_sets++;
+    return 0;
+}
+
+static int ds3231_command_config_write(ds3231_command_t * command, const ds3231_link_frame_t * request) {
+    if(!command->storage || request->length < 2)
+        return -1;
+    uint32_t offset = request->payload[0] | (request->payload[1] << 8);
+    uint32_t length = request->length - 2;
+    const uint8_t * data = &request->payload[2];
+    if(offset + length > command->config_size)
+        return -1;
+
+    uint32_t page_size = command->storage->page_size;
+    while(length) {
+        uint32_t page_offset = offset % page_size;
+        uint32_t chunk = page_size - page_offset;
+        if(chunk > length)
+            chunk = length;
+        if(ds3231_storage_program(command->storage, command->config_page + offset / page_size, page_offset, chunk, data))
+            return -1;
+        offset += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    command->config_writes++;
+    return 0;
+}
+
+/**
+ * @brief               Initiliaze the host commands.
+ *
+ * @param[out] command  Command struct.
+ * @param[in] rtc       DS3231 struct.
+ * @param[in] super     Mounted superblock with a configuration partition, NULL to refuse
+ *                      configuration writes.
+ * @return              0 if succesful, -1 if the superblock has no configuration partition.
+ */
+int ds3231_command_init(ds3231_command_t * command, ds3231_t * rtc, ds3231_super_t * super) {
+    command->rtc = rtc;
+    command->storage = NULL;
+    command->config_page = 0;
+    command->config_size = 0;
+    command->time_sets = 0;
+    command->config_writes = 0;
+    if(!super)
+        return 0;
+    ds3231_super_partition_t * part = ds3231_super_find(super, DS3231_SUPER_CONFIG);
+    if(!part)
+        return -1;
+    command->storage = super->storage;
+    command->config_page = part->first_page;
+    command->config_size = part->page_count * super->storage->page_size;
+    return 0;
+}
+
+/**
+ * @brief               Answer a time request, time set or configuration write. Time sets and
+ * configuration writes are answered with an ack frame of the same sequence number.
+ *
+ * @param[in] command   Command struct.
+ * @param[in] request   Frame received from the host.
+ * @param[in] write     Function that sends bytes to the host.
+ * @param[in] ctx       Passed to the write function.
+ * @return              0 if succesful, 1 if the frame is not a command, -1 if the command failed
+ *                      or sending failed.
+ */
+int ds3231_command_handle(ds3231_command_t * command, const ds3231_link_frame_t * request,
+    ds3231_link_write_t write, void * ctx)
+{
+    int result;
+    switch(request->type) {
+    case DS3231_LINK_TIME_REQUEST:
+        return ds3231_command_time(command, request, write, ctx);
+    case DS3231_LINK_TIME_SET:
+        result = ds3231_command_time_set(command, request);
+        break;
+    case DS3231_LINK_CONFIG_WRITE:
+        result = ds3231_command_config_write(command, request);
+        break;
+    default:
+        return 1;
+    }
+    if(ds3231_command_ack(write, ctx, request, result))
+        return -1;
+    return result;
+}
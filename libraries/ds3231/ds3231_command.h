@@ -0,0 +1,36 @@
+/**
+ * @file    ds3231_command.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Device side of the host commands that read and set the time and write the configuration.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231.h"
+#include "ds3231_super.h"
+#include "ds3231_link.h"
+
+#ifndef DS_3231_COMMAND
+#define DS_3231_COMMAND
+
+/**
+ * @brief Struct to hold what the host commands act on.
+ *
+ */
+typedef struct ds3231_command_t {
+    ds3231_t * rtc;
+    ds3231_storage_t * storage;     // Device of the configuration partition, NULL without one.
+    uint32_t config_page;           // First page of the configuration partition.
+    uint32_t config_size;           // Bytes.
+    uint32_t time_sets;
+    uint32_t config_writes;
+} ds3231_command_t;
+
+int ds3231_command_init(ds3231_command_t * command, ds3231_t * rtc, ds3231_super_t * super);
+int ds3231_command_handle(ds3231_command_t * command, const ds3231_link_frame_t * request,
+    ds3231_link_write_t write, void * ctx);
+
+#endif
@@ -0,0 +1,60 @@
+/**
+ * @file    ds3231_config.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Features of the driver that can be compiled out for a smaller image.
+ * Set an option to 0 to leave its code out. CMake sets all of them from the DS3231_AM_PM,
+ * DS3231_FLOAT, DS3231_EEPROM, DS3231_ALARMS, DS3231_TRACE, DS3231_METRICS and DS3231_CRUMBS options, which also leave out the
+ * modules that need the feature. The defaults below only apply to builds without CMake.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef DS_3231_CONFIG
+#define DS_3231_CONFIG
+
+/* 12-hour mode. Without it hours are always 0-23 and am_pm is always false. */
+#ifndef DS3231_CONFIG_AM_PM
+#define DS3231_CONFIG_AM_PM             1
+#endif
+
+/* Float temperature functions. The quarter degree functions are always there. */
+#ifndef DS3231_CONFIG_FLOAT
+#define DS3231_CONFIG_FLOAT             1
+#endif
+
+/* AT24C32 functions and the EEPROM storage backend. */
+#ifndef DS3231_CONFIG_EEPROM
+#define DS3231_CONFIG_EEPROM            1
+#endif
+
+/* Alarm 1 and alarm 2. */
+#ifndef DS3231_CONFIG_ALARMS
+#define DS3231_CONFIG_ALARMS            1
+#endif
+
+/* Capture and replay of bus transfers. Without it every transfer goes straight to the SDK. */
+#ifndef DS3231_CONFIG_TRACE
+#define DS3231_CONFIG_TRACE             1
+#endif
+
+/* Bus counters for ds3231_metrics. Without it transfers are not timed. */
+#ifndef DS3231_CONFIG_METRICS
+#define DS3231_CONFIG_METRICS           1
+#endif
+
+/* Breadcrumbs of the operation in flight in the watchdog scratch registers, see ds3231_crumb. */
+#ifndef DS3231_CONFIG_CRUMBS
+#define DS3231_CONFIG_CRUMBS            1
+#endif
+
+/* Constant false without 12-hour mode, so the compiler drops the 12-hour branches. */
+#if DS3231_CONFIG_AM_PM
+#define DS3231_AM_PM_MODE(rtc)          ((rtc)->am_pm_mode)
+#else
+#define DS3231_AM_PM_MODE(rtc)          false
+#endif
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ * @file    ds3231_crumb.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Breadcrumbs of the driver operation in flight, kept in the watchdog scratch registers.
+ * Every ds3231_* and at24c32_* function that goes to the bus stores its id on entry, and
+ * ds3231_bus_write and ds3231_bus_read store the device, register, length and phase of every
+ * transfer before and after it. That is a few stores to a peripheral register per transfer and
+ * nothing is kept in RAM. The scratch registers survive a watchdog or software reset, so after a
+ * unit resets during an I2C hang, ds3231_crumb_recover on the next boot tells which call and
+ * which transfer were in flight. Nested calls leave the innermost id, the one that was on the bus.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_crumb.h"
+#include "hardware/watchdog.h"
+#include <stdio.h>
+
+static const char * ds3231_crumb_names[] = {
+    [DS3231_CRUMB_NONE] = "none",
+    [DS3231_CRUMB_INIT] = "ds3231_init",
+    [DS3231_CRUMB_ENABLE_AM_PM_MODE] = "ds3231_enable_am_pm_mode",
+    [DS3231_CRUMB_CONFIGURE_TIME] = "ds3231_configure_time",
+    [DS3231_CRUMB_READ_CURRENT_TIME] = "ds3231_read_current_time",
+    [DS3231_CRUMB_READ_TIME_FIELDS] = "ds3231_read_time_fields",
+    [DS3231_CRUMB_TIME_WATCH_POLL] = "ds3231_time_watch_poll",
+    [DS3231_CRUMB_SET_ALARM_1] = "ds3231_set_alarm_1",
+    [DS3231_CRUMB_SET_ALARM_2] = "ds3231_set_alarm_2",
+    [DS3231_CRUMB_ENABLE_ALARM_INTERRUPT] = "ds3231_enable_alarm_interrupt",
+    [DS3231_CRUMB_ENABLE_32KHZ_SQUARE_WAVE] = "ds3231_enable_32khz_square_wave",
+    [DS3231_CRUMB_ENABLE_OSCILLATOR] = "ds3231_enable_oscillator",
+    [DS3231_CRUMB_ENABLE_BATTERY_BACKED_SQUARE_WAVE] = "ds3231_enable_battery_backed_square_wave",
+    [DS3231_CRUMB_SET_SQUARE_WAVE_FREQUENCY] = "ds3231_set_square_wave_frequency",
+    [DS3231_CRUMB_FORCE_CONVERT_TEMPERATURE] = "ds3231_force_convert_temperature",
+    [DS3231_CRUMB_READ_TEMPERATURE_QUARTERS] = "ds3231_read_temperature_quarters",
+    [DS3231_CRUMB_READ_TEMPERATURE] = "ds3231_read_temperature",
+    [DS3231_CRUMB_CHECK_OSCILLATOR_STOP_FLAG] = "ds3231_check_oscillator_stop_flag",
+    [DS3231_CRUMB_SET_AGING_OFFSET] = "ds3231_set_aging_offset",
+    [DS3231_CRUMB_AT24C32_WRITE_PAGE] = "at24c32_i2c_write_page",
+    [DS3231_CRUMB_AT24C32_READ_PAGE] = "at24c32_i2c_read_page",
+    [DS3231_CRUMB_AT24C32_WAIT_WRITE_CYCLE] = "at24c32_wait_write_cycle",
+    [DS3231_CRUMB_AT24C32_READ_CURRENT_ADRESS] = "at24c32_read_current_adress",
+    [DS3231_CRUMB_AT24C32_WRITE_CURRENT_TIME] = "at24c32_write_current_time",
+    [DS3231_CRUMB_QUEUE_EXECUTE] = "ds3231_queue_execute",
+    [DS3231_CRUMB_TEMP] = "ds3231_temp",
+    [DS3231_CRUMB_PIN] = "ds3231_pin",
+    [DS3231_CRUMB_SCHEDULE_ARM] = "ds3231_schedule_arm",
+    [DS3231_CRUMB_HYBRID] = "ds3231_hybrid",
+    [DS3231_CRUMB_HWRTC_SEED] = "ds3231_hwrtc_seed",
+    [DS3231_CRUMB_VOTE_READ] = "ds3231_vote_read",
+    [DS3231_CRUMB_COMMAND] = "ds3231_command_handle"
+};
+
+/**
+ * @brief               Read and clear the breadcrumb of the last boot. Call it before any other
+ * driver function, they leave breadcrumbs of their own.
+ *
+ * @param[out] crumb    Breadcrumb of the last boot.
+ * @return              1 if a transfer was in flight, 0 if not, -1 if there is no breadcrumb,
+ *                      e.g. after a power on.
+ */
+int ds3231_crumb_recover(ds3231_crumb_t * crumb) {
+    uint32_t api = watchdog_hw->scratch[DS3231_CRUMB_SCRATCH];
+    uint32_t transfer = watchdog_hw->scratch[DS3231_CRUMB_SCRATCH + 1];
+    watchdog_hw->scratch[DS3231_CRUMB_SCRATCH] = 0;
+    watchdog_hw->scratch[DS3231_CRUMB_SCRATCH + 1] = 0;
+
+    crumb->watchdog = watchdog_caused_reboot();
+    if((api & 0xFF000000) != DS3231_CRUMB_MAGIC)
+        return -1;
+    crumb->api = api & 0xFF;
+    crumb->phase = transfer >> 24;
+    crumb->dev_addr = (transfer >> 16) & 0xFF;
+    crumb->reg = (transfer >> 8) & 0xFF;
+    crumb->length = transfer & 0xFF;
+    return crumb->phase == DS3231_CRUMB_WRITE || crumb->phase == DS3231_CRUMB_READ;
+}
+
+/**
+ * @brief               Get the name of the function an API id stands for.
+ *
+ * @param[in] api       DS3231_CRUMB_APIS
+ * @return              Name of the function, "unknown" for ids of another driver version.
+ */
+const char * ds3231_crumb_api_name(uint8_t api) {
+    if(api >= sizeof(ds3231_crumb_names) / sizeof(ds3231_crumb_names[0]) || !ds3231_crumb_names[api])
+        return "unknown";
+    return ds3231_crumb_names[api];
+}
+
+/**
+ * @brief               Describe a breadcrumb in one line, e.g. to print it on boot.
+ *
+ * @param[in] crumb     Breadcrumb from ds3231_crumb_recover.
+ * @param[out] text     Buffer for the description.
+ * @param[in] size      Size of the buffer in bytes.
+ * @return              Length of the description as snprintf returns it.
+ */
+int ds3231_crumb_describe(const ds3231_crumb_t * crumb, char * text, size_t size) {
+    static const char * phases[] = {"no transfer yet", "write in flight", "read in flight",
+        "last transfer done", "last transfer failed"};
+    const char * phase = crumb->phase < sizeof(phases) / sizeof(phases[0]) ? phases[crumb->phase] : "unknown phase";
+    if(crumb->phase == DS3231_CRUMB_IDLE)
+        return snprintf(text, size, "%s: %s%s", ds3231_crumb_api_name(crumb->api), phase,
+            crumb->watchdog ? ", watchdog reset" : "");
+    return snprintf(text, size, "%s: %s, device 0x%02X register 0x%02X, %u%s bytes%s",
+        ds3231_crumb_api_name(crumb->api), phase, crumb->dev_addr, crumb->reg, crumb->length,
+        crumb->length == 0xFF ? "+" : "", crumb->watchdog ? ", watchdog reset" : "");
+}
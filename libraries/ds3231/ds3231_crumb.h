@@ -0,0 +1,115 @@
+/**
+ * @file    ds3231_crumb.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Breadcrumbs of the driver operation in flight, kept in the watchdog scratch registers.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_config.h"
+#include "hardware/structs/watchdog.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef DS_3231_CRUMB
+#define DS_3231_CRUMB
+
+/* First of the two scratch registers used. The boot ROM uses scratch 4 to 7. */
+#ifndef DS3231_CRUMB_SCRATCH
+#define DS3231_CRUMB_SCRATCH            0
+#endif
+
+/* Scratch: magic (8), 0 (16), API id (8). Scratch + 1: phase (8), device adress (8),
+register or first byte written (8), length capped at 255 (8). */
+#define DS3231_CRUMB_MAGIC              0xD3000000
+
+enum DS3231_CRUMB_PHASES {
+    DS3231_CRUMB_IDLE = 0,          // API entered, no transfer yet.
+    DS3231_CRUMB_WRITE,             // Write in flight.
+    DS3231_CRUMB_READ,              // Read in flight.
+    DS3231_CRUMB_DONE,              // Last transfer completed.
+    DS3231_CRUMB_FAILED             // Last transfer failed.
+};
+
+/* Ids are stored in the field, do not renumber them. */
+enum DS3231_CRUMB_APIS {
+    DS3231_CRUMB_NONE = 0x00,
+    DS3231_CRUMB_INIT = 0x01,
+    DS3231_CRUMB_ENABLE_AM_PM_MODE = 0x02,
+    DS3231_CRUMB_CONFIGURE_TIME = 0x03,
+    DS3231_CRUMB_READ_CURRENT_TIME = 0x04,
+    DS3231_CRUMB_READ_TIME_FIELDS = 0x05,
+    DS3231_CRUMB_TIME_WATCH_POLL = 0x06,
+    DS3231_CRUMB_SET_ALARM_1 = 0x07,
+    DS3231_CRUMB_SET_ALARM_2 = 0x08,
+    DS3231_CRUMB_ENABLE_ALARM_INTERRUPT = 0x09,
+    DS3231_CRUMB_ENABLE_32KHZ_SQUARE_WAVE = 0x0A,
+    DS3231_CRUMB_ENABLE_OSCILLATOR = 0x0B,
+    DS3231_CRUMB_ENABLE_BATTERY_BACKED_SQUARE_WAVE = 0x0C,
+    DS3231_CRUMB_SET_SQUARE_WAVE_FREQUENCY = 0x0D,
+    DS3231_CRUMB_FORCE_CONVERT_TEMPERATURE = 0x0E,
+    DS3231_CRUMB_READ_TEMPERATURE_QUARTERS = 0x0F,
+    DS3231_CRUMB_READ_TEMPERATURE = 0x10,
+    DS3231_CRUMB_CHECK_OSCILLATOR_STOP_FLAG = 0x11,
+    DS3231_CRUMB_SET_AGING_OFFSET = 0x12,
+
+    DS3231_CRUMB_AT24C32_WRITE_PAGE = 0x20,
+    DS3231_CRUMB_AT24C32_READ_PAGE = 0x21,
+    DS3231_CRUMB_AT24C32_WAIT_WRITE_CYCLE = 0x22,
+    DS3231_CRUMB_AT24C32_READ_CURRENT_ADRESS = 0x23,
+    DS3231_CRUMB_AT24C32_WRITE_CURRENT_TIME = 0x24,
+
+    DS3231_CRUMB_QUEUE_EXECUTE = 0x40,
+    DS3231_CRUMB_TEMP = 0x41,
+    DS3231_CRUMB_PIN = 0x42,
+    DS3231_CRUMB_SCHEDULE_ARM = 0x43,
+    DS3231_CRUMB_HYBRID = 0x44,
+    DS3231_CRUMB_HWRTC_SEED = 0x45,
+    DS3231_CRUMB_VOTE_READ = 0x46,
+    DS3231_CRUMB_COMMAND = 0x47
+};
+
+/* Two stores on entering an API, two stores around every transfer. */
+#if DS3231_CONFIG_CRUMBS
+#define DS3231_CRUMB_API(api)           (watchdog_hw->scratch[DS3231_CRUMB_SCRATCH] = DS3231_CRUMB_MAGIC | (api), \
+                                         watchdog_hw->scratch[DS3231_CRUMB_SCRATCH + 1] = DS3231_CRUMB_IDLE)
+#define DS3231_CRUMB_WRITE_START(dev_addr, first, length) \
+    (watchdog_hw->scratch[DS3231_CRUMB_SCRATCH + 1] = ((uint32_t)DS3231_CRUMB_WRITE << 24) | \
+        ((uint32_t)(dev_addr) << 16) | ((uint32_t)(first) << 8) | ((length) > 0xFF ? 0xFF : (length)))
+/* Keeps the register of the write before, which selected it. */
+#define DS3231_CRUMB_READ_START(dev_addr, length) \
+    (watchdog_hw->scratch[DS3231_CRUMB_SCRATCH + 1] = ((uint32_t)DS3231_CRUMB_READ << 24) | \
+        ((uint32_t)(dev_addr) << 16) | (watchdog_hw->scratch[DS3231_CRUMB_SCRATCH + 1] & 0xFF00) | \
+        ((length) > 0xFF ? 0xFF : (length)))
+#define DS3231_CRUMB_END(failed) \
+    (watchdog_hw->scratch[DS3231_CRUMB_SCRATCH + 1] = (watchdog_hw->scratch[DS3231_CRUMB_SCRATCH + 1] & 0x00FFFFFF) | \
+        ((uint32_t)((failed) ? DS3231_CRUMB_FAILED : DS3231_CRUMB_DONE) << 24))
+#else
+#define DS3231_CRUMB_API(api)                               ((void)0)
+#define DS3231_CRUMB_WRITE_START(dev_addr, first, length)   ((void)0)
+#define DS3231_CRUMB_READ_START(dev_addr, length)           ((void)0)
+#define DS3231_CRUMB_END(failed)                            ((void)0)
+#endif
+
+/**
+ * @brief Struct to hold the breadcrumb left by the last boot.
+ *
+ */
+typedef struct ds3231_crumb_t {
+    bool watchdog;                  // The last reset was caused by the watchdog.
+    uint8_t api;                    // DS3231_CRUMB_APIS
+    uint8_t phase;                  // DS3231_CRUMB_PHASES
+    uint8_t dev_addr;
+    uint8_t reg;
+    uint8_t length;
+} ds3231_crumb_t;
+
+int ds3231_crumb_recover(ds3231_crumb_t * crumb);
+const char * ds3231_crumb_api_name(uint8_t api);
+int ds3231_crumb_describe(const ds3231_crumb_t * crumb, char * text, size_t size);
+
+#endif
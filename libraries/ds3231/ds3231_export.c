@@ -0,0 +1,210 @@
+/**
+ * @file    ds3231_export.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Double-buffered export of the AT24C32 EEPROM to a host.
+ * The EEPROM is read in DS3231_EXPORT_CHUNK byte sequential reads by DMA: one channel feeds the
+ * read commands to the I2C data register, another one moves the received bytes to a buffer.
+ * While chunk N + 1 is read into one buffer, chunk N is sent from the other as a ds3231_link frame,
+ * so the export takes about as long as the slower of the I2C bus and the host link instead of
+ * their sum. bus_wait_us shows how long the CPU still waited for the bus.
+ *
+ * The write function is usually USB CDC, e.g. a loop over tud_cdc_write and tud_cdc_write_flush,
+ * or stdio_put_string with CR/LF translation off when stdio_usb is used.
+ * DMA transfers bypass ds3231_bus_read, so exports are not recorded by a trace.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_export.h"
+#include "hardware/dma.h"
+#include "hardware/timer.h"
+
+static void ds3231_export_abort(ds3231_export_t * exporter) {
+    dma_channel_abort(exporter->command_channel);
+    dma_channel_abort(exporter->stop_channel);
+    dma_channel_abort(exporter->rx_channel);
+}
+
+/* Start a sequential read of length bytes, at least 2, from the EEPROM adress. */
+static void ds3231_export_start_read(ds3231_export_t * exporter, uint16_t adress, uint8_t * buffer, size_t length) {
+    i2c_hw_t * hw = i2c_get_hw(exporter->i2c);
+    hw->enable = 0;
+    hw->tar = exporter->dev_addr;
+    hw->enable = 1;
+    hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+
+    dma_channel_config config = dma_channel_get_default_config(exporter->rx_channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_dreq(&config, i2c_get_dreq(exporter->i2c, false));
+    dma_channel_configure(exporter->rx_channel, &config, buffer, &hw->data_cmd, length, true);
+
+    config = dma_channel_get_default_config(exporter->stop_channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, i2c_get_dreq(exporter->i2c, true));
+    dma_channel_configure(exporter->stop_channel, &config, &hw->data_cmd, &exporter->stop_command, 1, false);
+
+    /* The word adress and the first read command with a restart go straight into the TX FIFO. */
+    hw->data_cmd = adress >> 8;
+    hw->data_cmd = adress & 0xFF;
+    hw->data_cmd = I2C_IC_DATA_CMD_CMD_BITS | I2C_IC_DATA_CMD_RESTART_BITS;
+
+    if(length > 2) {
+        config = dma_channel_get_default_config(exporter->command_channel);
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+        channel_config_set_read_increment(&config, false);
+        channel_config_set_write_increment(&config, false);
+        channel_config_set_dreq(&config, i2c_get_dreq(exporter->i2c, true));
+        channel_config_set_chain_to(&config, exporter->stop_channel);
+        dma_channel_configure(exporter->command_channel, &config, &hw->data_cmd, &exporter->read_command, length - 2, true);
+    } else {
+        dma_channel_start(exporter->stop_channel);
+    }
+}
+
+/* Wait for the read started by ds3231_export_start_read. */
+static int ds3231_export_wait_read(ds3231_export_t * exporter, size_t length) {
+    i2c_hw_t * hw = i2c_get_hw(exporter->i2c);
+    /* About 23 us per byte at 400 kHz, allow the 100 kHz time with margin. */
+    uint64_t deadline = time_us_64() + 10000 + length * 200;
+    int result = 0;
+    while(dma_channel_is_busy(exporter->rx_channel)) {
+        if(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS) {
+            (void)hw->clr_tx_abrt;
+            result = -1;
+            break;
+        }
+        if(time_us_64() > deadline) {
+            result = -1;
+            break;
+        }
+    }
+    if(result)
+        ds3231_export_abort(exporter);
+    hw->dma_cr = 0;
+    return result;
+}
+
+/**
+ * @brief               Claim the DMA channels of an export.
+ *
+ * @param[out] exporter Export struct, holds two chunk buffers.
+ * @param[in] rtc       DS3231 struct that holds the I2C instance and the EEPROM adress.
+ * @return              0 if succesful, -1 if there are not enough free DMA channels.
+ */
+int ds3231_export_init(ds3231_export_t * exporter, ds3231_t * rtc) {
+    exporter->i2c = rtc->i2c;
+    exporter->dev_addr = rtc->at24c32_addr;
+    exporter->read_command = I2C_IC_DATA_CMD_CMD_BITS;
+    exporter->stop_command = I2C_IC_DATA_CMD_CMD_BITS | I2C_IC_DATA_CMD_STOP_BITS;
+    exporter->rx_channel = dma_claim_unused_channel(false);
+    exporter->command_channel = dma_claim_unused_channel(false);
+    exporter->stop_channel = dma_claim_unused_channel(false);
+    if(exporter->rx_channel < 0 || exporter->command_channel < 0 || exporter->stop_channel < 0) {
+        ds3231_export_deinit(exporter);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief               Release the DMA channels of an export.
+ *
+ * @param[in] exporter  Export struct.
+ */
+void ds3231_export_deinit(ds3231_export_t * exporter) {
+    if(exporter->rx_channel >= 0)
+        dma_channel_unclaim(exporter->rx_channel);
+    if(exporter->command_channel >= 0)
+        dma_channel_unclaim(exporter->command_channel);
+    if(exporter->stop_channel >= 0)
+        dma_channel_unclaim(exporter->stop_channel);
+    exporter->rx_channel = -1;
+    exporter->command_channel = -1;
+    exporter->stop_channel = -1;
+}
+
+/**
+ * @brief               Send the whole EEPROM as ds3231_link frames: an export start frame, one data
+ * frame per chunk and an export end frame with the result. Frames are numbered from 0.
+ * No other code may use the I2C bus during the export.
+ *
+ * @param[in] exporter  Export struct, initialised with ds3231_export_init.
+ * @param[in] write     Function that sends bytes to the host.
+ * @param[in] ctx       Passed to the write function.
+ * @return              0 if succesful, -1 if reading the EEPROM or sending failed.
+ */
+int ds3231_export_eeprom(ds3231_export_t * exporter, ds3231_link_write_t write, void * ctx) {
+    const uint32_t size = AT24C32_PAGE_SIZE * AT24C32_PAGE_COUNT;
+    const uint32_t chunks = size / DS3231_EXPORT_CHUNK;
+    uint64_t start = time_us_64();
+    uint16_t seq = 0;
+    uint8_t header[6];
+    int result = 0;
+
+    exporter->bytes = 0;
+    exporter->send_us = 0;
+    exporter->bus_wait_us = 0;
+
+    header[0] = size & 0xFF;
+    header[1] = (size >> 8) & 0xFF;
+    header[2] = (size >> 16) & 0xFF;
+    header[3] = size >> 24;
+    header[4] = DS3231_EXPORT_CHUNK & 0xFF;
+    header[5] = DS3231_EXPORT_CHUNK >> 8;
+    if(ds3231_link_send(write, ctx, DS3231_LINK_EXPORT_START, seq++, header, 6, NULL, 0))
+        return -1;
+
+    /* A write cycle that is still running would make the first read fail. */
+    at24c32_wait_write_cycle(exporter->i2c, exporter->dev_addr, AT24C32_WRITE_CYCLE_US);
+
+    ds3231_export_start_read(exporter, 0, exporter->buffers[0], DS3231_EXPORT_CHUNK);
+    result = ds3231_export_wait_read(exporter, DS3231_EXPORT_CHUNK);
+
+    for(uint32_t chunk = 0; chunk < chunks && !result; chunk++) {
+        bool next = (chunk + 1) < chunks;
+        if(next)
+            ds3231_export_start_read(exporter, (chunk + 1) * DS3231_EXPORT_CHUNK,
+                exporter->buffers[(chunk + 1) & 1], DS3231_EXPORT_CHUNK);
+
+        uint32_t offset = chunk * DS3231_EXPORT_CHUNK;
+        header[0] = offset & 0xFF;
+        header[1] = (offset >> 8) & 0xFF;
+        header[2] = (offset >> 16) & 0xFF;
+        header[3] = offset >> 24;
+        uint64_t send_start = time_us_64();
+        if(ds3231_link_send(write, ctx, DS3231_LINK_EXPORT_DATA, seq++, header, 4,
+            exporter->buffers[chunk & 1], DS3231_EXPORT_CHUNK))
+        {
+            result = -1;
+        } else {
+            exporter->bytes += DS3231_EXPORT_CHUNK;
+        }
+        uint64_t wait_start = time_us_64();
+        exporter->send_us += wait_start - send_start;
+
+        if(next) {
+            if(result)
+                ds3231_export_wait_read(exporter, DS3231_EXPORT_CHUNK);
+            else
+                result = ds3231_export_wait_read(exporter, DS3231_EXPORT_CHUNK);
+            exporter->bus_wait_us += time_us_64() - wait_start;
+        }
+    }
+
+    header[0] = exporter->bytes & 0xFF;
+    header[1] = (exporter->bytes >> 8) & 0xFF;
+    header[2] = (exporter->bytes >> 16) & 0xFF;
+    header[3] = exporter->bytes >> 24;
+    header[4] = result ? 1 : 0;
+    if(ds3231_link_send(write, ctx, DS3231_LINK_EXPORT_END, seq++, header, 5, NULL, 0))
+        result = -1;
+    exporter->total_us = time_us_64() - start;
+    return result;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file    ds3231_export.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Double-buffered export of the AT24C32 EEPROM to a host.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231.h"
+#include "ds3231_link.h"
+
+#ifndef DS_3231_EXPORT
+#define DS_3231_EXPORT
+
+/* Bytes read per I2C transaction and sent per frame. */
+#define DS3231_EXPORT_CHUNK             256
+
+/**
+ * @brief Struct to hold the DMA channels, buffers and timing of an export.
+ *
+ */
+typedef struct ds3231_export_t {
+    i2c_inst_t * i2c;
+    uint8_t dev_addr;
+    int rx_channel;             // I2C data register to buffer.
+    int command_channel;        // Read commands to the I2C data register.
+    int stop_channel;           // Last read command with stop, chained from command_channel.
+    uint32_t read_command;
+    uint32_t stop_command;
+    uint8_t buffers[2][DS3231_EXPORT_CHUNK];
+    uint32_t bytes;
+    uint32_t total_us;          // Duration of the last export.
+    uint32_t send_us;           // Time spent in the write function.
+    uint32_t bus_wait_us;       // Time spent waiting for a chunk after sending the previous one.
+} ds3231_export_t;
+
+int ds3231_export_init(ds3231_export_t * exporter, ds3231_t * rtc);
+void ds3231_export_deinit(ds3231_export_t * exporter);
+int ds3231_export_eeprom(ds3231_export_t * exporter, ds3231_link_write_t write, void * ctx);
+
+#endif
@@ -0,0 +1,244 @@
+/**
+ * @file    ds3231_hwrtc.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   RP2040 RTC clocked from the DS3231 32K output and seeded from the DS3231 time.
+ * The 32K pin of DS3231 is routed to GPIN0 (GPIO 20) or GPIN1 (GPIO 22) and clocks clk_rtc, so the
+ * RP2040 RTC counts seconds of the DS3231 TCXO instead of the crystal of the board. It is seeded
+ * once, right after a DS3231 second boundary, and afterwards reads are served by
+ * rtc_get_datetime without any I2C traffic. Both clocks then run from the same oscillator and
+ * can only drift apart by a missed edge or a reset of either one.
+ * ds3231_hwrtc_poll compares the two at a fixed interval and seeds the RP2040 RTC again after
+ * two checks in a row disagree. If the 32K output is lost, e.g. because EN32kHz was cleared,
+ * clk_rtc is switched back to its default source so the RP2040 RTC keeps running.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_hwrtc.h"
+#include "hardware/clocks.h"
+#include "hardware/timer.h"
+
+static uint ds3231_hwrtc_counter_source(uint gpio) {
+    return gpio == DS3231_HWRTC_GPIN0_GPIO ? CLOCKS_FC0_SRC_VALUE_CLKSRC_GPIN0 : CLOCKS_FC0_SRC_VALUE_CLKSRC_GPIN1;
+}
+
+/* The frequency counter has 1 kHz resolution, 32.768 kHz reads as 32 or 33. */
+static bool ds3231_hwrtc_32k_present(ds3231_hwrtc_t * hwrtc) {
+    uint32_t khz = frequency_count_khz(ds3231_hwrtc_counter_source(hwrtc->gpio));
+    return khz >= 31 && khz <= 34;
+}
+
+/**
+ * @brief                   Convert a DS3231 time to the datetime of the RP2040 RTC.
+ *
+ * @param[in] rtc           DS3231 struct, used to tell if hours are in AM/PM mode.
+ * @param[in] data          DS3231 time.
+ * @param[out] datetime     Converted time, hours 0-23 and Sunday as day 0.
+ */
+void ds3231_hwrtc_to_datetime(ds3231_t * rtc, const ds3231_data_t * data, datetime_t * datetime) {
+    uint8_t hours = data->hours;
+    if(DS3231_AM_PM_MODE(rtc)) {
+        hours %= 12;
+        if(data->am_pm)
+            hours += 12;
+    }
+    datetime->year = 2000 + (data->century ? 100 : 0) + data->year;
+    datetime->month = data->month;
+    datetime->day = data->date;
+    datetime->dotw = data->day % 7;
+    datetime->hour = hours;
+    datetime->min = data->minutes;
+    datetime->sec = data->seconds;
+}
+
+/**
+ * @brief                   Convert a datetime of the RP2040 RTC to a DS3231 time.
+ *
+ * @param[in] rtc           DS3231 struct, used to tell if hours must be in AM/PM mode.
+ * @param[in] datetime      RP2040 RTC time.
+ * @param[out] data         Converted time.
+ */
+void ds3231_hwrtc_from_datetime(ds3231_t * rtc, const datetime_t * datetime, ds3231_data_t * data) {
+    uint16_t year = datetime->year - 2000;
+    data->seconds = datetime->sec;
+    data->minutes = datetime->min;
+    if(DS3231_AM_PM_MODE(rtc)) {
+        data->am_pm = datetime->hour >= 12;
+        data->hours = (datetime->hour % 12) ? (datetime->hour % 12) : 12;
+    } else {
+        data->am_pm = false;
+        data->hours = datetime->hour;
+    }
+    data->day = datetime->dotw ? datetime->dotw : SUNDAY;
+    data->date = datetime->day;
+    data->month = datetime->month;
+    data->century = year >= 100;
+    data->year = year % 100;
+}
+
+/**
+ * @brief               Seed the RP2040 RTC from DS3231. Waits for the next DS3231 second so the
+ * seconds of both clocks start together, up to one second.
+ *
+ * @param[in] hwrtc     Hardware RTC struct.
+ * @return              0 if succesful, -1 if DS3231 could not be read or its seconds do not advance.
+ */
+int ds3231_hwrtc_seed(ds3231_hwrtc_t * hwrtc) {
+    DS3231_CRUMB_API(DS3231_CRUMB_HWRTC_SEED);
+    ds3231_t * rtc = hwrtc->rtc;
+    uint8_t first = 0;
+    uint8_t seconds = 0;
+    if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_SECONDS_REG, 1, &first))
+        return -1;
+    uint64_t deadline = time_us_64() + 1100000;
+    do {
+        if(time_us_64() > deadline)
+            return -1;
+        if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_SECONDS_REG, 1, &seconds))
+            return -1;
+    } while(seconds == first);
+
+    ds3231_data_t data;
+    datetime_t datetime;
+    if(ds3231_read_current_time(rtc, &data))
+        return -1;
+    ds3231_hwrtc_to_datetime(rtc, &data, &datetime);
+    if(!rtc_set_datetime(&datetime))
+        return -1;
+    hwrtc->mismatches = 0;
+    return 0;
+}
+
+/**
+ * @brief                           Clock the RP2040 RTC from the DS3231 32K output and seed it.
+ * Enables the 32K output of DS3231. clk_rtc is left as it is if no 32.768 kHz clock arrives.
+ *
+ * @param[out] hwrtc                Hardware RTC struct.
+ * @param[in] rtc                   DS3231 struct.
+ * @param[in] gpio                  GPIO the 32K pin is connected to, DS3231_HWRTC_GPIN0_GPIO or
+ *                                  DS3231_HWRTC_GPIN1_GPIO. Its pull-up is enabled, the 32K pin is
+ *                                  open drain.
+ * @param[in] check_interval_ms     Interval of the checks made by ds3231_hwrtc_poll.
+ * @return                          0 if succesful, -1 if the GPIO can not clock clk_rtc, there is no
+ *                                  32.768 kHz clock on it or DS3231 could not be read.
+ */
+int ds3231_hwrtc_init(ds3231_hwrtc_t * hwrtc, ds3231_t * rtc, uint gpio, uint32_t check_interval_ms) {
+    if(gpio != DS3231_HWRTC_GPIN0_GPIO && gpio != DS3231_HWRTC_GPIN1_GPIO)
+        return -1;
+    hwrtc->rtc = rtc;
+    hwrtc->gpio = gpio;
+    hwrtc->tcxo = false;
+    hwrtc->check_interval_us = check_interval_ms * 1000;
+    hwrtc->last_offset_s = 0;
+    hwrtc->mismatches = 0;
+    hwrtc->checks = 0;
+    hwrtc->resyncs = 0;
+    hwrtc->fallbacks = 0;
+
+    if(ds3231_enable_32khz_square_wave(rtc, true))
+        return -1;
+    gpio_set_function(gpio, GPIO_FUNC_GPCK);
+    gpio_pull_up(gpio);
+    if(!ds3231_hwrtc_32k_present(hwrtc))
+        return -1;
+
+    clock_configure_gpin(clk_rtc, gpio, DS3231_HWRTC_32K_HZ, DS3231_HWRTC_32K_HZ);
+    hwrtc->tcxo = true;
+    /* rtc_init sets the 1 Hz divider from the clk_rtc frequency. */
+    rtc_init();
+    if(ds3231_hwrtc_seed(hwrtc))
+        return -1;
+    hwrtc->next_check_us = time_us_64() + hwrtc->check_interval_us;
+    return 0;
+}
+
+/**
+ * @brief                   Read the time from the RP2040 RTC, without any I2C traffic.
+ *
+ * @param[in] hwrtc         Hardware RTC struct.
+ * @param[out] datetime     Current time.
+ * @return                  0 if succesful, -1 if the RP2040 RTC is not running.
+ */
+int ds3231_hwrtc_read(ds3231_hwrtc_t * hwrtc, datetime_t * datetime) {
+    (void)hwrtc;
+    return rtc_get_datetime(datetime) ? 0 : -1;
+}
+
+/**
+ * @brief               Read the time from the RP2040 RTC in the format of ds3231_read_current_time.
+ *
+ * @param[in] hwrtc     Hardware RTC struct.
+ * @param[out] data     Current time.
+ * @return              0 if succesful, -1 if the RP2040 RTC is not running.
+ */
+int ds3231_hwrtc_read_time(ds3231_hwrtc_t * hwrtc, ds3231_data_t * data) {
+    datetime_t datetime;
+    if(!rtc_get_datetime(&datetime))
+        return -1;
+    ds3231_hwrtc_from_datetime(hwrtc->rtc, &datetime, data);
+    return 0;
+}
+
+/**
+ * @brief               Compare the RP2040 RTC with DS3231 and correct it. The RP2040 RTC is seeded
+ * again after two checks in a row found an offset, a single one may come from reading both right
+ * at a second boundary. Seeding waits for the next DS3231 second. Falls back to the default clk_rtc
+ * source if the 32K clock is gone.
+ *
+ * @param[in] hwrtc     Hardware RTC struct.
+ * @return              0 if succesful, -1 if DS3231 could not be read.
+ */
+int ds3231_hwrtc_check(ds3231_hwrtc_t * hwrtc) {
+    ds3231_t * rtc = hwrtc->rtc;
+    if(hwrtc->tcxo && !ds3231_hwrtc_32k_present(hwrtc)) {
+        clock_configure(clk_rtc, 0, CLOCKS_CLK_RTC_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, 48 * MHZ, 46875);
+        rtc_init();
+        hwrtc->tcxo = false;
+        hwrtc->fallbacks++;
+        return ds3231_hwrtc_seed(hwrtc);
+    }
+
+    datetime_t before;
+    datetime_t after;
+    ds3231_data_t reference;
+    ds3231_data_t local;
+    for(int attempt = 0; attempt < 2; attempt++) {
+        if(!rtc_get_datetime(&before))
+            return ds3231_hwrtc_seed(hwrtc);
+        if(ds3231_read_current_time(rtc, &reference))
+            return -1;
+        rtc_get_datetime(&after);
+        if(before.sec == after.sec)
+            break;
+    }
+    ds3231_hwrtc_from_datetime(rtc, &after, &local);
+    hwrtc->last_offset_s = (int32_t)(ds3231_time_to_epoch(rtc, &local) - ds3231_time_to_epoch(rtc, &reference));
+    hwrtc->checks++;
+
+    if(!hwrtc->last_offset_s) {
+        hwrtc->mismatches = 0;
+        return 0;
+    }
+    if(++hwrtc->mismatches < 2)
+        return 0;
+    hwrtc->resyncs++;
+    return ds3231_hwrtc_seed(hwrtc);
+}
+
+/**
+ * @brief               Check the RP2040 RTC against DS3231 if the check interval passed.
+ * Call it from the main loop.
+ *
+ * @param[in] hwrtc     Hardware RTC struct.
+ * @return              0 if succesful, -1 if the check failed.
+ */
+int ds3231_hwrtc_poll(ds3231_hwrtc_t * hwrtc) {
+    uint64_t now = time_us_64();
+    if(now < hwrtc->next_check_us)
+        return 0;
+    hwrtc->next_check_us = now + hwrtc->check_interval_us;
+    return ds3231_hwrtc_check(hwrtc);
+}
@@ -0,0 +1,52 @@
+/**
+ * @file    ds3231_hwrtc.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   RP2040 RTC clocked from the DS3231 32K output and seeded from the DS3231 time.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231.h"
+#include "hardware/rtc.h"
+
+#ifndef DS_3231_HWRTC
+#define DS_3231_HWRTC
+
+/* GPIOs that can clock clk_rtc, GPIN0 and GPIN1. */
+#define DS3231_HWRTC_GPIN0_GPIO         20
+#define DS3231_HWRTC_GPIN1_GPIO         22
+
+#define DS3231_HWRTC_32K_HZ             32768
+#define DS3231_HWRTC_DEFAULT_CHECK_MS   60000
+
+/**
+ * @brief Struct to hold the state of an RP2040 RTC that follows DS3231.
+ *
+ */
+typedef struct ds3231_hwrtc_t {
+    ds3231_t * rtc;
+    uint gpio;                  // 32K pin input, DS3231_HWRTC_GPIN0_GPIO or DS3231_HWRTC_GPIN1_GPIO.
+    bool tcxo;                  // clk_rtc runs from the 32K output, false after a fallback to PLL_USB.
+    uint32_t check_interval_us;
+    uint64_t next_check_us;
+    int32_t last_offset_s;      // RP2040 RTC minus DS3231 at the last check.
+    uint8_t mismatches;         // Consecutive checks with an offset.
+    uint32_t checks;
+    uint32_t resyncs;
+    uint32_t fallbacks;
+} ds3231_hwrtc_t;
+
+int ds3231_hwrtc_init(ds3231_hwrtc_t * hwrtc, ds3231_t * rtc, uint gpio, uint32_t check_interval_ms);
+int ds3231_hwrtc_seed(ds3231_hwrtc_t * hwrtc);
+int ds3231_hwrtc_read(ds3231_hwrtc_t * hwrtc, datetime_t * datetime);
+int ds3231_hwrtc_read_time(ds3231_hwrtc_t * hwrtc, ds3231_data_t * data);
+int ds3231_hwrtc_check(ds3231_hwrtc_t * hwrtc);
+int ds3231_hwrtc_poll(ds3231_hwrtc_t * hwrtc);
+
+void ds3231_hwrtc_to_datetime(ds3231_t * rtc, const ds3231_data_t * data, datetime_t * datetime);
+void ds3231_hwrtc_from_datetime(ds3231_t * rtc, const datetime_t * datetime, ds3231_data_t * data);
+
+#endif
@@ -0,0 +1,240 @@
+/**
+ * @file    ds3231_hybrid.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Microsecond alarms that sleep on DS3231 alarm 1 and finish on an RP2040 timer alarm.
+ * DS3231 alarms only match whole seconds, and the RP2040 timer drifts with the board crystal and
+ * stops while the chip is dormant. A deadline far enough away is therefore split in two stages:
+ * DS3231 alarm 1 wakes the system at a whole second handover_ms or a bit more before the deadline,
+ * and its falling edge on INT/SQW arms a hardware timer alarm for the remainder. The edge marks
+ * an exact DS3231 second, so the timer stage starts from a fresh reference point no matter how
+ * long the sleep was, and the timer only has to be accurate over the short remainder. Closer
+ * deadlines use the timer alone, placed with the corrected view of the clock.
+ * The alarm 1 edge is also handed to the clock as a correction by ds3231_hybrid_poll, which
+ * clears the alarm flag from the main loop.
+ * Alarm 1 matches the date but not the month, so a deadline more than a month away also matches
+ * on the same date of earlier months. Such an edge is more than a second away from the wake time
+ * on the clock: it neither starts the timer stage nor corrects the clock, poll only clears the
+ * flag so alarm 1 can match again a month later.
+ *
+ * The reported error is the firing time on the corrected view of the clock minus the deadline.
+ * It includes the interrupt latency of the timer stage and what is left of the clock error. The
+ * latency of the INT/SQW edge, including any wake from dormant, is not visible to the engine.
+ * Only one engine can be active, the timer and GPIO callbacks have no context argument. It owns
+ * alarm 1 and INT/SQW of its DS3231 like the ds3231_pin arbiter does, so the two do not run on
+ * the same DS3231 at once, and ds3231_schedule_arm refuses to run while either owns it.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_hybrid.h"
+#include "hardware/timer.h"
+#include "hardware/sync.h"
+
+static ds3231_hybrid_t * ds3231_hybrid_active = NULL;
+
+static int ds3231_hybrid_clear_flag(ds3231_t * rtc) {
+    DS3231_CRUMB_API(DS3231_CRUMB_HYBRID);
+    uint8_t status = 0;
+    if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
+        return -1;
+    /* Clear A1F alone, writing back a stale 0 would also clear a new A2F or OSF. */
+    status = (status & ~(0x01)) | (0x01 << 1) | (0x01 << 7);
+    if(i2c_write_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
+        return -1;
+    return 0;
+}
+
+static void ds3231_hybrid_timer(uint alarm_num) {
+    ds3231_hybrid_t * hybrid = ds3231_hybrid_active;
+    if(!hybrid || hybrid->state != DS3231_HYBRID_TIMER_WAIT)
+        return;
+    int32_t error = (int32_t)(ds3231_clock_corrected_at(hybrid->clock, time_us_64()) - hybrid->deadline_us);
+    hybrid->state = DS3231_HYBRID_IDLE;
+    hybrid->last_error_us = error;
+    if((error < 0 ? -error : error) > hybrid->max_error_us)
+        hybrid->max_error_us = error < 0 ? -error : error;
+    hybrid->fired++;
+    if(hybrid->callback)
+        hybrid->callback(hybrid->ctx, error);
+}
+
+static void ds3231_hybrid_start_timer(ds3231_hybrid_t * hybrid, uint64_t target_local_us) {
+    hybrid->target_local_us = target_local_us;
+    hybrid->state = DS3231_HYBRID_TIMER_WAIT;
+    /* A target that already passed is reported as missed and fired at once. */
+    if(hardware_alarm_set_target(hybrid->alarm_num, from_us_since_boot(target_local_us)))
+        ds3231_hybrid_timer(hybrid->alarm_num);
+}
+
+/**
+ * @brief                   GPIO callback of the INT/SQW pin. Registered by ds3231_hybrid_init, call
+ * it from your own GPIO callback if one is set later on the same core.
+ *
+ * @param[in] gpio          GPIO that caused the interrupt.
+ * @param[in] event_mask    GPIO events.
+ */
+void ds3231_hybrid_irq(uint gpio, uint32_t event_mask) {
+    ds3231_hybrid_t * hybrid = ds3231_hybrid_active;
+    if(!hybrid || gpio != hybrid->gpio || !(event_mask & GPIO_IRQ_EDGE_FALL))
+        return;
+    if(hybrid->state != DS3231_HYBRID_RTC_WAIT)
+        return;
+    uint64_t edge = time_us_64();
+    int64_t offset = ds3231_clock_corrected_at(hybrid->clock, edge) - hybrid->wake_us;
+    if(offset < -1000000 || offset > 1000000) {
+        /* Same date of an earlier month, keep sleeping. */
+        hybrid->early_edge = true;
+        return;
+    }
+    hybrid->edge_local_us = edge;
+    hybrid->rtc_wakes++;
+    ds3231_hybrid_start_timer(hybrid, edge + (uint64_t)(hybrid->deadline_us - hybrid->wake_us));
+}
+
+/**
+ * @brief                   Initiliaze the hybrid alarm engine. Claims a hardware alarm and sets the
+ * GPIO callback of the INT/SQW pin.
+ *
+ * @param[out] hybrid       Hybrid alarm struct.
+ * @param[in] rtc           DS3231 struct.
+ * @param[in] clock         Clock that is synced before the first alarm is set.
+ * @param[in] gpio          GPIO connected to INT/SQW.
+ * @param[in] handover_ms   Shortest timer stage after a DS3231 wake, DS3231_HYBRID_DEFAULT_HANDOVER_MS
+ *                          leaves time for waking from dormant.
+ * @return                  0 if succesful, -1 if the pin arbiter owns the DS3231 or no hardware
+ *                          alarm is free.
+ */
+int ds3231_hybrid_init(ds3231_hybrid_t * hybrid, ds3231_t * rtc, ds3231_clock_t * clock, uint gpio, uint32_t handover_ms) {
+    if(rtc->int_owner != DS3231_INT_FREE && rtc->int_owner != DS3231_INT_HYBRID)
+        return -1;
+    hybrid->rtc = rtc;
+    hybrid->clock = clock;
+    hybrid->gpio = gpio;
+    hybrid->handover_us = handover_ms * 1000;
+    hybrid->state = DS3231_HYBRID_IDLE;
+    hybrid->edge_local_us = 0;
+    hybrid->early_edge = false;
+    hybrid->callback = NULL;
+    hybrid->last_error_us = 0;
+    hybrid->max_error_us = 0;
+    hybrid->fired = 0;
+    hybrid->rtc_wakes = 0;
+    hybrid->early_wakes = 0;
+
+    hybrid->alarm_num = hardware_alarm_claim_unused(false);
+    if(hybrid->alarm_num < 0)
+        return -1;
+    rtc->int_owner = DS3231_INT_HYBRID;
+    ds3231_hybrid_active = hybrid;
+    hardware_alarm_set_callback(hybrid->alarm_num, &ds3231_hybrid_timer);
+    return ds3231_set_interrupt_callback_function(gpio, &ds3231_hybrid_irq);
+}
+
+/**
+ * @brief                   Set the alarm, replacing one that is pending. Deadlines more than
+ * handover_ms + 2 seconds away sleep on DS3231 alarm 1 first, which needs the alarm interrupt
+ * enabled and is set up here.
+ *
+ * @param[in] hybrid        Hybrid alarm struct.
+ * @param[in] deadline_us   Reference time of the deadline in microseconds since 2000.
+ * @param[in] callback      Function called from the timer interrupt when the alarm fires.
+ * @param[in] ctx           Passed to the callback.
+ * @return                  0 if succesful, -1 if the engine was stopped, the clock was never
+ *                          synced or DS3231 could not be written.
+ */
+int ds3231_hybrid_set(ds3231_hybrid_t * hybrid, int64_t deadline_us, ds3231_hybrid_callback_t callback, void * ctx) {
+    if(hybrid->rtc->int_owner != DS3231_INT_HYBRID)
+        return -1;
+    ds3231_hybrid_cancel(hybrid);
+    if(!hybrid->clock->synced)
+        return -1;
+    hybrid->deadline_us = deadline_us;
+    hybrid->callback = callback;
+    hybrid->ctx = ctx;
+
+    uint64_t now_local = time_us_64();
+    int64_t remaining = deadline_us - ds3231_clock_corrected_at(hybrid->clock, now_local);
+    if(remaining < (int64_t)hybrid->handover_us + 2000000) {
+        ds3231_hybrid_start_timer(hybrid, now_local + (remaining > 0 ? remaining : 0));
+        return 0;
+    }
+
+    uint32_t wake_s = (uint32_t)((deadline_us - hybrid->handover_us) / 1000000);
+    hybrid->wake_us = (int64_t)wake_s * 1000000;
+    ds3231_data_t time;
+    ds3231_epoch_to_time(hybrid->rtc, wake_s, &time);
+    ds3231_alarm_1_t alarm = {
+        .seconds = time.seconds,
+        .minutes = time.minutes,
+        .hours = time.hours,
+        .am_pm = time.am_pm,
+        .day = time.day,
+        .date = time.date
+    };
+    hybrid->state = DS3231_HYBRID_RTC_WAIT;
+    /* The flag is cleared after the new alarm is written so that INT/SQW goes high again. */
+    if(ds3231_set_alarm_1(hybrid->rtc, &alarm, ON_MATCHING_SECOND_MINUTE_HOUR_AND_DATE)
+        || ds3231_hybrid_clear_flag(hybrid->rtc) || ds3231_enable_alarm_interrupt(hybrid->rtc, true))
+    {
+        hybrid->state = DS3231_HYBRID_IDLE;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief               Stop the engine: cancel a pending alarm, disable the alarm interrupt of the
+ * DS3231, free the hardware alarm and turn the GPIO interrupt off, so the DS3231 can be used by
+ * the pin arbiter or a schedule.
+ *
+ * @param[in] hybrid    Hybrid alarm struct.
+ * @return              0 if succesful, -1 if DS3231 could not be written. The engine stops either way.
+ */
+int ds3231_hybrid_deinit(ds3231_hybrid_t * hybrid) {
+    ds3231_hybrid_cancel(hybrid);
+    hardware_alarm_set_callback(hybrid->alarm_num, NULL);
+    hardware_alarm_unclaim(hybrid->alarm_num);
+    gpio_set_irq_enabled(hybrid->gpio, GPIO_IRQ_EDGE_FALL, false);
+    if(ds3231_hybrid_active == hybrid)
+        ds3231_hybrid_active = NULL;
+    hybrid->rtc->int_owner = DS3231_INT_FREE;
+    return ds3231_enable_alarm_interrupt(hybrid->rtc, false);
+}
+
+/**
+ * @brief               Cancel a pending alarm. DS3231 alarm 1 stays set, its edge is ignored.
+ *
+ * @param[in] hybrid    Hybrid alarm struct.
+ */
+void ds3231_hybrid_cancel(ds3231_hybrid_t * hybrid) {
+    hybrid->state = DS3231_HYBRID_IDLE;
+    hardware_alarm_cancel(hybrid->alarm_num);
+}
+
+/**
+ * @brief               Handle a DS3231 wake outside of the interrupt: correct the clock with the
+ * time of the edge and clear the alarm flag. An edge of an earlier month only clears the flag.
+ * Call it from the main loop.
+ *
+ * @param[in] hybrid    Hybrid alarm struct.
+ * @return              0 if succesful, -1 if DS3231 could not be written.
+ */
+int ds3231_hybrid_poll(ds3231_hybrid_t * hybrid) {
+    if(hybrid->early_edge) {
+        hybrid->early_edge = false;
+        hybrid->early_wakes++;
+        return ds3231_hybrid_clear_flag(hybrid->rtc);
+    }
+    uint64_t edge = hybrid->edge_local_us;
+    if(!edge)
+        return 0;
+    hybrid->edge_local_us = 0;
+    /* The interrupts read the clock. */
+    uint32_t ints = save_and_disable_interrupts();
+    ds3231_clock_correct(hybrid->clock, hybrid->wake_us, edge);
+    restore_interrupts(ints);
+    return ds3231_hybrid_clear_flag(hybrid->rtc);
+}
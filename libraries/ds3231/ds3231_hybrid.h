@@ -0,0 +1,66 @@
+/**
+ * @file    ds3231_hybrid.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Microsecond alarms that sleep on DS3231 alarm 1 and finish on an RP2040 timer alarm.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231.h"
+#include "ds3231_clock.h"
+
+#ifndef DS_3231_HYBRID
+#define DS_3231_HYBRID
+
+#define DS3231_HYBRID_DEFAULT_HANDOVER_MS   1000
+
+enum DS3231_HYBRID_STATES {
+    DS3231_HYBRID_IDLE = 0,
+    DS3231_HYBRID_RTC_WAIT,         // Waiting for the DS3231 alarm 1 edge on INT/SQW.
+    DS3231_HYBRID_TIMER_WAIT,       // Waiting for the RP2040 timer alarm.
+};
+
+/**
+ * @brief Function called from the timer interrupt when the alarm fires. error_us is the firing
+ * time on the corrected view of the clock minus the deadline.
+ *
+ */
+typedef void (*ds3231_hybrid_callback_t)(void * ctx, int32_t error_us);
+
+/**
+ * @brief Struct to hold the state of a hybrid alarm engine. Deadlines are reference times of
+ * the clock, microseconds since 2000-01-01 00:00:00.
+ *
+ */
+typedef struct ds3231_hybrid_t {
+    ds3231_t * rtc;
+    ds3231_clock_t * clock;         // Synced clock, maps reference times to the local timer.
+    uint gpio;                      // Connected to INT/SQW.
+    int alarm_num;                  // RP2040 hardware alarm.
+    uint32_t handover_us;           // Timer stage length after a DS3231 wake, at least this long.
+    volatile uint8_t state;
+    int64_t deadline_us;
+    int64_t wake_us;                // Reference time of the DS3231 alarm 1 edge.
+    uint64_t target_local_us;
+    volatile uint64_t edge_local_us;    // Local time of the last DS3231 edge, 0 once handled by poll.
+    volatile bool early_edge;       // Alarm 1 matched in an earlier month, not handled by poll yet.
+    ds3231_hybrid_callback_t callback;
+    void * ctx;
+    int32_t last_error_us;
+    int32_t max_error_us;           // Largest absolute firing error.
+    uint32_t fired;
+    uint32_t rtc_wakes;             // Alarms that slept on DS3231 before the timer stage.
+    uint32_t early_wakes;           // Alarm 1 edges a month or more before the wake time.
+} ds3231_hybrid_t;
+
+int ds3231_hybrid_init(ds3231_hybrid_t * hybrid, ds3231_t * rtc, ds3231_clock_t * clock, uint gpio, uint32_t handover_ms);
+int ds3231_hybrid_deinit(ds3231_hybrid_t * hybrid);
+int ds3231_hybrid_set(ds3231_hybrid_t * hybrid, int64_t deadline_us, ds3231_hybrid_callback_t callback, void * ctx);
+void ds3231_hybrid_cancel(ds3231_hybrid_t * hybrid);
+int ds3231_hybrid_poll(ds3231_hybrid_t * hybrid);
+void ds3231_hybrid_irq(uint gpio, uint32_t event_mask);
+
+#endif
@@ -0,0 +1,168 @@
+/**
+ * @file    ds3231_link.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Binary framing with CRC for data sent between the device and a host.
+ * Only depends on the C library so host tools parse frames with the same code.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_link.h"
+#include <string.h>
+
+/**
+ * @brief               Update a CRC-16/CCITT-FALSE, polynomial 0x1021. Start with 0xFFFF.
+ *
+ * @param[in] crc       CRC of the preceding data.
+ * @param[in] data      Data.
+ * @param[in] length    Length of the data in bytes.
+ * @return              Updated CRC.
+ */
+uint16_t ds3231_link_crc16(uint16_t crc, const uint8_t * data, size_t length) {
+    for(size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for(int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+    return crc;
+}
+
+/**
+ * @brief                   Send a frame. The payload is given in two parts so a small header can
+ * be sent in front of a buffer without copying it.
+ *
+ * @param[in] write         Function that sends bytes.
+ * @param[in] ctx           Passed to the write function.
+ * @param[in] type          Frame type, DS3231_LINK_TYPES.
+ * @param[in] seq           Sequence number.
+ * @param[in] header        First part of the payload, can be NULL if header_length is 0.
+ * @param[in] header_length Length of the first part in bytes.
+ * @param[in] payload       Second part of the payload, can be NULL if payload_length is 0.
+ * @param[in] payload_length Length of the second part in bytes.
+ * @return                  0 if succesful, -1 if the payload is too long or sending failed.
+ */
+int ds3231_link_send(ds3231_link_write_t write, void * ctx, uint8_t type, uint16_t seq,
+    const uint8_t * header, size_t header_length, const uint8_t * payload, size_t payload_length)
+{
+    size_t length = header_length + payload_length;
+    if(length > DS3231_LINK_PAYLOAD_MAX)
+        return -1;
+    uint8_t prefix[DS3231_LINK_HEADER_SIZE] = {DS3231_LINK_SYNC, type, seq & 0xFF, seq >> 8,
+        length & 0xFF, length >> 8};
+    uint16_t crc = ds3231_link_crc16(0xFFFF, &prefix[1], DS3231_LINK_HEADER_SIZE - 1);
+    crc = ds3231_link_crc16(crc, header, header_length);
+    crc = ds3231_link_crc16(crc, payload, payload_length);
+    uint8_t suffix[DS3231_LINK_CRC_SIZE] = {crc & 0xFF, crc >> 8};
+
+    if(write(ctx, prefix, sizeof(prefix)))
+        return -1;
+    if(header_length && write(ctx, header, header_length))
+        return -1;
+    if(payload_length && write(ctx, payload, payload_length))
+        return -1;
+    return write(ctx, suffix, sizeof(suffix)) ? -1 : 0;
+}
+
+/**
+ * @brief               Initialise a frame parser.
+ *
+ * @param[out] parser   Parser struct.
+ */
+void ds3231_link_parser_init(ds3231_link_parser_t * parser) {
+    parser->position = 0;
+    parser->crc_errors = 0;
+    parser->dropped = 0;
+}
+
+/* Skip the first held bytes and everything after them up to the next sync byte. */
+static void ds3231_link_skip(ds3231_link_parser_t * parser, uint16_t skip) {
+    while(skip < parser->position && parser->buffer[skip] != DS3231_LINK_SYNC)
+        skip++;
+    parser->dropped += skip;
+    parser->position -= skip;
+    memmove(parser->buffer, &parser->buffer[skip], parser->position);
+}
+
+/* Size of the frame starting at a sync byte, 0 if its header is not complete and -1 if the length is invalid. */
+static int ds3231_link_size(const uint8_t * buffer, uint16_t held) {
+    if(held < DS3231_LINK_HEADER_SIZE)
+        return 0;
+    uint16_t length = buffer[4] | (buffer[5] << 8);
+    if(length > DS3231_LINK_PAYLOAD_MAX)
+        return -1;
+    return DS3231_LINK_HEADER_SIZE + length + DS3231_LINK_CRC_SIZE;
+}
+
+static bool ds3231_link_valid(const uint8_t * buffer, uint16_t size) {
+    uint16_t crc = ds3231_link_crc16(0xFFFF, &buffer[1], size - DS3231_LINK_CRC_SIZE - 1);
+    return buffer[size - 2] == (crc & 0xFF) && buffer[size - 1] == (crc >> 8);
+}
+
+/* A later sync byte whose frame ends with the last held byte, 0 if there is none. */
+static uint16_t ds3231_link_inner(ds3231_link_parser_t * parser) {
+    for(uint16_t first = 1; first + DS3231_LINK_HEADER_SIZE + DS3231_LINK_CRC_SIZE <= parser->position; first++) {
+        if(parser->buffer[first] != DS3231_LINK_SYNC)
+            continue;
+        uint16_t held = parser->position - first;
+        if(ds3231_link_size(&parser->buffer[first], held) == held && ds3231_link_valid(&parser->buffer[first], held))
+            return first;
+    }
+    return 0;
+}
+
+/**
+ * @brief               Feed a received byte to the parser. Bytes outside frames are skipped.
+ * A sync byte that turns out not to start a frame, because of its length or CRC, does not take
+ * the bytes after it along: the parser looks for the next sync byte among them. A valid frame
+ * that ends while a longer candidate started by an earlier sync byte is still open wins over
+ * that candidate, so a stray sync byte does not delay the answer behind it. A payload that holds
+ * a whole frame is cut there, none of the frame types carries one.
+ *
+ * @param[in] parser    Parser struct.
+ * @param[in] byte      Received byte.
+ * @return              1 if a frame was completed and is in parser->frame, 0 otherwise.
+ */
+int ds3231_link_parse(ds3231_link_parser_t * parser, uint8_t byte) {
+    if(!parser->position && byte != DS3231_LINK_SYNC) {
+        parser->dropped++;
+        return 0;
+    }
+    parser->buffer[parser->position++] = byte;
+
+    int size;
+    while(1) {
+        size = ds3231_link_size(parser->buffer, parser->position);
+        if(size > 0 && size <= parser->position) {
+            if(ds3231_link_valid(parser->buffer, size))
+                break;
+            parser->crc_errors++;
+            size = -1;
+        }
+        if(size < 0) {
+            /* Also rescans the bytes held after the frame ended. */
+            ds3231_link_skip(parser, 1);
+            if(parser->position)
+                continue;
+            return 0;
+        }
+        uint16_t first = ds3231_link_inner(parser);
+        if(!first)
+            return 0;
+        parser->dropped += first;
+        parser->position -= first;
+        memmove(parser->buffer, &parser->buffer[first], parser->position);
+        size = parser->position;
+        break;
+    }
+
+    ds3231_link_frame_t * frame = &parser->frame;
+    frame->type = parser->buffer[1];
+    frame->seq = parser->buffer[2] | (parser->buffer[3] << 8);
+    frame->length = size - DS3231_LINK_HEADER_SIZE - DS3231_LINK_CRC_SIZE;
+    memcpy(frame->payload, &parser->buffer[DS3231_LINK_HEADER_SIZE], frame->length);
+    parser->position = 0;
+    return 1;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file    ds3231_link.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Binary framing with CRC for data sent between the device and a host.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef DS_3231_LINK
+#define DS_3231_LINK
+
+/* Frame: sync byte, type, sequence number, payload length, payload and CRC-16/CCITT-FALSE
+over everything after the sync byte. Multi-byte fields are little endian. */
+#define DS3231_LINK_SYNC                0xA5
+#define DS3231_LINK_HEADER_SIZE         6
+#define DS3231_LINK_CRC_SIZE            2
+
+#ifndef DS3231_LINK_PAYLOAD_MAX
+#define DS3231_LINK_PAYLOAD_MAX         260
+#endif
+
+enum DS3231_LINK_TYPES {
+    DS3231_LINK_EXPORT_START = 0x01,    // Payload: total size (4), chunk size (2).
+    DS3231_LINK_EXPORT_DATA = 0x02,     // Payload: offset (4), data.
+    DS3231_LINK_EXPORT_END = 0x03,      // Payload: total size (4), result (1), 0 if succesful.
+    DS3231_LINK_SYNC_REQUEST = 0x04,    // Host to device. Payload: session (4), generation of each page (2).
+    DS3231_LINK_SYNC_PAGES = 0x05,      // Payload: first page (2), page count (1), their generations (2), data.
+    DS3231_LINK_SYNC_END = 0x06,        // Payload: session (4), pages sent (2), result (1), 0 if succesful.
+    DS3231_LINK_METRICS_REQUEST = 0x07, // Host to device, no payload.
+    DS3231_LINK_METRICS = 0x08,         // Payload: flags (1), records, see ds3231_metrics.h.
+    DS3231_LINK_TIME_REQUEST = 0x09,    // Host to device, no payload.
+    DS3231_LINK_TIME = 0x0A,            // Payload: seconds since 2000 (4), status register (1), result (1).
+    DS3231_LINK_TIME_SET = 0x0B,        // Host to device. Payload: seconds since 2000 (4), sent at the start of that second.
+    DS3231_LINK_CONFIG_WRITE = 0x0C,    // Host to device. Payload: offset in the configuration partition (2), data.
+    DS3231_LINK_ACK = 0x0D,             // Payload: type of the answered frame (1), result (1), 0 if succesful.
+};
+
+/**
+ * @brief Function that sends bytes to the host, e.g. over USB CDC.
+ *
+ */
+typedef int (*ds3231_link_write_t)(void * ctx, const uint8_t * data, size_t length);
+
+/**
+ * @brief Struct to hold a received frame.
+ *
+ */
+typedef struct ds3231_link_frame_t {
+    uint8_t type;
+    uint16_t seq;
+    uint16_t length;
+    uint8_t payload[DS3231_LINK_PAYLOAD_MAX];
+} ds3231_link_frame_t;
+
+/**
+ * @brief Struct to hold the state of a frame parser.
+ *
+ */
+typedef struct ds3231_link_parser_t {
+    ds3231_link_frame_t frame;
+    uint8_t buffer[DS3231_LINK_HEADER_SIZE + DS3231_LINK_PAYLOAD_MAX + DS3231_LINK_CRC_SIZE];
+    uint16_t position;          // Bytes held in buffer from a sync byte on, 0 while looking for one.
+    uint32_t crc_errors;
+    uint32_t dropped;           // Bytes skipped while looking for a frame.
+} ds3231_link_parser_t;
+
+uint16_t ds3231_link_crc16(uint16_t crc, const uint8_t * data, size_t length);
+
+int ds3231_link_send(ds3231_link_write_t write, void * ctx, uint8_t type, uint16_t seq,
+    const uint8_t * header, size_t header_length, const uint8_t * payload, size_t payload_length);
+
+void ds3231_link_parser_init(ds3231_link_parser_t * parser);
+int ds3231_link_parse(ds3231_link_parser_t * parser, uint8_t byte);
+
+#endif
@@ -0,0 +1,346 @@
+/**
+ * @file    ds3231_log.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Append-only record log on a storage device with snapshot cursors.
+ * The log is a circular range of storage pages, usually in the AT24C32 EEPROM. Every page starts
+ * with a lap byte, the number of times the log has wrapped, so the head can be found at boot with
+ * a binary search over the lap bytes instead of a scan. Records are stored as a length byte
+ * followed by up to page size - 2 bytes and never cross a page. Unused bytes are DS3231_LOG_END.
+ *
+ * Cursors see the log as it was when they were created. Records are decoded in place from a
+ * small page cache shared by the appender and all cursors of the log, so pages one cursor
+ * loaded are not read again by another cursor, and pages the appender wrote are not read at all.
+ * Appending while cursors walk the log is allowed. A cursor whose unread records were overwritten
+ * after the log wrapped returns DS3231_LOG_OVERRUN.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_log.h"
+#include <string.h>
+
+static uint32_t ds3231_log_phys(ds3231_log_t * log, uint32_t page) {
+    return log->first_page + (page % log->page_count);
+}
+
+static uint8_t ds3231_log_lap(ds3231_log_t * log, uint32_t page) {
+    return (page / log->page_count) & 0x7F;
+}
+
+static int ds3231_log_read_lap(ds3231_log_t * log, uint32_t index, uint8_t * lap) {
+    return ds3231_storage_read(log->storage, log->first_page + index, 0, 1, lap);
+}
+
+static ds3231_log_page_t * ds3231_log_cached(ds3231_log_t * log, uint32_t page) {
+    for(int i = 0; i < DS3231_LOG_CACHE_PAGES; i++) {
+        ds3231_log_page_t * entry = &log->cache[i];
+        if(entry->valid && entry->page == page) {
+            entry->used = ++log->use_counter;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static ds3231_log_page_t * ds3231_log_evict(ds3231_log_t * log, uint32_t page) {
+    ds3231_log_page_t * victim = &log->cache[0];
+    for(int i = 0; i < DS3231_LOG_CACHE_PAGES; i++) {
+        ds3231_log_page_t * entry = &log->cache[i];
+        if(!entry->valid || entry->page == page) {
+            victim = entry;
+            break;
+        }
+        if(entry->used < victim->used)
+            victim = entry;
+    }
+    victim->valid = false;
+    victim->page = page;
+    victim->used = ++log->use_counter;
+    return victim;
+}
+
+/* Get a log page from the cache, reading it from the EEPROM on a miss. */
+static const uint8_t * ds3231_log_load(ds3231_log_t * log, uint32_t page) {
+    ds3231_log_page_t * entry = ds3231_log_cached(log, page);
+    if(entry)
+        return entry->data;
+    entry = ds3231_log_evict(log, page);
+    if(ds3231_storage_read(log->storage, ds3231_log_phys(log, page), 0, log->page_size, entry->data))
+        return NULL;
+    if(entry->data[0] != ds3231_log_lap(log, page))
+        return NULL;
+    entry->valid = true;
+    return entry->data;
+}
+
+/* Offset of the first free byte of a page. */
+static uint8_t ds3231_log_scan(const uint8_t * data, uint8_t limit) {
+    uint8_t offset = 1;
+    while(offset < limit) {
+        uint8_t length = data[offset];
+        if(length == DS3231_LOG_END || !length || (offset + 1 + length) > limit)
+            break;
+        offset += 1 + length;
+    }
+    return offset;
+}
+
+static int ds3231_log_setup(ds3231_log_t * log, ds3231_storage_t * storage, uint32_t first_page, uint32_t page_count) {
+    if(page_count < 2 || (first_page + page_count) > storage->page_count)
+        return -1;
+    if(storage->page_size < 3 || storage->page_size > DS3231_LOG_PAGE_SIZE_MAX)
+        return -1;
+    log->storage = storage;
+    log->first_page = first_page;
+    log->page_count = page_count;
+    log->page_size = storage->page_size;
+    log->pages_written = 0;
+    log->tail_page = 0;
+    log->head_offset = log->page_size;
+    log->use_counter = 0;
+    for(int i = 0; i < DS3231_LOG_CACHE_PAGES; i++)
+        log->cache[i].valid = false;
+    return 0;
+}
+
+/**
+ * @brief                   Mount a log over a range of storage pages. The head is found with a binary
+ * search over the lap bytes, which takes about log2(page_count) single byte reads plus one page read.
+ * A range that was never written must be formatted once with ds3231_log_format.
+ *
+ * @param[out] log          Log struct.
+ * @param[in] storage       Storage device, with a page size of at most DS3231_LOG_PAGE_SIZE_MAX.
+ * @param[in] first_page    First storage page of the log.
+ * @param[in] page_count    Number of storage pages of the log, at least 2.
+ * @return                  0 if succesful, -1 if storage failure or invalid range.
+ */
+int ds3231_log_init(ds3231_log_t * log, ds3231_storage_t * storage, uint32_t first_page, uint32_t page_count) {
+    if(ds3231_log_setup(log, storage, first_page, page_count))
+        return -1;
+
+    uint8_t first_lap;
+    if(ds3231_log_read_lap(log, 0, &first_lap))
+        return -1;
+    if(first_lap & 0x80)
+        return 0;
+
+    /* Pages of the current lap come first, followed by the previous lap or unused pages. */
+    uint32_t lo = 1;
+    uint32_t hi = page_count;
+    while(lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint8_t lap;
+        if(ds3231_log_read_lap(log, mid, &lap))
+            return -1;
+        if(lap == first_lap)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    uint32_t laps = first_lap;
+    bool wrapped = false;
+    if(lo < page_count) {
+        uint8_t lap;
+        if(ds3231_log_read_lap(log, lo, &lap))
+            return -1;
+        wrapped = !(lap & 0x80);
+    } else {
+        wrapped = true;
+    }
+    /* Lap bytes are 7 bits, lap 0 after a wrapped lap 127 is lap 128. */
+    if(wrapped && !laps && lo < page_count)
+        laps = 0x80;
+    log->pages_written = laps * page_count + lo;
+    if(wrapped)
+        log->tail_page = log->pages_written - page_count;
+    else
+        log->tail_page = log->pages_written - lo;
+
+    const uint8_t * head = ds3231_log_load(log, log->pages_written - 1);
+    if(!head)
+        return -1;
+    log->head_offset = ds3231_log_scan(head, log->page_size);
+    return 0;
+}
+
+/**
+ * @brief                   Mount a log at a known head, e.g. one kept in a superblock. The head is
+ * checked with two single byte reads, a head that is no longer valid falls back to ds3231_log_init.
+ *
+ * @param[out] log          Log struct.
+ * @param[in] storage       Storage device, with a page size of at most DS3231_LOG_PAGE_SIZE_MAX.
+ * @param[in] first_page    First storage page of the log.
+ * @param[in] page_count    Number of storage pages of the log, at least 2.
+ * @param[in] head          Value of ds3231_log_head when it was saved.
+ * @return                  0 if succesful, -1 if storage failure or invalid range.
+ */
+int ds3231_log_init_at(ds3231_log_t * log, ds3231_storage_t * storage, uint32_t first_page, uint32_t page_count,
+    uint32_t head)
+{
+    if(ds3231_log_setup(log, storage, first_page, page_count))
+        return -1;
+    if(!head)
+        return ds3231_log_init(log, storage, first_page, page_count);
+
+    /* The head page must hold its lap and the page after it must not hold the lap it would get next. */
+    uint8_t lap;
+    uint8_t next_lap;
+    if(ds3231_log_read_lap(log, (head - 1) % page_count, &lap))
+        return -1;
+    if(ds3231_log_read_lap(log, head % page_count, &next_lap))
+        return -1;
+    if(lap != ds3231_log_lap(log, head - 1) || next_lap == ds3231_log_lap(log, head))
+        return ds3231_log_init(log, storage, first_page, page_count);
+
+    log->pages_written = head;
+    log->tail_page = (head > page_count) ? head - page_count : 0;
+    const uint8_t * data = ds3231_log_load(log, head - 1);
+    if(!data)
+        return -1;
+    log->head_offset = ds3231_log_scan(data, log->page_size);
+    return 0;
+}
+
+/**
+ * @brief               Get the head of a log in a form that can be stored and passed to
+ * ds3231_log_init_at. It stays below 129 * page_count, 16 bits for logs of up to 508 pages.
+ *
+ * @param[in] log       Log struct.
+ * @return              Head of the log, 0 if nothing was written.
+ */
+uint32_t ds3231_log_head(ds3231_log_t * log) {
+    uint32_t period = 0x80 * log->page_count;
+    uint32_t head = log->pages_written % period;
+    /* Keep a wrapped log wrapped, as ds3231_log_init counts lap 0 after lap 127 as lap 128. */
+    if(log->pages_written >= log->page_count && head < log->page_count)
+        head += period;
+    return head;
+}
+
+/**
+ * @brief               Erase the log by marking every page of its range as unused.
+ * Takes one write cycle per page.
+ *
+ * @param[in] log       Log struct, initiliazed with ds3231_log_init.
+ * @return              0 if succesful, -1 if storage failure.
+ */
+int ds3231_log_format(ds3231_log_t * log) {
+    uint8_t unused = DS3231_LOG_END;
+    for(uint32_t i = 0; i < log->page_count; i++) {
+        if(ds3231_storage_program(log->storage, log->first_page + i, 0, 1, &unused))
+            return -1;
+    }
+    log->pages_written = 0;
+    log->tail_page = 0;
+    log->head_offset = log->page_size;
+    for(int i = 0; i < DS3231_LOG_CACHE_PAGES; i++)
+        log->cache[i].valid = false;
+    return 0;
+}
+
+/**
+ * @brief               Append a record to the log. Each append is a single page write. A record that
+ * does not fit into the head page opens a new page, overwriting the oldest page once the log is full.
+ *
+ * @param[in] log       Log struct.
+ * @param[in] record    Record data.
+ * @param[in] length    Length of the record, 1 to page size - 2 bytes.
+ * @return              0 if succesful, -1 if storage failure or invalid length.
+ */
+int ds3231_log_append(ds3231_log_t * log, const uint8_t * record, uint8_t length) {
+    if(!length || length > (log->page_size - 2))
+        return -1;
+
+    if(log->pages_written && (log->head_offset + 1 + length) <= log->page_size) {
+        uint32_t page = log->pages_written - 1;
+        uint8_t buffer[DS3231_LOG_MAX_RECORD + 1];
+        buffer[0] = length;
+        memcpy(&buffer[1], record, length);
+        if(ds3231_storage_program(log->storage, ds3231_log_phys(log, page), log->head_offset, length + 1, buffer))
+            return -1;
+        ds3231_log_page_t * entry = ds3231_log_cached(log, page);
+        if(entry)
+            memcpy(&entry->data[log->head_offset], buffer, length + 1);
+        log->head_offset += length + 1;
+        return 0;
+    }
+
+    /* The whole page is written so that records of the previous lap are cleared. */
+    uint32_t page = log->pages_written;
+    ds3231_log_page_t * entry = ds3231_log_evict(log, page);
+    memset(entry->data, DS3231_LOG_END, log->page_size);
+    entry->data[0] = ds3231_log_lap(log, page);
+    entry->data[1] = length;
+    memcpy(&entry->data[2], record, length);
+    if(ds3231_storage_program(log->storage, ds3231_log_phys(log, page), 0, log->page_size, entry->data))
+        return -1;
+    entry->valid = true;
+    log->pages_written++;
+    if((log->pages_written - log->tail_page) > log->page_count)
+        log->tail_page = log->pages_written - log->page_count;
+    log->head_offset = length + 2;
+    return 0;
+}
+
+/**
+ * @brief               Create a cursor at the oldest record of the log. The cursor sees the records
+ * that were appended before this call only.
+ *
+ * @param[out] cursor   Cursor struct.
+ * @param[in] log       Log struct.
+ * @return              0 if succesful.
+ */
+int ds3231_log_cursor_init(ds3231_log_cursor_t * cursor, ds3231_log_t * log) {
+    cursor->log = log;
+    cursor->page = log->tail_page;
+    cursor->offset = 1;
+    if(log->pages_written) {
+        cursor->end_page = log->pages_written - 1;
+        cursor->end_offset = log->head_offset;
+    } else {
+        cursor->end_page = 0;
+        cursor->end_offset = 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief               Get the next record of the cursor's snapshot. The record is not copied,
+ * it points into the page cache of the log and stays valid until the next call to any cursor
+ * or append on the same log.
+ *
+ * @param[in] cursor    Cursor struct.
+ * @param[out] record   Pointer to the record data.
+ * @param[out] length   Length of the record.
+ * @return              1 if a record is returned, 0 at the end of the snapshot, -1 if storage failure
+ *                      or a corrupt page, DS3231_LOG_OVERRUN if unread records were overwritten.
+ */
+int ds3231_log_cursor_next(ds3231_log_cursor_t * cursor, const uint8_t ** record, uint8_t * length) {
+    ds3231_log_t * log = cursor->log;
+    while(cursor->page < cursor->end_page
+        || (cursor->page == cursor->end_page && cursor->offset < cursor->end_offset))
+    {
+        if(cursor->page < log->tail_page)
+            return DS3231_LOG_OVERRUN;
+        const uint8_t * data = ds3231_log_load(log, cursor->page);
+        if(!data)
+            return -1;
+
+        uint8_t limit = (cursor->page == cursor->end_page) ? cursor->end_offset : log->page_size;
+        uint8_t size = (cursor->offset < limit) ? data[cursor->offset] : DS3231_LOG_END;
+        if(size == DS3231_LOG_END || !size || (cursor->offset + 1 + size) > limit) {
+            cursor->page++;
+            cursor->offset = 1;
+            continue;
+        }
+        *record = &data[cursor->offset + 1];
+        *length = size;
+        cursor->offset += 1 + size;
+        return 1;
+    }
+    return 0;
+}
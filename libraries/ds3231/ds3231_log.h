@@ -0,0 +1,85 @@
+/**
+ * @file    ds3231_log.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Append-only record log on a storage device with snapshot cursors.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_storage.h"
+
+#ifndef DS_3231_LOG
+#define DS_3231_LOG
+
+/* Number of pages kept in RAM and shared by the appender and all cursors of a log. */
+#define DS3231_LOG_CACHE_PAGES          4
+
+/* Largest storage page size the log supports, the size of a cache entry. */
+#ifndef DS3231_LOG_PAGE_SIZE_MAX
+#define DS3231_LOG_PAGE_SIZE_MAX        32
+#endif
+
+/* Every page starts with a lap byte, every record with a length byte.
+Records are limited to the page size of the storage device minus 2. */
+#define DS3231_LOG_MAX_RECORD           (DS3231_LOG_PAGE_SIZE_MAX - 2)
+
+/* Length byte of an unused page area. */
+#define DS3231_LOG_END                  0xFF
+
+/* Returned by cursors whose unread records were overwritten by the appender. */
+#define DS3231_LOG_OVERRUN              -2
+
+/**
+ * @brief Struct to hold a page cached in RAM.
+ *
+ */
+typedef struct ds3231_log_page_t {
+    uint32_t page;      // Log page number, counting up from the first page ever written.
+    uint32_t used;      // Last use, for eviction.
+    bool valid;
+    uint8_t data[DS3231_LOG_PAGE_SIZE_MAX];
+} ds3231_log_page_t;
+
+/**
+ * @brief Struct to hold the state of a log over a range of storage pages.
+ *
+ */
+typedef struct ds3231_log_t {
+    ds3231_storage_t * storage;
+    uint32_t first_page;        // First storage page of the log.
+    uint32_t page_count;        // Number of storage pages of the log.
+    uint8_t page_size;
+    uint32_t pages_written;     // Log pages opened so far, the head page is pages_written - 1.
+    uint32_t tail_page;         // Oldest log page that was not overwritten.
+    uint8_t head_offset;        // Next free byte in the head page.
+    uint32_t use_counter;
+    ds3231_log_page_t cache[DS3231_LOG_CACHE_PAGES];
+} ds3231_log_t;
+
+/**
+ * @brief Struct to hold a cursor that walks the log as it was when the cursor was created.
+ *
+ */
+typedef struct ds3231_log_cursor_t {
+    ds3231_log_t * log;
+    uint32_t page;
+    uint8_t offset;
+    uint32_t end_page;          // Head page at creation.
+    uint8_t end_offset;         // Head offset at creation.
+} ds3231_log_cursor_t;
+
+int ds3231_log_init(ds3231_log_t * log, ds3231_storage_t * storage, uint32_t first_page, uint32_t page_count);
+int ds3231_log_init_at(ds3231_log_t * log, ds3231_storage_t * storage, uint32_t first_page, uint32_t page_count,
+    uint32_t head);
+uint32_t ds3231_log_head(ds3231_log_t * log);
+int ds3231_log_format(ds3231_log_t * log);
+
+int ds3231_log_append(ds3231_log_t * log, const uint8_t * record, uint8_t length);
+
+int ds3231_log_cursor_init(ds3231_log_cursor_t * cursor, ds3231_log_t * log);
+int ds3231_log_cursor_next(ds3231_log_cursor_t * cursor, const uint8_t ** record, uint8_t * length);
+
+#endif
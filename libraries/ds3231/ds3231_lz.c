@@ -0,0 +1,384 @@
+/**
+ * @file    ds3231_lz.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Streaming small-window LZ compression for logs stored in the EEPROM.
+ * The format is LZSS with a 224 byte window. Data is coded in groups of a flag byte and 8 tokens,
+ * bit n of the flag byte set means token n is a match of 2 bytes, distance - 1 and length - 3,
+ * otherwise it is a literal byte. Encoder and decoder each need a little under 300 bytes of RAM
+ * and no heap, so the same code runs on the Pico and on the host.
+ *
+ * ds3231_lz_log_t puts the encoder between the writer and ds3231_log_append. Compressed bytes are
+ * collected in RAM until a record fills the rest of the head page, so every byte of a page is
+ * still written once, also when ds3231_lz_log_sync writes a partial record.
+ * Each record starts with a header byte. Groups may continue into the next record, a record
+ * with DS3231_LZ_RECORD_RESET starts with an empty window so readers can start there after the
+ * older pages were overwritten.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_lz.h"
+#include <string.h>
+
+static int ds3231_lz_emit_group(ds3231_lz_encoder_t * encoder) {
+    if(!encoder->group_tokens)
+        return 0;
+    int result = encoder->sink(encoder->ctx, encoder->group, encoder->group_length);
+    encoder->bytes_out += encoder->group_length;
+    encoder->group[0] = 0;
+    encoder->group_length = 1;
+    encoder->group_tokens = 0;
+    return result;
+}
+
+/* Encode the token at the start of the lookahead. */
+static int ds3231_lz_encode_token(ds3231_lz_encoder_t * encoder) {
+    const uint8_t * ring = encoder->ring;
+    uint8_t head = encoder->head;
+    uint8_t max = encoder->lookahead;
+    uint8_t best_length = 0;
+    uint8_t best_distance = 0;
+
+    /* Matches may run into the lookahead, which codes repeated bytes. */
+    for(uint16_t distance = 1; distance <= encoder->history; distance++) {
+        uint8_t start = (uint8_t)(head - distance);
+        if(ring[start] != ring[head])
+            continue;
+        uint8_t length = 1;
+        while(length < max && ring[(uint8_t)(start + length)] == ring[(uint8_t)(head + length)])
+            length++;
+        if(length > best_length) {
+            best_length = length;
+            best_distance = distance;
+            if(length == max)
+                break;
+        }
+    }
+
+    uint8_t advance;
+    if(best_length >= DS3231_LZ_MIN_MATCH) {
+        encoder->group[0] |= 1 << encoder->group_tokens;
+        encoder->group[encoder->group_length++] = best_distance - 1;
+        encoder->group[encoder->group_length++] = best_length - DS3231_LZ_MIN_MATCH;
+        advance = best_length;
+    } else {
+        encoder->group[encoder->group_length++] = ring[head];
+        advance = 1;
+    }
+    encoder->head += advance;
+    encoder->lookahead -= advance;
+    encoder->history = (encoder->history + advance > DS3231_LZ_WINDOW) ? DS3231_LZ_WINDOW : encoder->history + advance;
+
+    if(++encoder->group_tokens == 8)
+        return ds3231_lz_emit_group(encoder);
+    return 0;
+}
+
+/**
+ * @brief               Initialise an encoder.
+ *
+ * @param[out] encoder  Encoder struct.
+ * @param[in] sink      Function called with every complete group of encoded data.
+ * @param[in] ctx       Passed to the sink.
+ * @return              0 if succesful, -1 if the sink is NULL.
+ */
+int ds3231_lz_encoder_init(ds3231_lz_encoder_t * encoder, ds3231_lz_sink_t sink, void * ctx) {
+    if(!sink)
+        return -1;
+    encoder->sink = sink;
+    encoder->ctx = ctx;
+    encoder->bytes_in = 0;
+    encoder->bytes_out = 0;
+    ds3231_lz_encoder_reset(encoder);
+    return 0;
+}
+
+/**
+ * @brief               Start with an empty window. Data that was not flushed is dropped.
+ *
+ * @param[in] encoder   Encoder struct.
+ */
+void ds3231_lz_encoder_reset(ds3231_lz_encoder_t * encoder) {
+    encoder->head = 0;
+    encoder->lookahead = 0;
+    encoder->history = 0;
+    encoder->group[0] = 0;
+    encoder->group_length = 1;
+    encoder->group_tokens = 0;
+}
+
+/**
+ * @brief               Compress data. Up to DS3231_LZ_MAX_MATCH bytes are held back as lookahead
+ * until more data arrives or the encoder is flushed.
+ *
+ * @param[in] encoder   Encoder struct.
+ * @param[in] data      Data to be compressed.
+ * @param[in] length    Length of the data in bytes.
+ * @return              0 if succesful, -1 if the sink failed.
+ */
+int ds3231_lz_encode(ds3231_lz_encoder_t * encoder, const uint8_t * data, size_t length) {
+    int result = 0;
+    for(size_t i = 0; i < length; i++) {
+        encoder->ring[(uint8_t)(encoder->head + encoder->lookahead)] = data[i];
+        encoder->lookahead++;
+        encoder->bytes_in++;
+        if(encoder->lookahead == DS3231_LZ_MAX_MATCH && ds3231_lz_encode_token(encoder))
+            result = -1;
+    }
+    return result;
+}
+
+/**
+ * @brief               Encode the lookahead and pass the last, possibly partial, group to the sink.
+ * This ends a chunk, the decoder must be told with ds3231_lz_decoder_end_chunk after decoding it.
+ * The window is kept.
+ *
+ * @param[in] encoder   Encoder struct.
+ * @return              0 if succesful, -1 if the sink failed.
+ */
+int ds3231_lz_flush(ds3231_lz_encoder_t * encoder) {
+    int result = 0;
+    while(encoder->lookahead) {
+        if(ds3231_lz_encode_token(encoder))
+            result = -1;
+    }
+    if(ds3231_lz_emit_group(encoder))
+        result = -1;
+    return result;
+}
+
+/**
+ * @brief               Initialise a decoder.
+ *
+ * @param[out] decoder  Decoder struct.
+ * @param[in] sink      Function called with the decompressed data.
+ * @param[in] ctx       Passed to the sink.
+ * @return              0 if succesful, -1 if the sink is NULL.
+ */
+int ds3231_lz_decoder_init(ds3231_lz_decoder_t * decoder, ds3231_lz_sink_t sink, void * ctx) {
+    if(!sink)
+        return -1;
+    decoder->sink = sink;
+    decoder->ctx = ctx;
+    ds3231_lz_decoder_reset(decoder);
+    return 0;
+}
+
+/**
+ * @brief               Start with an empty window, matching ds3231_lz_encoder_reset.
+ *
+ * @param[in] decoder   Decoder struct.
+ */
+void ds3231_lz_decoder_reset(ds3231_lz_decoder_t * decoder) {
+    decoder->head = 0;
+    ds3231_lz_decoder_end_chunk(decoder);
+}
+
+/**
+ * @brief               Drop the rest of the current group, matching ds3231_lz_flush.
+ *
+ * @param[in] decoder   Decoder struct.
+ */
+void ds3231_lz_decoder_end_chunk(ds3231_lz_decoder_t * decoder) {
+    decoder->flags = 0;
+    decoder->tokens = 0;
+    decoder->distance = 0;
+}
+
+/**
+ * @brief               Decompress data. Input can be split anywhere, output is passed to the sink
+ * in pieces of up to DS3231_LZ_MAX_MATCH bytes.
+ *
+ * @param[in] decoder   Decoder struct.
+ * @param[in] data      Compressed data.
+ * @param[in] length    Length of the data in bytes.
+ * @return              0 if succesful, -1 if the sink failed.
+ */
+int ds3231_lz_decode(ds3231_lz_decoder_t * decoder, const uint8_t * data, size_t length) {
+    int result = 0;
+    for(size_t i = 0; i < length; i++) {
+        uint8_t byte = data[i];
+        if(!decoder->tokens) {
+            decoder->flags = byte;
+            decoder->tokens = 8;
+            continue;
+        }
+        if(!(decoder->flags & 1)) {
+            decoder->ring[decoder->head++] = byte;
+            if(decoder->sink(decoder->ctx, &byte, 1))
+                result = -1;
+        } else if(!decoder->distance) {
+            decoder->distance = byte + 1;
+            continue;
+        } else {
+            uint8_t match[DS3231_LZ_MAX_MATCH];
+            uint8_t match_length = byte + DS3231_LZ_MIN_MATCH;
+            if(match_length > DS3231_LZ_MAX_MATCH)
+                match_length = DS3231_LZ_MAX_MATCH;
+            uint8_t start = (uint8_t)(decoder->head - decoder->distance);
+            for(uint8_t j = 0; j < match_length; j++) {
+                match[j] = decoder->ring[(uint8_t)(start + j)];
+                decoder->ring[decoder->head++] = match[j];
+            }
+            decoder->distance = 0;
+            if(decoder->sink(decoder->ctx, match, match_length))
+                result = -1;
+        }
+        decoder->flags >>= 1;
+        decoder->tokens--;
+    }
+    return result;
+}
+
+static int ds3231_lz_log_commit(ds3231_lz_log_t * lz_log) {
+    if(lz_log->record_length <= 1)
+        return 0;
+    int result = ds3231_log_append(lz_log->log, lz_log->record, lz_log->record_length);
+    lz_log->records++;
+    lz_log->record[0] = 0;
+    lz_log->record_length = 1;
+    return result;
+}
+
+/* After a sync the head page is partly used, the next record fills the rest of it. Appending
+there programs only the new bytes, so syncs do not cost a page each. */
+static uint8_t ds3231_lz_log_capacity(ds3231_lz_log_t * lz_log) {
+    ds3231_log_t * log = lz_log->log;
+    if(log->pages_written && log->head_offset + 3 <= log->page_size)
+        return log->page_size - log->head_offset - 1;
+    return log->page_size - 2;
+}
+
+static int ds3231_lz_log_sink(void * ctx, const uint8_t * data, size_t length) {
+    ds3231_lz_log_t * lz_log = ctx;
+    int result = 0;
+    while(length) {
+        uint8_t capacity = ds3231_lz_log_capacity(lz_log);
+        /* A full record is kept until more data arrives, so a sync can still mark it as the end. */
+        if(lz_log->record_length == capacity && ds3231_lz_log_commit(lz_log))
+            result = -1;
+        size_t chunk = capacity - lz_log->record_length;
+        if(chunk > length)
+            chunk = length;
+        memcpy(&lz_log->record[lz_log->record_length], data, chunk);
+        lz_log->record_length += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    return result;
+}
+
+/**
+ * @brief                       Initialise a compressing writer on a log.
+ *
+ * @param[out] lz_log           Compressing writer struct.
+ * @param[in] log               Log struct, initialised with ds3231_log_init.
+ * @param[in] restart_records   Records between window resets. Readers can only start at a reset,
+ *                              so this bounds the data lost when the oldest pages are overwritten.
+ *                              0 resets only at the first record.
+ * @return                      0 if succesful, -1 if the log pages are too small.
+ */
+int ds3231_lz_log_init(ds3231_lz_log_t * lz_log, ds3231_log_t * log, uint16_t restart_records) {
+    if(log->page_size < 4)
+        return -1;
+    lz_log->log = log;
+    lz_log->restart_records = restart_records;
+    lz_log->records = 0;
+    lz_log->record[0] = DS3231_LZ_RECORD_RESET;
+    lz_log->record_length = 1;
+    return ds3231_lz_encoder_init(&lz_log->encoder, &ds3231_lz_log_sink, lz_log);
+}
+
+/**
+ * @brief               Compress data into the log. Nothing reaches the storage until a page
+ * record is full, use ds3231_lz_log_sync to write the pending data earlier.
+ *
+ * @param[in] lz_log    Compressing writer struct.
+ * @param[in] data      Data to be written.
+ * @param[in] length    Length of the data in bytes.
+ * @return              0 if succesful, -1 if appending to the log failed.
+ */
+int ds3231_lz_log_write(ds3231_lz_log_t * lz_log, const uint8_t * data, size_t length) {
+    if(lz_log->restart_records && lz_log->records >= lz_log->restart_records && ds3231_lz_log_sync(lz_log))
+        return -1;
+    return ds3231_lz_encode(&lz_log->encoder, data, length);
+}
+
+/**
+ * @brief               Write all pending data as a record that ends a chunk. The next record
+ * resets the window if restart_records records were written since the last reset.
+ *
+ * @param[in] lz_log    Compressing writer struct.
+ * @return              0 if succesful, -1 if appending to the log failed.
+ */
+int ds3231_lz_log_sync(ds3231_lz_log_t * lz_log) {
+    int result = ds3231_lz_flush(&lz_log->encoder);
+    if(lz_log->record_length > 1) {
+        lz_log->record[0] |= DS3231_LZ_RECORD_END;
+        if(ds3231_lz_log_commit(lz_log))
+            result = -1;
+    }
+    if(lz_log->restart_records && lz_log->records >= lz_log->restart_records) {
+        ds3231_lz_encoder_reset(&lz_log->encoder);
+        lz_log->record[0] = DS3231_LZ_RECORD_RESET;
+        lz_log->records = 0;
+    }
+    return result;
+}
+
+/**
+ * @brief               Initialise a decompressing reader at the oldest record of a log.
+ * Like a log cursor, the reader sees the records appended before this call only.
+ *
+ * @param[out] reader   Reader struct.
+ * @param[in] log       Log struct.
+ * @param[in] sink      Function called with the decompressed data.
+ * @param[in] ctx       Passed to the sink.
+ * @return              0 if succesful, -1 if the sink is NULL.
+ */
+int ds3231_lz_log_reader_init(ds3231_lz_log_reader_t * reader, ds3231_log_t * log,
+    ds3231_lz_sink_t sink, void * ctx)
+{
+    reader->synced = false;
+    if(ds3231_log_cursor_init(&reader->cursor, log))
+        return -1;
+    return ds3231_lz_decoder_init(&reader->decoder, sink, ctx);
+}
+
+/**
+ * @brief               Decompress the next record of the log into the sink. Records before the
+ * first window reset are skipped, as are records between an overrun and the next reset.
+ *
+ * @param[in] reader    Reader struct.
+ * @return              1 if a record was read, 0 at the end of the snapshot, -1 if the log or sink failed.
+ */
+int ds3231_lz_log_read(ds3231_lz_log_reader_t * reader) {
+    const uint8_t * record;
+    uint8_t length;
+    while(1) {
+        int result = ds3231_log_cursor_next(&reader->cursor, &record, &length);
+        if(result == DS3231_LOG_OVERRUN) {
+            /* Continue from the oldest page that is left. */
+            reader->cursor.page = reader->cursor.log->tail_page;
+            reader->cursor.offset = 1;
+            reader->synced = false;
+            continue;
+        }
+        if(result <= 0)
+            return result;
+
+        if(record[0] & DS3231_LZ_RECORD_RESET) {
+            ds3231_lz_decoder_reset(&reader->decoder);
+            reader->synced = true;
+        }
+        if(!reader->synced)
+            continue;
+        result = ds3231_lz_decode(&reader->decoder, &record[1], length - 1);
+        if(record[0] & DS3231_LZ_RECORD_END)
+            ds3231_lz_decoder_end_chunk(&reader->decoder);
+        return result ? -1 : 1;
+    }
+}
@@ -0,0 +1,111 @@
+/**
+ * @file    ds3231_lz.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Streaming small-window LZ compression for logs stored in the EEPROM.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_log.h"
+
+#ifndef DS_3231_LZ
+#define DS_3231_LZ
+
+/* Encoder and decoder share a 256 byte ring. The encoder keeps up to DS3231_LZ_MAX_MATCH bytes of
+lookahead in it, the rest is the window matches are searched in. */
+#define DS3231_LZ_RING_SIZE             256
+#define DS3231_LZ_MIN_MATCH             3
+#define DS3231_LZ_MAX_MATCH             32
+#define DS3231_LZ_WINDOW                (DS3231_LZ_RING_SIZE - DS3231_LZ_MAX_MATCH)
+
+/* A group is a flag byte followed by 8 tokens, a literal byte or a 2 byte match. */
+#define DS3231_LZ_GROUP_SIZE            (1 + 8 * 2)
+
+/* Header bits of a compressed log record. */
+#define DS3231_LZ_RECORD_RESET          0x01    // Window starts empty at this record.
+#define DS3231_LZ_RECORD_END            0x02    // A chunk ends with this record, see ds3231_lz_flush.
+
+/**
+ * @brief Function that receives encoded or decoded data.
+ *
+ */
+typedef int (*ds3231_lz_sink_t)(void * ctx, const uint8_t * data, size_t length);
+
+/**
+ * @brief Struct to hold the state of a streaming encoder.
+ *
+ */
+typedef struct ds3231_lz_encoder_t {
+    uint8_t ring[DS3231_LZ_RING_SIZE];
+    uint8_t head;               // First lookahead byte.
+    uint8_t lookahead;          // Bytes waiting to be encoded.
+    uint8_t history;            // Encoded bytes in the window.
+    uint8_t group[DS3231_LZ_GROUP_SIZE];
+    uint8_t group_length;
+    uint8_t group_tokens;
+    ds3231_lz_sink_t sink;
+    void * ctx;
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+} ds3231_lz_encoder_t;
+
+/**
+ * @brief Struct to hold the state of a streaming decoder.
+ *
+ */
+typedef struct ds3231_lz_decoder_t {
+    uint8_t ring[DS3231_LZ_RING_SIZE];
+    uint8_t head;
+    uint8_t flags;
+    uint8_t tokens;             // Tokens left in the current group.
+    uint8_t distance;           // First byte of a match split across inputs, 0 if none.
+    ds3231_lz_sink_t sink;
+    void * ctx;
+} ds3231_lz_decoder_t;
+
+/**
+ * @brief Struct to hold a compressing writer on top of a log. Compressed data is collected in RAM
+ * and appended as a record that fills the head page, so compression never adds write cycles.
+ *
+ */
+typedef struct ds3231_lz_log_t {
+    ds3231_log_t * log;
+    ds3231_lz_encoder_t encoder;
+    uint8_t record[DS3231_LOG_MAX_RECORD];
+    uint8_t record_length;
+    uint16_t restart_records;   // A record with DS3231_LZ_RECORD_RESET is written every restart_records records.
+    uint16_t records;           // Records since the last reset.
+} ds3231_lz_log_t;
+
+/**
+ * @brief Struct to hold a decompressing reader on top of a log cursor.
+ *
+ */
+typedef struct ds3231_lz_log_reader_t {
+    ds3231_log_cursor_t cursor;
+    ds3231_lz_decoder_t decoder;
+    bool synced;                // A reset record was seen.
+} ds3231_lz_log_reader_t;
+
+int ds3231_lz_encoder_init(ds3231_lz_encoder_t * encoder, ds3231_lz_sink_t sink, void * ctx);
+int ds3231_lz_encode(ds3231_lz_encoder_t * encoder, const uint8_t * data, size_t length);
+int ds3231_lz_flush(ds3231_lz_encoder_t * encoder);
+void ds3231_lz_encoder_reset(ds3231_lz_encoder_t * encoder);
+
+int ds3231_lz_decoder_init(ds3231_lz_decoder_t * decoder, ds3231_lz_sink_t sink, void * ctx);
+int ds3231_lz_decode(ds3231_lz_decoder_t * decoder, const uint8_t * data, size_t length);
+void ds3231_lz_decoder_end_chunk(ds3231_lz_decoder_t * decoder);
+void ds3231_lz_decoder_reset(ds3231_lz_decoder_t * decoder);
+
+int ds3231_lz_log_init(ds3231_lz_log_t * lz_log, ds3231_log_t * log, uint16_t restart_records);
+int ds3231_lz_log_write(ds3231_lz_log_t * lz_log, const uint8_t * data, size_t length);
+int ds3231_lz_log_sync(ds3231_lz_log_t * lz_log);
+
+int ds3231_lz_log_reader_init(ds3231_lz_log_reader_t * reader, ds3231_log_t * log,
+    ds3231_lz_sink_t sink, void * ctx);
+int ds3231_lz_log_read(ds3231_lz_log_reader_t * reader);
+
+#endif
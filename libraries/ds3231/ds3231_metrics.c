@@ -0,0 +1,238 @@
+/**
+ * @file    ds3231_metrics.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Binary dump of the driver counters for host side monitoring.
+ * While metrics are active, ds3231_bus_write and ds3231_bus_read count every transfer with its
+ * result and duration. A DS3231_LINK_METRICS_REQUEST from the host is answered with the bus
+ * counters and the counters of every module set in the metrics struct, 6 bytes per value in as
+ * few DS3231_LINK_METRICS frames as they fit in. Nothing is formatted on the device, names and
+ * units are added by the host, see tools/ds3231_metrics_bridge.c.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_metrics.h"
+#include "ds3231_queue.h"
+#include "ds3231_skew.h"
+#include "ds3231_vote.h"
+#include "ds3231_wear.h"
+#include "ds3231_writer.h"
+#include "ds3231_verify.h"
+#if DS3231_CONFIG_FLOAT
+#include "ds3231_temp.h"
+#endif
+#include "hardware/timer.h"
+#include <string.h>
+
+ds3231_metrics_t * ds3231_metrics_active = NULL;
+
+/**
+ * @brief Struct to hold a dump while its frames are filled.
+ *
+ */
+typedef struct ds3231_metrics_writer_t {
+    uint8_t payload[1 + DS3231_METRICS_FRAME_RECORDS * DS3231_METRICS_RECORD_SIZE];
+    uint8_t records;
+    uint16_t seq;
+    ds3231_link_write_t write;
+    void * ctx;
+    int result;
+} ds3231_metrics_writer_t;
+
+static void ds3231_metrics_flush(ds3231_metrics_writer_t * out, bool last) {
+    out->payload[0] = last ? DS3231_METRICS_FLAG_LAST : 0;
+    if(!out->result && ds3231_link_send(out->write, out->ctx, DS3231_LINK_METRICS, out->seq, NULL, 0,
+        out->payload, 1 + out->records * DS3231_METRICS_RECORD_SIZE))
+        out->result = -1;
+    out->records = 0;
+}
+
+static void ds3231_metrics_put(ds3231_metrics_writer_t * out, uint8_t id, uint8_t index, uint32_t value) {
+    if(out->records == DS3231_METRICS_FRAME_RECORDS)
+        ds3231_metrics_flush(out, false);
+    uint8_t * record = &out->payload[1 + out->records * DS3231_METRICS_RECORD_SIZE];
+    record[0] = id;
+    record[1] = index;
+    record[2] = value & 0xFF;
+    record[3] = (value >> 8) & 0xFF;
+    record[4] = (value >> 16) & 0xFF;
+    record[5] = value >> 24;
+    out->records++;
+}
+
+/**
+ * @brief               Initiliaze metrics with no modules and cleared bus counters.
+ *
+ * @param[out] metrics  Metrics struct.
+ */
+void ds3231_metrics_init(ds3231_metrics_t * metrics) {
+    memset(metrics, 0, sizeof(*metrics));
+}
+
+/**
+ * @brief               Count every transfer of the drivers in the bus counters of the metrics.
+ *
+ * @param[in] metrics   Metrics struct.
+ * @return              0 if succesful, -1 if other metrics are active.
+ */
+int ds3231_metrics_start(ds3231_metrics_t * metrics) {
+    if(ds3231_metrics_active)
+        return -1;
+    ds3231_metrics_active = metrics;
+    return 0;
+}
+
+/**
+ * @brief               Stop counting transfers. The counters are kept.
+ *
+ * @return              0 if succesful, -1 if no metrics were active.
+ */
+int ds3231_metrics_stop(void) {
+    if(!ds3231_metrics_active)
+        return -1;
+    ds3231_metrics_active = NULL;
+    return 0;
+}
+
+/**
+ * @brief               Library function that counts a transfer, called by ds3231_bus_write and
+ * ds3231_bus_read.
+ *
+ * @param[in] metrics   Metrics struct.
+ * @param[in] start_us  time_us_32 at the start of the transfer.
+ * @param[in] result    Result of the transfer, number of bytes or a negative error.
+ */
+void ds3231_metrics_transfer(ds3231_metrics_t * metrics, uint32_t start_us, int result) {
+    ds3231_metrics_bus_t * bus = &metrics->bus;
+    uint32_t elapsed = time_us_32() - start_us;
+    bus->transfers++;
+    if(result < 0)
+        bus->errors++;
+    else
+        bus->bytes += result;
+    uint8_t bucket = 0;
+    while(bucket < DS3231_METRICS_BUS_BUCKETS - 1 && elapsed >= ((uint32_t)DS3231_METRICS_BUS_BUCKET_US << bucket))
+        bucket++;
+    bus->latency[bucket]++;
+    bus->latency_sum_us += elapsed;
+}
+
+/**
+ * @brief               Send the bus counters and the counters of every module set in the metrics.
+ *
+ * @param[in] metrics   Metrics struct.
+ * @param[in] seq       Sequence number of the frames, the one of the request.
+ * @param[in] write     Function that sends bytes to the host.
+ * @param[in] ctx       Passed to the write function.
+ * @return              0 if succesful, -1 if sending failed.
+ */
+int ds3231_metrics_dump(ds3231_metrics_t * metrics, uint16_t seq, ds3231_link_write_t write, void * ctx) {
+    ds3231_metrics_writer_t out = {.records = 0, .seq = seq, .write = write, .ctx = ctx, .result = 0};
+
+    ds3231_metrics_bus_t * bus = &metrics->bus;
+    ds3231_metrics_put(&out, DS3231_METRICS_UPTIME_S, 0, (uint32_t)(time_us_64() / 1000000));
+    ds3231_metrics_put(&out, DS3231_METRICS_BUS_TRANSFERS, 0, bus->transfers);
+    ds3231_metrics_put(&out, DS3231_METRICS_BUS_ERRORS, 0, bus->errors);
+    ds3231_metrics_put(&out, DS3231_METRICS_BUS_BYTES, 0, bus->bytes);
+    for(uint8_t i = 0; i < DS3231_METRICS_BUS_BUCKETS; i++)
+        ds3231_metrics_put(&out, DS3231_METRICS_BUS_LATENCY, i, bus->latency[i]);
+    ds3231_metrics_put(&out, DS3231_METRICS_BUS_LATENCY_SUM_US, 0, bus->latency_sum_us);
+
+    if(metrics->queue) {
+        ds3231_metrics_put(&out, DS3231_METRICS_QUEUE_REQUESTED, 0, metrics->queue->requested);
+        ds3231_metrics_put(&out, DS3231_METRICS_QUEUE_TRANSACTIONS, 0, metrics->queue->transactions);
+    }
+#if DS3231_CONFIG_FLOAT
+    ds3231_temp_t * temp = metrics->temp;
+    if(temp) {
+        if(temp->reads)
+            ds3231_metrics_put(&out, DS3231_METRICS_TEMP_QUARTERS, 0, (uint32_t)(int32_t)(temp->temperature * 4));
+        ds3231_metrics_put(&out, DS3231_METRICS_TEMP_READS, 0, temp->reads);
+        ds3231_metrics_put(&out, DS3231_METRICS_TEMP_PROBES, 0, temp->probes);
+        ds3231_metrics_put(&out, DS3231_METRICS_TEMP_HITS, 0, temp->hits);
+        ds3231_metrics_put(&out, DS3231_METRICS_TEMP_ACQUIRE_FAILURES, 0, temp->acquire_failures);
+    }
+#endif
+    ds3231_skew_t * skew = metrics->skew;
+    if(skew) {
+        ds3231_metrics_put(&out, DS3231_METRICS_SKEW_EDGES, 0, skew->edges);
+        for(uint8_t i = 0; i < skew->count; i++) {
+            int32_t value;
+            if(i == skew->reference)
+                continue;
+            if(!ds3231_skew_pair_ns(skew, i, skew->reference, &value))
+                ds3231_metrics_put(&out, DS3231_METRICS_SKEW_NS, i, (uint32_t)value);
+            if(!ds3231_skew_pair_drift_ppb(skew, i, skew->reference, &value))
+                ds3231_metrics_put(&out, DS3231_METRICS_SKEW_DRIFT_PPB, i, (uint32_t)value);
+        }
+    }
+    ds3231_vote_t * vote = metrics->vote;
+    if(vote) {
+        ds3231_vote_metrics_t * vm = &vote->metrics;
+        ds3231_metrics_put(&out, DS3231_METRICS_VOTE_READS, 0, vm->reads);
+        ds3231_metrics_put(&out, DS3231_METRICS_VOTE_READ_US, 0, vm->read_us);
+        ds3231_metrics_put(&out, DS3231_METRICS_VOTE_MAX_READ_US, 0, vm->max_read_us);
+        ds3231_metrics_put(&out, DS3231_METRICS_VOTE_FAILOVERS, 0, vm->failovers);
+        ds3231_metrics_put(&out, DS3231_METRICS_VOTE_MAX_FAILOVER_US, 0, vm->max_failover_us);
+        ds3231_metrics_put(&out, DS3231_METRICS_VOTE_HOLDOVERS, 0, vm->holdovers);
+        ds3231_metrics_put(&out, DS3231_METRICS_VOTE_DISAGREEMENTS, 0, vm->disagreements);
+        for(uint8_t i = 0; i < vote->count; i++) {
+            ds3231_metrics_put(&out, DS3231_METRICS_VOTE_BUS_ERRORS, i, vote->units[i].bus_errors);
+            ds3231_metrics_put(&out, DS3231_METRICS_VOTE_OSF_READS, i, vote->units[i].osf_reads);
+            ds3231_metrics_put(&out, DS3231_METRICS_VOTE_OUTLIERS, i, vote->units[i].outliers);
+        }
+    }
+    ds3231_wear_t * wear = metrics->wear;
+    if(wear) {
+        uint32_t writes = 0;
+        uint32_t most = 0;
+        for(uint32_t page = 0; page < wear->lower->page_count && page < DS3231_WEAR_MAX_PAGES; page++) {
+            writes += wear->counts[page];
+            if(wear->counts[page] > most)
+                most = wear->counts[page];
+        }
+        ds3231_metrics_put(&out, DS3231_METRICS_WEAR_WRITES, 0, writes);
+        ds3231_metrics_put(&out, DS3231_METRICS_WEAR_MAX, 0, most);
+        ds3231_metrics_put(&out, DS3231_METRICS_WEAR_CHECKPOINTS, 0, wear->checkpoints);
+    }
+    if(metrics->writer) {
+        ds3231_metrics_put(&out, DS3231_METRICS_WRITER_ISSUED, 0, metrics->writer->issued);
+        ds3231_metrics_put(&out, DS3231_METRICS_WRITER_MERGED, 0, metrics->writer->merged);
+        ds3231_metrics_put(&out, DS3231_METRICS_WRITER_STALLS, 0, metrics->writer->stalls);
+        ds3231_metrics_put(&out, DS3231_METRICS_WRITER_FAILURES, 0, metrics->writer->failures);
+        ds3231_metrics_put(&out, DS3231_METRICS_WRITER_DROPPED, 0, metrics->writer->dropped);
+    }
+    if(metrics->verify) {
+        ds3231_metrics_put(&out, DS3231_METRICS_VERIFY_MISMATCHES, 0, metrics->verify->mismatches);
+        ds3231_metrics_put(&out, DS3231_METRICS_VERIFY_REMAPS, 0, metrics->verify->remaps);
+        ds3231_metrics_put(&out, DS3231_METRICS_VERIFY_SPARES_USED, 0, metrics->verify->spares_used);
+    }
+    if(metrics->parser) {
+        ds3231_metrics_put(&out, DS3231_METRICS_LINK_CRC_ERRORS, 0, metrics->parser->crc_errors);
+        ds3231_metrics_put(&out, DS3231_METRICS_LINK_DROPPED, 0, metrics->parser->dropped);
+    }
+
+    ds3231_metrics_flush(&out, true);
+    metrics->dumps++;
+    return out.result;
+}
+
+/**
+ * @brief               Answer a metrics request with a dump.
+ *
+ * @param[in] metrics   Metrics struct.
+ * @param[in] request   Frame received from the host.
+ * @param[in] write     Function that sends bytes to the host.
+ * @param[in] ctx       Passed to the write function.
+ * @return              0 if succesful, 1 if the frame is not a metrics request, -1 if sending failed.
+ */
+int ds3231_metrics_handle(ds3231_metrics_t * metrics, const ds3231_link_frame_t * request,
+    ds3231_link_write_t write, void * ctx)
+{
+    if(request->type != DS3231_LINK_METRICS_REQUEST)
+        return 1;
+    return ds3231_metrics_dump(metrics, request->seq, write, ctx);
+}
@@ -0,0 +1,127 @@
+/**
+ * @file    ds3231_metrics.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Binary dump of the driver counters for host side monitoring.
+ * Only needs the C library, so host tools can include it for the record format.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_config.h"
+#include "ds3231_link.h"
+
+#ifndef DS_3231_METRICS
+#define DS_3231_METRICS
+
+/* Dump record: metric id (1), index (1), value (4). The index is the bucket of a histogram or
+the module of a per module metric, 0 otherwise. Counters are unsigned and wrap around, gauges
+are signed. */
+#define DS3231_METRICS_RECORD_SIZE      6
+
+/* Records per DS3231_LINK_METRICS frame, after the flags byte. */
+#define DS3231_METRICS_FRAME_RECORDS    ((DS3231_LINK_PAYLOAD_MAX - 1) / DS3231_METRICS_RECORD_SIZE)
+
+/* Flags byte of a DS3231_LINK_METRICS frame. */
+#define DS3231_METRICS_FLAG_LAST        0x01
+
+/* Bus latency histogram: bucket i counts transfers that took less than
+DS3231_METRICS_BUS_BUCKET_US << i microseconds, the last bucket counts the rest. */
+#define DS3231_METRICS_BUS_BUCKETS      12
+#define DS3231_METRICS_BUS_BUCKET_US    32
+
+enum DS3231_METRICS_IDS {
+    /* Every transfer through ds3231_bus_write and ds3231_bus_read while metrics are active. */
+    DS3231_METRICS_BUS_TRANSFERS = 0x01,
+    DS3231_METRICS_BUS_ERRORS = 0x02,
+    DS3231_METRICS_BUS_BYTES = 0x03,
+    DS3231_METRICS_BUS_LATENCY = 0x04,          // Index: bucket.
+    DS3231_METRICS_BUS_LATENCY_SUM_US = 0x05,
+    DS3231_METRICS_UPTIME_S = 0x06,             // Gauge, seconds since boot.
+
+    DS3231_METRICS_QUEUE_REQUESTED = 0x10,
+    DS3231_METRICS_QUEUE_TRANSACTIONS = 0x11,
+
+    DS3231_METRICS_TEMP_QUARTERS = 0x18,        // Gauge, cached temperature in 0.25 C.
+    DS3231_METRICS_TEMP_READS = 0x19,
+    DS3231_METRICS_TEMP_PROBES = 0x1A,
+    DS3231_METRICS_TEMP_HITS = 0x1B,
+    DS3231_METRICS_TEMP_ACQUIRE_FAILURES = 0x1C,
+
+    DS3231_METRICS_SKEW_NS = 0x20,              // Gauge, index: module.
+    DS3231_METRICS_SKEW_DRIFT_PPB = 0x21,       // Gauge, index: module.
+    DS3231_METRICS_SKEW_EDGES = 0x22,
+
+    DS3231_METRICS_VOTE_READS = 0x28,
+    DS3231_METRICS_VOTE_READ_US = 0x29,         // Gauge, last parallel read.
+    DS3231_METRICS_VOTE_MAX_READ_US = 0x2A,     // Gauge.
+    DS3231_METRICS_VOTE_FAILOVERS = 0x2B,
+    DS3231_METRICS_VOTE_MAX_FAILOVER_US = 0x2C, // Gauge.
+    DS3231_METRICS_VOTE_HOLDOVERS = 0x2D,
+    DS3231_METRICS_VOTE_DISAGREEMENTS = 0x2E,
+    DS3231_METRICS_VOTE_BUS_ERRORS = 0x2F,      // Index: module.
+    DS3231_METRICS_VOTE_OSF_READS = 0x30,       // Index: module.
+    DS3231_METRICS_VOTE_OUTLIERS = 0x31,        // Index: module.
+
+    DS3231_METRICS_WEAR_WRITES = 0x38,          // Writes of all pages.
+    DS3231_METRICS_WEAR_MAX = 0x39,             // Gauge, writes of the most worn page.
+    DS3231_METRICS_WEAR_CHECKPOINTS = 0x3A,
+
+    DS3231_METRICS_WRITER_ISSUED = 0x40,
+    DS3231_METRICS_WRITER_MERGED = 0x41,
+    DS3231_METRICS_WRITER_STALLS = 0x42,
+    DS3231_METRICS_WRITER_FAILURES = 0x43,
+    DS3231_METRICS_WRITER_DROPPED = 0x44,
+
+    DS3231_METRICS_VERIFY_MISMATCHES = 0x48,    // Programs that were retried.
+    DS3231_METRICS_VERIFY_REMAPS = 0x49,
+    DS3231_METRICS_VERIFY_SPARES_USED = 0x4A,   // Gauge.
+
+    DS3231_METRICS_LINK_CRC_ERRORS = 0x50,
+    DS3231_METRICS_LINK_DROPPED = 0x51
+};
+
+/**
+ * @brief Struct to hold the counters of every transfer of the drivers.
+ *
+ */
+typedef struct ds3231_metrics_bus_t {
+    uint32_t transfers;
+    uint32_t errors;
+    uint32_t bytes;
+    uint32_t latency[DS3231_METRICS_BUS_BUCKETS];
+    uint32_t latency_sum_us;
+} ds3231_metrics_bus_t;
+
+/**
+ * @brief Struct to hold the modules whose counters are dumped. Every module is optional, set the
+ * ones that are used after ds3231_metrics_init.
+ *
+ */
+typedef struct ds3231_metrics_t {
+    ds3231_metrics_bus_t bus;
+    struct ds3231_queue_t * queue;
+    struct ds3231_temp_t * temp;
+    struct ds3231_skew_t * skew;
+    struct ds3231_vote_t * vote;
+    struct ds3231_wear_t * wear;
+    struct ds3231_writer_t * writer;
+    struct ds3231_verify_t * verify;
+    ds3231_link_parser_t * parser;      // Parser of the host link the dump is requested over.
+    uint32_t dumps;
+} ds3231_metrics_t;
+
+extern ds3231_metrics_t * ds3231_metrics_active;
+
+void ds3231_metrics_init(ds3231_metrics_t * metrics);
+int ds3231_metrics_start(ds3231_metrics_t * metrics);
+int ds3231_metrics_stop(void);
+void ds3231_metrics_transfer(ds3231_metrics_t * metrics, uint32_t start_us, int result);
+
+int ds3231_metrics_dump(ds3231_metrics_t * metrics, uint16_t seq, ds3231_link_write_t write, void * ctx);
+int ds3231_metrics_handle(ds3231_metrics_t * metrics, const ds3231_link_frame_t * request,
+    ds3231_link_write_t write, void * ctx);
+
+#endif
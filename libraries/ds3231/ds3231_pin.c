@@ -0,0 +1,382 @@
+/**
+ * @file    ds3231_pin.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Arbiter that shares the INT/SQW pin between 1 Hz tick and alarm consumers.
+ * INTCN selects either the square wave or the alarm interrupts on INT/SQW, so enabling one
+ * silently disables the other. The arbiter owns the control register instead: consumers register
+ * for 1 Hz ticks or for alarm 1 and 2, and the pin is set up for all of them.
+ * With ticks only, the pin outputs the 1 Hz square wave. As soon as an alarm is used, INTCN is set
+ * and alarm 1 is set to ON_EVERY_SECOND to keep the ticks going. If a consumer also wants alarm 1,
+ * its match is checked in software against every second that passed since the last tick.
+ * Alarm 1 flags of seconds missed by a late poll collapse into one, so in interrupt mode the ticks
+ * are counted from the time instead, which costs one time read per tick.
+ * Both sources have their edge at the seconds update, so switching right after a tick neither
+ * drops nor doubles one. While ticks are delivered, changes are therefore applied in
+ * ds3231_pin_poll right after the next tick, otherwise at once.
+ * The interrupt only counts edges, flags are read and cleared by ds3231_pin_poll from the main
+ * loop. Only one arbiter can be active, the GPIO callback has no context argument.
+ * ds3231_hybrid and ds3231_schedule_arm write alarm 1 and the control register themselves, which
+ * would undo the setup of the arbiter, so they are mutually exclusive with it. The arbiter claims
+ * the DS3231 in int_owner, the others refuse to run while it is claimed, and ds3231_pin_init
+ * refuses while a hybrid engine runs. ds3231_pin_deinit gives the DS3231 back.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_pin.h"
+
+#define DS3231_PIN_A1IE     (0x01 << 0)
+#define DS3231_PIN_A2IE     (0x01 << 1)
+#define DS3231_PIN_INTCN    (0x01 << 2)
+#define DS3231_PIN_RS       (0x03 << 3)
+#define DS3231_PIN_FLAGS    0x03
+
+static ds3231_pin_t * ds3231_pin_active = NULL;
+
+/* Check an alarm 1 match in software, the same way DS3231 does. */
+static bool ds3231_pin_match_alarm_1(ds3231_pin_t * pin, const ds3231_data_t * time) {
+    const ds3231_alarm_1_t * alarm = &pin->alarm_1;
+    bool hours = time->hours == alarm->hours && (!DS3231_AM_PM_MODE(pin->rtc) || time->am_pm == alarm->am_pm);
+    switch(pin->alarm_1_mask) {
+        case ON_EVERY_SECOND:
+            return true;
+        case ON_MATCHING_SECOND:
+            return time->seconds == alarm->seconds;
+        case ON_MATCHING_SECOND_AND_MINUTE:
+            return time->seconds == alarm->seconds && time->minutes == alarm->minutes;
+        case ON_MATCHING_SECOND_MINUTE_AND_HOUR:
+            return time->seconds == alarm->seconds && time->minutes == alarm->minutes && hours;
+        case ON_MATCHING_SECOND_MINUTE_HOUR_AND_DATE:
+            return time->seconds == alarm->seconds && time->minutes == alarm->minutes && hours
+                && time->date == alarm->date;
+        case ON_MATCHING_SECOND_MINUTE_HOUR_AND_DAY:
+            return time->seconds == alarm->seconds && time->minutes == alarm->minutes && hours
+                && time->day == alarm->day;
+    }
+    return false;
+}
+
+/* Set up the alarms and the control register for the current consumers. */
+static int ds3231_pin_apply(ds3231_pin_t * pin) {
+    DS3231_CRUMB_API(DS3231_CRUMB_PIN);
+    ds3231_t * rtc = pin->rtc;
+    bool alarm_1 = pin->alarm_1_consumer.callback != NULL;
+    bool alarm_2 = pin->alarm_2_consumer.callback != NULL;
+    uint8_t mode;
+
+    uint8_t control = 0;
+    if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_REG, 1, &control))
+        return -1;
+    control &= ~(DS3231_PIN_A1IE | DS3231_PIN_A2IE | DS3231_PIN_INTCN | DS3231_PIN_RS);
+    pin->alarm_1_emulated = false;
+
+    if(!alarm_1 && !alarm_2) {
+        mode = pin->tick_count ? DS3231_PIN_SQUARE_WAVE : DS3231_PIN_OFF;
+        if(mode == DS3231_PIN_OFF)
+            control |= DS3231_PIN_INTCN;
+        else
+            control |= (FREQUENCY_1_HZ << 3);
+    } else {
+        mode = DS3231_PIN_INTERRUPT;
+        control |= DS3231_PIN_INTCN;
+        if(pin->tick_count) {
+            ds3231_alarm_1_t every_second = {.seconds = 0, .minutes = 0, .hours = 1, .day = 1, .date = 1};
+            if(ds3231_set_alarm_1(rtc, &every_second, ON_EVERY_SECOND))
+                return -1;
+            pin->alarm_1_emulated = alarm_1;
+            control |= DS3231_PIN_A1IE;
+        } else if(alarm_1) {
+            ds3231_alarm_1_t alarm = pin->alarm_1;
+            if(ds3231_set_alarm_1(rtc, &alarm, pin->alarm_1_mask))
+                return -1;
+            control |= DS3231_PIN_A1IE;
+        }
+        if(alarm_2) {
+            ds3231_alarm_2_t alarm = pin->alarm_2;
+            if(ds3231_set_alarm_2(rtc, &alarm, pin->alarm_2_mask))
+                return -1;
+            control |= DS3231_PIN_A2IE;
+        }
+    }
+
+    /* Old flags would hold the pin low and hide the next edge. */
+    DS3231_CRUMB_API(DS3231_CRUMB_PIN);
+    uint8_t status = 0;
+    if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
+        return -1;
+    status &= ~DS3231_PIN_FLAGS;
+    if(i2c_write_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
+        return -1;
+    if(i2c_write_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_REG, 1, &control))
+        return -1;
+
+    if(mode != pin->mode)
+        pin->switches++;
+    pin->mode = mode;
+    pin->pending = false;
+    pin->handled = pin->edges;
+    pin->last_second_valid = false;
+    return 0;
+}
+
+/* Apply a change now unless ticks are running, then it waits for the next tick. */
+static int ds3231_pin_request(ds3231_pin_t * pin) {
+    pin->pending = true;
+    if(pin->mode == DS3231_PIN_SQUARE_WAVE || (pin->mode == DS3231_PIN_INTERRUPT && pin->tick_count))
+        return 0;
+    return ds3231_pin_apply(pin);
+}
+
+static void ds3231_pin_tick(ds3231_pin_t * pin) {
+    for(uint8_t i = 0; i < pin->tick_count; i++)
+        pin->ticks[i].callback(pin->ticks[i].ctx);
+}
+
+/* Deliver a tick and the emulated alarm 1 for every second since the last tick in interrupt mode. */
+static int ds3231_pin_catch_up(ds3231_pin_t * pin) {
+    ds3231_t * rtc = pin->rtc;
+    ds3231_data_t time;
+    if(ds3231_read_current_time(rtc, &time))
+        return -1;
+    uint32_t now = ds3231_time_to_epoch(rtc, &time);
+    uint32_t second = now;
+    if(pin->last_second_valid && now - pin->last_second - 1 < DS3231_PIN_MAX_MISSED)
+        second = pin->last_second + 1;
+    pin->missed += now - second;
+    pin->last_second = now;
+    pin->last_second_valid = true;
+
+    for(; second - 1 != now; second++) {
+        ds3231_pin_tick(pin);
+        if(!pin->alarm_1_emulated)
+            continue;
+        ds3231_epoch_to_time(rtc, second, &time);
+        if(ds3231_pin_match_alarm_1(pin, &time))
+            pin->alarm_1_consumer.callback(pin->alarm_1_consumer.ctx);
+    }
+    return 0;
+}
+
+/**
+ * @brief                   GPIO callback of the INT/SQW pin. Registered by ds3231_pin_init, call it
+ * from your own GPIO callback if one is set later on the same core.
+ *
+ * @param[in] gpio          GPIO that caused the interrupt.
+ * @param[in] event_mask    GPIO events.
+ */
+void ds3231_pin_irq(uint gpio, uint32_t event_mask) {
+    ds3231_pin_t * pin = ds3231_pin_active;
+    if(pin && gpio == pin->gpio && (event_mask & GPIO_IRQ_EDGE_FALL))
+        pin->edges++;
+}
+
+/**
+ * @brief               Take over the INT/SQW pin. It stays high until consumers are added.
+ *
+ * @param[out] pin      Pin arbiter struct.
+ * @param[in] rtc       DS3231 struct.
+ * @param[in] gpio      GPIO connected to INT/SQW.
+ * @return              0 if succesful, -1 if a hybrid alarm engine owns the DS3231, the GPIO could
+ *                      not be set up or i2c failure.
+ */
+int ds3231_pin_init(ds3231_pin_t * pin, ds3231_t * rtc, uint gpio) {
+    if(rtc->int_owner != DS3231_INT_FREE && rtc->int_owner != DS3231_INT_PIN)
+        return -1;
+    rtc->int_owner = DS3231_INT_PIN;
+    pin->rtc = rtc;
+    pin->gpio = gpio;
+    pin->tick_count = 0;
+    pin->alarm_1_consumer.callback = NULL;
+    pin->alarm_2_consumer.callback = NULL;
+    pin->mode = DS3231_PIN_OFF;
+    pin->alarm_1_emulated = false;
+    pin->pending = false;
+    pin->edges = 0;
+    pin->handled = 0;
+    pin->last_second_valid = false;
+    pin->missed = 0;
+    pin->switches = 0;
+    ds3231_pin_active = pin;
+    if(ds3231_set_interrupt_callback_function(gpio, &ds3231_pin_irq))
+        return -1;
+    return ds3231_pin_apply(pin);
+}
+
+/**
+ * @brief               Give the INT/SQW pin back. The alarms are disabled, the pin stays high and
+ * the GPIO interrupt is turned off, so ds3231_hybrid or ds3231_schedule_arm can take over.
+ *
+ * @param[in] pin       Pin arbiter struct.
+ * @return              0 if succesful, -1 if i2c failure. The pin is given back either way.
+ */
+int ds3231_pin_deinit(ds3231_pin_t * pin) {
+    pin->tick_count = 0;
+    pin->alarm_1_consumer.callback = NULL;
+    pin->alarm_2_consumer.callback = NULL;
+    int result = ds3231_pin_apply(pin);
+    gpio_set_irq_enabled(pin->gpio, GPIO_IRQ_EDGE_FALL, false);
+    if(ds3231_pin_active == pin)
+        ds3231_pin_active = NULL;
+    pin->rtc->int_owner = DS3231_INT_FREE;
+    return result;
+}
+
+/**
+ * @brief               Add a consumer of 1 Hz ticks.
+ *
+ * @param[in] pin       Pin arbiter struct.
+ * @param[in] callback  Function called from ds3231_pin_poll on every tick.
+ * @param[in] ctx       Passed to the callback.
+ * @return              0 if succesful, -1 if there are DS3231_PIN_MAX_TICKS consumers or i2c failure.
+ */
+int ds3231_pin_add_tick(ds3231_pin_t * pin, ds3231_pin_callback_t callback, void * ctx) {
+    if(pin->tick_count == DS3231_PIN_MAX_TICKS || !callback)
+        return -1;
+    pin->ticks[pin->tick_count].callback = callback;
+    pin->ticks[pin->tick_count].ctx = ctx;
+    pin->tick_count++;
+    return ds3231_pin_request(pin);
+}
+
+/**
+ * @brief               Remove a consumer of 1 Hz ticks.
+ *
+ * @param[in] pin       Pin arbiter struct.
+ * @param[in] callback  Callback the consumer was added with.
+ * @param[in] ctx       Context the consumer was added with.
+ * @return              0 if succesful, -1 if there is no such consumer or i2c failure.
+ */
+int ds3231_pin_remove_tick(ds3231_pin_t * pin, ds3231_pin_callback_t callback, void * ctx) {
+    for(uint8_t i = 0; i < pin->tick_count; i++) {
+        if(pin->ticks[i].callback != callback || pin->ticks[i].ctx != ctx)
+            continue;
+        pin->ticks[i] = pin->ticks[--pin->tick_count];
+        /* Ticks are never delivered to a removed consumer, so there is no need to wait. */
+        pin->pending = true;
+        return ds3231_pin_apply(pin);
+    }
+    return -1;
+}
+
+/**
+ * @brief               Use alarm 1. Replaces the alarm of a previous consumer.
+ *
+ * @param[in] pin       Pin arbiter struct.
+ * @param[in] alarm     Alarm time, as for ds3231_set_alarm_1.
+ * @param[in] mask      Alarm trigger, as for ds3231_set_alarm_1.
+ * @param[in] callback  Function called from ds3231_pin_poll when the alarm triggers.
+ * @param[in] ctx       Passed to the callback.
+ * @return              0 if succesful, -1 if i2c failure.
+ */
+int ds3231_pin_set_alarm_1(ds3231_pin_t * pin, const ds3231_alarm_1_t * alarm, enum ALARM_1_MASKS mask,
+    ds3231_pin_callback_t callback, void * ctx)
+{
+    if(!callback)
+        return -1;
+    pin->alarm_1 = *alarm;
+    pin->alarm_1_mask = mask;
+    pin->alarm_1_consumer.callback = callback;
+    pin->alarm_1_consumer.ctx = ctx;
+    return ds3231_pin_request(pin);
+}
+
+/**
+ * @brief               Use alarm 2. Replaces the alarm of a previous consumer.
+ *
+ * @param[in] pin       Pin arbiter struct.
+ * @param[in] alarm     Alarm time, as for ds3231_set_alarm_2.
+ * @param[in] mask      Alarm trigger, as for ds3231_set_alarm_2.
+ * @param[in] callback  Function called from ds3231_pin_poll when the alarm triggers.
+ * @param[in] ctx       Passed to the callback.
+ * @return              0 if succesful, -1 if i2c failure.
+ */
+int ds3231_pin_set_alarm_2(ds3231_pin_t * pin, const ds3231_alarm_2_t * alarm, enum ALARM_2_MASKS mask,
+    ds3231_pin_callback_t callback, void * ctx)
+{
+    if(!callback)
+        return -1;
+    pin->alarm_2 = *alarm;
+    pin->alarm_2_mask = mask;
+    pin->alarm_2_consumer.callback = callback;
+    pin->alarm_2_consumer.ctx = ctx;
+    return ds3231_pin_request(pin);
+}
+
+/**
+ * @brief               Stop using alarm 1.
+ *
+ * @param[in] pin       Pin arbiter struct.
+ * @return              0 if succesful, -1 if i2c failure.
+ */
+int ds3231_pin_clear_alarm_1(ds3231_pin_t * pin) {
+    pin->alarm_1_consumer.callback = NULL;
+    return ds3231_pin_request(pin);
+}
+
+/**
+ * @brief               Stop using alarm 2.
+ *
+ * @param[in] pin       Pin arbiter struct.
+ * @return              0 if succesful, -1 if i2c failure.
+ */
+int ds3231_pin_clear_alarm_2(ds3231_pin_t * pin) {
+    pin->alarm_2_consumer.callback = NULL;
+    return ds3231_pin_request(pin);
+}
+
+/**
+ * @brief               Deliver the ticks and alarms of the edges seen since the last call, then
+ * apply pending consumer changes. Call it from the main loop.
+ *
+ * @param[in] pin       Pin arbiter struct.
+ * @return              0 if succesful, -1 if i2c failure.
+ */
+int ds3231_pin_poll(ds3231_pin_t * pin) {
+    ds3231_t * rtc = pin->rtc;
+    uint32_t edges = pin->edges;
+    if(edges == pin->handled)
+        return 0;
+
+    if(pin->mode == DS3231_PIN_SQUARE_WAVE) {
+        /* Every edge is a tick, even if the main loop fell behind. */
+        while(pin->handled != edges) {
+            pin->handled++;
+            ds3231_pin_tick(pin);
+        }
+    } else {
+        pin->handled = edges;
+        /* Flags set while others are cleared keep the pin low without an edge, so read again. */
+        for(int round = 0; round < 2; round++) {
+            uint8_t status = 0;
+            DS3231_CRUMB_API(DS3231_CRUMB_PIN);
+            if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
+                return -1;
+            uint8_t flags = status & DS3231_PIN_FLAGS;
+            if(!flags)
+                break;
+            /* Only flags written 0 clear, a flag raised since the read must be written 1. */
+            status = (status | DS3231_PIN_FLAGS) & ~flags;
+            if(i2c_write_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
+                return -1;
+
+            if(flags & 0x01) {
+                if(pin->tick_count) {
+                    if(ds3231_pin_catch_up(pin))
+                        return -1;
+                } else if(pin->alarm_1_consumer.callback) {
+                    pin->alarm_1_consumer.callback(pin->alarm_1_consumer.ctx);
+                }
+            }
+            if((flags & 0x02) && pin->alarm_2_consumer.callback)
+                pin->alarm_2_consumer.callback(pin->alarm_2_consumer.ctx);
+        }
+    }
+
+    /* Right after a tick both sources are a second away from their next edge. */
+    if(pin->pending)
+        return ds3231_pin_apply(pin);
+    return 0;
+}
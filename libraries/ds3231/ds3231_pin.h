@@ -0,0 +1,87 @@
+/**
+ * @file    ds3231_pin.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Arbiter that shares the INT/SQW pin between 1 Hz tick and alarm consumers.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231.h"
+
+#ifndef DS_3231_PIN
+#define DS_3231_PIN
+
+/* Number of 1 Hz tick consumers. */
+#ifndef DS3231_PIN_MAX_TICKS
+#define DS3231_PIN_MAX_TICKS            4
+#endif
+
+/* Seconds of ticks caught up in interrupt mode, a larger gap is taken as a time change. */
+#ifndef DS3231_PIN_MAX_MISSED
+#define DS3231_PIN_MAX_MISSED           60
+#endif
+
+enum DS3231_PIN_MODES {
+    DS3231_PIN_OFF = 0,             // INTCN set, no alarm enabled, the pin stays high.
+    DS3231_PIN_SQUARE_WAVE,         // INTCN cleared, 1 Hz square wave.
+    DS3231_PIN_INTERRUPT            // INTCN set, alarms enabled. Ticks come from alarm 1 every second.
+};
+
+/**
+ * @brief Function called from ds3231_pin_poll for a tick or an alarm.
+ *
+ */
+typedef void (*ds3231_pin_callback_t)(void * ctx);
+
+/**
+ * @brief Struct to hold a consumer of the pin.
+ *
+ */
+typedef struct ds3231_pin_consumer_t {
+    ds3231_pin_callback_t callback;
+    void * ctx;
+} ds3231_pin_consumer_t;
+
+/**
+ * @brief Struct to hold the state of the INT/SQW pin arbiter.
+ *
+ */
+typedef struct ds3231_pin_t {
+    ds3231_t * rtc;
+    uint gpio;
+    ds3231_pin_consumer_t ticks[DS3231_PIN_MAX_TICKS];
+    uint8_t tick_count;
+    ds3231_pin_consumer_t alarm_1_consumer;     // No callback if alarm 1 is not used.
+    ds3231_alarm_1_t alarm_1;
+    enum ALARM_1_MASKS alarm_1_mask;
+    ds3231_pin_consumer_t alarm_2_consumer;     // No callback if alarm 2 is not used.
+    ds3231_alarm_2_t alarm_2;
+    enum ALARM_2_MASKS alarm_2_mask;
+    uint8_t mode;
+    bool alarm_1_emulated;          // Alarm 1 gives the ticks, its consumer is matched in software.
+    bool pending;                   // Consumers changed, the pin is set up again at a safe point.
+    volatile uint32_t edges;        // Falling edges counted by the interrupt.
+    uint32_t handled;
+    uint32_t last_second;           // DS3231 time of the last tick in interrupt mode.
+    bool last_second_valid;
+    uint32_t missed;                // Ticks caught up from the time after a late poll.
+    uint32_t switches;              // Mode changes.
+} ds3231_pin_t;
+
+int ds3231_pin_init(ds3231_pin_t * pin, ds3231_t * rtc, uint gpio);
+int ds3231_pin_deinit(ds3231_pin_t * pin);
+int ds3231_pin_add_tick(ds3231_pin_t * pin, ds3231_pin_callback_t callback, void * ctx);
+int ds3231_pin_remove_tick(ds3231_pin_t * pin, ds3231_pin_callback_t callback, void * ctx);
+int ds3231_pin_set_alarm_1(ds3231_pin_t * pin, const ds3231_alarm_1_t * alarm, enum ALARM_1_MASKS mask,
+    ds3231_pin_callback_t callback, void * ctx);
+int ds3231_pin_set_alarm_2(ds3231_pin_t * pin, const ds3231_alarm_2_t * alarm, enum ALARM_2_MASKS mask,
+    ds3231_pin_callback_t callback, void * ctx);
+int ds3231_pin_clear_alarm_1(ds3231_pin_t * pin);
+int ds3231_pin_clear_alarm_2(ds3231_pin_t * pin);
+int ds3231_pin_poll(ds3231_pin_t * pin);
+void ds3231_pin_irq(uint gpio, uint32_t event_mask);
+
+#endif
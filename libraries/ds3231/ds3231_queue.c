@@ -0,0 +1,216 @@
+/**
+ * @file    ds3231_queue.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Register read queue for DS3231 that merges adjacent reads into burst transactions.
+ * Reads are collected during a superloop iteration and issued together by ds3231_queue_execute.
+ * Pending reads on the same device whose register ranges overlap or lie within merge_gap bytes
+ * of each other are fetched with a single burst read and the results are split back out.
+ * A device is a bus and an adress, so reads through different ds3231_t structs of one DS3231
+ * are merged too.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_queue.h"
+
+static bool ds3231_queue_same_device(const ds3231_t * a, const ds3231_t * b) {
+    return a->i2c == b->i2c && a->ds3231_addr == b->ds3231_addr;
+}
+#include <string.h>
+
+/**
+ * @brief               Initiliaze an empty read queue.
+ *
+ * @param[out] queue    Queue struct.
+ * @param[in] merge_gap Maximum number of unrequested registers read to merge two reads.
+ *                      Use DS3231_QUEUE_DEFAULT_MERGE_GAP if unsure.
+ * @return              0 if succesful.
+ */
+int ds3231_queue_init(ds3231_queue_t * queue, uint8_t merge_gap) {
+    queue->count = 0;
+    queue->merge_gap = merge_gap;
+    queue->requested = 0;
+    queue->transactions = 0;
+    return 0;
+}
+
+/**
+ * @brief               Add a register read to the queue. Nothing is sent until ds3231_queue_execute is called.
+ *
+ * @param[in] queue     Queue struct.
+ * @param[in] rtc       DS3231 struct of the device to be read.
+ * @param[in] reg       First register to be read.
+ * @param[in] length    Number of registers to be read. Range must not pass DS3231_TEMPERATURE_LSB_REG.
+ * @param[out] data     Buffer to store the raw bytes. Can be NULL if a callback is given.
+ * @param[in] callback  Function to call with the raw bytes once read. Can be NULL.
+ * @param[in] ctx       Pointer passed to the callback.
+ * @return              0 if succesful, -1 if the queue is full or the range is invalid.
+ */
+int ds3231_queue_read(ds3231_queue_t * queue, ds3231_t * rtc, uint8_t reg, uint8_t length,
+    uint8_t * data, ds3231_queue_callback_t callback, void * ctx)
+{
+    if(!length)
+        return -1;
+    if((reg + length) > DS3231_QUEUE_REG_COUNT)
+        return -1;
+    if(queue->count >= DS3231_QUEUE_MAX_OPS)
+        return -1;
+    ds3231_queue_op_t * op = &queue->ops[queue->count++];
+    op->rtc = rtc;
+    op->reg = reg;
+    op->length = length;
+    op->data = data;
+    op->callback = callback;
+    op->ctx = ctx;
+    queue->requested++;
+    return 0;
+}
+
+static void ds3231_queue_decode_time(ds3231_t * rtc, const uint8_t * raw, void * ctx) {
+    ds3231_decode_time(rtc, raw, (ds3231_data_t *)ctx);
+}
+
+static void ds3231_queue_decode_temperature_quarters(ds3231_t * rtc, const uint8_t * raw, void * ctx) {
+    *(int16_t *)ctx = ds3231_decode_temperature_quarters(raw);
+}
+
+#if DS3231_CONFIG_FLOAT
+static void ds3231_queue_decode_temperature(ds3231_t * rtc, const uint8_t * raw, void * ctx) {
+    ds3231_decode_temperature(raw, (float *)ctx);
+}
+#endif
+
+/**
+ * @brief               Queue a read of the timekeeping registers. Deferred version of ds3231_read_current_time.
+ *
+ * @param[in] queue     Queue struct.
+ * @param[in] rtc       DS3231 struct.
+ * @param[out] data     Filled in when the queue is executed.
+ * @return              0 if succesful.
+ */
+int ds3231_queue_read_current_time(ds3231_queue_t * queue, ds3231_t * rtc, ds3231_data_t * data) {
+    return ds3231_queue_read(queue, rtc, DS3231_SECONDS_REG, 7, NULL, &ds3231_queue_decode_time, data);
+}
+
+/**
+ * @brief                   Queue a read of the temperature registers. Deferred version of
+ * ds3231_read_temperature_quarters.
+ *
+ * @param[in] queue         Queue struct.
+ * @param[in] rtc           DS3231 struct.
+ * @param[out] quarters     Filled in when the queue is executed.
+ * @return                  0 if succesful.
+ */
+int ds3231_queue_read_temperature_quarters(ds3231_queue_t * queue, ds3231_t * rtc, int16_t * quarters) {
+    return ds3231_queue_read(queue, rtc, DS3231_TEMPERATURE_MSB_REG, 2, NULL, &ds3231_queue_decode_temperature_quarters, quarters);
+}
+
+#if DS3231_CONFIG_FLOAT
+/**
+ * @brief                   Queue a read of the temperature registers. Deferred version of ds3231_read_temperature.
+ *
+ * @param[in] queue         Queue struct.
+ * @param[in] rtc           DS3231 struct.
+ * @param[out] temperature  Filled in when the queue is executed.
+ * @return                  0 if succesful.
+ */
+int ds3231_queue_read_temperature(ds3231_queue_t * queue, ds3231_t * rtc, float * temperature) {
+    return ds3231_queue_read(queue, rtc, DS3231_TEMPERATURE_MSB_REG, 2, NULL, &ds3231_queue_decode_temperature, temperature);
+}
+#endif
+
+/**
+ * @brief               Queue a read of the control/status register.
+ *
+ * @param[in] queue     Queue struct.
+ * @param[in] rtc       DS3231 struct.
+ * @param[out] status   Raw status byte, filled in when the queue is executed.
+ * @return              0 if succesful.
+ */
+int ds3231_queue_read_status(ds3231_queue_t * queue, ds3231_t * rtc, uint8_t * status) {
+    return ds3231_queue_read(queue, rtc, DS3231_CONTROL_STATUS_REG, 1, status, NULL, NULL);
+}
+
+/**
+ * @brief               Issue all pending reads. Reads are sorted by device and register, and reads
+ * that overlap or are at most merge_gap registers apart are combined into one burst read.
+ * Destination buffers and callbacks of every read in a burst are served from that burst.
+ * The queue is empty afterwards, even if a transaction fails.
+ *
+ * @param[in] queue     Queue struct.
+ * @return              Number of bus transactions issued, -1 if any transaction failed.
+ *                      Reads belonging to a failed transaction are not delivered.
+ */
+int ds3231_queue_execute(ds3231_queue_t * queue) {
+    uint8_t order[DS3231_QUEUE_MAX_OPS];
+    uint8_t device[DS3231_QUEUE_MAX_OPS];
+    uint8_t count = queue->count;
+    queue->count = 0;
+
+    /* Devices are numbered in the order they were first queued. Buses can only be compared
+    for equality. */
+    for(uint8_t i = 0; i < count; i++) {
+        device[i] = i;
+        for(uint8_t k = 0; k < i; k++) {
+            if(ds3231_queue_same_device(queue->ops[k].rtc, queue->ops[i].rtc)) {
+                device[i] = device[k];
+                break;
+            }
+        }
+    }
+
+    /* Insertion sort on (device, register). The queue is short, so this is cheaper than anything smarter. */
+    for(uint8_t i = 0; i < count; i++) {
+        uint8_t j = i;
+        while(j > 0) {
+            uint8_t prev = order[j - 1];
+            if(device[prev] < device[i] || (device[prev] == device[i] && queue->ops[prev].reg <= queue->ops[i].reg))
+                break;
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    int transactions = 0;
+    int result = 0;
+    uint8_t i = 0;
+    while(i < count) {
+        ds3231_queue_op_t * first = &queue->ops[order[i]];
+        uint8_t start = first->reg;
+        uint8_t end = first->reg + first->length;
+        uint8_t j = i + 1;
+        while(j < count) {
+            ds3231_queue_op_t * next = &queue->ops[order[j]];
+            if(device[order[j]] != device[order[i]] || next->reg > (end + queue->merge_gap))
+                break;
+            if((next->reg + next->length) > end)
+                end = next->reg + next->length;
+            j++;
+        }
+
+        uint8_t burst[DS3231_QUEUE_REG_COUNT];
+        transactions++;
+        DS3231_CRUMB_API(DS3231_CRUMB_QUEUE_EXECUTE);
+        if(i2c_read_reg(first->rtc->i2c, first->rtc->ds3231_addr, start, end - start, burst)) {
+            result = -1;
+        } else {
+            for(uint8_t k = i; k < j; k++) {
+                ds3231_queue_op_t * op = &queue->ops[order[k]];
+                const uint8_t * raw = &burst[op->reg - start];
+                if(op->data)
+                    memcpy(op->data, raw, op->length);
+                if(op->callback)
+                    op->callback(op->rtc, raw, op->ctx);
+            }
+        }
+        i = j;
+    }
+    queue->transactions += transactions;
+    if(result)
+        return -1;
+    return transactions;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file    ds3231_queue.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Register read queue for DS3231 that merges adjacent reads into burst transactions.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231.h"
+
+#ifndef DS_3231_QUEUE
+#define DS_3231_QUEUE
+
+/* Maximum number of pending reads a queue can hold. */
+#define DS3231_QUEUE_MAX_OPS            16
+
+/* Registers 0x00 - 0x12. The DS3231 register pointer wraps to 0x00 after 0x12. */
+#define DS3231_QUEUE_REG_COUNT          0x13
+
+/* Number of unrequested bytes that may be read between two pending reads to merge them.
+Every extra transaction costs a start, two adress bytes, the register byte, a restart, a stop and
+a blocking SDK call, about as long as eight unused registers at 400 kHz. 8 merges the time
+registers 0x00 - 0x06 with the status register 0x0F. */
+#define DS3231_QUEUE_DEFAULT_MERGE_GAP  8
+
+/**
+ * @brief Function called after a queued read completes. raw points to the requested registers.
+ *
+ */
+typedef void (*ds3231_queue_callback_t)(ds3231_t * rtc, const uint8_t * raw, void * ctx);
+
+/**
+ * @brief Struct to hold a single pending register read.
+ *
+ */
+typedef struct ds3231_queue_op_t {
+    ds3231_t * rtc;
+    uint8_t reg;
+    uint8_t length;
+    uint8_t * data;                     // Optional destination for the raw bytes.
+    ds3231_queue_callback_t callback;   // Optional, called with the raw bytes.
+    void * ctx;
+} ds3231_queue_op_t;
+
+/**
+ * @brief Struct to hold pending reads and transaction statistics.
+ *
+ */
+typedef struct ds3231_queue_t {
+    ds3231_queue_op_t ops[DS3231_QUEUE_MAX_OPS];
+    uint8_t count;
+    uint8_t merge_gap;
+    uint32_t requested;     // Reads enqueued since init.
+    uint32_t transactions;  // Bus transactions issued since init.
+} ds3231_queue_t;
+
+int ds3231_queue_init(ds3231_queue_t * queue, uint8_t merge_gap);
+
+int ds3231_queue_read(ds3231_queue_t * queue, ds3231_t * rtc, uint8_t reg, uint8_t length,
+    uint8_t * data, ds3231_queue_callback_t callback, void * ctx);
+
+int ds3231_queue_read_current_time(ds3231_queue_t * queue, ds3231_t * rtc, ds3231_data_t * data);
+int ds3231_queue_read_temperature_quarters(ds3231_queue_t * queue, ds3231_t * rtc, int16_t * quarters);
+#if DS3231_CONFIG_FLOAT
+int ds3231_queue_read_temperature(ds3231_queue_t * queue, ds3231_t * rtc, float * temperature);
+#endif
+int ds3231_queue_read_status(ds3231_queue_t * queue, ds3231_t * rtc, uint8_t * status);
+
+int ds3231_queue_execute(ds3231_queue_t * queue);
+
+#endif
@@ -0,0 +1,243 @@
+/**
+ * @file    ds3231_rollup.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Per-minute, per-hour, per-day and per-week rollups of temperature and event counts.
+ * Every level keeps one open bucket in RAM, and a sample updates each of them in constant time.
+ * Bucket boundaries come from the DS3231 time, converted with ds3231_time_to_epoch. Weeks start on
+ * Monday. When a sample falls into a different bucket, also after the time was set, the open bucket
+ * is closed and written to the log of its level as a single record.
+ *
+ * Records are DS3231_ROLLUP_RECORD_SIZE bytes, two to a 32 byte page. Hour buckets alone fill
+ * 12 pages a day, so a log that also holds days and weeks keeps only about ten days of any of
+ * them on the 128 pages of the AT24C32. ds3231_rollup_set_log gives the long levels a ring of
+ * their own: with hours on 96 pages and days and weeks on 32, the AT24C32 keeps 8 days of hours
+ * and 7 weeks of days and weeks.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_rollup.h"
+#include <string.h>
+
+static const uint32_t ds3231_rollup_seconds[DS3231_ROLLUP_LEVEL_COUNT] = {60, 3600, 86400, 604800};
+/* Added before rounding down, 2000-01-01 was a Saturday and weeks start on Monday. */
+static const uint32_t ds3231_rollup_shift[DS3231_ROLLUP_LEVEL_COUNT] = {0, 0, 0, 5 * 86400};
+
+static void ds3231_rollup_put16(uint8_t * data, uint16_t value) {
+    data[0] = value & 0xFF;
+    data[1] = value >> 8;
+}
+
+static uint16_t ds3231_rollup_get16(const uint8_t * data) {
+    return data[0] | (data[1] << 8);
+}
+
+static int ds3231_rollup_close(ds3231_rollup_t * rollup, uint8_t level, bool partial) {
+    ds3231_rollup_bucket_t * bucket = &rollup->buckets[level];
+    if(!bucket->open)
+        return 0;
+    int result = 0;
+    if(rollup->logs[level]) {
+        uint8_t record[DS3231_ROLLUP_RECORD_SIZE];
+        ds3231_rollup_encode(partial ? (level | DS3231_ROLLUP_PARTIAL) : level, bucket, record);
+        result = ds3231_log_append(rollup->logs[level], record, sizeof(record));
+        if(!result)
+            rollup->records_written++;
+    }
+    return result;
+}
+
+/* Get the bucket of every level for a sample, closing buckets the sample does not fall into. */
+static int ds3231_rollup_advance(ds3231_rollup_t * rollup, uint32_t epoch) {
+    int result = 0;
+    for(uint8_t level = 0; level < DS3231_ROLLUP_LEVEL_COUNT; level++) {
+        ds3231_rollup_bucket_t * bucket = &rollup->buckets[level];
+        uint32_t into = (epoch + ds3231_rollup_shift[level]) % ds3231_rollup_seconds[level];
+        uint32_t start = epoch >= into ? epoch - into : 0;
+        if(bucket->open && bucket->start == start)
+            continue;
+        if(ds3231_rollup_close(rollup, level, false))
+            result = -1;
+        memset(bucket, 0, sizeof(*bucket));
+        bucket->start = start;
+        bucket->open = true;
+    }
+    return result;
+}
+
+/**
+ * @brief               Initialise a rollup.
+ *
+ * @param[out] rollup   Rollup struct.
+ * @param[in] log       Log the completed buckets are written to, NULL to keep them in RAM only.
+ * @param[in] persist   Levels to be written, DS3231_ROLLUP_PERSIST_ masks ORed together.
+ * @return              0 if succesful, -1 if the log pages are too small for a record.
+ */
+int ds3231_rollup_init(ds3231_rollup_t * rollup, ds3231_log_t * log, uint8_t persist) {
+    memset(rollup, 0, sizeof(*rollup));
+    return ds3231_rollup_set_log(rollup, log, persist);
+}
+
+/**
+ * @brief               Write the completed buckets of some levels to another log, e.g. days and
+ * weeks to a ring of their own so hour records do not overwrite them.
+ *
+ * @param[in] rollup    Rollup struct.
+ * @param[in] log       Log the completed buckets are written to, NULL to keep them in RAM only.
+ * @param[in] persist   Levels to be written there, DS3231_ROLLUP_PERSIST_ masks ORed together.
+ * @return              0 if succesful, -1 if the log pages are too small for a record.
+ */
+int ds3231_rollup_set_log(ds3231_rollup_t * rollup, ds3231_log_t * log, uint8_t persist) {
+    if(log && (log->page_size - 2) < DS3231_ROLLUP_RECORD_SIZE)
+        return -1;
+    for(uint8_t level = 0; level < DS3231_ROLLUP_LEVEL_COUNT; level++) {
+        if(persist & (1 << level))
+            rollup->logs[level] = log;
+    }
+    return 0;
+}
+
+/**
+ * @brief                   Add a temperature sample.
+ *
+ * @param[in] rollup        Rollup struct.
+ * @param[in] epoch         Time of the sample, see ds3231_time_to_epoch.
+ * @param[in] temperature   Temperature read by ds3231_read_temperature.
+ * @return                  0 if succesful, -1 if writing a completed bucket failed. The sample is
+ *                          added either way.
+ */
+int ds3231_rollup_add_temperature(ds3231_rollup_t * rollup, uint32_t epoch, float temperature) {
+    int result = ds3231_rollup_advance(rollup, epoch);
+    int16_t quarters = (int16_t)(temperature * 4.0f + (temperature < 0 ? -0.5f : 0.5f));
+    for(uint8_t level = 0; level < DS3231_ROLLUP_LEVEL_COUNT; level++) {
+        ds3231_rollup_bucket_t * bucket = &rollup->buckets[level];
+        if(!bucket->count || quarters < bucket->min)
+            bucket->min = quarters;
+        if(!bucket->count || quarters > bucket->max)
+            bucket->max = quarters;
+        bucket->sum += quarters;
+        bucket->count++;
+    }
+    return result;
+}
+
+/**
+ * @brief               Count an event.
+ *
+ * @param[in] rollup    Rollup struct.
+ * @param[in] epoch     Time of the event, see ds3231_time_to_epoch.
+ * @param[in] event     Event counter, smaller than DS3231_ROLLUP_EVENTS.
+ * @return              0 if succesful, -1 if the event is invalid or writing a completed bucket failed.
+ */
+int ds3231_rollup_add_event(ds3231_rollup_t * rollup, uint32_t epoch, uint8_t event) {
+    if(event >= DS3231_ROLLUP_EVENTS)
+        return -1;
+    int result = ds3231_rollup_advance(rollup, epoch);
+    for(uint8_t level = 0; level < DS3231_ROLLUP_LEVEL_COUNT; level++) {
+        ds3231_rollup_bucket_t * bucket = &rollup->buckets[level];
+        if(bucket->events[event] < UINT16_MAX)
+            bucket->events[event]++;
+    }
+    return result;
+}
+
+/**
+ * @brief               Write the open buckets of the persisted levels, marked with
+ * DS3231_ROLLUP_PARTIAL, e.g. before powering down. The buckets stay open, and the record written
+ * when a bucket completes supersedes its partial records.
+ *
+ * @param[in] rollup    Rollup struct.
+ * @return              0 if succesful, -1 if writing failed.
+ */
+int ds3231_rollup_flush(ds3231_rollup_t * rollup) {
+    int result = 0;
+    for(uint8_t level = 0; level < DS3231_ROLLUP_LEVEL_COUNT; level++) {
+        if(ds3231_rollup_close(rollup, level, true))
+            result = -1;
+    }
+    return result;
+}
+
+/**
+ * @brief               Encode a bucket as a log record. Multi-byte values are little endian.
+ * Minimum and maximum are stored as offsets from the mean, saturated at 63.75 degrees. Counts
+ * above 65535 are stored as 65535 with DS3231_ROLLUP_SATURATED.
+ *
+ * @param[in] level     Level of the bucket, optionally with DS3231_ROLLUP_PARTIAL.
+ * @param[in] bucket    Bucket to be encoded.
+ * @param[out] record   Buffer of DS3231_ROLLUP_RECORD_SIZE bytes.
+ * @return              0 if succesful.
+ */
+int ds3231_rollup_encode(uint8_t level, const ds3231_rollup_bucket_t * bucket, uint8_t * record) {
+    int16_t mean = 0;
+    if(bucket->count)
+        mean = (int16_t)(bucket->sum / (int32_t)bucket->count);
+    int32_t below = bucket->count ? mean - bucket->min : 0;
+    int32_t above = bucket->count ? bucket->max - mean : 0;
+    bool saturated = bucket->count > UINT16_MAX;
+    for(int i = 0; i < DS3231_ROLLUP_EVENTS; i++)
+        saturated |= bucket->events[i] == UINT16_MAX;
+    uint32_t start = (bucket->start / 60) & 0x03FFFFFF;
+    start |= (uint32_t)(level & 0x03) << 26;
+    if(saturated)
+        start |= 1UL << 30;
+    if(level & DS3231_ROLLUP_PARTIAL)
+        start |= 1UL << 31;
+    ds3231_rollup_put16(&record[0], start & 0xFFFF);
+    ds3231_rollup_put16(&record[2], start >> 16);
+    ds3231_rollup_put16(&record[4], bucket->count > UINT16_MAX ? UINT16_MAX : bucket->count);
+    ds3231_rollup_put16(&record[6], (uint16_t)mean);
+    record[8] = below > 0xFF ? 0xFF : below;
+    record[9] = above > 0xFF ? 0xFF : above;
+    for(int i = 0; i < DS3231_ROLLUP_EVENTS; i++)
+        ds3231_rollup_put16(&record[10 + 2 * i], bucket->events[i]);
+    return 0;
+}
+
+/**
+ * @brief               Decode a log record written by a rollup. The sum is rebuilt from the mean.
+ *
+ * @param[in] record    Record data.
+ * @param[in] length    Length of the record.
+ * @param[out] level    Level of the record, with DS3231_ROLLUP_PARTIAL if it was flushed early and
+ *                      DS3231_ROLLUP_SATURATED if a count did not fit.
+ * @param[out] bucket   Decoded bucket.
+ * @return              0 if succesful, -1 if the record is not a rollup record.
+ */
+int ds3231_rollup_decode(const uint8_t * record, uint8_t length, uint8_t * level, ds3231_rollup_bucket_t * bucket) {
+    if(length != DS3231_ROLLUP_RECORD_SIZE)
+        return -1;
+    uint32_t start = ds3231_rollup_get16(&record[0]) | ((uint32_t)ds3231_rollup_get16(&record[2]) << 16);
+    *level = (start >> 26) & 0x03;
+    if(*level >= DS3231_ROLLUP_LEVEL_COUNT)
+        return -1;
+    if(start & (1UL << 30))
+        *level |= DS3231_ROLLUP_SATURATED;
+    if(start & (1UL << 31))
+        *level |= DS3231_ROLLUP_PARTIAL;
+    int16_t mean = (int16_t)ds3231_rollup_get16(&record[6]);
+    bucket->start = (start & 0x03FFFFFF) * 60;
+    bucket->count = ds3231_rollup_get16(&record[4]);
+    bucket->min = mean - record[8];
+    bucket->max = mean + record[9];
+    bucket->sum = (int32_t)mean * bucket->count;
+    for(int i = 0; i < DS3231_ROLLUP_EVENTS; i++)
+        bucket->events[i] = ds3231_rollup_get16(&record[10 + 2 * i]);
+    bucket->open = false;
+    return 0;
+}
+
+/**
+ * @brief               Mean temperature of a bucket in degrees.
+ *
+ * @param[in] bucket    Bucket struct.
+ * @return              Mean temperature, 0 if the bucket has no temperature samples.
+ */
+float ds3231_rollup_mean(const ds3231_rollup_bucket_t * bucket) {
+    if(!bucket->count)
+        return 0.0f;
+    return (float)bucket->sum / bucket->count / 4.0f;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file    ds3231_rollup.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Per-minute, per-hour, per-day and per-week rollups of temperature and event counts.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_log.h"
+
+#ifndef DS_3231_ROLLUP
+#define DS_3231_ROLLUP
+
+/* Number of event counters kept per bucket. */
+#ifndef DS3231_ROLLUP_EVENTS
+#define DS3231_ROLLUP_EVENTS            2
+#endif
+
+enum DS3231_ROLLUP_LEVELS {
+    DS3231_ROLLUP_MINUTE = 0,
+    DS3231_ROLLUP_HOUR,
+    DS3231_ROLLUP_DAY,
+    DS3231_ROLLUP_WEEK,
+    DS3231_ROLLUP_LEVEL_COUNT
+};
+
+/* Masks of the levels whose completed buckets are written to the log. */
+#define DS3231_ROLLUP_PERSIST_MINUTE    (1 << DS3231_ROLLUP_MINUTE)
+#define DS3231_ROLLUP_PERSIST_HOUR      (1 << DS3231_ROLLUP_HOUR)
+#define DS3231_ROLLUP_PERSIST_DAY       (1 << DS3231_ROLLUP_DAY)
+#define DS3231_ROLLUP_PERSIST_WEEK      (1 << DS3231_ROLLUP_WEEK)
+
+/* Set in the level of a record written by ds3231_rollup_flush before the bucket ended. */
+#define DS3231_ROLLUP_PARTIAL           0x80
+/* Set in the level of a record whose sample count or an event counter did not fit in 16 bits.
+The stored count and counters are 65535 then, the mean is still that of all samples. */
+#define DS3231_ROLLUP_SATURATED         0x40
+
+/* Start minute with the level in its top bits, count, mean, min and max below and above the mean,
+and the event counters. With 2 events two records fit in a 32 byte page. */
+#define DS3231_ROLLUP_RECORD_SIZE       (10 + 2 * DS3231_ROLLUP_EVENTS)
+
+/**
+ * @brief Struct to hold one bucket. Temperatures are in 0.25 degree steps, as the DS3231 reports them.
+ *
+ */
+typedef struct ds3231_rollup_bucket_t {
+    uint32_t start;             // Seconds since 2000-01-01 00:00:00, see ds3231_time_to_epoch.
+    uint32_t count;             // Temperature samples.
+    int16_t min;
+    int16_t max;
+    int32_t sum;                // Holds a week of samples every second.
+    uint16_t events[DS3231_ROLLUP_EVENTS];
+    bool open;
+} ds3231_rollup_bucket_t;
+
+/**
+ * @brief Struct to hold the open bucket of every level.
+ *
+ */
+typedef struct ds3231_rollup_t {
+    ds3231_log_t * logs[DS3231_ROLLUP_LEVEL_COUNT];     // Log of every level, NULL to keep it in RAM only.
+    ds3231_rollup_bucket_t buckets[DS3231_ROLLUP_LEVEL_COUNT];
+    uint32_t records_written;
+} ds3231_rollup_t;
+
+int ds3231_rollup_init(ds3231_rollup_t * rollup, ds3231_log_t * log, uint8_t persist);
+int ds3231_rollup_set_log(ds3231_rollup_t * rollup, ds3231_log_t * log, uint8_t persist);
+int ds3231_rollup_add_temperature(ds3231_rollup_t * rollup, uint32_t epoch, float temperature);
+int ds3231_rollup_add_event(ds3231_rollup_t * rollup, uint32_t epoch, uint8_t event);
+int ds3231_rollup_flush(ds3231_rollup_t * rollup);
+
+int ds3231_rollup_encode(uint8_t level, const ds3231_rollup_bucket_t * bucket, uint8_t * record);
+int ds3231_rollup_decode(const uint8_t * record, uint8_t length, uint8_t * level, ds3231_rollup_bucket_t * bucket);
+float ds3231_rollup_mean(const ds3231_rollup_bucket_t * bucket);
+
+#endif
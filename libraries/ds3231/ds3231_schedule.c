@@ -0,0 +1,315 @@
+/**
+ * @file    ds3231_schedule.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Alarm schedule kept in a storage device, with catch-up of alarms missed while powered down.
+ * The schedule is a table of up to DS3231_SCHEDULE_MAX alarms with a next deadline and a period,
+ * stored as a fixed image so it is restored by ds3231_schedule_init after a reboot. Like the
+ * superblock, the image is kept in two copies with a sequence number and a CRC. A save goes to the
+ * older copy, so a reset in the middle of it leaves the newer one intact, and init takes the
+ * newest copy whose CRC matches. Only the bytes that differ from the older copy are written, with
+ * one program per page, so advancing a single alarm usually costs two write cycles, one for the
+ * entry and one for the sequence number and CRC.
+ * ds3231_schedule_run takes the current DS3231 time, works out in one pass how many deadlines of
+ * every alarm are due, and dispatches them in deadline order, also across alarms. The same call
+ * handles a normal alarm and the catch-up after a power loss. ds3231_schedule_arm then sets DS3231
+ * alarm 1 to the next deadline, so the usual loop is: read the time, run, arm, sleep until the
+ * INT/SQW pin goes low.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_schedule.h"
+#include "ds3231_link.h"
+#include <string.h>
+
+static void ds3231_schedule_put_u32(uint8_t * data, uint32_t value) {
+    data[0] = value & 0xFF;
+    data[1] = (value >> 8) & 0xFF;
+    data[2] = (value >> 16) & 0xFF;
+    data[3] = value >> 24;
+}
+
+static uint32_t ds3231_schedule_get_u32(const uint8_t * data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint32_t ds3231_schedule_pages(ds3231_storage_t * storage) {
+    return (DS3231_SCHEDULE_IMAGE_SIZE + storage->page_size - 1) / storage->page_size;
+}
+
+static void ds3231_schedule_encode(ds3231_schedule_t * sched, uint8_t sequence, uint8_t * image) {
+    image[0] = DS3231_SCHEDULE_MAGIC;
+    for(uint8_t i = 0; i < DS3231_SCHEDULE_MAX; i++) {
+        uint8_t * entry = &image[1 + i * DS3231_SCHEDULE_ENTRY_SIZE];
+        ds3231_schedule_put_u32(&entry[0], sched->entries[i].next);
+        ds3231_schedule_put_u32(&entry[4], sched->entries[i].period_s);
+        entry[8] = sched->entries[i].id;
+        entry[9] = sched->entries[i].flags;
+    }
+    image[DS3231_SCHEDULE_IMAGE_SIZE - 3] = sequence;
+    uint16_t crc = ds3231_link_crc16(0xFFFF, image, DS3231_SCHEDULE_IMAGE_SIZE - 2);
+    image[DS3231_SCHEDULE_IMAGE_SIZE - 2] = crc & 0xFF;
+    image[DS3231_SCHEDULE_IMAGE_SIZE - 1] = crc >> 8;
+}
+
+static bool ds3231_schedule_valid(const uint8_t * image) {
+    if(image[0] != DS3231_SCHEDULE_MAGIC)
+        return false;
+    uint16_t crc = ds3231_link_crc16(0xFFFF, image, DS3231_SCHEDULE_IMAGE_SIZE - 2);
+    return image[DS3231_SCHEDULE_IMAGE_SIZE - 2] == (crc & 0xFF) && image[DS3231_SCHEDULE_IMAGE_SIZE - 1] == (crc >> 8);
+}
+
+/* Write the schedule to the older copy with the next sequence number, programming the bytes that
+differ from that copy, one range per page. */
+static int ds3231_schedule_save(ds3231_schedule_t * sched) {
+    uint8_t image[DS3231_SCHEDULE_IMAGE_SIZE];
+    uint32_t page_size = sched->storage->page_size;
+    uint8_t copy = (sched->copy + 1) % DS3231_SCHEDULE_COPIES;
+    uint8_t * stored = sched->stored[copy];
+    uint32_t first_page = sched->first_page + copy * ds3231_schedule_pages(sched->storage);
+    ds3231_schedule_encode(sched, sched->sequence + 1, image);
+
+    for(uint32_t base = 0; base < DS3231_SCHEDULE_IMAGE_SIZE; base += page_size) {
+        uint32_t end = base + page_size;
+        if(end > DS3231_SCHEDULE_IMAGE_SIZE)
+            end = DS3231_SCHEDULE_IMAGE_SIZE;
+        uint32_t first = base;
+        while(first < end && image[first] == stored[first])
+            first++;
+        if(first == end)
+            continue;
+        uint32_t last = end - 1;
+        while(image[last] == stored[last])
+            last--;
+        /* The newer copy is still the current one, the next save writes this one again. */
+        if(ds3231_storage_program(sched->storage, first_page + base / page_size,
+            first - base, last - first + 1, &image[first]))
+            return -1;
+        memcpy(&stored[first], &image[first], last - first + 1);
+    }
+    sched->copy = copy;
+    sched->sequence++;
+    return 0;
+}
+
+static ds3231_schedule_entry_t * ds3231_schedule_find(ds3231_schedule_t * sched, uint8_t id) {
+    for(uint8_t i = 0; i < DS3231_SCHEDULE_MAX; i++) {
+        if(sched->entries[i].flags && sched->entries[i].id == id)
+            return &sched->entries[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief                   Load a schedule from a storage device, from the newest copy with a
+ * valid CRC. A device without a valid copy gets an empty schedule.
+ *
+ * @param[out] sched        Schedule struct.
+ * @param[in] storage       Storage device, rewritten in place.
+ * @param[in] first_page    First of the pages that hold the schedule. Each copy takes
+ *                          DS3231_SCHEDULE_IMAGE_SIZE bytes rounded up to whole pages.
+ * @return                  0 if succesful, -1 if the pages are out of range or could not be read
+ *                          or written.
+ */
+int ds3231_schedule_init(ds3231_schedule_t * sched, ds3231_storage_t * storage, uint32_t first_page) {
+    uint32_t pages = ds3231_schedule_pages(storage);
+    if(first_page + DS3231_SCHEDULE_COPIES * pages > storage->page_count)
+        return -1;
+
+    memset(sched, 0, sizeof(*sched));
+    sched->storage = storage;
+    sched->first_page = first_page;
+    bool found = false;
+    for(uint8_t copy = 0; copy < DS3231_SCHEDULE_COPIES; copy++) {
+        const uint8_t * image = sched->stored[copy];
+        if(ds3231_storage_read(storage, first_page + copy * pages, 0, DS3231_SCHEDULE_IMAGE_SIZE, sched->stored[copy]))
+            return -1;
+        if(!ds3231_schedule_valid(image))
+            continue;
+        /* Sequence numbers wrap, the newer copy is one save ahead. */
+        uint8_t sequence = image[DS3231_SCHEDULE_IMAGE_SIZE - 3];
+        if(found && (int8_t)(sequence - sched->sequence) <= 0)
+            continue;
+        sched->copy = copy;
+        sched->sequence = sequence;
+        found = true;
+    }
+    if(!found) {
+        sched->copy = DS3231_SCHEDULE_COPIES - 1;
+        return ds3231_schedule_save(sched);
+    }
+
+    for(uint8_t i = 0; i < DS3231_SCHEDULE_MAX; i++) {
+        const uint8_t * entry = &sched->stored[sched->copy][1 + i * DS3231_SCHEDULE_ENTRY_SIZE];
+        sched->entries[i].next = ds3231_schedule_get_u32(&entry[0]);
+        sched->entries[i].period_s = ds3231_schedule_get_u32(&entry[4]);
+        sched->entries[i].id = entry[8];
+        sched->entries[i].flags = entry[9];
+    }
+    return 0;
+}
+
+/**
+ * @brief                       Add an alarm to the schedule and store it. An alarm with the same id
+ * is replaced.
+ *
+ * @param[in] sched             Schedule struct.
+ * @param[in] id                Id passed to the callback.
+ * @param[in] first_deadline    First deadline in seconds since 2000. A deadline in the past is
+ *                              caught up on the next run.
+ * @param[in] period_s          Seconds between deadlines, 0 for an alarm that fires once.
+ * @param[in] flags             DS3231_SCHEDULE_COALESCE or 0.
+ * @return                      0 if succesful, -1 if the schedule is full or could not be stored.
+ */
+int ds3231_schedule_add(ds3231_schedule_t * sched, uint8_t id, uint32_t first_deadline, uint32_t period_s, uint8_t flags) {
+    ds3231_schedule_entry_t * entry = ds3231_schedule_find(sched, id);
+    for(uint8_t i = 0; i < DS3231_SCHEDULE_MAX && !entry; i++) {
+        if(!sched->entries[i].flags)
+            entry = &sched->entries[i];
+    }
+    if(!entry)
+        return -1;
+    entry->next = first_deadline;
+    entry->period_s = period_s;
+    entry->id = id;
+    entry->flags = flags | DS3231_SCHEDULE_ENABLED;
+    return ds3231_schedule_save(sched);
+}
+
+/**
+ * @brief               Remove an alarm from the schedule and store it.
+ *
+ * @param[in] sched     Schedule struct.
+ * @param[in] id        Id of the alarm.
+ * @return              0 if succesful, -1 if there is no such alarm or the schedule could not be stored.
+ */
+int ds3231_schedule_remove(ds3231_schedule_t * sched, uint8_t id) {
+    ds3231_schedule_entry_t * entry = ds3231_schedule_find(sched, id);
+    if(!entry)
+        return -1;
+    entry->flags = 0;
+    return ds3231_schedule_save(sched);
+}
+
+/**
+ * @brief                   Get the earliest deadline of the schedule.
+ *
+ * @param[in] sched         Schedule struct.
+ * @param[out] deadline     Earliest deadline in seconds since 2000.
+ * @return                  1 if an alarm is scheduled, 0 if the schedule is empty.
+ */
+int ds3231_schedule_next(ds3231_schedule_t * sched, uint32_t * deadline) {
+    int found = 0;
+    for(uint8_t i = 0; i < DS3231_SCHEDULE_MAX; i++) {
+        ds3231_schedule_entry_t * entry = &sched->entries[i];
+        if(!(entry->flags & DS3231_SCHEDULE_ENABLED))
+            continue;
+        if(!found || entry->next < *deadline)
+            *deadline = entry->next;
+        found = 1;
+    }
+    return found;
+}
+
+/**
+ * @brief               Dispatch every deadline up to now in deadline order, advance the alarms
+ * past now and store the schedule. Alarms that fire once are removed. The callback must not change
+ * the schedule, every periodic alarm that was missed for a long time should be coalesced.
+ *
+ * @param[in] sched     Schedule struct.
+ * @param[in] now       Current DS3231 time in seconds since 2000.
+ * @param[in] callback  Function called for each due deadline, or once per coalesced alarm.
+ * @param[in] ctx       Passed to the callback.
+ * @return              Number of callbacks, -1 if the schedule could not be stored.
+ */
+int ds3231_schedule_run(ds3231_schedule_t * sched, uint32_t now, ds3231_schedule_callback_t callback, void * ctx) {
+    uint32_t due[DS3231_SCHEDULE_MAX];
+    uint32_t total = 0;
+
+    /* Single pass: the number of due deadlines of every alarm follows from its period. */
+    for(uint8_t i = 0; i < DS3231_SCHEDULE_MAX; i++) {
+        ds3231_schedule_entry_t * entry = &sched->entries[i];
+        due[i] = 0;
+        if(!(entry->flags & DS3231_SCHEDULE_ENABLED) || entry->next > now)
+            continue;
+        due[i] = entry->period_s ? (now - entry->next) / entry->period_s + 1 : 1;
+        uint32_t last = entry->next + (due[i] - 1) * entry->period_s;
+        sched->missed += (last < now) ? due[i] : due[i] - 1;
+        total += due[i];
+    }
+    if(!total)
+        return 0;
+
+    int calls = 0;
+    while(total) {
+        uint8_t first = DS3231_SCHEDULE_MAX;
+        for(uint8_t i = 0; i < DS3231_SCHEDULE_MAX; i++) {
+            if(due[i] && (first == DS3231_SCHEDULE_MAX || sched->entries[i].next < sched->entries[first].next))
+                first = i;
+        }
+        ds3231_schedule_entry_t * entry = &sched->entries[first];
+        uint32_t count = (entry->flags & DS3231_SCHEDULE_COALESCE) ? due[first] : 1;
+        callback(ctx, entry->id, entry->next, count);
+        calls++;
+
+        due[first] -= count;
+        total -= count;
+        if(entry->period_s)
+            entry->next += count * entry->period_s;
+        else
+            entry->flags = 0;
+    }
+    sched->dispatched += calls;
+
+    if(ds3231_schedule_save(sched))
+        return -1;
+    return calls;
+}
+
+/**
+ * @brief               Set DS3231 alarm 1 to the next deadline of the schedule and clear its alarm
+ * flag. The INT/SQW pin only signals the alarm after ds3231_enable_alarm_interrupt. Alarm 1 matches
+ * the date and time, so a deadline more than a month away fires early once; the following run
+ * dispatches nothing and arms it again.
+ *
+ * @param[in] sched     Schedule struct, run with the same now before.
+ * @param[in] rtc       DS3231 struct.
+ * @param[in] now       Current DS3231 time in seconds since 2000.
+ * @return              0 if succesful, 1 if the schedule is empty and the alarm was not set,
+ *                      -1 if the DS3231 could not be written or the pin arbiter or a hybrid
+ *                      alarm engine owns alarm 1, see DS3231_INT_OWNERS.
+ */
+int ds3231_schedule_arm(ds3231_schedule_t * sched, ds3231_t * rtc, uint32_t now) {
+    DS3231_CRUMB_API(DS3231_CRUMB_SCHEDULE_ARM);
+    if(rtc->int_owner != DS3231_INT_FREE)
+        return -1;
+    uint8_t status = 0;
+    if(i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
+        return -1;
+    /* Only flags written 0 clear, so A2F and OSF are written 1 in case they were raised meanwhile. */
+    status = (status & ~(0x01)) | (0x01 << 1) | (0x01 << 7);
+    if(i2c_write_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
+        return -1;
+
+    uint32_t deadline = 0;
+    if(!ds3231_schedule_next(sched, &deadline))
+        return 1;
+    /* A match on a second that already ticked by while writing would only come a month later. */
+    if(deadline < now + 2)
+        deadline = now + 2;
+
+    ds3231_data_t time;
+    ds3231_epoch_to_time(rtc, deadline, &time);
+    ds3231_alarm_1_t alarm = {
+        .seconds = time.seconds,
+        .minutes = time.minutes,
+        .hours = time.hours,
+        .am_pm = time.am_pm,
+        .day = time.day,
+        .date = time.date
+    };
+    return ds3231_set_alarm_1(rtc, &alarm, ON_MATCHING_SECOND_MINUTE_HOUR_AND_DATE);
+}
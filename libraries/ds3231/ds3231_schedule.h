@@ -0,0 +1,76 @@
+/**
+ * @file    ds3231_schedule.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Alarm schedule kept in a storage device, with catch-up of alarms missed while powered down.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231.h"
+#include "ds3231_storage.h"
+
+#ifndef DS_3231_SCHEDULE
+#define DS_3231_SCHEDULE
+
+/* Number of alarms in a schedule. */
+#ifndef DS3231_SCHEDULE_MAX
+#define DS3231_SCHEDULE_MAX             8
+#endif
+
+/* Stored image: magic byte, then per alarm the next deadline and the period as little endian
+32-bit seconds, the id and the flags, then a sequence number and a CRC-16 of the bytes before it.
+8 alarms take 84 bytes, 3 AT24C32 pages. Two copies follow each other, 6 pages in all. */
+#define DS3231_SCHEDULE_MAGIC           0xA2
+#define DS3231_SCHEDULE_COPIES          2
+#define DS3231_SCHEDULE_ENTRY_SIZE      10
+#define DS3231_SCHEDULE_IMAGE_SIZE      (4 + DS3231_SCHEDULE_ENTRY_SIZE * DS3231_SCHEDULE_MAX)
+
+enum DS3231_SCHEDULE_FLAGS {
+    DS3231_SCHEDULE_ENABLED  = 0x01,
+    DS3231_SCHEDULE_COALESCE = 0x02     // Missed deadlines of a periodic alarm are dispatched as one.
+};
+
+/**
+ * @brief Function called for each due alarm. count is the number of deadlines the call stands for,
+ * more than 1 only for coalesced alarms that were missed.
+ *
+ */
+typedef void (*ds3231_schedule_callback_t)(void * ctx, uint8_t id, uint32_t deadline, uint32_t count);
+
+/**
+ * @brief Struct to hold an alarm of a schedule. Deadlines are seconds since 2000, see ds3231_time_to_epoch.
+ *
+ */
+typedef struct ds3231_schedule_entry_t {
+    uint32_t next;          // Next deadline.
+    uint32_t period_s;      // 0 for an alarm that fires once.
+    uint8_t id;
+    uint8_t flags;          // 0 if the entry is free.
+} ds3231_schedule_entry_t;
+
+/**
+ * @brief Struct to hold a schedule and the images of it that are in the storage device.
+ *
+ */
+typedef struct ds3231_schedule_t {
+    ds3231_storage_t * storage;
+    uint32_t first_page;
+    ds3231_schedule_entry_t entries[DS3231_SCHEDULE_MAX];
+    uint8_t stored[DS3231_SCHEDULE_COPIES][DS3231_SCHEDULE_IMAGE_SIZE];
+    uint8_t copy;           // Copy with the newest valid image.
+    uint8_t sequence;       // Its sequence number.
+    uint32_t dispatched;    // Callbacks made.
+    uint32_t missed;        // Deadlines that were already over by more than a second when run.
+} ds3231_schedule_t;
+
+int ds3231_schedule_init(ds3231_schedule_t * sched, ds3231_storage_t * storage, uint32_t first_page);
+int ds3231_schedule_add(ds3231_schedule_t * sched, uint8_t id, uint32_t first_deadline, uint32_t period_s, uint8_t flags);
+int ds3231_schedule_remove(ds3231_schedule_t * sched, uint8_t id);
+int ds3231_schedule_next(ds3231_schedule_t * sched, uint32_t * deadline);
+int ds3231_schedule_run(ds3231_schedule_t * sched, uint32_t now, ds3231_schedule_callback_t callback, void * ctx);
+int ds3231_schedule_arm(ds3231_schedule_t * sched, ds3231_t * rtc, uint32_t now);
+
+#endif
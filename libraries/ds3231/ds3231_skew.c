@@ -0,0 +1,313 @@
+/**
+ * @file    ds3231_skew.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Phase skew and drift between the seconds of several DS3231 modules, measured by PIO.
+ * The 1 Hz SQW outputs of up to 8 modules are wired to consecutive GPIOs. A PIO state machine
+ * samples them every 7 system clock cycles and pushes the count of its own counter whenever one
+ * changes, so every edge is timestamped against the same counter, 56 ns per count at 125 MHz.
+ * A DMA channel drains the RX FIFO into a ring buffer and ds3231_skew_poll turns the records into
+ * falling edges, the seconds boundaries of DS3231.
+ * Every module is measured against a reference module. The skew is the time from the reference
+ * boundary to the module boundary, folded into half a second either way; it is tracked unwrapped
+ * so its rate, the drift, stays valid when it crosses the fold. The drift is taken over a window
+ * that starts when the module is first seen or restarted, and is what the aging offset of the
+ * module is corrected from. The RP2040 crystal only scales both edges of a pair, its own error
+ * does not show up in the drift.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_skew.h"
+#include "ds3231_skew.pio.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/timer.h"
+
+static int64_t ds3231_skew_fold(ds3231_skew_t * skew, int64_t counts) {
+    int64_t period = skew->counts_per_s;
+    int64_t folded = counts % period;
+    if(folded > period / 2)
+        folded -= period;
+    else if(folded <= -period / 2)
+        folded += period;
+    return folded;
+}
+
+static void ds3231_skew_edge(ds3231_skew_t * skew, uint8_t index) {
+    ds3231_skew_channel_t * channel = &skew->channels[index];
+    ds3231_skew_channel_t * reference = &skew->channels[skew->reference];
+    channel->edge = skew->now;
+    channel->seen = true;
+    skew->edges++;
+    if(index == skew->reference) {
+        channel->skew = 0;
+        channel->tracking = true;
+        return;
+    }
+    if(!reference->seen)
+        return;
+
+    /* Against the last reference edge, which may be a second before. */
+    int64_t raw = (int64_t)(channel->edge - reference->edge);
+    if(!channel->tracking) {
+        channel->tracking = true;
+        channel->skew = ds3231_skew_fold(skew, raw);
+        channel->first_edge = channel->edge;
+        channel->first_skew = channel->skew;
+        channel->drift_ppb = 0;
+        return;
+    }
+    channel->skew += ds3231_skew_fold(skew, raw - channel->skew);
+    uint64_t window = channel->edge - channel->first_edge;
+    if(window)
+        channel->drift_ppb = (int32_t)((channel->skew - channel->first_skew) * 1000000000 / (int64_t)window);
+}
+
+static void ds3231_skew_record(ds3231_skew_t * skew, uint32_t pins, uint32_t count) {
+    /* The counter counts down from 0. */
+    uint32_t elapsed = 0u - count;
+    skew->now += (uint32_t)(elapsed - skew->last_count);
+    skew->last_count = elapsed;
+
+    pins &= (1u << skew->count) - 1;
+    uint32_t falling = skew->pins & ~pins;
+    skew->pins = pins;
+    for(uint8_t i = 0; i < skew->count; i++) {
+        if(falling & (1u << i))
+            ds3231_skew_edge(skew, i);
+    }
+}
+
+/**
+ * @brief                   Start measuring the SQW outputs of several DS3231 modules. Claims a state
+ * machine of pio, a DMA channel and room for the PIO program. SQW must be set to 1 Hz on every
+ * module, see ds3231_set_square_wave_frequency.
+ *
+ * @param[out] skew         Skew measurement struct.
+ * @param[in] pio           PIO block to run the program on.
+ * @param[in] base_gpio     GPIO of the first module, the others follow it.
+ * @param[in] count         Number of modules, 1 to DS3231_SKEW_MAX_CHANNELS. The program always
+ *                          samples 8 GPIOs, the ones after the last module are ignored.
+ * @param[in] reference     Module the others are measured against.
+ * @return                  0 if succesful, -1 if parameters are invalid or PIO or DMA resources
+ *                          are not available.
+ */
+int ds3231_skew_init(ds3231_skew_t * skew, PIO pio, uint base_gpio, uint8_t count, uint8_t reference) {
+    if(!count || count > DS3231_SKEW_MAX_CHANNELS || reference >= count || base_gpio + count > 30)
+        return -1;
+    skew->pio = pio;
+    skew->base_gpio = base_gpio;
+    skew->count = count;
+    skew->reference = reference;
+    skew->counts_per_s = clock_get_hz(clk_sys) / DS3231_SKEW_CYCLES_PER_COUNT;
+    skew->read_index = 0;
+    skew->last_count = 0;
+    skew->now = 0;
+    skew->last_record_us = time_us_64();
+    skew->pins = 0;
+    skew->edges = 0;
+    for(uint8_t i = 0; i < DS3231_SKEW_MAX_CHANNELS; i++) {
+        skew->channels[i].seen = false;
+        skew->channels[i].tracking = false;
+        skew->channels[i].drift_ppb = 0;
+    }
+
+    int sm = pio_claim_unused_sm(pio, false);
+    if(sm < 0)
+        return -1;
+    if(!pio_can_add_program(pio, &ds3231_skew_program)) {
+        pio_sm_unclaim(pio, sm);
+        return -1;
+    }
+    skew->dma_channel = dma_claim_unused_channel(false);
+    if(skew->dma_channel < 0) {
+        pio_sm_unclaim(pio, sm);
+        return -1;
+    }
+    skew->sm = sm;
+    skew->offset = pio_add_program(pio, &ds3231_skew_program);
+    ds3231_skew_program_init(pio, skew->sm, skew->offset, base_gpio, count);
+
+    dma_channel_config config = dma_channel_get_default_config(skew->dma_channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, DS3231_SKEW_RING_BITS);
+    channel_config_set_dreq(&config, pio_get_dreq(pio, skew->sm, false));
+    dma_channel_configure(skew->dma_channel, &config, skew->ring, &pio->rxf[skew->sm], 0xFFFFFFFF, true);
+
+    pio_sm_set_enabled(pio, skew->sm, true);
+    return 0;
+}
+
+/**
+ * @brief               Stop measuring and release the PIO and DMA resources.
+ *
+ * @param[in] skew      Skew measurement struct.
+ */
+void ds3231_skew_deinit(ds3231_skew_t * skew) {
+    pio_sm_set_enabled(skew->pio, skew->sm, false);
+    dma_channel_abort(skew->dma_channel);
+    dma_channel_unclaim(skew->dma_channel);
+    pio_remove_program(skew->pio, &ds3231_skew_program, skew->offset);
+    pio_sm_unclaim(skew->pio, skew->sm);
+}
+
+/**
+ * @brief               Process the edges captured since the last call. Call it from the main loop,
+ * at least every 4 seconds with 8 modules so the ring buffer does not overrun.
+ *
+ * @param[in] skew      Skew measurement struct.
+ * @return              Number of edge records processed.
+ */
+int ds3231_skew_poll(ds3231_skew_t * skew) {
+    uint32_t write_index = (dma_channel_hw_addr(skew->dma_channel)->write_addr - (uintptr_t)skew->ring) / 4;
+    uint32_t mask = DS3231_SKEW_RING_WORDS - 1;
+    int records = 0;
+
+    uint64_t now_us = time_us_64();
+    if(((write_index - skew->read_index) & mask) >= 2) {
+        /* After a long silence the counter may have wrapped, start over. */
+        if(now_us - skew->last_record_us > DS3231_SKEW_STALE_US) {
+            for(uint8_t i = 0; i < skew->count; i++) {
+                skew->channels[i].seen = false;
+                skew->channels[i].tracking = false;
+            }
+        }
+        skew->last_record_us = now_us;
+    }
+    while(((write_index - skew->read_index) & mask) >= 2) {
+        ds3231_skew_record(skew, skew->ring[skew->read_index], skew->ring[(skew->read_index + 1) & mask]);
+        skew->read_index = (skew->read_index + 2) & mask;
+        records++;
+    }
+
+    /* 2^32 records last for years, restart the channel once they are used up. */
+    if(!dma_channel_is_busy(skew->dma_channel))
+        dma_channel_set_trans_count(skew->dma_channel, 0xFFFFFFFF, true);
+    return records;
+}
+
+/**
+ * @brief                   Get the phase skew between the seconds of two modules.
+ *
+ * @param[in] skew          Skew measurement struct.
+ * @param[in] a             First module.
+ * @param[in] b             Second module.
+ * @param[out] skew_ns      Time from the boundary of b to the boundary of a, within half a second.
+ * @return                  0 if succesful, -1 if a module is invalid or not measured yet.
+ */
+int ds3231_skew_pair_ns(ds3231_skew_t * skew, uint8_t a, uint8_t b, int32_t * skew_ns) {
+    if(a >= skew->count || b >= skew->count)
+        return -1;
+    if(!skew->channels[a].tracking || !skew->channels[b].tracking)
+        return -1;
+    int64_t counts = ds3231_skew_fold(skew, skew->channels[a].skew - skew->channels[b].skew);
+    *skew_ns = (int32_t)(counts * 1000000000 / skew->counts_per_s);
+    return 0;
+}
+
+/**
+ * @brief                   Get the drift rate between two modules.
+ *
+ * @param[in] skew          Skew measurement struct.
+ * @param[in] a             First module.
+ * @param[in] b             Second module.
+ * @param[out] drift_ppb    Rate of the skew of a against b, negative if a runs faster.
+ * @return                  0 if succesful, -1 if a module is invalid or not measured yet.
+ */
+int ds3231_skew_pair_drift_ppb(ds3231_skew_t * skew, uint8_t a, uint8_t b, int32_t * drift_ppb) {
+    if(a >= skew->count || b >= skew->count)
+        return -1;
+    if(!skew->channels[a].tracking || !skew->channels[b].tracking)
+        return -1;
+    *drift_ppb = skew->channels[a].drift_ppb - skew->channels[b].drift_ppb;
+    return 0;
+}
+
+/**
+ * @brief               Restart the drift window of a module, e.g. after its aging offset changed.
+ *
+ * @param[in] skew      Skew measurement struct.
+ * @param[in] channel   Module to restart.
+ */
+void ds3231_skew_restart(ds3231_skew_t * skew, uint8_t channel) {
+    if(channel < skew->count && channel != skew->reference)
+        skew->channels[channel].tracking = false;
+}
+
+/**
+ * @brief               Suggest an aging offset that cancels the drift of a module against the
+ * reference. Positive offsets slow the oscillator by about 0.1 ppm per step.
+ *
+ * @param[in] skew      Skew measurement struct.
+ * @param[in] channel   Module to correct.
+ * @param[in] current   Aging offset the module has now.
+ * @param[out] offset   Suggested aging offset.
+ * @return              1 if the offset should change, 0 if not, -1 if the drift window is shorter
+ *                      than DS3231_SKEW_MIN_WINDOW_S.
+ */
+int ds3231_skew_suggest_aging(ds3231_skew_t * skew, uint8_t channel, int8_t current, int8_t * offset) {
+    *offset = current;
+    if(channel >= skew->count)
+        return -1;
+    if(channel == skew->reference)
+        return 0;
+    ds3231_skew_channel_t * c = &skew->channels[channel];
+    if(!c->tracking || c->edge - c->first_edge < (uint64_t)DS3231_SKEW_MIN_WINDOW_S * skew->counts_per_s)
+        return -1;
+
+    int32_t drift = c->drift_ppb;
+    int32_t steps = (drift < 0 ? -drift + DS3231_SKEW_AGING_STEP_PPB / 2 : -drift - DS3231_SKEW_AGING_STEP_PPB / 2)
+        / DS3231_SKEW_AGING_STEP_PPB;
+    int32_t suggested = current + steps;
+    if(suggested > 127)
+        suggested = 127;
+    else if(suggested < -128)
+        suggested = -128;
+    *offset = (int8_t)suggested;
+    return suggested != current;
+}
+
+/**
+ * @brief               Get the modules whose drift is worth at least one aging offset step.
+ *
+ * @param[in] skew      Skew measurement struct.
+ * @return              Bit mask of the modules, bit 0 for the module on base_gpio.
+ */
+uint8_t ds3231_skew_needs_aging(ds3231_skew_t * skew) {
+    uint8_t mask = 0;
+    int8_t offset;
+    for(uint8_t i = 0; i < skew->count; i++) {
+        if(ds3231_skew_suggest_aging(skew, i, 0, &offset) == 1)
+            mask |= (0x01 << i);
+    }
+    return mask;
+}
+
+/**
+ * @brief               Apply the suggested aging offset to a module and restart its drift window.
+ * A conversion is forced so the offset takes effect at once.
+ *
+ * @param[in] skew      Skew measurement struct.
+ * @param[in] channel   Module to correct.
+ * @param[in] rtc       DS3231 struct of the module.
+ * @param[in] current   Aging offset the module has now.
+ * @return              1 if the offset was changed, 0 if not, -1 if the drift window is too
+ *                      short or i2c failure.
+ */
+int ds3231_skew_correct(ds3231_skew_t * skew, uint8_t channel, ds3231_t * rtc, int8_t current) {
+    int8_t offset;
+    int result = ds3231_skew_suggest_aging(skew, channel, current, &offset);
+    if(result != 1)
+        return result;
+    if(ds3231_set_aging_offset(rtc, offset))
+        return -1;
+    /* Fails only if a conversion is already running, which applies the offset as well. */
+    ds3231_force_convert_temperature(rtc);
+    ds3231_skew_restart(skew, channel);
+    return 1;
+}
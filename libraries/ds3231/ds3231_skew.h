@@ -0,0 +1,81 @@
+/**
+ * @file    ds3231_skew.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Phase skew and drift between the seconds of several DS3231 modules, measured by PIO.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231.h"
+#include "hardware/pio.h"
+
+#ifndef DS_3231_SKEW
+#define DS_3231_SKEW
+
+#define DS3231_SKEW_MAX_CHANNELS        8
+
+/* Ring buffer of edge records, 2 words each. Poll at least every 4 seconds with 8 modules. */
+#define DS3231_SKEW_RING_BITS           9
+#define DS3231_SKEW_RING_WORDS          ((1 << DS3231_SKEW_RING_BITS) / 4)
+
+/* Shortest drift window an aging offset is suggested from, and the drift worth one step of it. */
+#ifndef DS3231_SKEW_MIN_WINDOW_S
+#define DS3231_SKEW_MIN_WINDOW_S        600
+#endif
+#define DS3231_SKEW_AGING_STEP_PPB      100
+
+/* Records further apart than this can not be told apart once the counter wraps. */
+#define DS3231_SKEW_STALE_US            100000000
+
+/**
+ * @brief Struct to hold the seconds edges of one DS3231 module.
+ *
+ */
+typedef struct ds3231_skew_channel_t {
+    bool seen;
+    bool tracking;                  // skew and the drift window are valid.
+    uint64_t edge;                  // Last falling edge in counts.
+    int64_t skew;                   // Edge minus the reference edge, unwrapped.
+    uint64_t first_edge;            // Start of the drift window.
+    int64_t first_skew;
+    int32_t drift_ppb;              // Rate of the skew, negative if the module runs fast.
+} ds3231_skew_channel_t;
+
+/**
+ * @brief Struct to hold the state of the skew measurement. Times are counts of the PIO program,
+ * DS3231_SKEW_CYCLES_PER_COUNT system clock cycles each.
+ *
+ */
+typedef struct ds3231_skew_t {
+    uint32_t ring[DS3231_SKEW_RING_WORDS] __attribute__((aligned(1 << DS3231_SKEW_RING_BITS)));
+    PIO pio;
+    uint sm;
+    uint offset;
+    int dma_channel;
+    uint base_gpio;
+    uint8_t count;
+    uint8_t reference;              // Channel the others are measured against.
+    uint32_t counts_per_s;
+    uint32_t read_index;
+    uint32_t last_count;
+    uint64_t now;                   // Extended count of the last record.
+    uint64_t last_record_us;
+    uint8_t pins;
+    ds3231_skew_channel_t channels[DS3231_SKEW_MAX_CHANNELS];
+    uint32_t edges;
+} ds3231_skew_t;
+
+int ds3231_skew_init(ds3231_skew_t * skew, PIO pio, uint base_gpio, uint8_t count, uint8_t reference);
+void ds3231_skew_deinit(ds3231_skew_t * skew);
+int ds3231_skew_poll(ds3231_skew_t * skew);
+int ds3231_skew_pair_ns(ds3231_skew_t * skew, uint8_t a, uint8_t b, int32_t * skew_ns);
+int ds3231_skew_pair_drift_ppb(ds3231_skew_t * skew, uint8_t a, uint8_t b, int32_t * drift_ppb);
+void ds3231_skew_restart(ds3231_skew_t * skew, uint8_t channel);
+int ds3231_skew_suggest_aging(ds3231_skew_t * skew, uint8_t channel, int8_t current, int8_t * offset);
+uint8_t ds3231_skew_needs_aging(ds3231_skew_t * skew);
+int ds3231_skew_correct(ds3231_skew_t * skew, uint8_t channel, ds3231_t * rtc, int8_t current);
+
+#endif
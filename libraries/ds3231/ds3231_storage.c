@@ -0,0 +1,59 @@
+/**
+ * @file    ds3231_storage.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Block storage interface used by the persistence layers of the library.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_storage.h"
+
+/**
+ * @brief               Read from a storage device. Reads may continue into the following pages.
+ *
+ * @param[in] storage   Storage device.
+ * @param[in] page      Page to start reading from.
+ * @param[in] offset    Byte in the page to start reading from.
+ * @param[in] length    Length of the data in bytes.
+ * @param[out] data     Buffer to store the read data.
+ * @return              0 if succesful, -1 if the range is invalid or the device failed.
+ */
+int ds3231_storage_read(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data) {
+    if(!length || offset >= storage->page_size || page >= storage->page_count)
+        return -1;
+    if(((uint64_t)page * storage->page_size + offset + length) > ((uint64_t)storage->page_count * storage->page_size))
+        return -1;
+    return storage->ops->read(storage, page, offset, length, data);
+}
+
+/**
+ * @brief               Program bytes of a single page. The other bytes of the page keep their value.
+ *
+ * @param[in] storage   Storage device.
+ * @param[in] page      Page to be programmed.
+ * @param[in] offset    Byte in the page to start programming from.
+ * @param[in] length    Length of the data in bytes, offset + length must not exceed the page size.
+ * @param[in] data      Data to be programmed.
+ * @return              0 if succesful, -1 if the range is invalid or the device failed.
+ */
+int ds3231_storage_program(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data) {
+    if(!length || page >= storage->page_count || (offset + length) > storage->page_size)
+        return -1;
+    return storage->ops->program(storage, page, offset, length, data);
+}
+
+/**
+ * @brief               Check if the device is still busy with a write cycle.
+ * Reads and programs wait for the device themselves, this lets callers do other work meanwhile.
+ *
+ * @param[in] storage   Storage device.
+ * @return              1 if busy, 0 if ready, -1 if the device failed.
+ */
+int ds3231_storage_busy(ds3231_storage_t * storage) {
+    if(!storage->ops->busy)
+        return 0;
+    return storage->ops->busy(storage);
+}
@@ -0,0 +1,97 @@
+/**
+ * @file    ds3231_storage.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Block storage interface used by the persistence layers of the library.
+ * Only depends on the C library, so the layers built on it also compile for the host.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifndef DS_3231_STORAGE
+#define DS_3231_STORAGE
+
+typedef struct ds3231_storage_t ds3231_storage_t;
+
+/**
+ * @brief Functions a storage backend implements. Pages are numbered from 0.
+ * program changes only the given bytes of a single page, the backend erases and restores
+ * the rest of the erase block itself if the medium needs it.
+ *
+ */
+typedef struct ds3231_storage_ops_t {
+    int (*read)(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data);
+    int (*program)(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data);
+    int (*busy)(ds3231_storage_t * storage);   // 1 if a write cycle is in progress, 0 if ready. Can be NULL.
+} ds3231_storage_ops_t;
+
+/**
+ * @brief Struct to hold a storage device. Backends embed it as their first member.
+ *
+ */
+struct ds3231_storage_t {
+    const ds3231_storage_ops_t * ops;
+    uint32_t page_size;         // Bytes, largest unit a single program can write.
+    uint32_t page_count;
+    uint32_t erase_pages;       // Erase granularity in pages, 1 if pages are rewritten in place.
+    uint32_t write_cycle_us;    // Typical time the device stays busy after a program.
+};
+
+int ds3231_storage_read(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data);
+int ds3231_storage_program(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data);
+int ds3231_storage_busy(ds3231_storage_t * storage);
+
+struct i2c_inst;
+struct ds3231_t;
+
+/**
+ * @brief AT24C32 EEPROM on the DS3231 module.
+ *
+ */
+typedef struct ds3231_at24c32_storage_t {
+    ds3231_storage_t storage;
+    struct i2c_inst * i2c;      // i2c_inst_t, declared as a struct so this header does not need the SDK.
+    uint8_t dev_addr;
+    bool write_pending;
+} ds3231_at24c32_storage_t;
+
+int ds3231_at24c32_storage_init(ds3231_at24c32_storage_t * eeprom, struct ds3231_t * rtc);
+
+/**
+ * @brief Region of the Pico on-board flash. Pages are programmed in place while only bits are
+ * cleared, otherwise the 4 KB sector is staged in RAM, erased and programmed back.
+ *
+ */
+#define DS3231_FLASH_SECTOR_SIZE        4096
+
+typedef struct ds3231_flash_storage_t {
+    ds3231_storage_t storage;
+    uint32_t flash_offset;      // Offset of the region from the start of flash, sector aligned.
+    uint8_t staging[DS3231_FLASH_SECTOR_SIZE];
+} ds3231_flash_storage_t;
+
+int ds3231_flash_storage_init(ds3231_flash_storage_t * flash, uint32_t flash_offset,
+    uint32_t size, uint32_t page_size);
+
+/**
+ * @brief Image file on the host. Not part of the Pico library, used by host tools and for
+ * running the persistence layers on the host.
+ *
+ */
+typedef struct ds3231_file_storage_t {
+    ds3231_storage_t storage;
+    FILE * file;
+} ds3231_file_storage_t;
+
+int ds3231_file_storage_open(ds3231_file_storage_t * image, const char * path,
+    uint32_t page_size, uint32_t page_count);
+int ds3231_file_storage_close(ds3231_file_storage_t * image);
+
+#endif
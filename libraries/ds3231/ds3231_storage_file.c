@@ -0,0 +1,102 @@
+/**
+ * @file    ds3231_storage_file.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Host image file backend of the storage interface.
+ * Not built into the Pico library. Host tools compile it together with the persistence layers
+ * so images can be created, inspected and benchmarked with the same code that runs on the device.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_storage.h"
+#include <string.h>
+
+static int file_storage_read(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data) {
+    ds3231_file_storage_t * image = (ds3231_file_storage_t *)storage;
+    if(fseek(image->file, (long)page * storage->page_size + offset, SEEK_SET))
+        return -1;
+    if(fread(data, 1, length, image->file) != length)
+        return -1;
+    return 0;
+}
+
+static int file_storage_program(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data) {
+    ds3231_file_storage_t * image = (ds3231_file_storage_t *)storage;
+    if(fseek(image->file, (long)page * storage->page_size + offset, SEEK_SET))
+        return -1;
+    if(fwrite(data, 1, length, image->file) != length)
+        return -1;
+    if(fflush(image->file))
+        return -1;
+    return 0;
+}
+
+static const ds3231_storage_ops_t file_storage_ops = {
+    .read = &file_storage_read,
+    .program = &file_storage_program,
+    .busy = NULL
+};
+
+/**
+ * @brief                   Open an image file as a storage device. A missing file is created, and a
+ * file shorter than the device is extended, filled with 0xFF like an erased device.
+ *
+ * @param[out] image        File storage struct.
+ * @param[in] path          Path of the image file.
+ * @param[in] page_size     Page size in bytes, AT24C32_PAGE_SIZE for an AT24C32 image.
+ * @param[in] page_count    Number of pages, AT24C32_PAGE_COUNT for an AT24C32 image.
+ * @return                  0 if succesful, -1 if the file could not be opened or extended.
+ */
+int ds3231_file_storage_open(ds3231_file_storage_t * image, const char * path,
+    uint32_t page_size, uint32_t page_count)
+{
+    if(!page_size || !page_count)
+        return -1;
+    image->file = fopen(path, "r+b");
+    if(!image->file)
+        image->file = fopen(path, "w+b");
+    if(!image->file)
+        return -1;
+
+    long size = (long)page_size * page_count;
+    if(fseek(image->file, 0, SEEK_END)) {
+        fclose(image->file);
+        return -1;
+    }
+    long current = ftell(image->file);
+    uint8_t erased[64];
+    memset(erased, 0xFF, sizeof(erased));
+    while(current >= 0 && current < size) {
+        size_t chunk = (size - current) < (long)sizeof(erased) ? (size_t)(size - current) : sizeof(erased);
+        if(fwrite(erased, 1, chunk, image->file) != chunk) {
+            fclose(image->file);
+            return -1;
+        }
+        current += chunk;
+    }
+    fflush(image->file);
+
+    image->storage.ops = &file_storage_ops;
+    image->storage.page_size = page_size;
+    image->storage.page_count = page_count;
+    image->storage.erase_pages = 1;
+    image->storage.write_cycle_us = 0;
+    return 0;
+}
+
+/**
+ * @brief               Close an image file opened with ds3231_file_storage_open.
+ *
+ * @param[in] image     File storage struct.
+ * @return              0 if succesful, -1 if the file could not be closed.
+ */
+int ds3231_file_storage_close(ds3231_file_storage_t * image) {
+    if(!image->file)
+        return -1;
+    int result = fclose(image->file);
+    image->file = NULL;
+    return result ? -1 : 0;
+}
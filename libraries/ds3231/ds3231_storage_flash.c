@@ -0,0 +1,100 @@
+/**
+ * @file    ds3231_storage_flash.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Pico on-board flash backend of the storage interface.
+ * NOR flash can only clear bits when programming and is erased in 4 KB sectors.
+ * A program that only clears bits is done in place by programming the 256 byte flash page
+ * with 0xFF everywhere else. Any other program copies the sector into RAM, applies the change,
+ * erases the sector and programs it back.
+ * Interrupts are disabled while the flash is written. If the other core is running, it must not
+ * execute from flash meanwhile, e.g. by using multicore_lockout.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_storage.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/regs/addressmap.h"
+#include <string.h>
+
+static const uint8_t * flash_storage_xip(uint32_t addr) {
+    return (const uint8_t *)(XIP_BASE + addr);
+}
+
+static int flash_storage_read(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data) {
+    ds3231_flash_storage_t * flash = (ds3231_flash_storage_t *)storage;
+    uint32_t addr = flash->flash_offset + page * storage->page_size + offset;
+    memcpy(data, flash_storage_xip(addr), length);
+    return 0;
+}
+
+static int flash_storage_program(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data) {
+    ds3231_flash_storage_t * flash = (ds3231_flash_storage_t *)storage;
+    uint32_t addr = flash->flash_offset + page * storage->page_size + offset;
+    const uint8_t * current = flash_storage_xip(addr);
+
+    bool in_place = true;
+    for(size_t i = 0; i < length; i++) {
+        if((current[i] & data[i]) != data[i]) {
+            in_place = false;
+            break;
+        }
+    }
+
+    if(in_place) {
+        /* Storage pages never cross a flash page, so a single flash page program is enough. */
+        uint32_t flash_page = addr & ~(FLASH_PAGE_SIZE - 1);
+        memset(flash->staging, 0xFF, FLASH_PAGE_SIZE);
+        memcpy(&flash->staging[addr - flash_page], data, length);
+        uint32_t ints = save_and_disable_interrupts();
+        flash_range_program(flash_page, flash->staging, FLASH_PAGE_SIZE);
+        restore_interrupts(ints);
+    } else {
+        uint32_t sector = addr & ~(FLASH_SECTOR_SIZE - 1);
+        memcpy(flash->staging, flash_storage_xip(sector), FLASH_SECTOR_SIZE);
+        memcpy(&flash->staging[addr - sector], data, length);
+        uint32_t ints = save_and_disable_interrupts();
+        flash_range_erase(sector, FLASH_SECTOR_SIZE);
+        flash_range_program(sector, flash->staging, FLASH_SECTOR_SIZE);
+        restore_interrupts(ints);
+    }
+    return 0;
+}
+
+static const ds3231_storage_ops_t flash_storage_ops = {
+    .read = &flash_storage_read,
+    .program = &flash_storage_program,
+    .busy = NULL
+};
+
+/**
+ * @brief                   Use a region of the Pico on-board flash as a storage device.
+ * The region must not overlap the program, usually it is placed at the end of flash,
+ * e.g. flash_offset = PICO_FLASH_SIZE_BYTES - size.
+ *
+ * @param[out] flash        Flash storage struct, holds a 4 KB staging buffer.
+ * @param[in] flash_offset  Offset of the region from the start of flash, multiple of 4096.
+ * @param[in] size          Size of the region in bytes, multiple of 4096.
+ * @param[in] page_size     Storage page size, a power of two from 16 to 256.
+ *                          32 gives the same layout as the AT24C32.
+ * @return                  0 if succesful, -1 if parameters are invalid.
+ */
+int ds3231_flash_storage_init(ds3231_flash_storage_t * flash, uint32_t flash_offset,
+    uint32_t size, uint32_t page_size)
+{
+    if((flash_offset % FLASH_SECTOR_SIZE) || !size || (size % FLASH_SECTOR_SIZE))
+        return -1;
+    if(page_size < 16 || page_size > FLASH_PAGE_SIZE || (page_size & (page_size - 1)))
+        return -1;
+    flash->storage.ops = &flash_storage_ops;
+    flash->storage.page_size = page_size;
+    flash->storage.page_count = size / page_size;
+    flash->storage.erase_pages = FLASH_SECTOR_SIZE / page_size;
+    flash->storage.write_cycle_us = 0;
+    flash->flash_offset = flash_offset;
+    return 0;
+}
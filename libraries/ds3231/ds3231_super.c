@@ -0,0 +1,209 @@
+/**
+ * @file    ds3231_super.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Superblock that describes the partitions of a storage device.
+ * Pages 0 and 1 hold the partition table, so mounting at boot is two reads of DS3231_SUPER_SIZE
+ * bytes instead of hard coded page numbers in every module. Log partitions also keep their head,
+ * which ds3231_log_init_at checks with two single byte reads instead of searching the lap bytes.
+ * The head only has to be saved now and then, e.g. before powering down or every few log pages,
+ * since a stale head is detected and falls back to the search. Saving it costs one write cycle.
+ * Saves alternate between the two copies with an increasing sequence number, so a save torn by a
+ * reset fails the CRC of its copy and the previous copy is mounted instead.
+ * The layout version is free for the application, tools/ds3231_image migrates images between
+ * layouts.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_super.h"
+#include "ds3231_link.h"
+#include <string.h>
+
+static void ds3231_super_encode(ds3231_super_t * super, uint8_t * block) {
+    memset(block, 0, DS3231_SUPER_SIZE);
+    block[0] = DS3231_SUPER_MAGIC;
+    block[1] = DS3231_SUPER_FORMAT;
+    block[2] = super->sequence;
+    block[3] = super->layout;
+    block[4] = super->partition_count;
+    for(uint8_t i = 0; i < super->partition_count; i++) {
+        uint8_t * entry = &block[5 + i * DS3231_SUPER_ENTRY_SIZE];
+        entry[0] = super->partitions[i].type;
+        entry[1] = super->partitions[i].first_page;
+        entry[2] = super->partitions[i].page_count;
+        entry[3] = super->partitions[i].head & 0xFF;
+        entry[4] = super->partitions[i].head >> 8;
+    }
+    uint16_t crc = ds3231_link_crc16(0xFFFF, block, DS3231_SUPER_SIZE - 2);
+    block[DS3231_SUPER_SIZE - 2] = crc & 0xFF;
+    block[DS3231_SUPER_SIZE - 1] = crc >> 8;
+}
+
+static int ds3231_super_decode(ds3231_super_t * super, const uint8_t * block) {
+    if(block[0] != DS3231_SUPER_MAGIC || block[1] != DS3231_SUPER_FORMAT || block[4] > DS3231_SUPER_PARTITIONS)
+        return -1;
+    uint16_t crc = ds3231_link_crc16(0xFFFF, block, DS3231_SUPER_SIZE - 2);
+    if(block[DS3231_SUPER_SIZE - 2] != (crc & 0xFF) || block[DS3231_SUPER_SIZE - 1] != (crc >> 8))
+        return -1;
+    super->sequence = block[2];
+    super->layout = block[3];
+    super->partition_count = block[4];
+    for(uint8_t i = 0; i < super->partition_count; i++) {
+        const uint8_t * entry = &block[5 + i * DS3231_SUPER_ENTRY_SIZE];
+        super->partitions[i].type = entry[0];
+        super->partitions[i].first_page = entry[1];
+        super->partitions[i].page_count = entry[2];
+        super->partitions[i].head = entry[3] | (entry[4] << 8);
+    }
+    return 0;
+}
+
+/* Write the superblock to the older copy, which becomes the current one. */
+static int ds3231_super_write(ds3231_super_t * super) {
+    uint8_t block[DS3231_SUPER_SIZE];
+    super->sequence++;
+    super->copy = (super->copy + 1) % DS3231_SUPER_COPIES;
+    ds3231_super_encode(super, block);
+    if(ds3231_storage_program(super->storage, super->copy, 0, DS3231_SUPER_SIZE, block)) {
+        /* The other copy is still the current one, the next save retries this one. */
+        super->sequence--;
+        super->copy = (super->copy + 1) % DS3231_SUPER_COPIES;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief                       Write both copies of a new superblock and format its log partitions.
+ * Contents of the other partitions are left as they are.
+ *
+ * @param[out] super            Superblock struct.
+ * @param[in] storage           Storage device with pages of at least DS3231_SUPER_SIZE bytes.
+ * @param[in] layout            Layout version.
+ * @param[in] partitions        Partitions, after page 1 and not overlapping. Heads are ignored.
+ * @param[in] partition_count   Number of partitions, at most DS3231_SUPER_PARTITIONS.
+ * @return                      0 if succesful, -1 if the partitions are invalid or storage failure.
+ */
+int ds3231_super_format(ds3231_super_t * super, ds3231_storage_t * storage, uint8_t layout,
+    const ds3231_super_partition_t * partitions, uint8_t partition_count)
+{
+    if(storage->page_size < DS3231_SUPER_SIZE || partition_count > DS3231_SUPER_PARTITIONS)
+        return -1;
+    for(uint8_t i = 0; i < partition_count; i++) {
+        const ds3231_super_partition_t * part = &partitions[i];
+        if(part->first_page < DS3231_SUPER_COPIES || !part->page_count || (uint32_t)part->first_page + part->page_count > storage->page_count)
+            return -1;
+        if(part->type == DS3231_SUPER_LOG && (part->page_count < 2 || storage->page_size > DS3231_LOG_PAGE_SIZE_MAX))
+            return -1;
+        for(uint8_t j = 0; j < i; j++) {
+            const ds3231_super_partition_t * other = &partitions[j];
+            if(part->first_page < other->first_page + other->page_count && other->first_page < part->first_page + part->page_count)
+                return -1;
+        }
+    }
+
+    super->storage = storage;
+    super->sequence = 0;
+    super->copy = 0;
+    super->layout = layout;
+    super->partition_count = partition_count;
+    for(uint8_t i = 0; i < partition_count; i++) {
+        super->partitions[i] = partitions[i];
+        super->partitions[i].head = 0;
+        if(partitions[i].type == DS3231_SUPER_LOG) {
+            /* Old contents may not mount, the range was checked above and is all format needs. */
+            ds3231_log_t log;
+            ds3231_log_init(&log, storage, partitions[i].first_page, partitions[i].page_count);
+            if(ds3231_log_format(&log))
+                return -1;
+        }
+    }
+
+    /* Page 1 then page 0, so a copy of an older superblock never outlives the format. */
+    if(ds3231_super_write(super))
+        return -1;
+    return ds3231_super_write(super);
+}
+
+/**
+ * @brief               Mount the current copy of the superblock of a storage device.
+ *
+ * @param[out] super    Superblock struct.
+ * @param[in] storage   Storage device.
+ * @return              0 if succesful, -1 if neither copy is valid or storage failure.
+ */
+int ds3231_super_mount(ds3231_super_t * super, ds3231_storage_t * storage) {
+    if(storage->page_size < DS3231_SUPER_SIZE || storage->page_count < DS3231_SUPER_COPIES)
+        return -1;
+    bool mounted = false;
+    for(uint8_t copy = 0; copy < DS3231_SUPER_COPIES; copy++) {
+        uint8_t block[DS3231_SUPER_SIZE];
+        ds3231_super_t candidate;
+        if(ds3231_storage_read(storage, copy, 0, DS3231_SUPER_SIZE, block))
+            return -1;
+        if(ds3231_super_decode(&candidate, block))
+            continue;
+        /* Sequence numbers wrap, the newer copy is at most 127 saves ahead. */
+        if(mounted && (int8_t)(candidate.sequence - super->sequence) <= 0)
+            continue;
+        *super = candidate;
+        super->storage = storage;
+        super->copy = copy;
+        mounted = true;
+    }
+    return mounted ? 0 : -1;
+}
+
+/**
+ * @brief               Find the first partition of a type.
+ *
+ * @param[in] super     Superblock struct.
+ * @param[in] type      Partition type, one of DS3231_SUPER_TYPES.
+ * @return              Partition, NULL if there is none of the type.
+ */
+ds3231_super_partition_t * ds3231_super_find(ds3231_super_t * super, uint8_t type) {
+    for(uint8_t i = 0; i < super->partition_count; i++) {
+        if(super->partitions[i].type == type)
+            return &super->partitions[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief               Mount the log partition at the head saved in the superblock.
+ *
+ * @param[in] super     Superblock struct.
+ * @param[out] log      Log struct.
+ * @return              0 if succesful, -1 if there is no log partition or storage failure.
+ */
+int ds3231_super_mount_log(ds3231_super_t * super, ds3231_log_t * log) {
+    ds3231_super_partition_t * part = ds3231_super_find(super, DS3231_SUPER_LOG);
+    if(!part)
+        return -1;
+    return ds3231_log_init_at(log, super->storage, part->first_page, part->page_count, part->head);
+}
+
+/**
+ * @brief               Save the head of a log partition in the superblock. Does nothing if the
+ * saved head is still current.
+ *
+ * @param[in] super     Superblock struct.
+ * @param[in] log       Log mounted with ds3231_super_mount_log.
+ * @return              0 if succesful, -1 if the log is not a partition or storage failure.
+ */
+int ds3231_super_save_head(ds3231_super_t * super, ds3231_log_t * log) {
+    for(uint8_t i = 0; i < super->partition_count; i++) {
+        ds3231_super_partition_t * part = &super->partitions[i];
+        if(part->type != DS3231_SUPER_LOG || part->first_page != log->first_page)
+            continue;
+        uint16_t head = ds3231_log_head(log);
+        if(head == part->head)
+            return 0;
+        part->head = head;
+        return ds3231_super_write(super);
+    }
+    return -1;
+}
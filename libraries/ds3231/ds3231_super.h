@@ -0,0 +1,68 @@
+/**
+ * @file    ds3231_super.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Superblock that describes the partitions of a storage device.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_storage.h"
+#include "ds3231_log.h"
+
+#ifndef DS_3231_SUPER
+#define DS_3231_SUPER
+
+/* Superblock copies in pages 0 and 1: magic byte, format version, sequence number, layout version,
+partition count, then per partition the type, first page, page count and 16-bit head, and a
+CRC-16/CCITT-FALSE over the bytes before it. Multi-byte fields are little endian. Saves go to the
+older copy, the valid copy with the newer sequence number is current. Devices of up to 256 pages. */
+#define DS3231_SUPER_MAGIC              0x5B
+#define DS3231_SUPER_FORMAT             2
+#define DS3231_SUPER_COPIES             2
+#define DS3231_SUPER_PARTITIONS         4
+#define DS3231_SUPER_ENTRY_SIZE         5
+#define DS3231_SUPER_SIZE               (5 + DS3231_SUPER_ENTRY_SIZE * DS3231_SUPER_PARTITIONS + 2)
+
+enum DS3231_SUPER_TYPES {
+    DS3231_SUPER_FREE = 0,
+    DS3231_SUPER_CONFIG = 1,
+    DS3231_SUPER_LOG = 2,           // ds3231_log, the head is kept in the superblock.
+    DS3231_SUPER_CHECKPOINT = 3,
+    DS3231_SUPER_CALIBRATION = 4
+};
+
+/**
+ * @brief Struct to hold a partition of a storage device.
+ *
+ */
+typedef struct ds3231_super_partition_t {
+    uint8_t type;
+    uint8_t first_page;
+    uint8_t page_count;
+    uint16_t head;                  // ds3231_log_head of a log partition when it was last saved.
+} ds3231_super_partition_t;
+
+/**
+ * @brief Struct to hold a mounted superblock.
+ *
+ */
+typedef struct ds3231_super_t {
+    ds3231_storage_t * storage;
+    uint8_t sequence;               // Sequence number of the current copy.
+    uint8_t copy;                   // Page of the current copy.
+    uint8_t layout;                 // Layout version chosen by the application.
+    uint8_t partition_count;
+    ds3231_super_partition_t partitions[DS3231_SUPER_PARTITIONS];
+} ds3231_super_t;
+
+int ds3231_super_format(ds3231_super_t * super, ds3231_storage_t * storage, uint8_t layout,
+    const ds3231_super_partition_t * partitions, uint8_t partition_count);
+int ds3231_super_mount(ds3231_super_t * super, ds3231_storage_t * storage);
+ds3231_super_partition_t * ds3231_super_find(ds3231_super_t * super, uint8_t type);
+int ds3231_super_mount_log(ds3231_super_t * super, ds3231_log_t * log);
+int ds3231_super_save_head(ds3231_super_t * super, ds3231_log_t * log);
+
+#endif
@@ -0,0 +1,223 @@
+/**
+ * @file    ds3231_sync.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Incremental sync of a storage device to a host with page generation numbers.
+ * The sync device sits on top of the storage stack, right below the log, and bumps the generation
+ * of a page on every program. The host keeps a mirror of the device with the generation of each
+ * page it holds and sends them in a sync request. The device answers with only the pages whose
+ * generation differs, in runs of consecutive pages per frame, and a sync end frame. Routine syncs
+ * of a log therefore move a few pages instead of the whole EEPROM.
+ * Generations live in RAM, so the device picks a new session at every boot, e.g. the DS3231 time
+ * at boot. A request of another session gets every page. The host only takes over the session
+ * when a sync ends without errors, an interrupted sync is completed by the next one.
+ * Generations are 16 bits, a page must not be programmed 65535 times between two syncs.
+ * Everything here is plain C, the mirror functions build on the host as well.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_sync.h"
+#include <string.h>
+
+static int ds3231_sync_read(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data) {
+    ds3231_sync_t * sync = (ds3231_sync_t *)storage;
+    return ds3231_storage_read(sync->lower, page, offset, length, data);
+}
+
+static int ds3231_sync_program(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data) {
+    ds3231_sync_t * sync = (ds3231_sync_t *)storage;
+    /* Bumped even if the program fails, the page may have changed partly. 0 is skipped on overflow. */
+    if(!++sync->generations[page])
+        sync->generations[page] = 1;
+    return ds3231_storage_program(sync->lower, page, offset, length, data);
+}
+
+static int ds3231_sync_busy(ds3231_storage_t * storage) {
+    ds3231_sync_t * sync = (ds3231_sync_t *)storage;
+    return ds3231_storage_busy(sync->lower);
+}
+
+static const ds3231_storage_ops_t ds3231_sync_ops = {
+    .read = &ds3231_sync_read,
+    .program = &ds3231_sync_program,
+    .busy = &ds3231_sync_busy
+};
+
+/**
+ * @brief               Put page generation numbers in front of a storage device. Layers on top of
+ * it must use the sync struct instead of the wrapped device.
+ *
+ * @param[out] sync     Sync struct.
+ * @param[in] lower     Wrapped storage device, with at most DS3231_SYNC_MAX_PAGES pages of at most
+ *                      DS3231_LINK_PAYLOAD_MAX - 5 bytes.
+ * @param[in] session   Number that differs from the previous boots.
+ * @return              0 if succesful, -1 if the device is too large.
+ */
+int ds3231_sync_init(ds3231_sync_t * sync, ds3231_storage_t * lower, uint32_t session) {
+    if(lower->page_count > DS3231_SYNC_MAX_PAGES || lower->page_size + 5 > DS3231_LINK_PAYLOAD_MAX)
+        return -1;
+    memset(sync, 0, sizeof(*sync));
+    sync->lower = lower;
+    sync->session = session;
+    for(uint32_t i = 0; i < lower->page_count; i++)
+        sync->generations[i] = 1;
+    sync->storage.ops = &ds3231_sync_ops;
+    sync->storage.page_size = lower->page_size;
+    sync->storage.page_count = lower->page_count;
+    sync->storage.erase_pages = lower->erase_pages;
+    sync->storage.write_cycle_us = lower->write_cycle_us;
+    return 0;
+}
+
+static int ds3231_sync_send_end(ds3231_sync_t * sync, ds3231_link_write_t write, void * ctx, uint16_t pages, uint8_t result) {
+    uint8_t end[7] = {sync->session & 0xFF, (sync->session >> 8) & 0xFF, (sync->session >> 16) & 0xFF,
+        sync->session >> 24, pages & 0xFF, pages >> 8, result};
+    return ds3231_link_send(write, ctx, DS3231_LINK_SYNC_END, sync->seq++, end, sizeof(end), NULL, 0);
+}
+
+/**
+ * @brief               Answer a sync request with the pages the host does not have and a sync end
+ * frame.
+ *
+ * @param[in] sync      Sync struct.
+ * @param[in] request   Frame received from the host.
+ * @param[in] write     Function that sends bytes to the host.
+ * @param[in] ctx       Passed to the write function.
+ * @return              0 if succesful, 1 if the frame is not a sync request, -1 if the request is
+ *                      invalid or reading or sending failed.
+ */
+int ds3231_sync_handle(ds3231_sync_t * sync, const ds3231_link_frame_t * request,
+    ds3231_link_write_t write, void * ctx)
+{
+    if(request->type != DS3231_LINK_SYNC_REQUEST)
+        return 1;
+
+    uint32_t page_count = sync->storage.page_count;
+    uint32_t page_size = sync->storage.page_size;
+    if(request->length != 4 + 2 * page_count) {
+        ds3231_sync_send_end(sync, write, ctx, 0, 1);
+        return -1;
+    }
+    const uint8_t * host = request->payload;
+    bool same_session = (host[0] | (host[1] << 8) | (host[2] << 16) | ((uint32_t)host[3] << 24)) == sync->session;
+    host += 4;
+
+    uint32_t run_max = (DS3231_LINK_PAYLOAD_MAX - 3) / (2 + page_size);
+    if(run_max > 255)
+        run_max = 255;
+    uint8_t header[3 + 2 * 255];
+    uint8_t data[DS3231_LINK_PAYLOAD_MAX];
+    uint16_t sent = 0;
+    int result = 0;
+
+    uint32_t page = 0;
+    while(page < page_count && !result) {
+        uint16_t seen = host[2 * page] | (host[2 * page + 1] << 8);
+        if(same_session && seen == sync->generations[page]) {
+            sync->pages_skipped++;
+            page++;
+            continue;
+        }
+
+        /* Extend the run over the following changed pages. */
+        uint32_t count = 0;
+        while(page + count < page_count && count < run_max) {
+            uint32_t next = page + count;
+            seen = host[2 * next] | (host[2 * next + 1] << 8);
+            if(same_session && seen == sync->generations[next])
+                break;
+            header[3 + 2 * count] = sync->generations[next] & 0xFF;
+            header[4 + 2 * count] = sync->generations[next] >> 8;
+            count++;
+        }
+        header[0] = page & 0xFF;
+        header[1] = page >> 8;
+        header[2] = count;
+
+        if(ds3231_storage_read(sync->lower, page, 0, count * page_size, data) ||
+            ds3231_link_send(write, ctx, DS3231_LINK_SYNC_PAGES, sync->seq++, header, 3 + 2 * count,
+            data, count * page_size))
+        {
+            result = -1;
+        } else {
+            sent += count;
+            sync->pages_sent += count;
+        }
+        page += count;
+    }
+
+    if(ds3231_sync_send_end(sync, write, ctx, sent, result ? 1 : 0))
+        result = -1;
+    return result;
+}
+
+/**
+ * @brief                   Initialise the host copy of a synced device as empty.
+ *
+ * @param[out] mirror       Mirror struct.
+ * @param[in] page_size     Page size of the synced device.
+ * @param[in] page_count    Pages of the synced device, at most DS3231_SYNC_MAX_PAGES.
+ * @param[in] image         Buffer of page_size * page_count bytes for the contents.
+ */
+void ds3231_sync_mirror_init(ds3231_sync_mirror_t * mirror, uint32_t page_size, uint32_t page_count, uint8_t * image) {
+    memset(mirror, 0, sizeof(*mirror));
+    mirror->page_size = page_size;
+    mirror->page_count = page_count;
+    mirror->image = image;
+}
+
+/**
+ * @brief               Send a sync request with the generations of the mirror.
+ *
+ * @param[in] mirror    Mirror struct.
+ * @param[in] seq       Sequence number of the frame.
+ * @param[in] write     Function that sends bytes to the device.
+ * @param[in] ctx       Passed to the write function.
+ * @return              0 if succesful, -1 if sending failed.
+ */
+int ds3231_sync_mirror_request(ds3231_sync_mirror_t * mirror, uint16_t seq, ds3231_link_write_t write, void * ctx) {
+    uint8_t payload[4 + 2 * DS3231_SYNC_MAX_PAGES];
+    payload[0] = mirror->session & 0xFF;
+    payload[1] = (mirror->session >> 8) & 0xFF;
+    payload[2] = (mirror->session >> 16) & 0xFF;
+    payload[3] = mirror->session >> 24;
+    for(uint32_t i = 0; i < mirror->page_count; i++) {
+        payload[4 + 2 * i] = mirror->generations[i] & 0xFF;
+        payload[5 + 2 * i] = mirror->generations[i] >> 8;
+    }
+    return ds3231_link_send(write, ctx, DS3231_LINK_SYNC_REQUEST, seq, payload, 4 + 2 * mirror->page_count, NULL, 0);
+}
+
+/**
+ * @brief               Apply a frame received from the device to the mirror.
+ *
+ * @param[in] mirror    Mirror struct.
+ * @param[in] frame     Received frame.
+ * @return              0 if a sync pages frame was applied, 1 if a sync ended without errors,
+ *                      2 for frames of other types, -1 if the frame is invalid or the sync failed.
+ */
+int ds3231_sync_mirror_apply(ds3231_sync_mirror_t * mirror, const ds3231_link_frame_t * frame) {
+    const uint8_t * payload = frame->payload;
+    if(frame->type == DS3231_LINK_SYNC_END) {
+        if(frame->length != 7 || payload[6])
+            return -1;
+        mirror->session = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24);
+        return 1;
+    }
+    if(frame->type != DS3231_LINK_SYNC_PAGES)
+        return 2;
+
+    if(frame->length < 3)
+        return -1;
+    uint32_t page = payload[0] | (payload[1] << 8);
+    uint32_t count = payload[2];
+    if(page + count > mirror->page_count || frame->length != 3 + count * (2 + mirror->page_size))
+        return -1;
+    memcpy(&mirror->image[page * mirror->page_size], &payload[3 + 2 * count], count * mirror->page_size);
+    for(uint32_t i = 0; i < count; i++)
+        mirror->generations[page + i] = payload[3 + 2 * i] | (payload[4 + 2 * i] << 8);
+    return 0;
+}
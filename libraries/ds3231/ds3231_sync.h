@@ -0,0 +1,60 @@
+/**
+ * @file    ds3231_sync.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Incremental sync of a storage device to a host with page generation numbers.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_storage.h"
+#include "ds3231_link.h"
+
+#ifndef DS_3231_SYNC
+#define DS_3231_SYNC
+
+/* Largest number of pages of the synced device. A sync request holds a 16-bit generation per
+page, so 128 pages fill a whole frame. */
+#ifndef DS3231_SYNC_MAX_PAGES
+#define DS3231_SYNC_MAX_PAGES           128
+#endif
+
+/**
+ * @brief Struct to hold a storage device that numbers the programs of every page of another one.
+ * Generations are kept in RAM only and start at 1 with a new session, 0 means a page was never
+ * seen by the host.
+ *
+ */
+typedef struct ds3231_sync_t {
+    ds3231_storage_t storage;
+    ds3231_storage_t * lower;
+    uint32_t session;           // Changes with every boot, generations of another session are void.
+    uint16_t generations[DS3231_SYNC_MAX_PAGES];
+    uint16_t seq;               // Sequence number of the next frame sent.
+    uint32_t pages_sent;
+    uint32_t pages_skipped;     // Pages the host already had.
+} ds3231_sync_t;
+
+/**
+ * @brief Struct to hold the host copy of a synced device.
+ *
+ */
+typedef struct ds3231_sync_mirror_t {
+    uint32_t session;
+    uint32_t page_size;
+    uint32_t page_count;
+    uint16_t generations[DS3231_SYNC_MAX_PAGES];
+    uint8_t * image;            // page_size * page_count bytes.
+} ds3231_sync_mirror_t;
+
+int ds3231_sync_init(ds3231_sync_t * sync, ds3231_storage_t * lower, uint32_t session);
+int ds3231_sync_handle(ds3231_sync_t * sync, const ds3231_link_frame_t * request,
+    ds3231_link_write_t write, void * ctx);
+
+void ds3231_sync_mirror_init(ds3231_sync_mirror_t * mirror, uint32_t page_size, uint32_t page_count, uint8_t * image);
+int ds3231_sync_mirror_request(ds3231_sync_mirror_t * mirror, uint16_t seq, ds3231_link_write_t write, void * ctx);
+int ds3231_sync_mirror_apply(ds3231_sync_mirror_t * mirror, const ds3231_link_frame_t * frame);
+
+#endif
@@ -0,0 +1,216 @@
+/**
+ * @file    ds3231_temp.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Temperature cache that follows the 64 second conversion cadence of DS3231, with alerts.
+ * DS3231 converts the temperature every 64 seconds, the registers hold the same value in between.
+ * The cache finds when conversions happen by polling BSY in the status register for up to one
+ * period, then reads the registers once right after each conversion. Every other read is served
+ * from the cache without I2C traffic. A read that finds BSY still set means the RP2040 timer ran
+ * ahead of DS3231, the cadence is moved to it. The cadence is searched again every
+ * DS3231_TEMP_RELOCK_PERIODS conversions, starting a little before the expected one, so the drift
+ * of the timer against the TCXO never adds up. If BSY is never seen, conversions are assumed every
+ * period from then on, which still keeps the cache at most one period old.
+ * Threshold alerts are only checked on the result of a conversion, forced ones included, so they
+ * cost nothing on the bus either.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_temp.h"
+#include "hardware/timer.h"
+
+#define DS3231_TEMP_BSY     (0x01 << 2)
+
+/* Read the status, aging offset and temperature registers at once. */
+static int ds3231_temp_fetch(ds3231_temp_t * temp, uint8_t * regs) {
+    DS3231_CRUMB_API(DS3231_CRUMB_TEMP);
+    temp->reads++;
+    return i2c_read_reg(temp->rtc->i2c, temp->rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 4, regs);
+}
+
+static void ds3231_temp_update(ds3231_temp_t * temp, const uint8_t * regs) {
+    ds3231_decode_temperature(&regs[2], &temp->temperature);
+    if(!temp->callback)
+        return;
+
+    float t = temp->temperature;
+    enum DS3231_TEMP_ALERTS alert = temp->alert;
+    if(alert == DS3231_TEMP_HIGH && t < temp->high - temp->hysteresis)
+        alert = DS3231_TEMP_NORMAL;
+    else if(alert == DS3231_TEMP_LOW && t > temp->low + temp->hysteresis)
+        alert = DS3231_TEMP_NORMAL;
+    if(alert == DS3231_TEMP_NORMAL) {
+        if(t >= temp->high)
+            alert = DS3231_TEMP_HIGH;
+        else if(t <= temp->low)
+            alert = DS3231_TEMP_LOW;
+    }
+    if(alert != temp->alert) {
+        temp->alert = alert;
+        temp->callback(temp->ctx, alert, t);
+    }
+}
+
+static void ds3231_temp_acquire(ds3231_temp_t * temp, uint64_t start_us) {
+    temp->locked = false;
+    temp->next_us = start_us;
+    temp->acquire_end_us = start_us + DS3231_TEMP_PERIOD_US + 2 * DS3231_TEMP_LEAD_US;
+}
+
+static void ds3231_temp_lock(ds3231_temp_t * temp, uint64_t conversion_us) {
+    temp->locked = true;
+    temp->conversion_us = conversion_us;
+    temp->next_us = conversion_us + DS3231_TEMP_SETTLE_US;
+    temp->periods = 0;
+}
+
+/**
+ * @brief           Initiliaze the temperature cache with the current temperature and start looking
+ * for the conversion cadence.
+ *
+ * @param[out] temp Temperature cache struct.
+ * @param[in] rtc   DS3231 struct.
+ * @return          0 if succesful, -1 if i2c failure.
+ */
+int ds3231_temp_init(ds3231_temp_t * temp, ds3231_t * rtc) {
+    temp->rtc = rtc;
+    temp->forced = false;
+    temp->alert = DS3231_TEMP_NORMAL;
+    temp->callback = NULL;
+    temp->reads = 0;
+    temp->probes = 0;
+    temp->hits = 0;
+    temp->acquire_failures = 0;
+
+    uint8_t regs[4];
+    if(ds3231_temp_fetch(temp, regs))
+        return -1;
+    ds3231_temp_update(temp, regs);
+    ds3231_temp_acquire(temp, time_us_64());
+    return 0;
+}
+
+/**
+ * @brief                   Set the temperature alert. The alert state starts as DS3231_TEMP_NORMAL and
+ * is first checked on the next conversion.
+ *
+ * @param[in] temp          Temperature cache struct.
+ * @param[in] low           Low threshold in degrees Celsius.
+ * @param[in] high          High threshold in degrees Celsius.
+ * @param[in] hysteresis    An alert ends once the temperature is this far back inside the thresholds.
+ * @param[in] callback      Function called on alert changes, NULL to disable the alert.
+ * @param[in] ctx           Passed to the callback.
+ */
+void ds3231_temp_set_alert(ds3231_temp_t * temp, float low, float high, float hysteresis,
+    ds3231_temp_callback_t callback, void * ctx)
+{
+    temp->low = low;
+    temp->high = high;
+    temp->hysteresis = hysteresis;
+    temp->alert = DS3231_TEMP_NORMAL;
+    temp->callback = callback;
+    temp->ctx = ctx;
+}
+
+/**
+ * @brief           Refresh the cache if a conversion finished since the last read. Call it from
+ * the main loop, alerts are called from here.
+ *
+ * @param[in] temp  Temperature cache struct.
+ * @return          0 if succesful, -1 if i2c failure.
+ */
+int ds3231_temp_poll(ds3231_temp_t * temp) {
+    uint64_t now = time_us_64();
+    uint8_t regs[4];
+
+    /* BSY of a forced conversion would be taken for an automatic one, the cadence waits for it. */
+    if(temp->forced) {
+        if(now < temp->forced_us)
+            return 0;
+        if(ds3231_temp_fetch(temp, regs))
+            return -1;
+        if(regs[0] & DS3231_TEMP_BSY) {
+            temp->forced_us = now + DS3231_TEMP_PROBE_US;
+            return 0;
+        }
+        temp->forced = false;
+        ds3231_temp_update(temp, regs);
+        return 0;
+    }
+
+    if(now < temp->next_us)
+        return 0;
+
+    if(!temp->locked) {
+        uint8_t status = 0;
+        temp->probes++;
+        DS3231_CRUMB_API(DS3231_CRUMB_TEMP);
+        if(i2c_read_reg(temp->rtc->i2c, temp->rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &status))
+            return -1;
+        if(status & DS3231_TEMP_BSY) {
+            ds3231_temp_lock(temp, now);
+        } else if(now >= temp->acquire_end_us) {
+            /* Missed every conversion, assume one just finished. */
+            temp->acquire_failures++;
+            ds3231_temp_lock(temp, now - DS3231_TEMP_SETTLE_US);
+            temp->next_us = now + DS3231_TEMP_PERIOD_US;
+            temp->conversion_us += DS3231_TEMP_PERIOD_US;
+        } else {
+            temp->next_us = now + DS3231_TEMP_PROBE_US;
+        }
+        return 0;
+    }
+
+    if(ds3231_temp_fetch(temp, regs))
+        return -1;
+    if(regs[0] & DS3231_TEMP_BSY) {
+        ds3231_temp_lock(temp, now);
+        return 0;
+    }
+    ds3231_temp_update(temp, regs);
+
+    /* A late poll skips the conversions it missed, their results are gone anyway. */
+    do {
+        temp->conversion_us += DS3231_TEMP_PERIOD_US;
+        temp->periods++;
+    } while(temp->conversion_us + DS3231_TEMP_SETTLE_US <= now);
+    temp->next_us = temp->conversion_us + DS3231_TEMP_SETTLE_US;
+    if(temp->periods >= DS3231_TEMP_RELOCK_PERIODS)
+        ds3231_temp_acquire(temp, temp->conversion_us - DS3231_TEMP_LEAD_US);
+    return 0;
+}
+
+/**
+ * @brief                   Read the temperature. Only reads DS3231 if a conversion finished since
+ * the last read, otherwise the cached value is returned.
+ *
+ * @param[in] temp          Temperature cache struct.
+ * @param[out] temperature  Temperature data with 0.25 resolution.
+ * @return                  0 if succesful, -1 if i2c failure.
+ */
+int ds3231_temp_read(ds3231_temp_t * temp, float * temperature) {
+    uint32_t transfers = temp->reads + temp->probes;
+    if(ds3231_temp_poll(temp))
+        return -1;
+    if(transfers == temp->reads + temp->probes)
+        temp->hits++;
+    *temperature = temp->temperature;
+    return 0;
+}
+
+/**
+ * @brief           Force a conversion. The result is read by ds3231_temp_poll once it is done.
+ *
+ * @param[in] temp  Temperature cache struct.
+ * @return          0 if succesful, -1 if a conversion is running or i2c failure.
+ */
+int ds3231_temp_convert(ds3231_temp_t * temp) {
+    if(ds3231_force_convert_temperature(temp->rtc))
+        return -1;
+    temp->forced = true;
+    temp->forced_us = time_us_64() + DS3231_TEMP_SETTLE_US;
+    return 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file    ds3231_temp.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Temperature cache that follows the 64 second conversion cadence of DS3231, with alerts.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231.h"
+
+#ifndef DS_3231_TEMP
+#define DS_3231_TEMP
+
+#define DS3231_TEMP_PERIOD_US           64000000    // Automatic conversion interval of DS3231.
+#define DS3231_TEMP_SETTLE_US           250000      // Conversion time is 200 ms at most.
+#define DS3231_TEMP_PROBE_US            100000      // BSY polling interval while finding the cadence.
+#define DS3231_TEMP_LEAD_US             500000      // Polling starts this early when locking again.
+
+/* Conversions between two checks of the cadence, about 68 minutes. */
+#ifndef DS3231_TEMP_RELOCK_PERIODS
+#define DS3231_TEMP_RELOCK_PERIODS      64
+#endif
+
+enum DS3231_TEMP_ALERTS {
+    DS3231_TEMP_NORMAL = 0,
+    DS3231_TEMP_HIGH,               // Reached the high threshold.
+    DS3231_TEMP_LOW                 // Reached the low threshold.
+};
+
+/**
+ * @brief Function called from ds3231_temp_poll when the alert state changes, back to
+ * DS3231_TEMP_NORMAL included.
+ *
+ */
+typedef void (*ds3231_temp_callback_t)(void * ctx, enum DS3231_TEMP_ALERTS alert, float temperature);
+
+/**
+ * @brief Struct to hold the cached temperature and the conversion cadence of DS3231.
+ * Times are from the RP2040 timer.
+ *
+ */
+typedef struct ds3231_temp_t {
+    ds3231_t * rtc;
+    float temperature;
+    bool locked;                    // Cadence known from BSY, or assumed after missing it.
+    bool forced;                    // A forced conversion is running.
+    uint64_t conversion_us;         // Start of the last automatic conversion.
+    uint64_t next_us;               // Next register read, or next BSY probe while not locked.
+    uint64_t acquire_end_us;        // Give up finding the cadence at this time.
+    uint64_t forced_us;             // Read the result of a forced conversion at this time.
+    uint32_t periods;               // Conversions since the cadence was locked.
+
+    float high;
+    float low;
+    float hysteresis;               // An alert ends this far back inside the thresholds.
+    enum DS3231_TEMP_ALERTS alert;
+    ds3231_temp_callback_t callback;
+    void * ctx;
+
+    uint32_t reads;                 // Temperature register reads.
+    uint32_t probes;                // Status register reads looking for BSY.
+    uint32_t hits;                  // Reads served from the cache.
+    uint32_t acquire_failures;
+} ds3231_temp_t;
+
+int ds3231_temp_init(ds3231_temp_t * temp, ds3231_t * rtc);
+void ds3231_temp_set_alert(ds3231_temp_t * temp, float low, float high, float hysteresis,
+    ds3231_temp_callback_t callback, void * ctx);
+int ds3231_temp_poll(ds3231_temp_t * temp);
+int ds3231_temp_read(ds3231_temp_t * temp, float * temperature);
+int ds3231_temp_convert(ds3231_temp_t * temp);
+
+#endif
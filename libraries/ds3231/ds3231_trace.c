@@ -0,0 +1,248 @@
+/**
+ * @file    ds3231_trace.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   I2C transaction trace capture and replay for the DS3231 and AT24C32 drivers.
+ * Every transfer of the drivers goes through ds3231_bus_write and ds3231_bus_read. While a trace
+ * is active, those functions hand the transfer to ds3231_trace_transfer instead of the bus.
+ * In capture mode the transfer goes to the bus and is recorded with its timing and result.
+ * In replay mode nothing goes to the bus: the request is checked against the next record and
+ * the recorded response, result and optionally duration are fed back to the driver. That makes
+ * a trace captured in the field reproducible at the desk without the hardware.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_trace.h"
+#include "hardware/timer.h"
+#include <string.h>
+
+ds3231_trace_t * ds3231_trace_active = NULL;
+
+/**
+ * @brief               Initiliaze a trace over a caller provided record buffer.
+ *
+ * @param[out] trace    Trace struct.
+ * @param[in] records   Record buffer.
+ * @param[in] capacity  Number of records the buffer can hold.
+ * @param[in] count     Number of valid records already in the buffer, e.g. a capture to be replayed.
+ *                      0 for a new capture.
+ * @return              0 if succesful, -1 if parameters are invalid.
+ */
+int ds3231_trace_init(ds3231_trace_t * trace, ds3231_trace_record_t * records, uint32_t capacity, uint32_t count) {
+    if(!records || !capacity || count > capacity)
+        return -1;
+    trace->records = records;
+    trace->capacity = capacity;
+    trace->count = count;
+    trace->next = 0;
+    trace->start_us = 0;
+    trace->mode = DS3231_TRACE_CAPTURE;
+    trace->mismatch = -1;
+    return 0;
+}
+
+static void ds3231_trace_reverse(ds3231_trace_record_t * records, uint32_t first, uint32_t last) {
+    while(first + 1 < last) {
+        ds3231_trace_record_t swap = records[first];
+        records[first++] = records[--last];
+        records[last] = swap;
+    }
+}
+
+/**
+ * @brief               Route all driver transfers through the trace. Capture mode starts from an
+ * empty buffer, replay modes start from the oldest record. A capture that wrapped is rotated in
+ * place first, so the records are oldest first from then on.
+ *
+ * @param[in] trace     Trace struct.
+ * @param[in] mode      DS3231_TRACE_CAPTURE, DS3231_TRACE_REPLAY or DS3231_TRACE_REPLAY_TIMED.
+ * @return              0 if succesful, -1 if another trace is active.
+ */
+int ds3231_trace_start(ds3231_trace_t * trace, enum DS3231_TRACE_MODE mode) {
+    if(ds3231_trace_active)
+        return -1;
+    if(mode == DS3231_TRACE_CAPTURE) {
+        trace->count = 0;
+    } else if(trace->mode == DS3231_TRACE_CAPTURE && trace->count == trace->capacity && trace->next) {
+        ds3231_trace_reverse(trace->records, 0, trace->next);
+        ds3231_trace_reverse(trace->records, trace->next, trace->capacity);
+        ds3231_trace_reverse(trace->records, 0, trace->capacity);
+    }
+    trace->mode = mode;
+    trace->next = 0;
+    trace->mismatch = -1;
+    trace->start_us = time_us_32();
+    ds3231_trace_active = trace;
+    return 0;
+}
+
+/**
+ * @brief               Stop routing transfers through the active trace. The records are kept.
+ *
+ * @return              0 if succesful, -1 if no trace was active.
+ */
+int ds3231_trace_stop(void) {
+    if(!ds3231_trace_active)
+        return -1;
+    ds3231_trace_active = NULL;
+    return 0;
+}
+
+/**
+ * @brief               Get a record in the order the transfers happened.
+ *
+ * @param[in] trace     Trace struct.
+ * @param[in] index     0 for the oldest record.
+ * @return              Pointer to the record, NULL if index is out of range.
+ */
+ds3231_trace_record_t * ds3231_trace_get(ds3231_trace_t * trace, uint32_t index) {
+    if(index >= trace->count)
+        return NULL;
+    /* A full capture buffer wraps, the oldest record is the one to be overwritten next. */
+    if(trace->mode == DS3231_TRACE_CAPTURE && trace->count == trace->capacity)
+        index = (trace->next + index) % trace->capacity;
+    return &trace->records[index];
+}
+
+static int ds3231_trace_capture(ds3231_trace_t * trace, i2c_inst_t * i2c, uint8_t dev_addr,
+    uint8_t * data, size_t length, bool nostop, bool read)
+{
+    uint32_t start = time_us_32();
+    int result;
+    if(read)
+        result = i2c_read_blocking(i2c, dev_addr, data, length, nostop);
+    else
+        result = i2c_write_blocking(i2c, dev_addr, data, length, nostop);
+    uint32_t duration = time_us_32() - start;
+
+    uint8_t flags = 0;
+    if(read)
+        flags |= DS3231_TRACE_FLAG_READ;
+    if(nostop)
+        flags |= DS3231_TRACE_FLAG_NOSTOP;
+    if(i2c_hw_index(i2c))
+        flags |= DS3231_TRACE_FLAG_I2C1;
+    if(result < 0)
+        flags |= DS3231_TRACE_FLAG_ERROR;
+
+    /* Long transfers take one record per DS3231_TRACE_DATA_SIZE bytes. */
+    size_t records = (length + DS3231_TRACE_DATA_SIZE - 1) / DS3231_TRACE_DATA_SIZE;
+    if(!records)
+        records = 1;
+    if(records > trace->capacity) {
+        records = trace->capacity;
+        flags |= DS3231_TRACE_FLAG_TRUNCATED;
+    }
+    size_t offset = 0;
+    for(size_t i = 0; i < records; i++) {
+        ds3231_trace_record_t * record = &trace->records[trace->next];
+        size_t chunk = length - offset;
+        if(chunk > DS3231_TRACE_DATA_SIZE)
+            chunk = DS3231_TRACE_DATA_SIZE;
+        record->timestamp_us = start - trace->start_us;
+        record->dev_addr = dev_addr;
+        if(i) {
+            record->duration_us = 0;
+            record->flags = flags | DS3231_TRACE_FLAG_CONTINUED;
+            record->length = chunk;
+        } else {
+            record->duration_us = (duration > UINT16_MAX) ? UINT16_MAX : duration;
+            record->flags = flags;
+            record->length = length;
+        }
+        memcpy(record->data, &data[offset], chunk);
+        offset += chunk;
+
+        trace->next = (trace->next + 1) % trace->capacity;
+        if(trace->count < trace->capacity)
+            trace->count++;
+    }
+    return result;
+}
+
+static int ds3231_trace_replay(ds3231_trace_t * trace, i2c_inst_t * i2c, uint8_t dev_addr,
+    uint8_t * data, size_t length, bool nostop, bool read)
+{
+    /* A wrapped capture can start with the rest of a transfer whose first record was overwritten. */
+    while(trace->mismatch < 0 && trace->next < trace->count
+        && (trace->records[trace->next].flags & DS3231_TRACE_FLAG_CONTINUED))
+        trace->next++;
+    if(trace->mismatch >= 0 || trace->next >= trace->count) {
+        if(trace->mismatch < 0)
+            trace->mismatch = trace->next;
+        return PICO_ERROR_GENERIC;
+    }
+    ds3231_trace_record_t * record = &trace->records[trace->next];
+    uint8_t flags = 0;
+    if(read)
+        flags |= DS3231_TRACE_FLAG_READ;
+    if(nostop)
+        flags |= DS3231_TRACE_FLAG_NOSTOP;
+    if(i2c_hw_index(i2c))
+        flags |= DS3231_TRACE_FLAG_I2C1;
+
+    /* The driver must issue the same request as the one that was recorded, and all of it must
+    have been recorded. Bytes that were not recorded are never made up. */
+    uint32_t last = trace->next;
+    bool match = record->dev_addr == dev_addr && record->length == length
+        && (record->flags & ~DS3231_TRACE_FLAG_ERROR) == flags;
+    for(size_t offset = 0; match && offset < length; offset += DS3231_TRACE_DATA_SIZE) {
+        const ds3231_trace_record_t * chunk = &trace->records[last];
+        size_t size = length - offset;
+        if(size > DS3231_TRACE_DATA_SIZE)
+            size = DS3231_TRACE_DATA_SIZE;
+        if(offset && (last >= trace->count || !(chunk->flags & DS3231_TRACE_FLAG_CONTINUED) || chunk->length != size))
+            match = false;
+        else if(!read && memcmp(chunk->data, &data[offset], size))
+            match = false;
+        last++;
+    }
+    if(!match) {
+        trace->mismatch = trace->next;
+        return PICO_ERROR_GENERIC;
+    }
+    trace->next = (last > trace->next) ? last : trace->next + 1;
+
+    if(trace->mode == DS3231_TRACE_REPLAY_TIMED)
+        busy_wait_us(record->duration_us);
+    if(record->flags & DS3231_TRACE_FLAG_ERROR)
+        return PICO_ERROR_GENERIC;
+    if(read) {
+        for(size_t offset = 0; offset < length; offset += DS3231_TRACE_DATA_SIZE) {
+            size_t size = length - offset;
+            if(size > DS3231_TRACE_DATA_SIZE)
+                size = DS3231_TRACE_DATA_SIZE;
+            memcpy(&data[offset], record[offset / DS3231_TRACE_DATA_SIZE].data, size);
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief               Capture or replay a single transfer. Called by ds3231_bus_write and
+ * ds3231_bus_read while a trace is active.
+ * Transfers longer than DS3231_TRACE_DATA_SIZE take a record per DS3231_TRACE_DATA_SIZE bytes.
+ * In replay mode a transfer that does not match the next record, a transfer after the last
+ * record, or a transfer that was truncated because it did not fit in the buffer, fails with
+ * PICO_ERROR_GENERIC and trace->mismatch is set to the index of that record.
+ * Every transfer after a mismatch fails as well.
+ *
+ * @param[in] trace     Trace struct.
+ * @param[in] i2c       I2C instance used.
+ * @param[in] dev_addr  Adress of the I2C device.
+ * @param[in,out] data  Data to be written, or buffer for the data to be read.
+ * @param[in] length    Length of the transfer in bytes.
+ * @param[in] nostop    If true, the bus is not released after the transfer.
+ * @param[in] read      True for a read, false for a write.
+ * @return              Number of bytes transferred, PICO_ERROR_GENERIC if i2c failure or mismatch.
+ */
+int ds3231_trace_transfer(ds3231_trace_t * trace, i2c_inst_t * i2c, uint8_t dev_addr,
+    uint8_t * data, size_t length, bool nostop, bool read)
+{
+    if(trace->mode == DS3231_TRACE_CAPTURE)
+        return ds3231_trace_capture(trace, i2c, dev_addr, data, length, nostop, read);
+    return ds3231_trace_replay(trace, i2c, dev_addr, data, length, nostop, read);
+}
@@ -0,0 +1,76 @@
+/**
+ * @file    ds3231_trace.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   I2C transaction trace capture and replay for the DS3231 and AT24C32 drivers.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231.h"
+
+#ifndef DS_3231_TRACE
+#define DS_3231_TRACE
+
+/* Largest transfer stored in one record: an AT24C32 page write with its 2 adress bytes.
+Longer transfers continue in the records after it. */
+#define DS3231_TRACE_DATA_SIZE          (AT24C32_PAGE_SIZE + 2)
+
+/* Record flags. */
+#define DS3231_TRACE_FLAG_READ          0x01
+#define DS3231_TRACE_FLAG_NOSTOP        0x02
+#define DS3231_TRACE_FLAG_I2C1          0x04
+#define DS3231_TRACE_FLAG_ERROR         0x08
+#define DS3231_TRACE_FLAG_CONTINUED     0x10    // Holds the next bytes of the transfer in the record before.
+#define DS3231_TRACE_FLAG_TRUNCATED     0x20    // Transfer did not fit in the whole buffer and cannot be replayed.
+
+enum DS3231_TRACE_MODE {
+    DS3231_TRACE_CAPTURE = 0,   // Transactions go to the bus and are recorded, oldest records are overwritten.
+    DS3231_TRACE_REPLAY,        // Transactions are checked against the records and answered from them.
+    DS3231_TRACE_REPLAY_TIMED   // Same as replay, recorded transaction durations are reproduced as well.
+};
+
+/**
+ * @brief Struct to hold one recorded I2C transfer. Plain data, so a buffer of records can be
+ * sent from the device as-is and compiled or loaded back in for replay.
+ *
+ */
+typedef struct ds3231_trace_record_t {
+    uint32_t timestamp_us;          // Start of the transfer relative to the start of capture.
+    uint16_t duration_us;
+    uint8_t dev_addr;
+    uint8_t flags;
+    uint16_t length;                // Full transfer length, bytes in this record for continued records.
+    uint8_t data[DS3231_TRACE_DATA_SIZE];
+} ds3231_trace_record_t;
+
+/**
+ * @brief Struct to hold a trace buffer and its replay state.
+ *
+ */
+typedef struct ds3231_trace_t {
+    ds3231_trace_record_t * records;
+    uint32_t capacity;
+    uint32_t count;         // Records in the buffer.
+    uint32_t next;          // Capture: next slot to be written. Replay: next record to be matched.
+    uint32_t start_us;
+    enum DS3231_TRACE_MODE mode;
+    int32_t mismatch;       // Index of the first record the driver did not match, -1 if none.
+} ds3231_trace_t;
+
+/* Trace that the bus functions currently route through, NULL if none. */
+extern ds3231_trace_t * ds3231_trace_active;
+
+int ds3231_trace_init(ds3231_trace_t * trace, ds3231_trace_record_t * records, uint32_t capacity, uint32_t count);
+
+int ds3231_trace_start(ds3231_trace_t * trace, enum DS3231_TRACE_MODE mode);
+int ds3231_trace_stop(void);
+
+ds3231_trace_record_t * ds3231_trace_get(ds3231_trace_t * trace, uint32_t index);
+
+int ds3231_trace_transfer(ds3231_trace_t * trace, i2c_inst_t * i2c, uint8_t dev_addr,
+    uint8_t * data, size_t length, bool nostop, bool read);
+
+#endif
@@ -0,0 +1,159 @@
+/**
+ * @file    ds3231_verify.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Read-after-write verification with bad page remapping for a storage device.
+ * Every program is followed by a single sequential read of the programmed bytes. On a mismatch the
+ * program is retried, and when all retries fail the logical page is moved to a spare page:
+ * the rest of the page is copied, the new data is programmed and verified, and the spare is
+ * recorded in the remap table. A spare that fails as well is replaced by the next one, since
+ * later table entries win. Callers see a device without the spare and table pages whose programs
+ * either return verified data or fail.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_verify.h"
+#include <string.h>
+
+/**
+ * @brief               Get the page of the wrapped device a logical page is stored in.
+ *
+ * @param[in] verify    Verify struct.
+ * @param[in] page      Logical page.
+ * @return              Page of the wrapped device.
+ */
+uint32_t ds3231_verify_physical_page(ds3231_verify_t * verify, uint32_t page) {
+    for(int i = verify->spares_used - 1; i >= 0; i--) {
+        if(verify->remap[i] == page)
+            return verify->table_page - verify->spare_count + i;
+    }
+    return page;
+}
+
+static int ds3231_verify_check(ds3231_verify_t * verify, uint32_t physical, uint32_t offset, size_t length, const uint8_t * data) {
+    uint8_t buffer[DS3231_VERIFY_PAGE_SIZE_MAX];
+    if(ds3231_storage_program(verify->lower, physical, offset, length, data))
+        return -1;
+    if(ds3231_storage_read(verify->lower, physical, offset, length, buffer))
+        return -1;
+    if(memcmp(buffer, data, length)) {
+        verify->mismatches++;
+        return -1;
+    }
+    return 0;
+}
+
+/* Move a logical page to the next free spare, with data programmed over the old contents. */
+static int ds3231_verify_remap(ds3231_verify_t * verify, uint32_t page, uint32_t offset, size_t length, const uint8_t * data) {
+    uint32_t page_size = verify->lower->page_size;
+    uint8_t contents[DS3231_VERIFY_PAGE_SIZE_MAX];
+    if(ds3231_storage_read(verify->lower, ds3231_verify_physical_page(verify, page), 0, page_size, contents))
+        return -1;
+    memcpy(&contents[offset], data, length);
+
+    while(verify->spares_used < verify->spare_count) {
+        uint8_t index = verify->spares_used++;
+        uint32_t spare = verify->table_page - verify->spare_count + index;
+        bool good = !ds3231_verify_check(verify, spare, 0, page_size, contents);
+
+        /* A bad spare is recorded as replacing no page, so it is skipped after a reboot too. */
+        verify->remap[index] = good ? page : 0xFFFF;
+        uint8_t entry[2] = {verify->remap[index] & 0xFF, verify->remap[index] >> 8};
+        if(ds3231_storage_program(verify->lower, verify->table_page, 2 + 2 * index, 2, entry))
+            return -1;
+        if(ds3231_storage_program(verify->lower, verify->table_page, 1, 1, &verify->spares_used))
+            return -1;
+        if(good) {
+            verify->remaps++;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int ds3231_verify_read(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data) {
+    ds3231_verify_t * verify = (ds3231_verify_t *)storage;
+    while(length) {
+        size_t chunk = storage->page_size - offset;
+        if(chunk > length)
+            chunk = length;
+        if(ds3231_storage_read(verify->lower, ds3231_verify_physical_page(verify, page), offset, chunk, data))
+            return -1;
+        data += chunk;
+        length -= chunk;
+        page++;
+        offset = 0;
+    }
+    return 0;
+}
+
+static int ds3231_verify_program(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data) {
+    ds3231_verify_t * verify = (ds3231_verify_t *)storage;
+    uint32_t physical = ds3231_verify_physical_page(verify, page);
+    for(uint8_t attempt = 0; attempt <= verify->retries; attempt++) {
+        if(!ds3231_verify_check(verify, physical, offset, length, data))
+            return 0;
+    }
+    return ds3231_verify_remap(verify, page, offset, length, data);
+}
+
+static int ds3231_verify_busy(ds3231_storage_t * storage) {
+    ds3231_verify_t * verify = (ds3231_verify_t *)storage;
+    return ds3231_storage_busy(verify->lower);
+}
+
+static const ds3231_storage_ops_t ds3231_verify_ops = {
+    .read = &ds3231_verify_read,
+    .program = &ds3231_verify_program,
+    .busy = &ds3231_verify_busy
+};
+
+/**
+ * @brief                   Put read-after-write verification in front of a storage device and load
+ * its remap table. A device without a table gets an empty one. Layers on top of it must use the
+ * verify struct instead of the wrapped device.
+ *
+ * @param[out] verify       Verify struct.
+ * @param[in] lower         Wrapped storage device, with pages of at most DS3231_VERIFY_PAGE_SIZE_MAX bytes.
+ * @param[in] spare_count   Spare pages reserved before the table page, at most DS3231_VERIFY_SPARES_MAX
+ *                          and (page size - 2) / 2. Must stay the same for a device.
+ * @param[in] retries       Programs retried before a page is remapped.
+ * @return                  0 if succesful, -1 if the parameters are invalid or the table could not be
+ *                          read or written.
+ */
+int ds3231_verify_init(ds3231_verify_t * verify, ds3231_storage_t * lower, uint8_t spare_count, uint8_t retries) {
+    if(lower->page_size > DS3231_VERIFY_PAGE_SIZE_MAX || spare_count > DS3231_VERIFY_SPARES_MAX)
+        return -1;
+    if(2 + 2 * (uint32_t)spare_count > lower->page_size || (uint32_t)spare_count + 2 > lower->page_count)
+        return -1;
+
+    verify->lower = lower;
+    verify->retries = retries;
+    verify->spare_count = spare_count;
+    verify->table_page = lower->page_count - 1;
+    verify->mismatches = 0;
+    verify->remaps = 0;
+
+    uint8_t table[DS3231_VERIFY_PAGE_SIZE_MAX];
+    if(ds3231_storage_read(lower, verify->table_page, 0, 2 + 2 * spare_count, table))
+        return -1;
+    if(table[0] != DS3231_VERIFY_MAGIC || table[1] > spare_count) {
+        uint8_t header[2] = {DS3231_VERIFY_MAGIC, 0};
+        if(ds3231_storage_program(lower, verify->table_page, 0, 2, header))
+            return -1;
+        table[1] = 0;
+    }
+    verify->spares_used = table[1];
+    for(uint8_t i = 0; i < verify->spares_used; i++)
+        verify->remap[i] = table[2 + 2 * i] | (table[3 + 2 * i] << 8);
+
+    verify->storage.ops = &ds3231_verify_ops;
+    verify->storage.page_size = lower->page_size;
+    verify->storage.page_count = lower->page_count - spare_count - 1;
+    verify->storage.erase_pages = lower->erase_pages;
+    verify->storage.write_cycle_us = lower->write_cycle_us;
+    return 0;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file    ds3231_verify.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Read-after-write verification with bad page remapping for a storage device.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_storage.h"
+
+#ifndef DS_3231_VERIFY
+#define DS_3231_VERIFY
+
+/* Remap table page: magic byte, number of used spares, then the 16-bit logical page each spare
+replaces, little endian. With 32 byte pages the table holds 15 entries. */
+#define DS3231_VERIFY_MAGIC             0x5A
+#define DS3231_VERIFY_SPARES_MAX        15
+
+/* Largest page size of the wrapped device. */
+#ifndef DS3231_VERIFY_PAGE_SIZE_MAX
+#define DS3231_VERIFY_PAGE_SIZE_MAX     32
+#endif
+
+/**
+ * @brief Struct to hold a storage device that verifies every program of another one.
+ * The last page of the wrapped device holds the remap table, the spare pages are right before it.
+ *
+ */
+typedef struct ds3231_verify_t {
+    ds3231_storage_t storage;
+    ds3231_storage_t * lower;
+    uint8_t retries;            // Programs retried on a mismatch before the page is remapped.
+    uint8_t spare_count;
+    uint8_t spares_used;
+    uint16_t remap[DS3231_VERIFY_SPARES_MAX];   // Logical page replaced by each spare.
+    uint32_t table_page;
+    uint32_t mismatches;
+    uint32_t remaps;
+} ds3231_verify_t;
+
+int ds3231_verify_init(ds3231_verify_t * verify, ds3231_storage_t * lower, uint8_t spare_count, uint8_t retries);
+uint32_t ds3231_verify_physical_page(ds3231_verify_t * verify, uint32_t page);
+
+#endif
@@ -0,0 +1,267 @@
+/**
+ * @file    ds3231_vote.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Redundant time source that reads several DS3231 modules in parallel and votes on the time.
+ * Each module is read in one transaction that starts at the status register and wraps around to
+ * the time registers, so the oscillator stop flag comes with the time. The transactions are
+ * queued straight into the I2C FIFOs of every bus before any of them is waited for, so modules
+ * on separate buses are read at the same time and a failing bus costs DS3231_VOTE_TIMEOUT_US once
+ * instead of adding up. Modules that share a bus are read one after the other.
+ * A module is faulty if its bus fails, its OSF is set or it disagrees with the median of the
+ * others by more than DS3231_VOTE_TOLERANCE_S. With two healthy modules the time extrapolated
+ * from the last good read on the local timer is the third vote.
+ * Time is served from a primary module that is kept while it is healthy. When it fails, the next
+ * healthy module was already read in the same call and takes over at once. With no healthy module
+ * the time is extrapolated on the local timer, and the served time never goes backwards, so
+ * callers see no gap or step on failover.
+ * The reads drive the FIFOs of i2c_get_hw directly and bypass ds3231_bus_write and
+ * ds3231_bus_read. A trace does not record them, the I2C metrics do not count them and they leave
+ * no breadcrumbs. The counters of ds3231_vote_t and its units are the only record of them.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_vote.h"
+#include "hardware/timer.h"
+
+static void ds3231_vote_start(ds3231_vote_unit_t * unit) {
+    i2c_hw_t * hw = i2c_get_hw(unit->rtc->i2c);
+    hw->enable = 0;
+    hw->tar = unit->rtc->ds3231_addr;
+    hw->enable = 1;
+    (void)hw->clr_tx_abrt;
+
+    hw->data_cmd = DS3231_CONTROL_STATUS_REG;
+    for(uint8_t i = 0; i < DS3231_VOTE_READ_SIZE; i++) {
+        uint32_t command = I2C_IC_DATA_CMD_CMD_BITS;
+        if(i == 0)
+            command |= I2C_IC_DATA_CMD_RESTART_BITS;
+        if(i == DS3231_VOTE_READ_SIZE - 1)
+            command |= I2C_IC_DATA_CMD_STOP_BITS;
+        hw->data_cmd = command;
+    }
+    unit->started = true;
+}
+
+static void ds3231_vote_collect(ds3231_vote_unit_t * unit, uint64_t deadline) {
+    i2c_hw_t * hw = i2c_get_hw(unit->rtc->i2c);
+    while(hw->rxflr && unit->received < DS3231_VOTE_READ_SIZE)
+        unit->raw[unit->received++] = (uint8_t)hw->data_cmd;
+    if(unit->received == DS3231_VOTE_READ_SIZE) {
+        unit->done = true;
+        return;
+    }
+    if((hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS) || time_us_64() > deadline) {
+        (void)hw->clr_tx_abrt;
+        /* Disabling flushes the FIFOs, the next transfer enables the bus again. */
+        hw->enable = 0;
+        unit->faults |= DS3231_VOTE_BUS_ERROR;
+        unit->bus_errors++;
+        unit->done = true;
+    }
+}
+
+static bool ds3231_vote_bus_busy(ds3231_vote_t * vote, i2c_inst_t * i2c) {
+    for(uint8_t i = 0; i < vote->count; i++) {
+        ds3231_vote_unit_t * unit = &vote->units[i];
+        if(unit->started && !unit->done && unit->rtc->i2c == i2c)
+            return true;
+    }
+    return false;
+}
+
+static uint32_t ds3231_vote_median(uint32_t * values, uint8_t count) {
+    for(uint8_t i = 1; i < count; i++) {
+        for(uint8_t j = i; j > 0 && values[j - 1] > values[j]; j--) {
+            uint32_t temp = values[j];
+            values[j] = values[j - 1];
+            values[j - 1] = temp;
+        }
+    }
+    return values[count / 2];
+}
+
+static bool ds3231_vote_agrees(uint32_t a, uint32_t b) {
+    return (a > b ? a - b : b - a) <= DS3231_VOTE_TOLERANCE_S;
+}
+
+/**
+ * @brief               Initiliaze a redundant time source.
+ *
+ * @param[out] vote     Redundant time source struct.
+ * @param[in] rtcs      DS3231 structs of the modules, initiliazed with ds3231_init.
+ * @param[in] count     Number of modules, 1 to DS3231_VOTE_MAX_UNITS.
+ * @return              0 if succesful, -1 if count is invalid.
+ */
+int ds3231_vote_init(ds3231_vote_t * vote, ds3231_t ** rtcs, uint8_t count) {
+    if(!count || count > DS3231_VOTE_MAX_UNITS)
+        return -1;
+    vote->count = count;
+    vote->primary = -1;
+    vote->served = 0;
+    vote->good_epoch = 0;
+    vote->good_us = 0;
+    vote->metrics = (ds3231_vote_metrics_t){0};
+    for(uint8_t i = 0; i < count; i++) {
+        vote->units[i] = (ds3231_vote_unit_t){0};
+        vote->units[i].rtc = rtcs[i];
+    }
+    return 0;
+}
+
+/**
+ * @brief               Read all modules, vote and serve the time. Fails over to another module or
+ * to the local timer without a gap.
+ *
+ * @param[in] vote      Redundant time source struct.
+ * @param[out] epoch    Seconds since 2000-01-01 00:00:00.
+ * @return              0 if succesful, -1 if no module was ever healthy.
+ */
+int ds3231_vote_read(ds3231_vote_t * vote, uint32_t * epoch) {
+    DS3231_CRUMB_API(DS3231_CRUMB_VOTE_READ);
+    ds3231_vote_metrics_t * metrics = &vote->metrics;
+    uint64_t start = time_us_64();
+    uint64_t deadlines[DS3231_VOTE_MAX_UNITS];
+
+    for(uint8_t i = 0; i < vote->count; i++) {
+        ds3231_vote_unit_t * unit = &vote->units[i];
+        unit->started = false;
+        unit->done = false;
+        unit->received = 0;
+        unit->faults = 0;
+    }
+
+    /* Queue a read on every free bus, then collect until every module answered or timed out. */
+    uint8_t pending = vote->count;
+    while(pending) {
+        for(uint8_t i = 0; i < vote->count; i++) {
+            ds3231_vote_unit_t * unit = &vote->units[i];
+            if(unit->done)
+                continue;
+            if(!unit->started) {
+                if(ds3231_vote_bus_busy(vote, unit->rtc->i2c))
+                    continue;
+                ds3231_vote_start(unit);
+                deadlines[i] = time_us_64() + DS3231_VOTE_TIMEOUT_US;
+            }
+            ds3231_vote_collect(unit, deadlines[i]);
+            if(unit->done)
+                pending--;
+        }
+    }
+    uint64_t read_end = time_us_64();
+
+    uint32_t votes[DS3231_VOTE_MAX_UNITS + 1];
+    uint8_t healthy = 0;
+    for(uint8_t i = 0; i < vote->count; i++) {
+        ds3231_vote_unit_t * unit = &vote->units[i];
+        if(unit->faults)
+            continue;
+        if(unit->raw[0] & (0x01 << 7)) {
+            unit->faults |= DS3231_VOTE_OSF;
+            unit->osf_reads++;
+            continue;
+        }
+        ds3231_data_t data;
+        ds3231_decode_time(unit->rtc, &unit->raw[4], &data);
+        unit->epoch = ds3231_time_to_epoch(unit->rtc, &data);
+        votes[healthy++] = unit->epoch;
+    }
+
+    bool history = vote->primary >= 0;
+    uint32_t predicted = vote->good_epoch + (uint32_t)((start - vote->good_us) / 1000000);
+    if(healthy == 2 && !ds3231_vote_agrees(votes[0], votes[1])) {
+        if(history)
+            votes[healthy++] = predicted;
+        else
+            metrics->disagreements++;
+    }
+    if(healthy >= 3) {
+        uint32_t median = ds3231_vote_median(votes, healthy);
+        for(uint8_t i = 0; i < vote->count; i++) {
+            ds3231_vote_unit_t * unit = &vote->units[i];
+            if(!unit->faults && !ds3231_vote_agrees(unit->epoch, median)) {
+                unit->faults |= DS3231_VOTE_OUTLIER;
+                unit->outliers++;
+            }
+        }
+    }
+
+    int8_t primary = vote->primary;
+    if(primary < 0 || vote->units[primary].faults) {
+        for(uint8_t i = 0; i < vote->count; i++) {
+            if(!vote->units[i].faults) {
+                primary = i;
+                break;
+            }
+        }
+    }
+
+    uint32_t served;
+    if(primary >= 0 && !vote->units[primary].faults) {
+        if(vote->primary >= 0 && primary != vote->primary) {
+            uint64_t latency = time_us_64() - start;
+            metrics->failovers++;
+            metrics->failover_us = (uint32_t)latency;
+            if(metrics->failover_us > metrics->max_failover_us)
+                metrics->max_failover_us = metrics->failover_us;
+        }
+        vote->primary = primary;
+        served = vote->units[primary].epoch;
+        vote->good_epoch = served;
+        vote->good_us = start;
+    } else if(history) {
+        metrics->holdovers++;
+        served = predicted;
+    } else {
+        return -1;
+    }
+    if(served < vote->served)
+        served = vote->served;
+    vote->served = served;
+    *epoch = served;
+
+    uint64_t end = time_us_64();
+    metrics->reads++;
+    metrics->read_us = (uint32_t)(read_end - start);
+    if(metrics->read_us > metrics->max_read_us)
+        metrics->max_read_us = metrics->read_us;
+    metrics->vote_us = (uint32_t)(end - read_end);
+    if(metrics->vote_us > metrics->max_vote_us)
+        metrics->max_vote_us = metrics->vote_us;
+    return 0;
+}
+
+/**
+ * @brief               Read the voted time in the format of ds3231_read_current_time. Hours are
+ * in AM/PM mode if the first module is.
+ *
+ * @param[in] vote      Redundant time source struct.
+ * @param[out] data     Current time.
+ * @return              0 if succesful, -1 if no module was ever healthy.
+ */
+int ds3231_vote_read_time(ds3231_vote_t * vote, ds3231_data_t * data) {
+    uint32_t epoch;
+    if(ds3231_vote_read(vote, &epoch))
+        return -1;
+    ds3231_epoch_to_time(vote->units[0].rtc, epoch, data);
+    return 0;
+}
+
+/**
+ * @brief               Get the modules that were faulty on the last read.
+ *
+ * @param[in] vote      Redundant time source struct.
+ * @return              Bit mask of the modules, bit 0 for the first one.
+ */
+uint8_t ds3231_vote_faulty(ds3231_vote_t * vote) {
+    uint8_t mask = 0;
+    for(uint8_t i = 0; i < vote->count; i++) {
+        if(vote->units[i].faults)
+            mask |= (0x01 << i);
+    }
+    return mask;
+}
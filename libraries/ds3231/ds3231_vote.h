@@ -0,0 +1,90 @@
+/**
+ * @file    ds3231_vote.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Redundant time source that reads several DS3231 modules in parallel and votes on the time.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231.h"
+
+#ifndef DS_3231_VOTE
+#define DS_3231_VOTE
+
+#define DS3231_VOTE_MAX_UNITS           3
+
+/* Modules read at slightly different times can straddle a second boundary. */
+#define DS3231_VOTE_TOLERANCE_S         1
+
+/* A module that has not answered by then is counted as a bus failure, 11 bytes take 1.1 ms at 100 kHz. */
+#ifndef DS3231_VOTE_TIMEOUT_US
+#define DS3231_VOTE_TIMEOUT_US          2000
+#endif
+
+/* Status, aging offset and temperature (0x0F - 0x12), then the time (0x00 - 0x06) after the
+register pointer wraps around. */
+#define DS3231_VOTE_READ_SIZE           11
+
+enum DS3231_VOTE_FAULTS {
+    DS3231_VOTE_BUS_ERROR = 0x01,   // No answer or an aborted transfer.
+    DS3231_VOTE_OSF       = 0x02,   // Oscillator stop flag set, the time can not be trusted.
+    DS3231_VOTE_OUTLIER   = 0x04    // Disagrees with the median of the other modules.
+};
+
+/**
+ * @brief Struct to hold one module of a redundant time source.
+ *
+ */
+typedef struct ds3231_vote_unit_t {
+    ds3231_t * rtc;
+    uint8_t raw[DS3231_VOTE_READ_SIZE];
+    uint8_t received;
+    bool started;
+    bool done;
+    uint8_t faults;                 // DS3231_VOTE_FAULTS of the last read, 0 if healthy.
+    uint32_t epoch;                 // Seconds since 2000 of the last read.
+    uint32_t bus_errors;
+    uint32_t osf_reads;
+    uint32_t outliers;
+} ds3231_vote_unit_t;
+
+/**
+ * @brief Struct to hold the metrics of a redundant time source. Times are in microseconds.
+ *
+ */
+typedef struct ds3231_vote_metrics_t {
+    uint32_t reads;
+    uint32_t read_us;               // Parallel bus read of the last call.
+    uint32_t max_read_us;
+    uint32_t vote_us;               // Decoding and voting of the last call.
+    uint32_t max_vote_us;
+    uint32_t failovers;
+    uint32_t failover_us;           // From the start of the read to serving from the new primary.
+    uint32_t max_failover_us;
+    uint32_t holdovers;             // Reads without a healthy module, served from the local timer.
+    uint32_t disagreements;         // Two modules that disagree with nothing to break the tie.
+} ds3231_vote_metrics_t;
+
+/**
+ * @brief Struct to hold the state of a redundant time source.
+ *
+ */
+typedef struct ds3231_vote_t {
+    ds3231_vote_unit_t units[DS3231_VOTE_MAX_UNITS];
+    uint8_t count;
+    int8_t primary;                 // Module the time is served from, -1 before the first good read.
+    uint32_t served;                // Last served time, never goes backwards.
+    uint32_t good_epoch;            // Last time read from a healthy module.
+    uint64_t good_us;               // Local time of that read.
+    ds3231_vote_metrics_t metrics;
+} ds3231_vote_t;
+
+int ds3231_vote_init(ds3231_vote_t * vote, ds3231_t ** rtcs, uint8_t count);
+int ds3231_vote_read(ds3231_vote_t * vote, uint32_t * epoch);
+int ds3231_vote_read_time(ds3231_vote_t * vote, ds3231_data_t * data);
+uint8_t ds3231_vote_faulty(ds3231_vote_t * vote);
+
+#endif
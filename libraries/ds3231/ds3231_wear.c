@@ -0,0 +1,185 @@
+/**
+ * @file    ds3231_wear.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Per-page write counters and endurance forecast for a storage device.
+ * Wraps another storage device and counts the programs of every page in RAM. The counters are
+ * checkpointed as one byte per page in the last pages of the tracked device, in steps of
+ * DS3231_WEAR_SCALE writes. A checkpoint byte is written only when the step of its page changes,
+ * so tracking adds one single-byte write per 4096 writes, and a reset loses less than one step.
+ * Erased checkpoint bytes (0xFF) read as 0, so a new device starts counting from zero.
+ * Writes to the checkpoint pages are counted as well.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_wear.h"
+#include <string.h>
+
+static void ds3231_wear_count_write(ds3231_wear_t * wear, uint32_t page);
+
+static void ds3231_wear_checkpoint(ds3231_wear_t * wear, uint32_t page) {
+    uint32_t step = wear->counts[page] / DS3231_WEAR_SCALE;
+    uint8_t value = step > DS3231_WEAR_CHECKPOINT_MAX ? DS3231_WEAR_CHECKPOINT_MAX : step;
+    uint32_t page_size = wear->lower->page_size;
+    uint32_t checkpoint_page = wear->checkpoint_page + page / page_size;
+    if(ds3231_storage_program(wear->lower, checkpoint_page, page % page_size, 1, &value))
+        return;
+    wear->checkpoints++;
+    ds3231_wear_count_write(wear, checkpoint_page);
+}
+
+static void ds3231_wear_count_write(ds3231_wear_t * wear, uint32_t page) {
+    wear->counts[page]++;
+    wear->session[page]++;
+    if(!(wear->counts[page] % DS3231_WEAR_SCALE))
+        ds3231_wear_checkpoint(wear, page);
+}
+
+static int ds3231_wear_read(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data) {
+    ds3231_wear_t * wear = (ds3231_wear_t *)storage;
+    return ds3231_storage_read(wear->lower, page, offset, length, data);
+}
+
+static int ds3231_wear_program(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data) {
+    ds3231_wear_t * wear = (ds3231_wear_t *)storage;
+    /* Failed programs may still have started a write cycle, so they are counted too. */
+    int result = ds3231_storage_program(wear->lower, page, offset, length, data);
+    ds3231_wear_count_write(wear, page);
+    return result;
+}
+
+static int ds3231_wear_busy(ds3231_storage_t * storage) {
+    ds3231_wear_t * wear = (ds3231_wear_t *)storage;
+    return ds3231_storage_busy(wear->lower);
+}
+
+static const ds3231_storage_ops_t ds3231_wear_ops = {
+    .read = &ds3231_wear_read,
+    .program = &ds3231_wear_program,
+    .busy = &ds3231_wear_busy
+};
+
+/**
+ * @brief               Start tracking a storage device and load its checkpointed counters.
+ * The wear struct is a storage device itself, with the checkpoint pages removed from the end.
+ * Layers on top of it must use it instead of the tracked device.
+ *
+ * @param[out] wear     Wear tracking struct.
+ * @param[in] lower     Tracked storage device with at most DS3231_WEAR_MAX_PAGES pages.
+ * @return              0 if succesful, -1 if the device is too large or reading the checkpoint failed.
+ */
+int ds3231_wear_init(ds3231_wear_t * wear, ds3231_storage_t * lower) {
+    if(lower->page_count > DS3231_WEAR_MAX_PAGES)
+        return -1;
+    uint32_t checkpoint_pages = (lower->page_count + lower->page_size - 1) / lower->page_size;
+    if(checkpoint_pages >= lower->page_count)
+        return -1;
+
+    memset(wear->counts, 0, sizeof(wear->counts));
+    memset(wear->session, 0, sizeof(wear->session));
+    wear->lower = lower;
+    wear->checkpoint_page = lower->page_count - checkpoint_pages;
+    wear->checkpoints = 0;
+
+    uint8_t steps[DS3231_WEAR_MAX_PAGES];
+    if(ds3231_storage_read(lower, wear->checkpoint_page, 0, lower->page_count, steps))
+        return -1;
+    for(uint32_t i = 0; i < lower->page_count; i++) {
+        if(steps[i] != 0xFF)
+            wear->counts[i] = (uint32_t)steps[i] * DS3231_WEAR_SCALE;
+    }
+
+    wear->storage.ops = &ds3231_wear_ops;
+    wear->storage.page_size = lower->page_size;
+    wear->storage.page_count = wear->checkpoint_page;
+    wear->storage.erase_pages = lower->erase_pages;
+    wear->storage.write_cycle_us = lower->write_cycle_us;
+    return 0;
+}
+
+/**
+ * @brief               Get the write count of a page of the tracked device.
+ *
+ * @param[in] wear      Wear tracking struct.
+ * @param[in] page      Page of the tracked device, including the checkpoint pages.
+ * @return              Number of writes, 0 if the page is invalid.
+ */
+uint32_t ds3231_wear_count(ds3231_wear_t * wear, uint32_t page) {
+    if(page >= wear->lower->page_count)
+        return 0;
+    return wear->counts[page];
+}
+
+/**
+ * @brief                   Find the least written page of a range, e.g. to place a new log or
+ * a frequently rewritten record.
+ *
+ * @param[in] wear          Wear tracking struct.
+ * @param[in] first_page    First page of the range.
+ * @param[in] page_count    Number of pages in the range.
+ * @return                  Least written page, first_page if the range is empty or invalid.
+ */
+uint32_t ds3231_wear_least_worn(ds3231_wear_t * wear, uint32_t first_page, uint32_t page_count) {
+    uint32_t best = first_page;
+    for(uint32_t page = first_page; page < first_page + page_count && page < wear->lower->page_count; page++) {
+        if(wear->counts[page] < wear->counts[best])
+            best = page;
+    }
+    return best;
+}
+
+/**
+ * @brief               Count the pages of the tracked device by number of writes.
+ *
+ * @param[in] wear      Wear tracking struct.
+ * @param[in] bin_width Writes per bin.
+ * @param[out] bins     Number of pages per bin. Pages beyond the last bin are counted in it.
+ * @param[in] bin_count Number of bins.
+ * @return              0 if succesful, -1 if bin_width or bin_count is 0.
+ */
+int ds3231_wear_histogram(ds3231_wear_t * wear, uint32_t bin_width, uint16_t * bins, uint8_t bin_count) {
+    if(!bin_width || !bin_count)
+        return -1;
+    memset(bins, 0, bin_count * sizeof(bins[0]));
+    for(uint32_t page = 0; page < wear->lower->page_count; page++) {
+        uint32_t bin = wear->counts[page] / bin_width;
+        bins[bin < bin_count ? bin : (uint32_t)bin_count - 1]++;
+    }
+    return 0;
+}
+
+/**
+ * @brief                   Forecast when the first page reaches its rated endurance, assuming every
+ * page keeps being written at its rate since ds3231_wear_init.
+ *
+ * @param[in] wear          Wear tracking struct.
+ * @param[in] endurance     Rated writes per page, e.g. DS3231_WEAR_AT24C32_ENDURANCE.
+ * @param[in] elapsed_s     Seconds since ds3231_wear_init, e.g. from the DS3231 time.
+ * @param[out] page         Page expected to wear out first.
+ * @param[out] remaining_s  Seconds until that page reaches the endurance, 0 if it already has.
+ * @return                  0 if succesful, -1 if no page was written since ds3231_wear_init
+ *                          or elapsed_s is 0.
+ */
+int ds3231_wear_forecast(ds3231_wear_t * wear, uint32_t endurance, uint32_t elapsed_s,
+    uint32_t * page, uint64_t * remaining_s)
+{
+    if(!elapsed_s)
+        return -1;
+    bool found = false;
+    for(uint32_t i = 0; i < wear->lower->page_count; i++) {
+        if(!wear->session[i])
+            continue;
+        uint64_t left = 0;
+        if(wear->counts[i] < endurance)
+            left = (uint64_t)(endurance - wear->counts[i]) * elapsed_s / wear->session[i];
+        if(!found || left < *remaining_s) {
+            *page = i;
+            *remaining_s = left;
+            found = true;
+        }
+    }
+    return found ? 0 : -1;
+}
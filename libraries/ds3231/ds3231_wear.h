@@ -0,0 +1,50 @@
+/**
+ * @file    ds3231_wear.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Per-page write counters and endurance forecast for a storage device.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_storage.h"
+
+#ifndef DS_3231_WEAR
+#define DS_3231_WEAR
+
+/* Largest number of pages of the tracked device, one counter each in RAM. */
+#ifndef DS3231_WEAR_MAX_PAGES
+#define DS3231_WEAR_MAX_PAGES           128
+#endif
+
+/* Counters are checkpointed as one byte per page in steps of DS3231_WEAR_SCALE writes. */
+#define DS3231_WEAR_SCALE               4096
+#define DS3231_WEAR_CHECKPOINT_MAX      0xFE
+
+/* Rated write cycles of an AT24C32 page. */
+#define DS3231_WEAR_AT24C32_ENDURANCE   1000000
+
+/**
+ * @brief Struct to hold a storage device that counts the writes of another one. The last pages
+ * of the tracked device hold the checkpointed counters and are not part of this device.
+ *
+ */
+typedef struct ds3231_wear_t {
+    ds3231_storage_t storage;
+    ds3231_storage_t * lower;           // Tracked device.
+    uint32_t checkpoint_page;           // First checkpoint page of the tracked device.
+    uint32_t counts[DS3231_WEAR_MAX_PAGES];
+    uint32_t session[DS3231_WEAR_MAX_PAGES];    // Writes since ds3231_wear_init.
+    uint32_t checkpoints;               // Checkpoint bytes written.
+} ds3231_wear_t;
+
+int ds3231_wear_init(ds3231_wear_t * wear, ds3231_storage_t * lower);
+uint32_t ds3231_wear_count(ds3231_wear_t * wear, uint32_t page);
+uint32_t ds3231_wear_least_worn(ds3231_wear_t * wear, uint32_t first_page, uint32_t page_count);
+int ds3231_wear_histogram(ds3231_wear_t * wear, uint32_t bin_width, uint16_t * bins, uint8_t bin_count);
+int ds3231_wear_forecast(ds3231_wear_t * wear, uint32_t endurance, uint32_t elapsed_s,
+    uint32_t * page, uint64_t * remaining_s);
+
+#endif
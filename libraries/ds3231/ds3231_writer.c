@@ -0,0 +1,245 @@
+/**
+ * @file    ds3231_writer.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Background writer that overlaps EEPROM write cycles with other work.
+ * Programs are copied into a queue and return at once. ds3231_writer_poll issues the oldest
+ * queued write as soon as the wrapped device is no longer busy, checked with a single address
+ * poll for the AT24C32, so it never waits for a write cycle itself. Call it from the main loop,
+ * the same context the programs come from, the queue is not guarded against interrupts.
+ *
+ * Polling from a timer or alarm interrupt is not supported: the AT24C32 shares the bus with the
+ * DS3231, and the main loop may be in the middle of a transfer when the interrupt fires. Instead
+ * a schedule hook set with ds3231_writer_set_schedule is told when the next poll is due, after a
+ * write cycle or a retry delay, e.g. to add an at-time worker to a pico_async_context that also
+ * does the other bus work, or to set a flag the main loop sleeps on.
+ *
+ * A write the device fails stays queued and is retried after DS3231_WRITER_RETRY_US, doubled for
+ * every further failure. After DS3231_WRITER_ATTEMPTS failures it is dropped, counted and its
+ * page kept in dropped_page, and poll returns DS3231_WRITER_DROPPED, so a failing device does not
+ * hold the queue forever.
+ * A program to a page that is already queued is merged into the queued write when the
+ * ranges touch, so log appends to the same page cost one write cycle.
+ * Reads overlay the queued data on the device contents, and reads covered by a single queued
+ * write do not touch the device at all. A program into a full queue never waits, it returns
+ * DS3231_WRITER_FULL and the caller tries again after a poll.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_writer.h"
+#include "hardware/timer.h"
+#include <string.h>
+
+static ds3231_writer_entry_t * ds3231_writer_entry(ds3231_writer_t * writer, uint8_t index) {
+    return &writer->queue[(writer->head + index) % DS3231_WRITER_QUEUE_LENGTH];
+}
+
+static void ds3231_writer_pop(ds3231_writer_t * writer) {
+    writer->head = (writer->head + 1) % DS3231_WRITER_QUEUE_LENGTH;
+    writer->count--;
+    writer->attempts = 0;
+}
+
+/* Ask for the next poll if writes are left. */
+static void ds3231_writer_later(ds3231_writer_t * writer, uint32_t delay_us) {
+    if(writer->count && writer->schedule)
+        writer->schedule(writer->schedule_ctx, delay_us);
+}
+
+/* Copy the queued bytes of a page range over data, oldest first so newer writes win. */
+static bool ds3231_writer_overlay(ds3231_writer_t * writer, uint32_t page, uint32_t offset, size_t length, uint8_t * data) {
+    bool covered = false;
+    for(uint8_t i = 0; i < writer->count; i++) {
+        ds3231_writer_entry_t * entry = ds3231_writer_entry(writer, i);
+        if(entry->page != page)
+            continue;
+        uint32_t start = entry->start > offset ? entry->start : offset;
+        uint32_t end = entry->end < offset + length ? entry->end : offset + length;
+        if(start >= end)
+            continue;
+        memcpy(&data[start - offset], &entry->data[start], end - start);
+        if(start == offset && end == offset + length)
+            covered = true;
+    }
+    return covered;
+}
+
+static int ds3231_writer_read(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data) {
+    ds3231_writer_t * writer = (ds3231_writer_t *)storage;
+    if(offset + length <= storage->page_size) {
+        /* Try the queue first, a full hit avoids waiting for a write cycle. */
+        uint8_t buffer[DS3231_WRITER_PAGE_SIZE_MAX];
+        if(ds3231_writer_overlay(writer, page, offset, length, buffer)) {
+            memcpy(data, buffer, length);
+            writer->queue_hits++;
+            return 0;
+        }
+    }
+    if(ds3231_storage_read(writer->lower, page, offset, length, data))
+        return -1;
+    while(length) {
+        size_t chunk = storage->page_size - offset;
+        if(chunk > length)
+            chunk = length;
+        ds3231_writer_overlay(writer, page, offset, chunk, data);
+        data += chunk;
+        length -= chunk;
+        page++;
+        offset = 0;
+    }
+    return 0;
+}
+
+static int ds3231_writer_program(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data) {
+    ds3231_writer_t * writer = (ds3231_writer_t *)storage;
+
+    /* Only the newest write of a page may be extended, older ones must stay ordered before it. */
+    for(int i = writer->count - 1; i >= 0; i--) {
+        ds3231_writer_entry_t * entry = ds3231_writer_entry(writer, i);
+        if(entry->page != page)
+            continue;
+        if(offset <= entry->end && (offset + length) >= entry->start) {
+            memcpy(&entry->data[offset], data, length);
+            if(offset < entry->start)
+                entry->start = offset;
+            if(offset + length > entry->end)
+                entry->end = offset + length;
+            writer->merged++;
+            return 0;
+        }
+        break;
+    }
+
+    if(writer->count == DS3231_WRITER_QUEUE_LENGTH)
+        ds3231_writer_poll(writer);
+    if(writer->count == DS3231_WRITER_QUEUE_LENGTH) {
+        writer->stalls++;
+        return DS3231_WRITER_FULL;
+    }
+
+    ds3231_writer_entry_t * entry = ds3231_writer_entry(writer, writer->count);
+    entry->page = page;
+    entry->start = offset;
+    entry->end = offset + length;
+    memcpy(&entry->data[offset], data, length);
+    writer->count++;
+    ds3231_writer_poll(writer);
+    return 0;
+}
+
+static int ds3231_writer_busy(ds3231_storage_t * storage) {
+    ds3231_writer_t * writer = (ds3231_writer_t *)storage;
+    ds3231_writer_poll(writer);
+    if(writer->count)
+        return 1;
+    return ds3231_storage_busy(writer->lower);
+}
+
+static const ds3231_storage_ops_t ds3231_writer_ops = {
+    .read = &ds3231_writer_read,
+    .program = &ds3231_writer_program,
+    .busy = &ds3231_writer_busy
+};
+
+/**
+ * @brief               Put a background writer in front of a storage device. Layers on top of it
+ * must use the writer instead of the wrapped device.
+ *
+ * @param[out] writer   Writer struct.
+ * @param[in] lower     Wrapped storage device, with pages of at most DS3231_WRITER_PAGE_SIZE_MAX bytes.
+ * @return              0 if succesful, -1 if the pages of the device are too large.
+ */
+int ds3231_writer_init(ds3231_writer_t * writer, ds3231_storage_t * lower) {
+    if(lower->page_size > DS3231_WRITER_PAGE_SIZE_MAX)
+        return -1;
+    memset(writer, 0, sizeof(*writer));
+    writer->lower = lower;
+    writer->storage.ops = &ds3231_writer_ops;
+    writer->storage.page_size = lower->page_size;
+    writer->storage.page_count = lower->page_count;
+    writer->storage.erase_pages = lower->erase_pages;
+    writer->storage.write_cycle_us = lower->write_cycle_us;
+    return 0;
+}
+
+/**
+ * @brief               Have a hook told when the next poll is due, so the queue drains without
+ * the main loop polling all the time. The hook is called from poll and program.
+ *
+ * @param[in] writer    Writer struct.
+ * @param[in] schedule  Hook, NULL to poll from the main loop only.
+ * @param[in] ctx       Passed to the hook.
+ */
+void ds3231_writer_set_schedule(ds3231_writer_t * writer, ds3231_writer_schedule_t schedule, void * ctx) {
+    writer->schedule = schedule;
+    writer->schedule_ctx = ctx;
+    ds3231_writer_later(writer, 0);
+}
+
+/**
+ * @brief               Issue the oldest queued write if the device finished its write cycle.
+ * Returns without waiting if it did not, or if a failed write waits for its retry. Call it from
+ * the main loop.
+ *
+ * @param[in] writer    Writer struct.
+ * @return              Number of writes still queued, -1 if the device failed and the write stays
+ *                      queued for a retry, DS3231_WRITER_DROPPED if it failed for the last time.
+ */
+int ds3231_writer_poll(ds3231_writer_t * writer) {
+    if(!writer->count)
+        return 0;
+    uint64_t now = time_us_64();
+    if(writer->attempts && now < writer->retry_us)
+        return writer->count;
+    int busy = ds3231_storage_busy(writer->lower);
+    if(busy > 0) {
+        if(now < writer->cycle_end_us)
+            ds3231_writer_later(writer, writer->cycle_end_us - now);
+        else
+            ds3231_writer_later(writer, writer->storage.write_cycle_us / 4);
+        return writer->count;
+    }
+
+    ds3231_writer_entry_t * entry = ds3231_writer_entry(writer, 0);
+    if(busy < 0 || ds3231_storage_program(writer->lower, entry->page, entry->start,
+        entry->end - entry->start, &entry->data[entry->start]))
+    {
+        writer->failures++;
+        if(++writer->attempts >= DS3231_WRITER_ATTEMPTS) {
+            writer->dropped++;
+            writer->dropped_page = entry->page;
+            ds3231_writer_pop(writer);
+            ds3231_writer_later(writer, 0);
+            return DS3231_WRITER_DROPPED;
+        }
+        uint32_t delay = DS3231_WRITER_RETRY_US << (writer->attempts - 1);
+        writer->retry_us = now + delay;
+        ds3231_writer_later(writer, delay);
+        return -1;
+    }
+    writer->issued++;
+    writer->cycle_end_us = now + writer->storage.write_cycle_us;
+    ds3231_writer_pop(writer);
+    ds3231_writer_later(writer, writer->storage.write_cycle_us);
+    return writer->count;
+}
+
+/**
+ * @brief               Wait until every queued write was issued, e.g. before powering down.
+ * A write that failed before is retried once its retry delay is over.
+ *
+ * @param[in] writer    Writer struct.
+ * @return              0 if succesful, -1 if a write failed, DS3231_WRITER_DROPPED if one was
+ *                      dropped. The writes after it stay queued, flush again to write them.
+ */
+int ds3231_writer_flush(ds3231_writer_t * writer) {
+    while(writer->count) {
+        int result = ds3231_writer_poll(writer);
+        if(result < 0)
+            return result;
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file    ds3231_writer.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Background writer that overlaps EEPROM write cycles with other work.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_storage.h"
+
+#ifndef DS_3231_WRITER
+#define DS_3231_WRITER
+
+/* Number of page writes that can wait for the device. */
+#ifndef DS3231_WRITER_QUEUE_LENGTH
+#define DS3231_WRITER_QUEUE_LENGTH      8
+#endif
+
+/* Largest page size of the wrapped device. */
+#ifndef DS3231_WRITER_PAGE_SIZE_MAX
+#define DS3231_WRITER_PAGE_SIZE_MAX     32
+#endif
+
+/* Failed attempts after which a queued write is dropped. */
+#ifndef DS3231_WRITER_ATTEMPTS
+#define DS3231_WRITER_ATTEMPTS          5
+#endif
+
+/* Wait before the first retry of a failed write, doubled for every further attempt. */
+#ifndef DS3231_WRITER_RETRY_US
+#define DS3231_WRITER_RETRY_US          1000
+#endif
+
+/* Returned by a program into a full queue, nothing was queued. */
+#define DS3231_WRITER_FULL              -2
+/* Returned by ds3231_writer_poll when a write failed DS3231_WRITER_ATTEMPTS times and was dropped. */
+#define DS3231_WRITER_DROPPED           -3
+
+/**
+ * @brief Called when the queue needs another poll, delay_us from now. The hook must not poll
+ * itself, only arrange for ds3231_writer_poll to run later in the context that owns the bus.
+ *
+ */
+typedef void (*ds3231_writer_schedule_t)(void * ctx, uint32_t delay_us);
+
+/**
+ * @brief Struct to hold a queued write, bytes start to end - 1 of a page.
+ *
+ */
+typedef struct ds3231_writer_entry_t {
+    uint32_t page;
+    uint8_t start;
+    uint8_t end;
+    uint8_t data[DS3231_WRITER_PAGE_SIZE_MAX];  // Indexed by the byte in the page.
+} ds3231_writer_entry_t;
+
+/**
+ * @brief Struct to hold a storage device that queues programs and writes them to another one
+ * in the background.
+ *
+ */
+typedef struct ds3231_writer_t {
+    ds3231_storage_t storage;
+    ds3231_storage_t * lower;
+    ds3231_writer_entry_t queue[DS3231_WRITER_QUEUE_LENGTH];
+    uint8_t head;
+    uint8_t count;
+    ds3231_writer_schedule_t schedule;          // NULL if the main loop polls on its own.
+    void * schedule_ctx;
+    uint8_t attempts;           // Failed attempts of the oldest queued write.
+    uint64_t retry_us;          // time_us_64 before which it is not retried.
+    uint64_t cycle_end_us;      // time_us_64 the last issued write cycle typically ends.
+    uint32_t issued;            // Programs passed to the wrapped device.
+    uint32_t merged;            // Programs merged into a queued write.
+    uint32_t stalls;            // Programs refused with DS3231_WRITER_FULL.
+    uint32_t queue_hits;        // Reads served from the queue only.
+    uint32_t failures;          // Attempts the wrapped device failed.
+    uint32_t dropped;           // Writes given up after DS3231_WRITER_ATTEMPTS failures.
+    uint32_t dropped_page;      // Page of the last dropped write.
+} ds3231_writer_t;
+
+int ds3231_writer_init(ds3231_writer_t * writer, ds3231_storage_t * lower);
+void ds3231_writer_set_schedule(ds3231_writer_t * writer, ds3231_writer_schedule_t schedule, void * ctx);
+int ds3231_writer_poll(ds3231_writer_t * writer);
+int ds3231_writer_flush(ds3231_writer_t * writer);
+
+#endif
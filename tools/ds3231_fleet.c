@@ -0,0 +1,674 @@
+/**
+ * @file    ds3231_fleet.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Linux daemon that syncs the time, pushes the configuration and harvests the EEPROM of
+ * every attached board at the same time.
+ * Every board has its own state machine and all of them are driven from one epoll loop over
+ * their USB CDC ttys, so a slow or hung board only holds up itself. A round of a board is:
+ *   1. Time requests back to back until the seconds of the DS3231 roll over. The rollover pins the
+ *      offset of the DS3231 to the host clock down to the round trip, well below a second.
+ *   2. Configuration push, chunks are sent with FLEET_WINDOW of them in flight. First round only.
+ *   3. Incremental harvest with ds3231_sync, only pages that changed since the last round are sent.
+ *   4. If the offset was FLEET_SET_THRESHOLD_MS or more or the oscillator had stopped, time set
+ *      at the start of the next second of the host clock and time requests to check the result.
+ * The harvest comes before the time set so the board is idle when the set goes out. See
+ * ds3231_command.c and ds3231_sync.c for the device side.
+ * Build on the host with:
+ *   cc -I libraries/ds3231 -o ds3231_fleet tools/ds3231_fleet.c libraries/ds3231/ds3231_link.c
+ *      libraries/ds3231/ds3231_sync.c libraries/ds3231/ds3231_storage.c
+ *
+ * Usage:
+ *   ds3231_fleet [-c config] [-o directory] [-r seconds] [-e page size:page count] [-f] <tty pattern>...
+ * Patterns are expanded again every second, so boards that are plugged in later join. Harvested
+ * images are written to <directory>/<tty name>.img, with the sync session and the generation of
+ * every page in <directory>/<tty name>.sync. Both are loaded when a board is first seen, so after
+ * a restart the harvest carries on from where it was instead of fetching every page again.
+ * Without -r every board runs one round and the daemon exits when all of them are done, with -r a
+ * board starts a round that many seconds after its last one ended. Boards that fail are opened
+ * and started again by the next scan. Without -r a match gets FLEET_ATTEMPTS tries, so a file
+ * that is not a board times out and is skipped, and the exit status is 1 if any was skipped.
+ * -f sets the time even if the offset is below the threshold.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_sync.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FLEET_MAX_DEVICES       1024
+#define FLEET_TIMEOUT_MS        5000
+#define FLEET_WINDOW            4
+#define FLEET_CHUNK_SIZE        128
+#define FLEET_OUT_SIZE          8192
+#define FLEET_EPOCH_2000        946684800
+#define FLEET_SAMPLE_MS         1200    // Longest time request series, the seconds roll over in it.
+#define FLEET_RESOLUTION_US     5000    // Time request series stops once the offset is known this well.
+#define FLEET_SET_THRESHOLD_MS  20
+#define FLEET_ATTEMPTS          3       // Tries of a board without -r before it is skipped.
+#define FLEET_STATE_MAGIC       0x54534C46  // "FLST", first word of a .sync file.
+
+enum FLEET_STATES {
+    FLEET_CLOSED = 0,
+    FLEET_TIME_QUERY,
+    FLEET_CONFIG,
+    FLEET_HARVEST,
+    FLEET_TIME_WAIT,            // Waiting for the start of the next second.
+    FLEET_TIME_SET,
+    FLEET_TIME_VERIFY,
+    FLEET_IDLE,
+    FLEET_FAILED                // Skipped after FLEET_ATTEMPTS failures without -r.
+};
+
+static const char * state_names[] = {"closed", "time query", "config", "harvest", "time wait",
+    "time set", "time verify", "idle", "failed"};
+
+typedef struct fleet_device_t {
+    char path[256];
+    const char * name;
+    int fd;
+    enum FLEET_STATES state;
+    uint64_t deadline_ms;       // Timeout of the state, start of the next round when idle.
+    ds3231_link_parser_t parser;
+    uint16_t seq;
+
+    uint8_t out[FLEET_OUT_SIZE];
+    size_t out_length;
+    bool out_waiting;           // EPOLLOUT is armed.
+
+    uint64_t round_ms;
+    uint32_t rounds;
+    uint32_t failures;
+    int32_t offset_ms;          // DS3231 minus host clock.
+    bool stopped;               // Oscillator stop flag was set.
+    int32_t residual_ms;
+    uint64_t sample_ms;         // Start of the time request series.
+    int64_t sent_us;            // Host clock when the last time request went out.
+    int64_t offset_min_us;      // The offset is within these bounds, narrowed by every answer.
+    int64_t offset_max_us;
+    bool time_set;
+    bool config_done;
+    uint32_t config_sent;
+    uint32_t config_acked;
+    uint8_t in_flight;
+    ds3231_sync_mirror_t mirror;
+    uint8_t * image;
+    uint32_t pages;             // Pages received in this round.
+} fleet_device_t;
+
+static fleet_device_t * devices[FLEET_MAX_DEVICES];
+static int device_count;
+static int epoll_fd;
+
+static uint8_t * config;
+static uint32_t config_size;
+static const char * out_dir = ".";
+static int repeat_s = -1;
+static bool force_set;
+static uint32_t page_size = 32;
+static uint32_t page_count = 128;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static struct timespec wall(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts;
+}
+
+static int64_t wall_us(void) {
+    struct timespec ts = wall();
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void device_arm(fleet_device_t * device, bool out) {
+    if(device->out_waiting == out)
+        return;
+    struct epoll_event event = {.events = EPOLLIN | (out ? EPOLLOUT : 0), .data.ptr = device};
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, device->fd, &event);
+    device->out_waiting = out;
+}
+
+static void device_flush(fleet_device_t * device) {
+    size_t done = 0;
+    while(done < device->out_length) {
+        ssize_t written = write(device->fd, device->out + done, device->out_length - done);
+        if(written < 0 && errno == EINTR)
+            continue;
+        if(written <= 0)
+            break;
+        done += written;
+    }
+    memmove(device->out, device->out + done, device->out_length - done);
+    device->out_length -= done;
+    device_arm(device, device->out_length > 0);
+}
+
+/* Frames are queued and flushed right away, whatever the tty does not take goes out on EPOLLOUT. */
+static int device_write(void * ctx, const uint8_t * data, size_t length) {
+    fleet_device_t * device = ctx;
+    if(device->out_length + length > FLEET_OUT_SIZE)
+        return -1;
+    memcpy(device->out + device->out_length, data, length);
+    device->out_length += length;
+    return 0;
+}
+
+static int device_send(fleet_device_t * device, uint8_t type, const uint8_t * payload, size_t length) {
+    int result = ds3231_link_send(device_write, device, type, ++device->seq, payload, length, NULL, 0);
+    device_flush(device);
+    return result;
+}
+
+static void device_state(fleet_device_t * device, enum FLEET_STATES state, uint64_t deadline_ms) {
+    device->state = state;
+    device->deadline_ms = deadline_ms;
+}
+
+static void device_close(fleet_device_t * device, const char * reason) {
+    if(device->fd < 0)
+        return;
+    if(reason)
+        printf("%s: %s in %s\n", device->name, reason, state_names[device->state]);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, device->fd, NULL);
+    close(device->fd);
+    device->fd = -1;
+    device->out_length = 0;
+    device->out_waiting = false;
+    device_state(device, FLEET_CLOSED, UINT64_MAX);
+}
+
+/* Without -r a board that keeps failing is given up, so the daemon still exits. */
+static void device_count_failure(fleet_device_t * device) {
+    if(repeat_s >= 0 || ++device->failures < FLEET_ATTEMPTS)
+        return;
+    printf("%s: skipped after %d attempts\n", device->name, FLEET_ATTEMPTS);
+    device_state(device, FLEET_FAILED, UINT64_MAX);
+}
+
+static void device_fail(fleet_device_t * device, const char * reason) {
+    /* Opened again by the next scan, the mirror is kept so the harvest stays incremental. */
+    device_close(device, reason);
+    device_count_failure(device);
+}
+
+static void device_idle(fleet_device_t * device) {
+    fflush(stdout);
+    if(repeat_s < 0)
+        device_state(device, FLEET_IDLE, UINT64_MAX);
+    else
+        device_state(device, FLEET_IDLE, now_ms() + (uint64_t)repeat_s * 1000);
+}
+
+static void device_path(fleet_device_t * device, const char * suffix, char * path, size_t size) {
+    snprintf(path, size, "%s/%s%s", out_dir, device->name, suffix);
+}
+
+/* Write a file under a temporary name and rename it, so a crash leaves the old file whole. */
+static int save_file(const char * path, const void * data, size_t size) {
+    char temporary[520];
+    snprintf(temporary, sizeof(temporary), "%s.new", path);
+    FILE * file = fopen(temporary, "wb");
+    if(!file)
+        return -1;
+    bool failed = fwrite(data, 1, size, file) != size;
+    if(fclose(file) || failed || rename(temporary, path)) {
+        unlink(temporary);
+        return -1;
+    }
+    return 0;
+}
+
+/* .sync file: magic, session, page size, page count, then the generation of every page, all
+little endian like the link payloads. */
+static size_t state_encode(fleet_device_t * device, uint8_t * state) {
+    uint32_t words[4] = {FLEET_STATE_MAGIC, device->mirror.session, page_size, page_count};
+    for(int i = 0; i < 4; i++) {
+        for(int j = 0; j < 4; j++)
+            state[i * 4 + j] = words[i] >> (8 * j);
+    }
+    for(uint32_t i = 0; i < page_count; i++) {
+        state[16 + 2 * i] = device->mirror.generations[i] & 0xFF;
+        state[17 + 2 * i] = device->mirror.generations[i] >> 8;
+    }
+    return 16 + 2 * page_count;
+}
+
+/* The image goes first: a crash in between leaves older generations, those pages are sent again. */
+static void device_save(fleet_device_t * device, bool image) {
+    char path[512];
+    uint8_t state[16 + 2 * DS3231_SYNC_MAX_PAGES];
+    size_t size = state_encode(device, state);
+    device_path(device, ".img", path, sizeof(path));
+    if(image && save_file(path, device->image, (size_t)page_size * page_count)) {
+        printf("%s: can not write %s\n", device->name, path);
+        return;
+    }
+    device_path(device, ".sync", path, sizeof(path));
+    if(save_file(path, state, size))
+        printf("%s: can not write %s\n", device->name, path);
+}
+
+/* Resume from the files of an earlier run, nothing is loaded unless both match the geometry. */
+static void device_load(fleet_device_t * device) {
+    char path[512];
+    uint8_t expected[16 + 2 * DS3231_SYNC_MAX_PAGES];
+    uint8_t state[sizeof(expected)];
+    size_t size = state_encode(device, expected);
+    device_path(device, ".sync", path, sizeof(path));
+    FILE * file = fopen(path, "rb");
+    if(!file)
+        return;
+    bool valid = fread(state, 1, size, file) == size && fgetc(file) == EOF && !memcmp(state, expected, 4)
+        && !memcmp(&state[8], &expected[8], 8);
+    fclose(file);
+    device_path(device, ".img", path, sizeof(path));
+    file = valid ? fopen(path, "rb") : NULL;
+    if(!file) {
+        printf("%s: no usable harvest state, harvesting every page\n", device->name);
+        return;
+    }
+    valid = fread(device->image, page_size, page_count, file) == page_count && fgetc(file) == EOF;
+    fclose(file);
+    if(!valid) {
+        memset(device->image, 0, (size_t)page_size * page_count);
+        printf("%s: %s does not match, harvesting every page\n", device->name, path);
+        return;
+    }
+    device->mirror.session = state[4] | (state[5] << 8) | (state[6] << 16) | ((uint32_t)state[7] << 24);
+    for(uint32_t i = 0; i < page_count; i++)
+        device->mirror.generations[i] = state[16 + 2 * i] | (state[17 + 2 * i] << 8);
+}
+
+static void device_report(fleet_device_t * device) {
+    printf("%s: round %u, offset %d ms%s, %s, config %s, %u pages harvested, %llu ms\n", device->name,
+        device->rounds, device->offset_ms, device->stopped ? " (oscillator stopped)" : "",
+        device->time_set ? "time set" : "time kept", !config ? "none" : device->config_done ? "pushed" : "pending",
+        device->pages, (unsigned long long)(now_ms() - device->round_ms));
+}
+
+static void send_time_request(fleet_device_t * device) {
+    device->deadline_ms = now_ms() + FLEET_TIMEOUT_MS;
+    device->sent_us = wall_us();
+    if(device_send(device, DS3231_LINK_TIME_REQUEST, NULL, 0))
+        device_fail(device, "send failed");
+}
+
+static void start_time_query(fleet_device_t * device, enum FLEET_STATES state) {
+    device_state(device, state, UINT64_MAX);
+    device->sample_ms = now_ms();
+    device->offset_min_us = INT64_MIN;
+    device->offset_max_us = INT64_MAX;
+    send_time_request(device);
+}
+
+static void start_round(fleet_device_t * device) {
+    device->round_ms = now_ms();
+    device->rounds++;
+    device->time_set = false;
+    device->pages = 0;
+    start_time_query(device, FLEET_TIME_QUERY);
+}
+
+static void send_config(fleet_device_t * device) {
+    while(device->in_flight < FLEET_WINDOW && device->config_sent < config_size) {
+        uint32_t length = config_size - device->config_sent;
+        if(length > FLEET_CHUNK_SIZE)
+            length = FLEET_CHUNK_SIZE;
+        uint8_t payload[2 + FLEET_CHUNK_SIZE];
+        payload[0] = device->config_sent & 0xFF;
+        payload[1] = device->config_sent >> 8;
+        memcpy(&payload[2], &config[device->config_sent], length);
+        if(device_send(device, DS3231_LINK_CONFIG_WRITE, payload, 2 + length)) {
+            device_fail(device, "send failed");
+            return;
+        }
+        device->config_sent += length;
+        device->in_flight++;
+    }
+}
+
+static void start_harvest(fleet_device_t * device) {
+    device_state(device, FLEET_HARVEST, now_ms() + FLEET_TIMEOUT_MS);
+    if(ds3231_sync_mirror_request(&device->mirror, ++device->seq, device_write, device))
+        device_fail(device, "send failed");
+    else
+        device_flush(device);
+}
+
+static void start_config(fleet_device_t * device) {
+    if(!config || device->config_done) {
+        start_harvest(device);
+        return;
+    }
+    device->config_sent = 0;
+    device->config_acked = 0;
+    device->in_flight = 0;
+    device_state(device, FLEET_CONFIG, now_ms() + FLEET_TIMEOUT_MS);
+    send_config(device);
+}
+
+static void after_harvest(fleet_device_t * device) {
+    if(!force_set && abs(device->offset_ms) < FLEET_SET_THRESHOLD_MS && !device->stopped) {
+        device_report(device);
+        device_idle(device);
+        return;
+    }
+    struct timespec ts = wall();
+    device_state(device, FLEET_TIME_WAIT, now_ms() + (1000000000 - ts.tv_nsec) / 1000000);
+}
+
+static void send_time_set(fleet_device_t * device) {
+    /* Woken up a few ms either side of the second boundary, round to the nearest second. */
+    struct timespec ts = wall();
+    uint32_t epoch = (uint32_t)(ts.tv_sec + (ts.tv_nsec >= 500000000) - FLEET_EPOCH_2000);
+    uint8_t payload[4] = {epoch & 0xFF, (epoch >> 8) & 0xFF, (epoch >> 16) & 0xFF, epoch >> 24};
+    device_state(device, FLEET_TIME_SET, now_ms() + FLEET_TIMEOUT_MS);
+    if(device_send(device, DS3231_LINK_TIME_SET, payload, sizeof(payload)))
+        device_fail(device, "send failed");
+}
+
+static void on_time(fleet_device_t * device, const ds3231_link_frame_t * frame) {
+    const uint8_t * payload = frame->payload;
+    if(frame->length != 6 || payload[5]) {
+        device_fail(device, "time read failed");
+        return;
+    }
+    uint32_t epoch = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24);
+    /* The DS3231 read the second epoch at some point between sending and now. */
+    int64_t second_us = ((int64_t)epoch + FLEET_EPOCH_2000) * 1000000;
+    int64_t received_us = wall_us();
+    if(second_us - received_us > device->offset_min_us)
+        device->offset_min_us = second_us - received_us;
+    if(second_us + 1000000 - device->sent_us < device->offset_max_us)
+        device->offset_max_us = second_us + 1000000 - device->sent_us;
+    if(device->offset_max_us - device->offset_min_us > FLEET_RESOLUTION_US
+        && now_ms() - device->sample_ms < FLEET_SAMPLE_MS)
+    {
+        send_time_request(device);
+        return;
+    }
+
+    int32_t offset = (int32_t)((device->offset_min_us / 2 + device->offset_max_us / 2) / 1000);
+    if(device->state == FLEET_TIME_QUERY) {
+        device->offset_ms = offset;
+        device->stopped = payload[4] & (0x01 << 7);
+        start_config(device);
+    } else {
+        device->residual_ms = offset;
+        device_report(device);
+        if(abs(offset) >= FLEET_SET_THRESHOLD_MS)
+            printf("%s: %d ms off after the time set\n", device->name, offset);
+        device_idle(device);
+    }
+}
+
+static void on_ack(fleet_device_t * device, const ds3231_link_frame_t * frame) {
+    if(frame->length != 2)
+        return;
+    if(frame->payload[1]) {
+        device_fail(device, frame->payload[0] == DS3231_LINK_TIME_SET ? "time set failed" : "config write failed");
+        return;
+    }
+    if(device->state == FLEET_CONFIG && frame->payload[0] == DS3231_LINK_CONFIG_WRITE) {
+        device->in_flight--;
+        device->config_acked++;
+        device->deadline_ms = now_ms() + FLEET_TIMEOUT_MS;
+        if(device->config_sent == config_size && !device->in_flight) {
+            device->config_done = true;
+            start_harvest(device);
+        } else {
+            send_config(device);
+        }
+    } else if(device->state == FLEET_TIME_SET && frame->payload[0] == DS3231_LINK_TIME_SET) {
+        device->time_set = true;
+        start_time_query(device, FLEET_TIME_VERIFY);
+    }
+}
+
+static void on_sync(fleet_device_t * device, const ds3231_link_frame_t * frame) {
+    int result = ds3231_sync_mirror_apply(&device->mirror, frame);
+    if(result < 0) {
+        device_fail(device, "harvest failed");
+    } else if(result == 0) {
+        device->pages += frame->payload[2];
+        device->deadline_ms = now_ms() + FLEET_TIMEOUT_MS;
+    } else {
+        /* The session may have changed without any page. */
+        device_save(device, device->pages > 0);
+        after_harvest(device);
+    }
+}
+
+static void on_frame(fleet_device_t * device, const ds3231_link_frame_t * frame) {
+    switch(frame->type) {
+    case DS3231_LINK_TIME:
+        if(device->state == FLEET_TIME_QUERY || device->state == FLEET_TIME_VERIFY)
+            on_time(device, frame);
+        break;
+    case DS3231_LINK_ACK:
+        on_ack(device, frame);
+        break;
+    case DS3231_LINK_SYNC_PAGES:
+    case DS3231_LINK_SYNC_END:
+        if(device->state == FLEET_HARVEST)
+            on_sync(device, frame);
+        break;
+    default:
+        break;
+    }
+}
+
+static void device_read(fleet_device_t * device) {
+    uint8_t buffer[4096];
+    for(;;) {
+        ssize_t length = read(device->fd, buffer, sizeof(buffer));
+        if(length < 0 && errno == EINTR)
+            continue;
+        if(length < 0 && errno == EAGAIN)
+            return;
+        if(length <= 0) {
+            device_fail(device, "disconnected");
+            return;
+        }
+        for(ssize_t i = 0; i < length && device->fd >= 0; i++) {
+            if(ds3231_link_parse(&device->parser, buffer[i]) == 1)
+                on_frame(device, &device->parser.frame);
+        }
+        if(device->fd < 0)
+            return;
+    }
+}
+
+static void device_timeout(fleet_device_t * device) {
+    if(device->state == FLEET_TIME_WAIT)
+        send_time_set(device);
+    else if(device->state == FLEET_IDLE)
+        start_round(device);
+    else
+        device_fail(device, "timed out");
+}
+
+static void device_open(fleet_device_t * device) {
+    device->fd = open(device->path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(device->fd < 0) {
+        device_count_failure(device);
+        return;
+    }
+    struct termios tio;
+    if(!tcgetattr(device->fd, &tio)) {
+        cfmakeraw(&tio);
+        tcsetattr(device->fd, TCSANOW, &tio);
+    }
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = device};
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, device->fd, &event)) {
+        /* Regular files can not be polled, they are not boards. */
+        close(device->fd);
+        device->fd = -1;
+        device_count_failure(device);
+        return;
+    }
+    tcflush(device->fd, TCIOFLUSH);
+    ds3231_link_parser_init(&device->parser);
+    device->out_length = 0;
+    device->out_waiting = false;
+    start_round(device);
+}
+
+static fleet_device_t * device_find(const char * path) {
+    for(int i = 0; i < device_count; i++) {
+        if(!strcmp(devices[i]->path, path))
+            return devices[i];
+    }
+    if(device_count == FLEET_MAX_DEVICES || strlen(path) >= sizeof(devices[0]->path))
+        return NULL;
+    fleet_device_t * device = calloc(1, sizeof(fleet_device_t));
+    uint8_t * image = calloc(page_count, page_size);
+    if(!device || !image) {
+        free(device);
+        free(image);
+        return NULL;
+    }
+    strcpy(device->path, path);
+    const char * slash = strrchr(device->path, '/');
+    device->name = slash ? slash + 1 : device->path;
+    device->fd = -1;
+    device->state = FLEET_CLOSED;
+    device->deadline_ms = UINT64_MAX;
+    device->image = image;
+    ds3231_sync_mirror_init(&device->mirror, page_size, page_count, image);
+    device_load(device);
+    devices[device_count++] = device;
+    return device;
+}
+
+/* Boards that are done with their only round or were skipped are not opened again. */
+static void scan(char ** patterns, int pattern_count) {
+    for(int p = 0; p < pattern_count; p++) {
+        glob_t found;
+        if(glob(patterns[p], 0, NULL, &found))
+            continue;
+        for(size_t i = 0; i < found.gl_pathc; i++) {
+            fleet_device_t * device = device_find(found.gl_pathv[i]);
+            if(device && device->fd < 0 && device->state != FLEET_FAILED
+                && !(repeat_s < 0 && device->rounds && device->state == FLEET_IDLE))
+                device_open(device);
+        }
+        globfree(&found);
+    }
+}
+
+static bool all_done(void) {
+    if(repeat_s >= 0 || !device_count)
+        return false;
+    for(int i = 0; i < device_count; i++) {
+        if(devices[i]->state != FLEET_IDLE && devices[i]->state != FLEET_FAILED)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char ** argv) {
+    const char * config_path = NULL;
+    int opt;
+    while((opt = getopt(argc, argv, "c:o:r:e:f")) != -1) {
+        if(opt == 'c')
+            config_path = optarg;
+        else if(opt == 'o')
+            out_dir = optarg;
+        else if(opt == 'r')
+            repeat_s = atoi(optarg);
+        else if(opt == 'e' && sscanf(optarg, "%u:%u", &page_size, &page_count) == 2)
+            continue;
+        else if(opt == 'f')
+            force_set = true;
+        else
+            break;
+    }
+    if(optind >= argc || !page_size || !page_count || page_count > DS3231_SYNC_MAX_PAGES) {
+        fprintf(stderr, "usage: %s [-c config] [-o directory] [-r seconds] [-e page size:page count] [-f] <tty pattern>...\n", argv[0]);
+        return 1;
+    }
+    if(config_path) {
+        FILE * file = fopen(config_path, "rb");
+        if(!file) {
+            perror(config_path);
+            return 1;
+        }
+        /* Offsets of configuration writes are 16-bit. */
+        config = malloc(0xFFFF);
+        config_size = config ? fread(config, 1, 0xFFFF, file) : 0;
+        fclose(file);
+        if(!config_size) {
+            fprintf(stderr, "%s: empty\n", config_path);
+            return 1;
+        }
+    }
+
+    /* One descriptor per board. */
+    struct rlimit limit;
+    if(!getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    epoll_fd = epoll_create1(0);
+    if(epoll_fd < 0) {
+        perror("epoll_create1");
+        return 1;
+    }
+
+    uint64_t scan_ms = 0;
+    struct epoll_event events[64];
+    while(!all_done()) {
+        uint64_t now = now_ms();
+        if(now >= scan_ms) {
+            scan(&argv[optind], argc - optind);
+            scan_ms = now + 1000;
+        }
+        uint64_t next = scan_ms;
+        for(int i = 0; i < device_count; i++) {
+            fleet_device_t * device = devices[i];
+            if(device->deadline_ms <= now)
+                device_timeout(device);
+            if(device->deadline_ms < next)
+                next = device->deadline_ms;
+        }
+        now = now_ms();
+        int count = epoll_wait(epoll_fd, events, 64, next > now ? (int)(next - now) : 0);
+        if(count < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            return 1;
+        }
+        for(int i = 0; i < count; i++) {
+            fleet_device_t * device = events[i].data.ptr;
+            if(device->fd < 0)
+                continue;
+            if(events[i].events & EPOLLOUT)
+                device_flush(device);
+            if(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                device_read(device);
+        }
+    }
+    for(int i = 0; i < device_count; i++) {
+        if(devices[i]->state == FLEET_FAILED)
+            return 1;
+    }
+    return 0;
+}
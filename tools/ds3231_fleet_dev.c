@@ -0,0 +1,190 @@
+/**
+ * @file    ds3231_fleet_dev.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Host stand-in for a board, to run ds3231_fleet without hardware.
+ * Opens a pseudo terminal, links its name to the given path and answers the link frames the way
+ * ds3231_command.c does: time requests with the seconds of a clock that is the host clock plus an
+ * offset, time sets by moving that clock, configuration writes and harvests of a RAM EEPROM with
+ * random contents. A few bytes of the EEPROM change after every harvest so the next one has work.
+ * Build on the host with:
+ *   cc -I libraries/ds3231 -o ds3231_fleet_dev tools/ds3231_fleet_dev.c libraries/ds3231/ds3231_link.c
+ *      libraries/ds3231/ds3231_sync.c libraries/ds3231/ds3231_storage.c
+ *
+ * Usage:
+ *   ds3231_fleet_dev <path> [offset ms]
+ * Several of them with paths matching one pattern make a fleet, e.g.
+ *   ds3231_fleet_dev /tmp/board0 1500 & ds3231_fleet_dev /tmp/board1 -250 & ds3231_fleet '/tmp/board*'
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#define _GNU_SOURCE
+#include "ds3231_sync.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* AT24C32 geometry, the defaults of ds3231_fleet -e. */
+#define DEV_PAGE_SIZE       32
+#define DEV_PAGE_COUNT      128
+#define DEV_EPOCH_2000      946684800
+
+static uint8_t memory[DEV_PAGE_SIZE * DEV_PAGE_COUNT];
+static int master_fd;
+static int64_t offset_us;       // Clock of the stand-in minus host clock.
+
+static int memory_read(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data) {
+    memcpy(data, &memory[page * DEV_PAGE_SIZE + offset], length);
+    return 0;
+}
+
+static int memory_program(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data) {
+    memcpy(&memory[page * DEV_PAGE_SIZE + offset], data, length);
+    return 0;
+}
+
+static const ds3231_storage_ops_t memory_ops = {
+    .read = memory_read,
+    .program = memory_program,
+    .busy = NULL
+};
+
+static ds3231_storage_t memory_storage = {
+    .ops = &memory_ops,
+    .page_size = DEV_PAGE_SIZE,
+    .page_count = DEV_PAGE_COUNT,
+    .erase_pages = 1,
+    .write_cycle_us = 0
+};
+
+static int dev_write(void * ctx, const uint8_t * data, size_t length) {
+    return write(master_fd, data, length) == (ssize_t)length ? 0 : -1;
+}
+
+static int64_t wall_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t payload_u32(const uint8_t * payload) {
+    return payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24);
+}
+
+static void send_ack(const ds3231_link_frame_t * frame, bool failed) {
+    uint8_t payload[2] = {frame->type, failed ? 1 : 0};
+    ds3231_link_send(dev_write, NULL, DS3231_LINK_ACK, frame->seq, payload, sizeof(payload), NULL, 0);
+}
+
+static void on_time_request(const ds3231_link_frame_t * frame) {
+    uint32_t epoch = (uint32_t)((wall_us() + offset_us) / 1000000 - DEV_EPOCH_2000);
+    uint8_t payload[6] = {epoch & 0xFF, (epoch >> 8) & 0xFF, (epoch >> 16) & 0xFF, epoch >> 24, 0, 0};
+    ds3231_link_send(dev_write, NULL, DS3231_LINK_TIME, frame->seq, payload, sizeof(payload), NULL, 0);
+}
+
+/* Like writing the seconds register, the clock starts the given second now. */
+static void on_time_set(const ds3231_link_frame_t * frame) {
+    if(frame->length != 4) {
+        send_ack(frame, true);
+        return;
+    }
+    offset_us = ((int64_t)payload_u32(frame->payload) + DEV_EPOCH_2000) * 1000000 - wall_us();
+    fprintf(stderr, "time set, %.1f ms off the host clock\n", offset_us / 1000.0);
+    send_ack(frame, false);
+}
+
+static void on_config_write(ds3231_sync_t * sync, const ds3231_link_frame_t * frame) {
+    if(frame->length < 2) {
+        send_ack(frame, true);
+        return;
+    }
+    uint32_t offset = frame->payload[0] | (frame->payload[1] << 8);
+    uint32_t length = frame->length - 2;
+    bool failed = offset + length > sizeof(memory);
+    /* Through the sync layer so the pages are harvested again. */
+    for(uint32_t done = 0; !failed && done < length;) {
+        uint32_t page_offset = (offset + done) % DEV_PAGE_SIZE;
+        uint32_t chunk = DEV_PAGE_SIZE - page_offset;
+        if(chunk > length - done)
+            chunk = length - done;
+        failed = ds3231_storage_program(&sync->storage, (offset + done) / DEV_PAGE_SIZE, page_offset, chunk,
+            &frame->payload[2 + done]) != 0;
+        done += chunk;
+    }
+    send_ack(frame, failed);
+}
+
+static void on_sync_request(ds3231_sync_t * sync, const ds3231_link_frame_t * frame) {
+    ds3231_sync_handle(sync, frame, dev_write, NULL);
+    uint8_t change[4] = {0x01, 0x02, 0x03, (uint8_t)rand()};
+    ds3231_storage_program(&sync->storage, rand() % DEV_PAGE_COUNT, 0, sizeof(change), change);
+}
+
+int main(int argc, char ** argv) {
+    if(argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <path> [offset ms]\n", argv[0]);
+        return 1;
+    }
+    offset_us = argc == 3 ? (int64_t)(atof(argv[2]) * 1000) : 0;
+
+    master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master_fd < 0 || grantpt(master_fd) || unlockpt(master_fd)) {
+        perror("posix_openpt");
+        return 1;
+    }
+    /* Raw mode on the slave side, ds3231_fleet sets it too but the first bytes may come earlier. */
+    int slave_fd = open(ptsname(master_fd), O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if(slave_fd < 0 || tcgetattr(slave_fd, &tio)) {
+        perror(ptsname(master_fd));
+        return 1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(slave_fd, TCSANOW, &tio);
+    unlink(argv[1]);
+    if(symlink(ptsname(master_fd), argv[1])) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    srand(getpid());
+    for(size_t i = 0; i < sizeof(memory); i++)
+        memory[i] = rand();
+    static ds3231_sync_t sync;
+    static ds3231_link_parser_t parser;
+    if(ds3231_sync_init(&sync, &memory_storage, getpid())) {
+        fprintf(stderr, "can not set up the sync layer\n");
+        return 1;
+    }
+    ds3231_link_parser_init(&parser);
+
+    uint8_t buffer[512];
+    while(true) {
+        ssize_t length = read(master_fd, buffer, sizeof(buffer));
+        if(length <= 0) {
+            /* No reader on the slave side yet. */
+            usleep(1000);
+            continue;
+        }
+        for(ssize_t i = 0; i < length; i++) {
+            if(ds3231_link_parse(&parser, buffer[i]) != 1)
+                continue;
+            const ds3231_link_frame_t * frame = &parser.frame;
+            if(frame->type == DS3231_LINK_TIME_REQUEST)
+                on_time_request(frame);
+            else if(frame->type == DS3231_LINK_TIME_SET)
+                on_time_set(frame);
+            else if(frame->type == DS3231_LINK_CONFIG_WRITE)
+                on_config_write(&sync, frame);
+            else if(frame->type == DS3231_LINK_SYNC_REQUEST)
+                on_sync_request(&sync, frame);
+        }
+    }
+}
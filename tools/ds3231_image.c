@@ -0,0 +1,280 @@
+/**
+ * @file    ds3231_image.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Host tool to create, inspect and migrate AT24C32 images with a superblock.
+ * Uses the file backend and the same superblock and log code as the device.
+ * Build on the host with:
+ *   cc -I libraries/ds3231 -o ds3231_image tools/ds3231_image.c libraries/ds3231/ds3231_storage.c
+ *      libraries/ds3231/ds3231_storage_file.c libraries/ds3231/ds3231_log.c
+ *      libraries/ds3231/ds3231_super.c libraries/ds3231/ds3231_link.c
+ *
+ * Usage:
+ *   ds3231_image create <image> <layout> <type:first:count>...
+ *   ds3231_image info <image>
+ *   ds3231_image migrate <image> <new image> <layout> <type:first:count>...
+ * Types are config, log, checkpoint and calibration. migrate copies every partition into the
+ * partition of the same type in the new layout: log records are appended to the new log oldest
+ * first, so a smaller log keeps the newest records, other partitions are copied page by page and
+ * may not shrink. Images with a format 1 superblock, a single copy in page 0 without a sequence
+ * number, are migrated too; the device only mounts format 2.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_super.h"
+#include "ds3231_link.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* AT24C32 geometry, the library header needs the Pico SDK. */
+#define IMAGE_PAGE_SIZE     32
+#define IMAGE_PAGE_COUNT    128
+
+/* Format 1 superblock: magic, format, layout, partition count, the entries and the CRC. */
+#define IMAGE_FORMAT_1      1
+#define IMAGE_FORMAT_1_SIZE (4 + DS3231_SUPER_ENTRY_SIZE * DS3231_SUPER_PARTITIONS + 2)
+
+static const char * type_names[] = {"free", "config", "log", "checkpoint", "calibration"};
+
+static int parse_type(const char * name) {
+    for(int i = 0; i < (int)(sizeof(type_names) / sizeof(type_names[0])); i++) {
+        if(!strcmp(name, type_names[i]))
+            return i;
+    }
+    return -1;
+}
+
+static const char * type_name(uint8_t type) {
+    if(type < sizeof(type_names) / sizeof(type_names[0]))
+        return type_names[type];
+    return "unknown";
+}
+
+/* Parse type:first:count arguments into a partition table. */
+static int parse_partitions(int argc, char ** argv, ds3231_super_partition_t * partitions) {
+    if(argc > DS3231_SUPER_PARTITIONS) {
+        fprintf(stderr, "at most %d partitions\n", DS3231_SUPER_PARTITIONS);
+        return -1;
+    }
+    for(int i = 0; i < argc; i++) {
+        char name[16];
+        unsigned first;
+        unsigned count;
+        if(sscanf(argv[i], "%15[a-z]:%u:%u", name, &first, &count) != 3 || parse_type(name) < 0
+            || first > 0xFF || count > 0xFF)
+        {
+            fprintf(stderr, "invalid partition %s\n", argv[i]);
+            return -1;
+        }
+        partitions[i].type = parse_type(name);
+        partitions[i].first_page = first;
+        partitions[i].page_count = count;
+        partitions[i].head = 0;
+    }
+    return argc;
+}
+
+static int open_image(ds3231_file_storage_t * image, const char * path) {
+    if(ds3231_file_storage_open(image, path, IMAGE_PAGE_SIZE, IMAGE_PAGE_COUNT)) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/* Mount a format 1 superblock from page 0, it has no sequence number and no second copy. */
+static int mount_format_1(ds3231_super_t * super, ds3231_storage_t * storage) {
+    uint8_t block[IMAGE_FORMAT_1_SIZE];
+    if(ds3231_storage_read(storage, 0, 0, IMAGE_FORMAT_1_SIZE, block))
+        return -1;
+    if(block[0] != DS3231_SUPER_MAGIC || block[1] != IMAGE_FORMAT_1 || block[3] > DS3231_SUPER_PARTITIONS)
+        return -1;
+    uint16_t crc = ds3231_link_crc16(0xFFFF, block, IMAGE_FORMAT_1_SIZE - 2);
+    if(block[IMAGE_FORMAT_1_SIZE - 2] != (crc & 0xFF) || block[IMAGE_FORMAT_1_SIZE - 1] != (crc >> 8))
+        return -1;
+    super->storage = storage;
+    super->sequence = 0;
+    super->copy = 0;
+    super->layout = block[2];
+    super->partition_count = block[3];
+    for(uint8_t i = 0; i < super->partition_count; i++) {
+        const uint8_t * entry = &block[4 + i * DS3231_SUPER_ENTRY_SIZE];
+        super->partitions[i].type = entry[0];
+        super->partitions[i].first_page = entry[1];
+        super->partitions[i].page_count = entry[2];
+        super->partitions[i].head = entry[3] | (entry[4] << 8);
+    }
+    return 0;
+}
+
+static int create(int argc, char ** argv) {
+    ds3231_super_partition_t partitions[DS3231_SUPER_PARTITIONS];
+    int count = parse_partitions(argc - 2, &argv[2], partitions);
+    if(count < 0)
+        return 1;
+    ds3231_file_storage_t image;
+    if(open_image(&image, argv[0]))
+        return 1;
+    ds3231_super_t super;
+    int result = ds3231_super_format(&super, &image.storage, (uint8_t)atoi(argv[1]), partitions, count);
+    if(result)
+        fprintf(stderr, "invalid layout\n");
+    ds3231_file_storage_close(&image);
+    return result ? 1 : 0;
+}
+
+static int info(char * path) {
+    ds3231_file_storage_t image;
+    if(open_image(&image, path))
+        return 1;
+    ds3231_super_t super;
+    if(!ds3231_super_mount(&super, &image.storage)) {
+        printf("format %u, layout %u, %u partitions, sequence %u in page %u\n", DS3231_SUPER_FORMAT, super.layout,
+            super.partition_count, super.sequence, super.copy);
+    } else if(!mount_format_1(&super, &image.storage)) {
+        printf("format %u, layout %u, %u partitions, migrate to mount it on the device\n", IMAGE_FORMAT_1,
+            super.layout, super.partition_count);
+    } else {
+        fprintf(stderr, "%s has no superblock\n", path);
+        ds3231_file_storage_close(&image);
+        return 1;
+    }
+    for(uint8_t i = 0; i < super.partition_count; i++) {
+        ds3231_super_partition_t * part = &super.partitions[i];
+        printf("  %-12s pages %3u-%3u", type_name(part->type), part->first_page, part->first_page + part->page_count - 1);
+        if(part->type == DS3231_SUPER_LOG) {
+            ds3231_log_t log;
+            ds3231_log_cursor_t cursor;
+            const uint8_t * record;
+            uint8_t length;
+            uint32_t records = 0;
+            if(ds3231_log_init_at(&log, &image.storage, part->first_page, part->page_count, part->head)) {
+                printf("  log does not mount\n");
+                continue;
+            }
+            ds3231_log_cursor_init(&cursor, &log);
+            while(ds3231_log_cursor_next(&cursor, &record, &length) == 1)
+                records++;
+            printf("  %u records, head %u, saved head %u%s", records, ds3231_log_head(&log), part->head,
+                ds3231_log_head(&log) == part->head ? "" : " (stale)");
+        }
+        printf("\n");
+    }
+    ds3231_file_storage_close(&image);
+    return 0;
+}
+
+static int copy_log(ds3231_super_t * from, ds3231_super_partition_t * src, ds3231_super_t * to,
+    ds3231_super_partition_t * dst)
+{
+    ds3231_log_t old_log;
+    ds3231_log_t new_log;
+    ds3231_log_cursor_t cursor;
+    const uint8_t * record;
+    uint8_t length;
+    int next;
+    if(ds3231_log_init_at(&old_log, from->storage, src->first_page, src->page_count, src->head))
+        return -1;
+    if(ds3231_log_init_at(&new_log, to->storage, dst->first_page, dst->page_count, dst->head))
+        return -1;
+    ds3231_log_cursor_init(&cursor, &old_log);
+    while((next = ds3231_log_cursor_next(&cursor, &record, &length)) == 1) {
+        if(length > new_log.page_size - 2 || ds3231_log_append(&new_log, record, length))
+            return -1;
+    }
+    if(next < 0)
+        return -1;
+    return ds3231_super_save_head(to, &new_log);
+}
+
+static int copy_pages(ds3231_super_t * from, ds3231_super_partition_t * src, ds3231_super_t * to,
+    ds3231_super_partition_t * dst)
+{
+    uint8_t page[IMAGE_PAGE_SIZE];
+    if(dst->page_count < src->page_count) {
+        fprintf(stderr, "%s: %u pages do not fit into %u\n", type_name(dst->type), src->page_count,
+            dst->page_count);
+        return -1;
+    }
+    for(uint32_t i = 0; i < src->page_count; i++) {
+        if(ds3231_storage_read(from->storage, src->first_page + i, 0, IMAGE_PAGE_SIZE, page))
+            return -1;
+        if(ds3231_storage_program(to->storage, dst->first_page + i, 0, IMAGE_PAGE_SIZE, page))
+            return -1;
+    }
+    return 0;
+}
+
+static int migrate(int argc, char ** argv) {
+    ds3231_super_partition_t partitions[DS3231_SUPER_PARTITIONS];
+    int count = parse_partitions(argc - 3, &argv[3], partitions);
+    if(count < 0)
+        return 1;
+    if(!strcmp(argv[0], argv[1])) {
+        fprintf(stderr, "the new image must be a different file\n");
+        return 1;
+    }
+
+    ds3231_file_storage_t old_image;
+    ds3231_file_storage_t new_image;
+    if(open_image(&old_image, argv[0]))
+        return 1;
+    if(open_image(&new_image, argv[1])) {
+        ds3231_file_storage_close(&old_image);
+        return 1;
+    }
+    int result = 0;
+    ds3231_super_t from;
+    ds3231_super_t to;
+    if(ds3231_super_mount(&from, &old_image.storage) && mount_format_1(&from, &old_image.storage)) {
+        fprintf(stderr, "%s has no superblock\n", argv[0]);
+        result = 1;
+    } else if(ds3231_super_format(&to, &new_image.storage, (uint8_t)atoi(argv[2]), partitions, count)) {
+        fprintf(stderr, "invalid layout\n");
+        result = 1;
+    }
+
+    /* Partitions of the same type are paired in the order they appear. */
+    for(uint8_t i = 0; !result && i < to.partition_count; i++) {
+        ds3231_super_partition_t * dst = &to.partitions[i];
+        ds3231_super_partition_t * src = NULL;
+        uint8_t seen = 0;
+        for(uint8_t j = 0; j < i; j++)
+            seen += to.partitions[j].type == dst->type;
+        for(uint8_t j = 0; j < from.partition_count && !src; j++) {
+            if(from.partitions[j].type == dst->type && !seen--)
+                src = &from.partitions[j];
+        }
+        if(!src) {
+            printf("%s: new partition\n", type_name(dst->type));
+            continue;
+        }
+        if(dst->type == DS3231_SUPER_LOG ? copy_log(&from, src, &to, dst) : copy_pages(&from, src, &to, dst)) {
+            fprintf(stderr, "%s: copy failed\n", type_name(dst->type));
+            result = 1;
+        } else {
+            printf("%s: pages %u-%u -> %u-%u\n", type_name(dst->type), src->first_page,
+                src->first_page + src->page_count - 1, dst->first_page, dst->first_page + dst->page_count - 1);
+        }
+    }
+    ds3231_file_storage_close(&old_image);
+    ds3231_file_storage_close(&new_image);
+    return result;
+}
+
+int main(int argc, char ** argv) {
+    if(argc >= 4 && !strcmp(argv[1], "create"))
+        return create(argc - 2, &argv[2]);
+    if(argc == 3 && !strcmp(argv[1], "info"))
+        return info(argv[2]);
+    if(argc >= 5 && !strcmp(argv[1], "migrate"))
+        return migrate(argc - 2, &argv[2]);
+    fprintf(stderr, "usage: %s create <image> <layout> <type:first:count>...\n"
+        "       %s info <image>\n"
+        "       %s migrate <image> <new image> <layout> <type:first:count>...\n", argv[0], argv[0], argv[0]);
+    return 1;
+}
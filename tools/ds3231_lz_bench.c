@@ -0,0 +1,159 @@
+/**
+ * @file    ds3231_lz_bench.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Compression ratio and speed of ds3231_lz on synthetic log data.
+ * Three data sets of 8 byte records: timestamp and temperature, the same with one random byte
+ * per record, and random bytes. Each is encoded and decoded in 32 byte writes, the way a logger
+ * feeds the encoder.
+ * On the Pico it is built as ds3231_lz_bench when configured with -DDS3231_LZ_BENCH=ON and prints
+ * cycles per byte counted with SysTick on stdio. On the host it prints ns per byte, build with:
+ *   cc -O2 -I libraries/ds3231 -o ds3231_lz_bench tools/ds3231_lz_bench.c libraries/ds3231/ds3231_lz.c
+ *      libraries/ds3231/ds3231_log.c libraries/ds3231/ds3231_storage.c
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_lz.h"
+#include <stdio.h>
+#include <string.h>
+
+#if PICO_ON_DEVICE
+#include "pico/stdlib.h"
+#include "hardware/structs/systick.h"
+#define BENCH_UNIT          "cycles"
+#else
+#include <time.h>
+#define BENCH_UNIT          "ns"
+#endif
+
+#define BENCH_SIZE          4096
+#define BENCH_CHUNK         32
+
+static uint8_t input[BENCH_SIZE];
+static uint8_t encoded[BENCH_SIZE + BENCH_SIZE / 8 + DS3231_LZ_GROUP_SIZE];
+static uint8_t decoded[BENCH_SIZE];
+static size_t encoded_length;
+static size_t decoded_length;
+static uint32_t seed = 1;
+
+static uint8_t bench_random(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+#if PICO_ON_DEVICE
+/* SysTick counts down from 0xFFFFFF at the processor clock, elapsed counts are taken modulo 2^24. */
+static uint32_t bench_start(void) {
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;
+    return systick_hw->cvr;
+}
+
+static void bench_elapsed(uint32_t start, uint64_t * total) {
+    uint32_t now = systick_hw->cvr;
+    *total += (start - now) & 0x00FFFFFF;
+}
+#else
+static uint32_t bench_start(void) {
+    return 0;
+}
+
+static void bench_elapsed(uint32_t start, uint64_t * total) {}
+
+static uint64_t bench_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+static int encoded_sink(void * ctx, const uint8_t * data, size_t length) {
+    memcpy(&encoded[encoded_length], data, length);
+    encoded_length += length;
+    return 0;
+}
+
+static int decoded_sink(void * ctx, const uint8_t * data, size_t length) {
+    if(decoded_length + length > BENCH_SIZE)
+        return -1;
+    memcpy(&decoded[decoded_length], data, length);
+    decoded_length += length;
+    return 0;
+}
+
+/* Time the encoder or decoder over the whole buffer, one chunk per measurement so SysTick cannot wrap. */
+static uint64_t bench_run(bool encode) {
+    static ds3231_lz_encoder_t encoder;
+    static ds3231_lz_decoder_t decoder;
+    const uint8_t * data = encode ? input : encoded;
+    size_t length = encode ? BENCH_SIZE : encoded_length;
+    uint64_t total = 0;
+    if(encode) {
+        encoded_length = 0;
+        ds3231_lz_encoder_init(&encoder, &encoded_sink, NULL);
+    } else {
+        decoded_length = 0;
+        ds3231_lz_decoder_init(&decoder, &decoded_sink, NULL);
+    }
+#if !PICO_ON_DEVICE
+    uint64_t begin = bench_ns();
+#endif
+    for(size_t offset = 0; offset < length; offset += BENCH_CHUNK) {
+        size_t chunk = length - offset < BENCH_CHUNK ? length - offset : BENCH_CHUNK;
+        uint32_t start = bench_start();
+        if(encode)
+            ds3231_lz_encode(&encoder, &data[offset], chunk);
+        else
+            ds3231_lz_decode(&decoder, &data[offset], chunk);
+        bench_elapsed(start, &total);
+    }
+    if(encode) {
+        uint32_t start = bench_start();
+        ds3231_lz_flush(&encoder);
+        bench_elapsed(start, &total);
+    }
+#if !PICO_ON_DEVICE
+    total = bench_ns() - begin;
+#endif
+    return total;
+}
+
+static void bench(const char * name) {
+    uint64_t encode = bench_run(true);
+    uint64_t decode = bench_run(false);
+    bool ok = decoded_length == BENCH_SIZE && !memcmp(input, decoded, BENCH_SIZE);
+    printf("%-12s ratio %5.2f, encode %6.1f %s/byte, decode %5.1f %s/byte%s\n", name,
+        (double)BENCH_SIZE / encoded_length, (double)encode / BENCH_SIZE, BENCH_UNIT,
+        (double)decode / BENCH_SIZE, BENCH_UNIT, ok ? "" : ", MISMATCH");
+}
+
+int main() {
+#if PICO_ON_DEVICE
+    stdio_init_all();
+    sleep_ms(2000);
+#endif
+    /* Timestamp a second apart, temperature in quarter degrees drifting slowly, two flag bytes. */
+    for(int i = 0; i < BENCH_SIZE / 8; i++) {
+        uint32_t timestamp = 746012345 + i;
+        int16_t quarters = 100 + (i / 64) % 8;
+        uint8_t record[8] = {timestamp, timestamp >> 8, timestamp >> 16, timestamp >> 24,
+            quarters & 0xFF, quarters >> 8, 0x01, 0x00};
+        memcpy(&input[i * 8], record, 8);
+    }
+    bench("records");
+    for(int i = 0; i < BENCH_SIZE / 8; i++)
+        input[i * 8 + 7] = bench_random();
+    bench("noisy");
+    for(int i = 0; i < BENCH_SIZE; i++)
+        input[i] = bench_random();
+    bench("random");
+#if PICO_ON_DEVICE
+    while(true)
+        tight_loop_contents();
+#endif
+    return 0;
+}
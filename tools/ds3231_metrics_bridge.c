@@ -0,0 +1,505 @@
+/**
+ * @file    ds3231_metrics_bridge.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Host bridge that polls the metrics dump of many boards and serves them to Prometheus.
+ * Every board is asked for a dump once per interval over its USB CDC tty, all of them at the same
+ * time from one poll loop, see ds3231_metrics.c for the device side. The last complete dump of
+ * every board is kept and the Prometheus text is built from those at most once per interval, so a
+ * scrape never waits for a board and costs a copy of the cached text.
+ * Build on the host with:
+ *   cc -I libraries/ds3231 -o ds3231_metrics_bridge tools/ds3231_metrics_bridge.c
+ *      libraries/ds3231/ds3231_link.c
+ *
+ * Usage:
+ *   ds3231_metrics_bridge [-l port] [-i interval ms] <tty>...
+ * Serves http://127.0.0.1:<port>/metrics, port 9231 and 1000 ms by default. Boards that are
+ * unplugged are opened again on the next interval and reported with ds3231_up 0 meanwhile.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_metrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BRIDGE_MAX_DEVICES      256
+#define BRIDGE_MAX_CLIENTS      16
+#define BRIDGE_MAX_RECORDS      256
+#define BRIDGE_REQUEST_MAX      2048
+
+enum BRIDGE_TYPES {
+    BRIDGE_COUNTER = 0,
+    BRIDGE_GAUGE,
+    BRIDGE_HISTOGRAM
+};
+
+/* How a metric id is served: name, type, help, factor to base units and the label of the index. */
+typedef struct bridge_metric_t {
+    uint8_t id;
+    const char * name;
+    uint8_t type;
+    double scale;
+    const char * label;
+    const char * help;
+} bridge_metric_t;
+
+static const bridge_metric_t metrics[] = {
+    {DS3231_METRICS_UPTIME_S, "ds3231_uptime_seconds", BRIDGE_GAUGE, 1, NULL, "Time since the board booted."},
+    {DS3231_METRICS_BUS_TRANSFERS, "ds3231_bus_transfers_total", BRIDGE_COUNTER, 1, NULL, "I2C transfers of the drivers."},
+    {DS3231_METRICS_BUS_ERRORS, "ds3231_bus_errors_total", BRIDGE_COUNTER, 1, NULL, "I2C transfers that failed."},
+    {DS3231_METRICS_BUS_BYTES, "ds3231_bus_bytes_total", BRIDGE_COUNTER, 1, NULL, "Bytes transferred on I2C."},
+    {DS3231_METRICS_BUS_LATENCY, "ds3231_bus_latency_seconds", BRIDGE_HISTOGRAM, 1e-6, NULL, "Duration of I2C transfers."},
+    {DS3231_METRICS_QUEUE_REQUESTED, "ds3231_queue_requested_total", BRIDGE_COUNTER, 1, NULL, "Reads enqueued."},
+    {DS3231_METRICS_QUEUE_TRANSACTIONS, "ds3231_queue_transactions_total", BRIDGE_COUNTER, 1, NULL, "Bus transactions issued by the read queue."},
+    {DS3231_METRICS_TEMP_QUARTERS, "ds3231_temperature_celsius", BRIDGE_GAUGE, 0.25, NULL, "Cached DS3231 temperature."},
+    {DS3231_METRICS_TEMP_READS, "ds3231_temp_reads_total", BRIDGE_COUNTER, 1, NULL, "Temperature register reads."},
+    {DS3231_METRICS_TEMP_PROBES, "ds3231_temp_probes_total", BRIDGE_COUNTER, 1, NULL, "Status reads looking for the conversion cadence."},
+    {DS3231_METRICS_TEMP_HITS, "ds3231_temp_hits_total", BRIDGE_COUNTER, 1, NULL, "Temperature reads served from the cache."},
+    {DS3231_METRICS_TEMP_ACQUIRE_FAILURES, "ds3231_temp_acquire_failures_total", BRIDGE_COUNTER, 1, NULL, "Conversion cadence searches that gave up."},
+    {DS3231_METRICS_SKEW_NS, "ds3231_skew_seconds", BRIDGE_GAUGE, 1e-9, "module", "Phase of the seconds of a module against the reference module."},
+    {DS3231_METRICS_SKEW_DRIFT_PPB, "ds3231_skew_drift_ppb", BRIDGE_GAUGE, 1, "module", "Drift of a module against the reference module, negative if it runs fast."},
+    {DS3231_METRICS_SKEW_EDGES, "ds3231_skew_edges_total", BRIDGE_COUNTER, 1, NULL, "Seconds edges captured."},
+    {DS3231_METRICS_VOTE_READS, "ds3231_vote_reads_total", BRIDGE_COUNTER, 1, NULL, "Voted reads."},
+    {DS3231_METRICS_VOTE_READ_US, "ds3231_vote_read_seconds", BRIDGE_GAUGE, 1e-6, NULL, "Parallel bus read of the last voted read."},
+    {DS3231_METRICS_VOTE_MAX_READ_US, "ds3231_vote_read_max_seconds", BRIDGE_GAUGE, 1e-6, NULL, "Longest parallel bus read."},
+    {DS3231_METRICS_VOTE_FAILOVERS, "ds3231_vote_failovers_total", BRIDGE_COUNTER, 1, NULL, "Changes of the primary module."},
+    {DS3231_METRICS_VOTE_MAX_FAILOVER_US, "ds3231_vote_failover_max_seconds", BRIDGE_GAUGE, 1e-6, NULL, "Longest failover."},
+    {DS3231_METRICS_VOTE_HOLDOVERS, "ds3231_vote_holdovers_total", BRIDGE_COUNTER, 1, NULL, "Reads served from the local timer."},
+    {DS3231_METRICS_VOTE_DISAGREEMENTS, "ds3231_vote_disagreements_total", BRIDGE_COUNTER, 1, NULL, "Reads with two disagreeing modules and no tie breaker."},
+    {DS3231_METRICS_VOTE_BUS_ERRORS, "ds3231_vote_bus_errors_total", BRIDGE_COUNTER, 1, "module", "Voted reads a module did not answer."},
+    {DS3231_METRICS_VOTE_OSF_READS, "ds3231_vote_osf_reads_total", BRIDGE_COUNTER, 1, "module", "Voted reads with the oscillator stop flag set."},
+    {DS3231_METRICS_VOTE_OUTLIERS, "ds3231_vote_outliers_total", BRIDGE_COUNTER, 1, "module", "Voted reads a module disagreed with the median."},
+    {DS3231_METRICS_WEAR_WRITES, "ds3231_wear_writes_total", BRIDGE_COUNTER, 1, NULL, "Writes of all tracked pages."},
+    {DS3231_METRICS_WEAR_MAX, "ds3231_wear_max_writes", BRIDGE_GAUGE, 1, NULL, "Writes of the most worn page."},
+    {DS3231_METRICS_WEAR_CHECKPOINTS, "ds3231_wear_checkpoints_total", BRIDGE_COUNTER, 1, NULL, "Wear counter checkpoint bytes written."},
+    {DS3231_METRICS_WRITER_ISSUED, "ds3231_writer_issued_total", BRIDGE_COUNTER, 1, NULL, "Programs passed to the storage device."},
+    {DS3231_METRICS_WRITER_MERGED, "ds3231_writer_merged_total", BRIDGE_COUNTER, 1, NULL, "Programs merged into a queued write."},
+    {DS3231_METRICS_WRITER_STALLS, "ds3231_writer_stalls_total", BRIDGE_COUNTER, 1, NULL, "Programs refused because the write queue was full."},
+    {DS3231_METRICS_WRITER_FAILURES, "ds3231_writer_failures_total", BRIDGE_COUNTER, 1, NULL, "Write attempts that failed and were kept queued for retry."},
+    {DS3231_METRICS_WRITER_DROPPED, "ds3231_writer_dropped_total", BRIDGE_COUNTER, 1, NULL, "Writes dropped after failing every retry."},
+    {DS3231_METRICS_VERIFY_MISMATCHES, "ds3231_verify_retries_total", BRIDGE_COUNTER, 1, NULL, "Programs retried after a verify mismatch."},
+    {DS3231_METRICS_VERIFY_REMAPS, "ds3231_verify_remaps_total", BRIDGE_COUNTER, 1, NULL, "Pages remapped to a spare."},
+    {DS3231_METRICS_VERIFY_SPARES_USED, "ds3231_verify_spares_used", BRIDGE_GAUGE, 1, NULL, "Spare pages in use."},
+    {DS3231_METRICS_LINK_CRC_ERRORS, "ds3231_link_crc_errors_total", BRIDGE_COUNTER, 1, NULL, "Host frames with a bad CRC."},
+    {DS3231_METRICS_LINK_DROPPED, "ds3231_link_dropped_bytes_total", BRIDGE_COUNTER, 1, NULL, "Bytes skipped looking for a host frame."},
+};
+
+typedef struct bridge_record_t {
+    uint8_t id;
+    uint8_t index;
+    uint32_t value;
+} bridge_record_t;
+
+typedef struct bridge_device_t {
+    const char * path;
+    const char * name;
+    int fd;
+    ds3231_link_parser_t parser;
+    uint16_t seq;
+    bool pending;               // A dump was requested and is not complete yet.
+    bridge_record_t partial[BRIDGE_MAX_RECORDS];
+    uint32_t partial_count;
+    bridge_record_t records[BRIDGE_MAX_RECORDS];    // Last complete dump.
+    uint32_t count;
+    bool up;
+    uint64_t dump_ms;
+    uint32_t timeouts;
+} bridge_device_t;
+
+typedef struct bridge_client_t {
+    int fd;
+    char request[BRIDGE_REQUEST_MAX];
+    size_t received;
+    char * response;            // Own copy, the cache may be rebuilt while it is sent.
+    size_t length;
+    size_t sent;
+} bridge_client_t;
+
+static bridge_device_t devices[BRIDGE_MAX_DEVICES];
+static int device_count;
+static bridge_client_t clients[BRIDGE_MAX_CLIENTS];
+
+/* Prometheus text of the last dumps, built again only when a dump changed. */
+static char * text;
+static size_t text_length;
+static size_t text_capacity;
+static bool text_dirty = true;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void text_append(const char * format, ...) {
+    va_list args;
+    for(;;) {
+        va_start(args, format);
+        int length = vsnprintf(text + text_length, text_capacity - text_length, format, args);
+        va_end(args);
+        if(length < 0)
+            return;
+        if(text_length + length < text_capacity) {
+            text_length += length;
+            return;
+        }
+        text_capacity = text_capacity ? text_capacity * 2 : 65536;
+        text = realloc(text, text_capacity);
+        if(!text) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+}
+
+static double record_value(const bridge_metric_t * metric, uint32_t value) {
+    if(metric->type == BRIDGE_GAUGE)
+        return (int32_t)value * metric->scale;
+    return value * metric->scale;
+}
+
+static void render_histogram(const bridge_metric_t * metric, bridge_device_t * device) {
+    uint64_t cumulative = 0;
+    uint32_t sum_us = 0;
+    bool found = false;
+    for(uint32_t i = 0; i < device->count; i++) {
+        bridge_record_t * record = &device->records[i];
+        if(record->id == DS3231_METRICS_BUS_LATENCY_SUM_US)
+            sum_us = record->value;
+        if(record->id != metric->id)
+            continue;
+        found = true;
+        cumulative += record->value;
+        if(record->index == DS3231_METRICS_BUS_BUCKETS - 1)
+            text_append("%s_bucket{device=\"%s\",le=\"+Inf\"} %llu\n", metric->name, device->name,
+                (unsigned long long)cumulative);
+        else
+            text_append("%s_bucket{device=\"%s\",le=\"%g\"} %llu\n", metric->name, device->name,
+                ((uint32_t)DS3231_METRICS_BUS_BUCKET_US << record->index) * metric->scale,
+                (unsigned long long)cumulative);
+    }
+    if(found) {
+        text_append("%s_sum{device=\"%s\"} %g\n", metric->name, device->name, sum_us * metric->scale);
+        text_append("%s_count{device=\"%s\"} %llu\n", metric->name, device->name, (unsigned long long)cumulative);
+    }
+}
+
+static void render(void) {
+    uint64_t now = now_ms();
+    text_length = 0;
+    text_append("# HELP ds3231_up Whether the last dump of the board was received in time.\n"
+        "# TYPE ds3231_up gauge\n");
+    for(int d = 0; d < device_count; d++)
+        text_append("ds3231_up{device=\"%s\"} %d\n", devices[d].name, devices[d].up);
+    text_append("# HELP ds3231_dump_age_seconds Time since the last complete dump of the board.\n"
+        "# TYPE ds3231_dump_age_seconds gauge\n");
+    for(int d = 0; d < device_count; d++) {
+        if(devices[d].count)
+            text_append("ds3231_dump_age_seconds{device=\"%s\"} %g\n", devices[d].name,
+                (now - devices[d].dump_ms) / 1000.0);
+    }
+    text_append("# HELP ds3231_bridge_timeouts_total Dumps that were not complete within an interval.\n"
+        "# TYPE ds3231_bridge_timeouts_total counter\n");
+    for(int d = 0; d < device_count; d++)
+        text_append("ds3231_bridge_timeouts_total{device=\"%s\"} %u\n", devices[d].name, devices[d].timeouts);
+
+    static const char * type_names[] = {"counter", "gauge", "histogram"};
+    for(size_t m = 0; m < sizeof(metrics) / sizeof(metrics[0]); m++) {
+        const bridge_metric_t * metric = &metrics[m];
+        text_append("# HELP %s %s\n# TYPE %s %s\n", metric->name, metric->help, metric->name,
+            type_names[metric->type]);
+        for(int d = 0; d < device_count; d++) {
+            bridge_device_t * device = &devices[d];
+            if(metric->type == BRIDGE_HISTOGRAM) {
+                render_histogram(metric, device);
+                continue;
+            }
+            for(uint32_t i = 0; i < device->count; i++) {
+                bridge_record_t * record = &device->records[i];
+                if(record->id != metric->id)
+                    continue;
+                if(metric->label)
+                    text_append("%s{device=\"%s\",%s=\"%u\"} %.10g\n", metric->name, device->name,
+                        metric->label, record->index, record_value(metric, record->value));
+                else
+                    text_append("%s{device=\"%s\"} %.10g\n", metric->name, device->name,
+                        record_value(metric, record->value));
+            }
+        }
+    }
+    text_dirty = false;
+}
+
+static int device_write(void * ctx, const uint8_t * data, size_t length) {
+    bridge_device_t * device = ctx;
+    while(length) {
+        ssize_t written = write(device->fd, data, length);
+        if(written < 0 && errno == EINTR)
+            continue;
+        if(written <= 0)
+            return -1;
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+static void device_close(bridge_device_t * device) {
+    if(device->fd >= 0)
+        close(device->fd);
+    device->fd = -1;
+    device->pending = false;
+    if(device->up)
+        text_dirty = true;
+    device->up = false;
+}
+
+static void device_open(bridge_device_t * device) {
+    device->fd = open(device->path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(device->fd < 0)
+        return;
+    struct termios tio;
+    if(!tcgetattr(device->fd, &tio)) {
+        cfmakeraw(&tio);
+        tcsetattr(device->fd, TCSANOW, &tio);
+    }
+    ds3231_link_parser_init(&device->parser);
+}
+
+static void device_request(bridge_device_t * device) {
+    if(device->fd < 0)
+        device_open(device);
+    if(device->fd < 0)
+        return;
+    if(device->pending) {
+        device->timeouts++;
+        if(device->up)
+            text_dirty = true;
+        device->up = false;
+    }
+    device->seq++;
+    device->partial_count = 0;
+    device->pending = true;
+    if(ds3231_link_send(device_write, device, DS3231_LINK_METRICS_REQUEST, device->seq, NULL, 0, NULL, 0))
+        device_close(device);
+}
+
+static void device_frame(bridge_device_t * device, const ds3231_link_frame_t * frame) {
+    if(frame->type != DS3231_LINK_METRICS || !device->pending || frame->seq != device->seq || !frame->length)
+        return;
+    const uint8_t * record = &frame->payload[1];
+    uint32_t count = (frame->length - 1) / DS3231_METRICS_RECORD_SIZE;
+    for(uint32_t i = 0; i < count && device->partial_count < BRIDGE_MAX_RECORDS; i++) {
+        device->partial[device->partial_count++] = (bridge_record_t){
+            .id = record[0],
+            .index = record[1],
+            .value = record[2] | (record[3] << 8) | (record[4] << 16) | ((uint32_t)record[5] << 24)
+        };
+        record += DS3231_METRICS_RECORD_SIZE;
+    }
+    if(frame->payload[0] & DS3231_METRICS_FLAG_LAST) {
+        memcpy(device->records, device->partial, device->partial_count * sizeof(bridge_record_t));
+        device->count = device->partial_count;
+        device->pending = false;
+        device->up = true;
+        device->dump_ms = now_ms();
+        text_dirty = true;
+    }
+}
+
+static void device_read(bridge_device_t * device) {
+    uint8_t buffer[4096];
+    ssize_t length = read(device->fd, buffer, sizeof(buffer));
+    if(length < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if(length <= 0) {
+        device_close(device);
+        return;
+    }
+    for(ssize_t i = 0; i < length; i++) {
+        if(ds3231_link_parse(&device->parser, buffer[i]) == 1)
+            device_frame(device, &device->parser.frame);
+    }
+}
+
+static void client_close(bridge_client_t * client) {
+    close(client->fd);
+    free(client->response);
+    client->fd = -1;
+    client->response = NULL;
+}
+
+static void client_respond(bridge_client_t * client) {
+    if(text_dirty)
+        render();
+    const char * status = strncmp(client->request, "GET /metrics", 12) ? "404 Not Found" : "200 OK";
+    size_t body = strcmp(status, "200 OK") ? 0 : text_length;
+    char header[160];
+    int header_length = snprintf(header, sizeof(header), "HTTP/1.0 %s\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+        status, body);
+    client->response = malloc(header_length + body);
+    if(!client->response) {
+        client_close(client);
+        return;
+    }
+    memcpy(client->response, header, header_length);
+    memcpy(client->response + header_length, text, body);
+    client->length = header_length + body;
+    client->sent = 0;
+}
+
+static void client_read(bridge_client_t * client) {
+    ssize_t length = read(client->fd, client->request + client->received,
+        sizeof(client->request) - 1 - client->received);
+    if(length < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if(length <= 0) {
+        client_close(client);
+        return;
+    }
+    client->received += length;
+    client->request[client->received] = '\0';
+    if(strstr(client->request, "\r\n\r\n") || strstr(client->request, "\n\n"))
+        client_respond(client);
+    else if(client->received == sizeof(client->request) - 1)
+        client_close(client);
+}
+
+static void client_write(bridge_client_t * client) {
+    ssize_t written = write(client->fd, client->response + client->sent, client->length - client->sent);
+    if(written < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if(written <= 0) {
+        client_close(client);
+        return;
+    }
+    client->sent += written;
+    if(client->sent == client->length)
+        client_close(client);
+}
+
+static int listen_local(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if(fd < 0)
+        return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 16)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char ** argv) {
+    int port = 9231;
+    int interval_ms = 1000;
+    int opt;
+    while((opt = getopt(argc, argv, "l:i:")) != -1) {
+        if(opt == 'l')
+            port = atoi(optarg);
+        else if(opt == 'i')
+            interval_ms = atoi(optarg);
+        else
+            break;
+    }
+    if(optind >= argc || argc - optind > BRIDGE_MAX_DEVICES || interval_ms <= 0) {
+        fprintf(stderr, "usage: %s [-l port] [-i interval ms] <tty>...\n", argv[0]);
+        return 1;
+    }
+    for(int i = optind; i < argc; i++) {
+        bridge_device_t * device = &devices[device_count++];
+        device->path = argv[i];
+        const char * slash = strrchr(argv[i], '/');
+        device->name = slash ? slash + 1 : argv[i];
+        device->fd = -1;
+    }
+    for(int i = 0; i < BRIDGE_MAX_CLIENTS; i++)
+        clients[i].fd = -1;
+
+    int listener = listen_local(port);
+    if(listener < 0) {
+        perror("listen");
+        return 1;
+    }
+
+    struct pollfd fds[1 + BRIDGE_MAX_DEVICES + BRIDGE_MAX_CLIENTS];
+    uint64_t next_ms = now_ms();
+    for(;;) {
+        uint64_t now = now_ms();
+        if(now >= next_ms) {
+            for(int d = 0; d < device_count; d++)
+                device_request(&devices[d]);
+            next_ms = now + interval_ms;
+            /* Keeps the dump ages current, at most one build per interval either way. */
+            text_dirty = true;
+        }
+
+        int count = 0;
+        fds[count++] = (struct pollfd){.fd = listener, .events = POLLIN};
+        for(int d = 0; d < device_count; d++)
+            fds[count++] = (struct pollfd){.fd = devices[d].fd, .events = POLLIN};
+        for(int c = 0; c < BRIDGE_MAX_CLIENTS; c++)
+            fds[count++] = (struct pollfd){.fd = clients[c].fd,
+                .events = clients[c].response ? POLLOUT : POLLIN};
+
+        if(poll(fds, count, (int)(next_ms - now)) < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("poll");
+            return 1;
+        }
+
+        if(fds[0].revents & POLLIN) {
+            int fd = accept(listener, NULL, NULL);
+            if(fd >= 0) {
+                fcntl(fd, F_SETFL, O_NONBLOCK);
+                int c = 0;
+                while(c < BRIDGE_MAX_CLIENTS && clients[c].fd >= 0)
+                    c++;
+                if(c == BRIDGE_MAX_CLIENTS) {
+                    close(fd);
+                } else {
+                    clients[c].fd = fd;
+                    clients[c].received = 0;
+                }
+            }
+        }
+        for(int d = 0; d < device_count; d++) {
+            short revents = fds[1 + d].revents;
+            if(devices[d].fd < 0 || !revents)
+                continue;
+            if(revents & POLLIN)
+                device_read(&devices[d]);
+            else if(revents & (POLLERR | POLLHUP | POLLNVAL))
+                device_close(&devices[d]);
+        }
+        for(int c = 0; c < BRIDGE_MAX_CLIENTS; c++) {
+            short revents = fds[1 + device_count + c].revents;
+            if(clients[c].fd < 0 || !revents)
+                continue;
+            if(revents & (POLLERR | POLLHUP | POLLNVAL))
+                client_close(&clients[c]);
+            else if(clients[c].response)
+                client_write(&clients[c]);
+            else
+                client_read(&clients[c]);
+        }
+    }
+}
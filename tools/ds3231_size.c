@@ -0,0 +1,79 @@
+/**
+ * @file    ds3231_size.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Firmware that calls every compiled in function of ds3231.h, so the linker keeps them and
+ * the size of the image shows the cost of a configuration of the driver.
+ * Configured with -DDS3231_SIZE_REPORT=ON it is built three times: ds3231_size with the driver,
+ * ds3231_size_baseline without any driver calls and ds3231_size_hwrtc with the driver and
+ * ds3231_hwrtc. The hardware RTC bridge is not part of any feature configuration, so it is
+ * measured on its own row against ds3231_size.
+ * tools/ds3231_size.sh builds every configuration and prints the size of the driver in each.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "pico/stdlib.h"
+#include "ds3231.h"
+#include "ds3231_hwrtc.h"
+
+/* Volatile so the calls are not folded away. */
+static volatile int sink;
+
+static void ds3231_size_callback(uint gpio, uint32_t event_mask) {
+    sink++;
+}
+
+int main() {
+    stdio_init_all();
+#ifndef DS3231_SIZE_BASELINE
+    static ds3231_t rtc;
+    ds3231_data_t data;
+    ds3231_init(&rtc, i2c0, DS3231_DEVICE_ADRESS, AT24C32_EEPROM_ADRESS_0);
+    sink += ds3231_read_current_time(&rtc, &data);
+    sink += ds3231_configure_time(&rtc, &data);
+    sink += ds3231_read_time_fields(&rtc, DS3231_FIELD_SECONDS, &data);
+    static ds3231_time_watch_t watch;
+    sink += ds3231_time_watch_init(&watch, DS3231_FIELD_SECONDS);
+    sink += ds3231_time_watch_poll(&rtc, &watch);
+
+    int16_t quarters;
+    sink += ds3231_read_temperature_quarters(&rtc, &quarters);
+    sink += ds3231_force_convert_temperature(&rtc);
+    sink += ds3231_set_aging_offset(&rtc, 0);
+    sink += ds3231_check_oscillator_stop_flag(&rtc);
+    sink += ds3231_set_square_wave_frequency(&rtc, FREQUENCY_1_HZ);
+    sink += ds3231_enable_oscillator(&rtc, true);
+    sink += ds3231_enable_32khz_square_wave(&rtc, true);
+    sink += ds3231_enable_battery_backed_square_wave(&rtc, false);
+    sink += ds3231_set_interrupt_callback_function(18, &ds3231_size_callback);
+
+#ifdef DS3231_SIZE_HWRTC
+    static ds3231_hwrtc_t hwrtc;
+    sink += ds3231_hwrtc_init(&hwrtc, &rtc, DS3231_HWRTC_GPIN0_GPIO, 1000);
+    sink += ds3231_hwrtc_seed(&hwrtc);
+    sink += ds3231_hwrtc_poll(&hwrtc);
+#endif
+#if DS3231_CONFIG_FLOAT
+    float temperature;
+    sink += ds3231_read_temperature(&rtc, &temperature);
+#endif
+#if DS3231_CONFIG_ALARMS
+    ds3231_alarm_1_t alarm_1 = {0};
+    ds3231_alarm_2_t alarm_2 = {0};
+    sink += ds3231_set_alarm_1(&rtc, &alarm_1, ON_EVERY_SECOND);
+    sink += ds3231_set_alarm_2(&rtc, &alarm_2, ON_EVERY_MINUTE);
+    sink += ds3231_enable_alarm_interrupt(&rtc, true);
+#endif
+#if DS3231_CONFIG_AM_PM
+    sink += ds3231_enable_am_pm_mode(&rtc, true);
+#endif
+#if DS3231_CONFIG_EEPROM
+    sink += at24c32_write_current_time(&rtc, 0);
+#endif
+#endif
+    while(true)
+        tight_loop_contents();
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Size of the driver in every feature configuration.
+# Builds tools/ds3231_size.c with each configuration and prints the flash (text + data) and RAM
+# (data + bss) it adds over ds3231_size_baseline, which links the same SDK code without the driver.
+# The hwrtc row is what ds3231_hwrtc adds to the driver with every feature on.
+# Usage: tools/ds3231_size.sh [build directory], PICO_SDK_PATH must be set.
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=${1:-"$ROOT/build-size"}
+SIZE=${SIZE:-arm-none-eabi-size}
+
+ALL="-DDS3231_AM_PM=ON -DDS3231_FLOAT=ON -DDS3231_EEPROM=ON -DDS3231_ALARMS=ON -DDS3231_TRACE=ON -DDS3231_METRICS=ON -DDS3231_CRUMBS=ON"
+NONE="-DDS3231_AM_PM=OFF -DDS3231_FLOAT=OFF -DDS3231_EEPROM=OFF -DDS3231_ALARMS=OFF -DDS3231_TRACE=OFF -DDS3231_METRICS=OFF -DDS3231_CRUMBS=OFF"
+
+# Print the flash and RAM of image $3 over image $4 of build directory $2 as row $1.
+difference() {
+    set -- "$1" $($SIZE "$2/$3.elf" | tail -n 1) $($SIZE "$2/$4.elf" | tail -n 1)
+    printf "%-12s %8d %8d\n" "$1" $(($2 + $3 - $8 - $9)) $(($3 + $4 - $9 - ${10}))
+}
+
+measure() {
+    name=$1
+    shift
+    dir="$BUILD/$name"
+    cmake -S "$ROOT" -B "$dir" -DDS3231_SIZE_REPORT=ON "$@" > /dev/null
+    cmake --build "$dir" --target ds3231_size ds3231_size_baseline ds3231_size_hwrtc -j > /dev/null
+    difference "$name" "$dir" ds3231_size ds3231_size_baseline
+}
+
+printf "%-12s %8s %8s\n" "config" "flash" "ram"
+measure all $ALL
+measure no-am-pm $ALL -DDS3231_AM_PM=OFF
+measure no-float $ALL -DDS3231_FLOAT=OFF
+measure no-eeprom $ALL -DDS3231_EEPROM=OFF
+measure no-alarms $ALL -DDS3231_ALARMS=OFF
+measure no-trace $ALL -DDS3231_TRACE=OFF
+measure no-metrics $ALL -DDS3231_METRICS=OFF
+measure no-crumbs $ALL -DDS3231_CRUMBS=OFF
+measure minimal $NONE
+difference hwrtc "$BUILD/all" ds3231_size_hwrtc ds3231_size
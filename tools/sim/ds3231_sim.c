@@ -0,0 +1,250 @@
+/**
+ * @file    ds3231_sim.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Virtual time simulator of a DS3231 on I2C, to check the driver on the host.
+ * Implements the SDK functions the driver calls. The DS3231 and the RP2040 timer both run off
+ * the virtual time with their own rate errors, and every transfer advances the virtual time by
+ * its length on a 400 kHz bus, so polling loops of the driver make progress. Writing the seconds
+ * register restarts the one second countdown like on the real chip. Timekeeping registers are
+ * computed from the virtual time on every read, the other registers are plain memory.
+ * Test programs next to this file link it with the driver sources they check, see their headers.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_sim.h"
+#include "hardware/gpio.h"
+#include "hardware/structs/watchdog.h"
+
+#define DS3231_SIM_ADRESS               0x68
+
+struct i2c_inst {
+    int index;
+};
+
+static struct i2c_inst ds3231_sim_i2c[2] = {{0}, {1}};
+i2c_inst_t * i2c0 = &ds3231_sim_i2c[0];
+i2c_inst_t * i2c1 = &ds3231_sim_i2c[1];
+
+ds3231_sim_t ds3231_sim;
+watchdog_hw_t ds3231_sim_watchdog;
+
+static uint8_t ds3231_sim_to_bcd(uint32_t value) {
+    return ((value / 10) << 4) | (value % 10);
+}
+
+static uint32_t ds3231_sim_from_bcd(uint8_t value) {
+    return (value >> 4) * 10 + (value & 0x0F);
+}
+
+/* Days since 2000-01-01 of a date, 2000 - 2199. */
+static int32_t ds3231_sim_days(uint32_t year, uint32_t month, uint32_t date) {
+    static const uint16_t before[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+    int32_t days = (year - 2000) * 365 + (year - 2000 + 3) / 4 - (year > 2100 ? 1 : 0);
+    days += before[(month - 1) % 12] + date - 1;
+    if(month > 2 && (year % 4) == 0 && year != 2100)
+        days++;
+    return days;
+}
+
+static void ds3231_sim_encode(int64_t rtc_us, uint8_t * regs) {
+    uint32_t seconds = (uint32_t)(rtc_us / 1000000);
+    regs[0] = ds3231_sim_to_bcd(seconds % 60);
+    regs[1] = ds3231_sim_to_bcd((seconds / 60) % 60);
+    uint32_t hours = (seconds / 3600) % 24;
+    if(ds3231_sim.hours_12)
+        regs[2] = 0x40 | (hours >= 12 ? 0x20 : 0) | ds3231_sim_to_bcd(hours % 12 ? hours % 12 : 12);
+    else
+        regs[2] = ds3231_sim_to_bcd(hours);
+
+    int32_t days = seconds / 86400;
+    regs[3] = (days + 5) % 7 + 1;   // 2000-01-01 was a saturday.
+    uint32_t year = 2000;
+    while(days >= ds3231_sim_days(year + 1, 1, 1))
+        year++;
+    uint32_t month = 1;
+    while(month < 12 && days >= ds3231_sim_days(year, month + 1, 1))
+        month++;
+    regs[4] = ds3231_sim_to_bcd(days - ds3231_sim_days(year, month, 1) + 1);
+    regs[5] = ds3231_sim_to_bcd(month) | (year >= 2100 ? 0x80 : 0);
+    regs[6] = ds3231_sim_to_bcd(year % 100);
+}
+
+static int64_t ds3231_sim_decode(const uint8_t * regs) {
+    uint32_t hours;
+    if(regs[2] & 0x40) {
+        hours = ds3231_sim_from_bcd(regs[2] & 0x1F) % 12;
+        if(regs[2] & 0x20)
+            hours += 12;
+    } else {
+        hours = ds3231_sim_from_bcd(regs[2] & 0x3F);
+    }
+    uint32_t year = 2000 + ds3231_sim_from_bcd(regs[6]) + ((regs[5] & 0x80) ? 100 : 0);
+    int32_t days = ds3231_sim_days(year, ds3231_sim_from_bcd(regs[5] & 0x1F), ds3231_sim_from_bcd(regs[4] & 0x3F));
+    int64_t seconds = (int64_t)days * 86400 + hours * 3600 +
+        ds3231_sim_from_bcd(regs[1] & 0x7F) * 60 + ds3231_sim_from_bcd(regs[0] & 0x7F);
+    return seconds * 1000000;
+}
+
+/* Virtual time on the wire: start, adress byte, data bytes with their acks and a stop. */
+static void ds3231_sim_transfer_time(size_t length) {
+    ds3231_sim_advance_us(((length + 1) * 9 + 2) * 1000000ull / DS3231_SIM_BAUDRATE + 1);
+}
+
+/**
+ * @brief               Start a simulation. The DS3231 is set to the given time with its
+ * oscillator stop flag set, like after a first power on, and the virtual time starts at 0.
+ *
+ * @param[in] epoch     DS3231 time in seconds since 2000-01-01 00:00:00.
+ * @param[in] rtc_ppm   Rate error of the DS3231, positive runs fast.
+ * @param[in] local_ppm Rate error of the RP2040 timer, positive runs fast.
+ */
+void ds3231_sim_init(uint32_t epoch, int32_t rtc_ppm, int32_t local_ppm) {
+    ds3231_sim.now_us = 0;
+    ds3231_sim.rtc_ppm = rtc_ppm;
+    ds3231_sim.local_ppm = local_ppm;
+    ds3231_sim.rtc_set_us = 0;
+    ds3231_sim.rtc_base_us = (int64_t)epoch * 1000000;
+    ds3231_sim.hours_12 = false;
+    ds3231_sim.stopped = false;
+    for(int i = 0; i < DS3231_SIM_REG_COUNT; i++)
+        ds3231_sim.regs[i] = 0;
+    ds3231_sim.regs[0x0E] = 0x1C;   // INTCN, RS2 and RS1 after power on.
+    ds3231_sim.regs[0x0F] = 0x88;   // OSF and EN32kHz after power on.
+    ds3231_sim.regs[0x11] = 25;     // 25.00 degrees.
+    ds3231_sim.pointer = 0;
+    ds3231_sim.fail = false;
+    ds3231_sim.transactions = 0;
+    ds3231_sim.reads = 0;
+    ds3231_sim.writes = 0;
+}
+
+/**
+ * @brief               Let virtual time pass.
+ *
+ * @param[in] us        Microseconds of virtual time.
+ */
+void ds3231_sim_advance_us(uint64_t us) {
+    ds3231_sim.now_us += us;
+}
+
+/**
+ * @brief               Stop or restart the oscillator of the DS3231. Stopping sets OSF.
+ *
+ * @param[in] stop      Stopped if true.
+ */
+void ds3231_sim_stop(bool stop) {
+    ds3231_sim.rtc_base_us = ds3231_sim_rtc_us();
+    ds3231_sim.rtc_set_us = ds3231_sim.now_us;
+    ds3231_sim.stopped = stop;
+    if(stop)
+        ds3231_sim.regs[0x0F] |= 0x80;
+}
+
+/**
+ * @brief               Time the DS3231 counts at the current virtual time.
+ *
+ * @return              Microseconds since 2000-01-01 00:00:00.
+ */
+int64_t ds3231_sim_rtc_us(void) {
+    if(ds3231_sim.stopped)
+        return ds3231_sim.rtc_base_us;
+    int64_t elapsed = (int64_t)(ds3231_sim.now_us - ds3231_sim.rtc_set_us);
+    return ds3231_sim.rtc_base_us + elapsed + elapsed * ds3231_sim.rtc_ppm / 1000000;
+}
+
+/**
+ * @brief               Value of the RP2040 timer at the current virtual time.
+ *
+ * @return              Microseconds since the start of the simulation on the local clock.
+ */
+int64_t ds3231_sim_local_us(void) {
+    int64_t now = (int64_t)ds3231_sim.now_us;
+    return now + now * ds3231_sim.local_ppm / 1000000;
+}
+
+uint i2c_init(i2c_inst_t * i2c, uint baudrate) {
+    return DS3231_SIM_BAUDRATE;
+}
+
+uint i2c_hw_index(i2c_inst_t * i2c) {
+    return i2c->index;
+}
+
+int i2c_write_blocking(i2c_inst_t * i2c, uint8_t addr, const uint8_t * src, size_t len, bool nostop) {
+    ds3231_sim_transfer_time(len);
+    if(ds3231_sim.fail || addr != DS3231_SIM_ADRESS || !len)
+        return PICO_ERROR_GENERIC;
+    ds3231_sim.writes++;
+    ds3231_sim.transactions++;
+    ds3231_sim.pointer = src[0] % DS3231_SIM_REG_COUNT;
+
+    uint8_t time[7];
+    ds3231_sim_encode(ds3231_sim_rtc_us(), time);
+    bool time_written = false;
+    bool seconds_written = false;
+    for(size_t i = 1; i < len; i++) {
+        uint8_t reg = ds3231_sim.pointer;
+        if(reg <= 0x06) {
+            time[reg] = src[i];
+            time_written = true;
+            if(reg == 0x00)
+                seconds_written = true;
+            if(reg == 0x02)
+                ds3231_sim.hours_12 = (src[i] & 0x40) != 0;
+        } else if(reg == 0x0F) {
+            /* OSF, A2F and A1F can only be cleared, the busy flag is read only. */
+            uint8_t flags = ds3231_sim.regs[reg] & src[i] & 0x83;
+            ds3231_sim.regs[reg] = (src[i] & 0x78) | flags;
+        } else if(reg < 0x11) {
+            ds3231_sim.regs[reg] = src[i];
+        }
+        ds3231_sim.pointer = (reg + 1) % DS3231_SIM_REG_COUNT;
+    }
+    if(time_written) {
+        /* Writing the seconds register restarts the countdown, other fields keep the fraction. */
+        int64_t fraction = seconds_written ? 0 : ds3231_sim_rtc_us() % 1000000;
+        ds3231_sim.rtc_base_us = ds3231_sim_decode(time) + fraction;
+        ds3231_sim.rtc_set_us = ds3231_sim.now_us;
+    }
+    return (int)len;
+}
+
+int i2c_read_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop) {
+    ds3231_sim_transfer_time(len);
+    if(ds3231_sim.fail || addr != DS3231_SIM_ADRESS)
+        return PICO_ERROR_GENERIC;
+    ds3231_sim.reads++;
+
+    /* The time is latched at the start of the read, like the user buffers of the chip. */
+    uint8_t time[7];
+    ds3231_sim_encode(ds3231_sim_rtc_us(), time);
+    for(size_t i = 0; i < len; i++) {
+        uint8_t reg = ds3231_sim.pointer;
+        dst[i] = reg <= 0x06 ? time[reg] : ds3231_sim.regs[reg];
+        ds3231_sim.pointer = (reg + 1) % DS3231_SIM_REG_COUNT;
+    }
+    return (int)len;
+}
+
+uint64_t time_us_64(void) {
+    return (uint64_t)ds3231_sim_local_us();
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t)ds3231_sim_local_us();
+}
+
+void busy_wait_us(uint64_t delay_us) {
+    ds3231_sim_advance_us(delay_us);
+}
+
+void gpio_init(uint gpio) {}
+void gpio_set_dir(uint gpio, bool out) {}
+void gpio_pull_up(uint gpio) {}
+void gpio_set_function(uint gpio, enum gpio_function fn) {}
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback) {}
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled) {}
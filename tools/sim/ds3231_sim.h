@@ -0,0 +1,57 @@
+/**
+ * @file    ds3231_sim.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Virtual time simulator of a DS3231 on I2C, to check the driver on the host.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "hardware/i2c.h"
+#include "hardware/timer.h"
+
+#ifndef DS_3231_SIM
+#define DS_3231_SIM
+
+/* Registers 0x00 - 0x12, the register pointer wraps to 0x00 after 0x12. */
+#define DS3231_SIM_REG_COUNT            0x13
+
+/* I2C clock of the simulated bus, transfers advance the virtual time by their length on the wire. */
+#define DS3231_SIM_BAUDRATE             400000
+
+/**
+ * @brief Struct to hold the state of the simulation. Times are in microseconds of virtual time.
+ *
+ */
+typedef struct ds3231_sim_t {
+    uint64_t now_us;            // Virtual time since the start of the simulation.
+    int32_t rtc_ppm;            // Rate error of the DS3231.
+    int32_t local_ppm;          // Rate error of the RP2040 timer.
+
+    /* The DS3231 counts rtc_base_us at rtc_set_us and runs at (1 + rtc_ppm) from there. */
+    uint64_t rtc_set_us;
+    int64_t rtc_base_us;        // Since 2000-01-01 00:00:00.
+    bool hours_12;              // Hours register was last written in 12-hour mode.
+    bool stopped;               // Oscillator stopped, the time does not advance.
+
+    uint8_t regs[DS3231_SIM_REG_COUNT];
+    uint8_t pointer;
+    bool fail;                  // Every transfer fails while set.
+
+    uint32_t transactions;      // Register pointer writes, i.e. read or write transactions.
+    uint32_t reads;
+    uint32_t writes;
+} ds3231_sim_t;
+
+extern ds3231_sim_t ds3231_sim;
+
+void ds3231_sim_init(uint32_t epoch, int32_t rtc_ppm, int32_t local_ppm);
+void ds3231_sim_advance_us(uint64_t us);
+void ds3231_sim_stop(bool stop);
+
+int64_t ds3231_sim_rtc_us(void);
+int64_t ds3231_sim_local_us(void);
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * @file    ds3231_sim_clock.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Checks ds3231_clock against the simulated DS3231 over hours of virtual time: the
+ * corrected view never goes backwards, never changes rate by more than max_slew_ppm and stays
+ * close to the DS3231, while the raw view steps on every correction. Also checks the clock before
+ * its first sync and a sync against a stopped oscillator.
+ * Build and run on the host with:
+ *   cc -I tools/sim -I libraries/ds3231 -DDS3231_CONFIG_TRACE=0 -DDS3231_CONFIG_METRICS=0
+ *      -o ds3231_sim_clock tools/sim/ds3231_sim_clock.c tools/sim/ds3231_sim.c
+ *      libraries/ds3231/ds3231.c libraries/ds3231/ds3231_clock.c
+ *   ./ds3231_sim_clock
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_sim.h"
+#include "ds3231_clock.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_SLEW_PPM                    500
+#define WINDOW_MS                       10000
+#define SAMPLE_US                       1000
+#define RATE_US                         100000
+#define SYNC_US                         60000000
+
+static int failures;
+
+#define CHECK(condition) do { \
+    if(!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while(0)
+
+typedef struct run_t {
+    int64_t last_corrected;
+    int64_t rate_corrected;     // Start of the interval the rate is measured over.
+    int64_t rate_local;
+    int64_t worst_error;        // Largest distance to the DS3231 once settled.
+    int64_t worst_rate_ppm;     // Largest rate change of the corrected view.
+    int backwards;
+    int raw_steps;
+} run_t;
+
+/* Sample the clock every SAMPLE_US of virtual time for the given duration, syncing every SYNC_US. */
+static void run(ds3231_clock_t * clock, run_t * r, uint64_t duration_us, bool settled) {
+    uint64_t end = ds3231_sim.now_us + duration_us;
+    uint64_t next_sync = ds3231_sim.now_us + SYNC_US;
+    while(ds3231_sim.now_us < end) {
+        if(ds3231_sim.now_us >= next_sync) {
+            int64_t raw_before = ds3231_clock_raw_at(clock, time_us_64());
+            CHECK(ds3231_clock_sync(clock) == 0);
+            if(llabs(ds3231_clock_raw_at(clock, time_us_64()) - raw_before) > 0)
+                r->raw_steps++;
+            next_sync += SYNC_US;
+        }
+        ds3231_sim_advance_us(SAMPLE_US);
+
+        int64_t raw, corrected;
+        CHECK(ds3231_clock_read(clock, &raw, &corrected) == 0);
+        int64_t local = (int64_t)time_us_64();
+        if(corrected < r->last_corrected)
+            r->backwards++;
+        r->last_corrected = corrected;
+        if(!r->rate_local) {
+            r->rate_corrected = corrected;
+            r->rate_local = local;
+        } else if(local - r->rate_local >= RATE_US) {
+            int64_t elapsed = local - r->rate_local;
+            int64_t rate = ((corrected - r->rate_corrected) - elapsed) * 1000000 / elapsed;
+            if(llabs(rate) > r->worst_rate_ppm)
+                r->worst_rate_ppm = llabs(rate);
+            r->rate_corrected = corrected;
+            r->rate_local = local;
+        }
+
+        int64_t error = llabs(corrected - ds3231_sim_rtc_us());
+        if(settled && error > r->worst_error)
+            r->worst_error = error;
+    }
+}
+
+/* Local timer 100 ppm fast, corrections every minute for an hour. */
+static void drift(void) {
+    ds3231_t rtc;
+    ds3231_clock_t clock;
+    run_t r = {0};
+    ds3231_sim_init(746012345, 0, 100);
+    ds3231_init(&rtc, i2c0, 0, 0);
+    CHECK(ds3231_clock_init(&clock, &rtc, MAX_SLEW_PPM, WINDOW_MS) == 0);
+    CHECK(ds3231_clock_read(&clock, NULL, NULL) == -1);
+    CHECK(ds3231_clock_sync(&clock) == 0);
+    r.last_corrected = ds3231_clock_now_us(&clock);
+
+    run(&clock, &r, 3600000000ull, true);
+    printf("drift: error %lld us, rate %lld ppm, %d raw steps\n",
+        (long long)r.worst_error, (long long)r.worst_rate_ppm, r.raw_steps);
+    CHECK(r.backwards == 0);
+    /* The timer gains 6 ms a minute, less the sampling error of the seconds boundary. */
+    CHECK(r.worst_error < 7000);
+    /* Rounding of one microsecond over RATE_US on top of the bound. */
+    CHECK(r.worst_rate_ppm <= MAX_SLEW_PPM + 10);
+    CHECK(r.raw_steps >= 59);
+}
+
+/* DS3231 set 2 s back: the corrected view slews down at the bound instead of stepping. */
+static void step_back(void) {
+    ds3231_t rtc;
+    ds3231_clock_t clock;
+    run_t r = {0};
+    ds3231_data_t time;
+    ds3231_sim_init(746012345, 0, 0);
+    ds3231_init(&rtc, i2c0, 0, 0);
+    CHECK(ds3231_clock_init(&clock, &rtc, MAX_SLEW_PPM, WINDOW_MS) == 0);
+    CHECK(ds3231_clock_sync(&clock) == 0);
+    r.last_corrected = ds3231_clock_now_us(&clock);
+    run(&clock, &r, 30000000, false);
+
+    ds3231_epoch_to_time(&rtc, (uint32_t)(ds3231_sim_rtc_us() / 1000000) - 2, &time);
+    CHECK(ds3231_configure_time(&rtc, &time) == 0);
+    CHECK(ds3231_clock_sync(&clock) == 0);
+    CHECK(clock.slew_ppm == -MAX_SLEW_PPM);
+    int64_t raw;
+    CHECK(ds3231_clock_read(&clock, &raw, NULL) == 0);
+    CHECK(llabs(raw - ds3231_sim_rtc_us()) < 1000);
+
+    /* 2 s at 500 ppm takes 4000 s. Halfway the error is still about 1 s. */
+    run(&clock, &r, 2000000000ull, false);
+    CHECK(r.backwards == 0);
+    CHECK(r.worst_rate_ppm <= MAX_SLEW_PPM + 10);
+    int64_t error = ds3231_clock_now_us(&clock) - ds3231_sim_rtc_us();
+    printf("step back: error %lld us after 2000 s\n", (long long)error);
+    CHECK(error > 900000 && error < 1100000);
+
+    r.worst_error = 0;
+    run(&clock, &r, 2200000000ull, false);
+    run(&clock, &r, 600000000, true);
+    printf("step back: error %lld us once settled\n", (long long)r.worst_error);
+    CHECK(r.backwards == 0);
+    CHECK(r.worst_error < 1000);
+}
+
+/* Nothing is served before the first sync, and a stopped oscillator makes the sync fail in time. */
+static void unsynced(void) {
+    ds3231_t rtc;
+    ds3231_clock_t clock;
+    ds3231_sim_init(746012345, 0, 0);
+    ds3231_init(&rtc, i2c0, 0, 0);
+    CHECK(ds3231_clock_init(&clock, &rtc, MAX_SLEW_PPM, WINDOW_MS) == 0);
+    CHECK(ds3231_clock_now_us(&clock) == 0);
+    CHECK(ds3231_clock_corrected_at(&clock, time_us_64()) == 0);
+
+    ds3231_sim_stop(true);
+    uint64_t start = ds3231_sim.now_us;
+    CHECK(ds3231_clock_sync(&clock) == -1);
+    CHECK(ds3231_sim.now_us - start < 1200000);
+    CHECK(!clock.synced);
+
+    ds3231_sim_stop(false);
+    CHECK(ds3231_clock_sync(&clock) == 0);
+    CHECK(llabs(ds3231_clock_now_us(&clock) - ds3231_sim_rtc_us()) < 1000);
+}
+
+int main(void) {
+    unsynced();
+    drift();
+    step_back();
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+/**
+ * @file    ds3231_sim_image.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Checks the migrate command of tools/ds3231_image.c on image files: a format 1 image is
+ * migrated into a format 2 image the device mounts, with its pages and log records, and a
+ * partition that would not fit into the new layout fails the migration instead of being cut.
+ * The tool is compiled into the test, its main renamed.
+ * Build and run on the host with:
+ *   cc -I libraries/ds3231 -o ds3231_sim_image tools/sim/ds3231_sim_image.c
+ *      libraries/ds3231/ds3231_storage.c libraries/ds3231/ds3231_storage_file.c
+ *      libraries/ds3231/ds3231_log.c libraries/ds3231/ds3231_super.c libraries/ds3231/ds3231_link.c
+ *   ./ds3231_sim_image
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#define _GNU_SOURCE
+#define main ds3231_image_main
+#include "../ds3231_image.c"
+#undef main
+#include <unistd.h>
+
+#define RECORDS                         40
+
+static int failures;
+
+#define CHECK(condition) do { \
+    if(!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while(0)
+
+static char old_path[64];
+static char new_path[64];
+
+static void fill(uint8_t * data, uint32_t page) {
+    for(int i = 0; i < IMAGE_PAGE_SIZE; i++)
+        data[i] = page * 5 + i;
+}
+
+/* Read the numbers of the records of a log, oldest first. */
+static int read_records(ds3231_log_t * log, uint32_t * numbers) {
+    ds3231_log_cursor_t cursor;
+    const uint8_t * record;
+    uint8_t length;
+    int count = 0;
+    ds3231_log_cursor_init(&cursor, log);
+    while(ds3231_log_cursor_next(&cursor, &record, &length) == 1 && count < RECORDS) {
+        CHECK(length == 6 && record[2] == 0xA5 && record[4] == (uint8_t)(record[0] * 3));
+        numbers[count++] = record[0] | (record[1] << 8);
+    }
+    return count;
+}
+
+/* Run the tool with the arguments after its name. */
+static int run(int argc, char ** argv) {
+    char * args[16] = {"ds3231_image"};
+    for(int i = 0; i < argc; i++)
+        args[i + 1] = argv[i];
+    return ds3231_image_main(argc + 1, args);
+}
+
+/* A format 1 image: config in pages 1-4, which format 2 keeps for its second copy, and a log in 5-12. */
+static void write_format_1(void) {
+    ds3231_file_storage_t image;
+    unlink(old_path);
+    CHECK(ds3231_file_storage_open(&image, old_path, IMAGE_PAGE_SIZE, IMAGE_PAGE_COUNT) == 0);
+    uint8_t data[IMAGE_PAGE_SIZE];
+    for(uint32_t page = 1; page < 5; page++) {
+        fill(data, page);
+        CHECK(ds3231_storage_program(&image.storage, page, 0, IMAGE_PAGE_SIZE, data) == 0);
+    }
+    ds3231_log_t log;
+    ds3231_log_init(&log, &image.storage, 5, 8);
+    CHECK(ds3231_log_format(&log) == 0);
+    for(uint32_t i = 0; i < RECORDS; i++) {
+        uint8_t record[6] = {i, i >> 8, 0xA5, 0x5A, i * 3, 0};
+        CHECK(ds3231_log_append(&log, record, sizeof(record)) == 0);
+    }
+
+    uint8_t block[IMAGE_FORMAT_1_SIZE] = {DS3231_SUPER_MAGIC, IMAGE_FORMAT_1, 7, 2,
+        DS3231_SUPER_CONFIG, 1, 4, 0, 0,
+        DS3231_SUPER_LOG, 5, 8, ds3231_log_head(&log) & 0xFF, ds3231_log_head(&log) >> 8};
+    uint16_t crc = ds3231_link_crc16(0xFFFF, block, IMAGE_FORMAT_1_SIZE - 2);
+    block[IMAGE_FORMAT_1_SIZE - 2] = crc & 0xFF;
+    block[IMAGE_FORMAT_1_SIZE - 1] = crc >> 8;
+    CHECK(ds3231_storage_program(&image.storage, 0, 0, IMAGE_FORMAT_1_SIZE, block) == 0);
+    CHECK(ds3231_file_storage_close(&image) == 0);
+}
+
+static uint32_t old_numbers[RECORDS];
+static int old_count;
+
+static void read_format_1(void) {
+    ds3231_file_storage_t image;
+    ds3231_super_t super;
+    ds3231_log_t log;
+    CHECK(ds3231_file_storage_open(&image, old_path, IMAGE_PAGE_SIZE, IMAGE_PAGE_COUNT) == 0);
+    CHECK(ds3231_super_mount(&super, &image.storage) == -1);
+    CHECK(mount_format_1(&super, &image.storage) == 0);
+    CHECK(ds3231_log_init_at(&log, &image.storage, 5, 8, super.partitions[1].head) == 0);
+    old_count = read_records(&log, old_numbers);
+    /* The log wrapped, the newest records are kept. */
+    CHECK(old_count > 0 && old_count < RECORDS && old_numbers[old_count - 1] == RECORDS - 1);
+    CHECK(ds3231_file_storage_close(&image) == 0);
+}
+
+static void format_1(void) {
+    write_format_1();
+    read_format_1();
+    char * info_args[] = {"info", old_path};
+    CHECK(run(2, info_args) == 0);
+    unlink(new_path);
+    char * args[] = {"migrate", old_path, new_path, "8", "config:2:4", "log:6:8"};
+    CHECK(run(6, args) == 0);
+
+    ds3231_file_storage_t image;
+    ds3231_super_t super;
+    CHECK(ds3231_file_storage_open(&image, new_path, IMAGE_PAGE_SIZE, IMAGE_PAGE_COUNT) == 0);
+    CHECK(ds3231_super_mount(&super, &image.storage) == 0);
+    CHECK(super.layout == 8);
+    uint8_t data[IMAGE_PAGE_SIZE];
+    uint8_t expected[IMAGE_PAGE_SIZE];
+    for(uint32_t i = 0; i < 4; i++) {
+        CHECK(ds3231_storage_read(&image.storage, 2 + i, 0, IMAGE_PAGE_SIZE, data) == 0);
+        fill(expected, 1 + i);
+        CHECK(memcmp(data, expected, IMAGE_PAGE_SIZE) == 0);
+    }
+
+    /* Every record comes over in order, the saved head is current. */
+    ds3231_log_t log;
+    uint32_t numbers[RECORDS];
+    CHECK(ds3231_super_mount_log(&super, &log) == 0);
+    CHECK(ds3231_log_head(&log) == ds3231_super_find(&super, DS3231_SUPER_LOG)->head);
+    CHECK(read_records(&log, numbers) == old_count);
+    CHECK(memcmp(numbers, old_numbers, old_count * sizeof(numbers[0])) == 0);
+    CHECK(ds3231_file_storage_close(&image) == 0);
+}
+
+/* Config pages are not cut to fit, the migration fails and says so. */
+static void shrink(void) {
+    unlink(old_path);
+    char * create_args[] = {"create", old_path, "1", "config:2:8", "log:10:16"};
+    CHECK(run(5, create_args) == 0);
+    unlink(new_path);
+    char * args[] = {"migrate", old_path, new_path, "2", "config:2:4", "log:6:16"};
+    CHECK(run(6, args) == 1);
+    /* A larger partition takes all of the old pages. */
+    unlink(new_path);
+    char * grow_args[] = {"migrate", old_path, new_path, "2", "config:2:12", "log:14:16"};
+    CHECK(run(6, grow_args) == 0);
+}
+
+int main(void) {
+    char dir[] = "/tmp/ds3231_sim_image.XXXXXX";
+    if(!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(old_path, sizeof(old_path), "%s/old.bin", dir);
+    snprintf(new_path, sizeof(new_path), "%s/new.bin", dir);
+    format_1();
+    shrink();
+    unlink(old_path);
+    unlink(new_path);
+    rmdir(dir);
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
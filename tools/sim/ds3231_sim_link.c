@@ -0,0 +1,143 @@
+/**
+ * @file    ds3231_sim_link.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Checks the ds3231_link frame parser on byte streams with noise: garbage, stray sync
+ * bytes, a false sync with a long length and a corrupted frame must not hide the valid frames
+ * behind them.
+ * Build and run on the host with:
+ *   cc -I libraries/ds3231 -o ds3231_sim_link tools/sim/ds3231_sim_link.c libraries/ds3231/ds3231_link.c
+ *   ./ds3231_sim_link
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_link.h"
+#include <stdio.h>
+#include <string.h>
+
+static int failures;
+
+#define CHECK(condition) do { \
+    if(!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while(0)
+
+static uint8_t stream[2048];
+static size_t stream_length;
+
+static int stream_write(void * ctx, const uint8_t * data, size_t length) {
+    memcpy(&stream[stream_length], data, length);
+    stream_length += length;
+    return 0;
+}
+
+static void put(const uint8_t * data, size_t length) {
+    stream_write(NULL, data, length);
+}
+
+/* An EXPORT_DATA frame with a payload of the given length, bytes counting up from seq. */
+static void put_frame(uint16_t seq, uint16_t length) {
+    uint8_t payload[DS3231_LINK_PAYLOAD_MAX];
+    for(uint16_t i = 0; i < length; i++)
+        payload[i] = seq + i;
+    CHECK(ds3231_link_send(stream_write, NULL, DS3231_LINK_EXPORT_DATA, seq, NULL, 0, payload, length) == 0);
+}
+
+/* Feed the stream and check that the frames come out in order with their payloads. */
+static void parse(ds3231_link_parser_t * parser, const uint16_t * seqs, const uint16_t * lengths, int count) {
+    int frames = 0;
+    for(size_t i = 0; i < stream_length; i++) {
+        if(ds3231_link_parse(parser, stream[i]) != 1)
+            continue;
+        const ds3231_link_frame_t * frame = &parser->frame;
+        CHECK(frames < count);
+        if(frames >= count)
+            continue;
+        CHECK(frame->type == DS3231_LINK_EXPORT_DATA);
+        CHECK(frame->seq == seqs[frames]);
+        CHECK(frame->length == lengths[frames]);
+        for(uint16_t j = 0; j < frame->length; j++)
+            CHECK(frame->payload[j] == (uint8_t)(seqs[frames] + j));
+        frames++;
+    }
+    CHECK(frames == count);
+    stream_length = 0;
+}
+
+/* The case from the review: one stray sync byte in front of a full size frame. */
+static void stray_sync(void) {
+    ds3231_link_parser_t parser;
+    ds3231_link_parser_init(&parser);
+    uint8_t sync = DS3231_LINK_SYNC;
+    put(&sync, 1);
+    put_frame(0x1234, 260);
+    uint16_t seqs[] = {0x1234};
+    uint16_t lengths[] = {260};
+    parse(&parser, seqs, lengths, 1);
+    CHECK(parser.dropped == 1);
+    CHECK(parser.crc_errors == 0);
+}
+
+/* Garbage with sync bytes in it, between and around valid frames. */
+static void garbage(void) {
+    ds3231_link_parser_t parser;
+    ds3231_link_parser_init(&parser);
+    uint8_t noise[] = {0x00, 0xA5, 0xA5, 0x13, 0xA5, 0x02, 0x01, 0x00, 0xFF, 0x7E};
+    put(noise, sizeof(noise));
+    put_frame(1, 10);
+    put(noise, sizeof(noise));
+    put_frame(2, 0);
+    put_frame(3, 100);
+    put(noise, 3);
+    uint16_t seqs[] = {1, 2, 3};
+    uint16_t lengths[] = {10, 0, 100};
+    parse(&parser, seqs, lengths, 3);
+    /* The two trailing sync bytes are held, the zero before them is not. */
+    CHECK(parser.position == 2);
+}
+
+/* A false sync whose length swallows two frames, the frames win as soon as they end. */
+static void false_length(void) {
+    ds3231_link_parser_t parser;
+    ds3231_link_parser_init(&parser);
+    uint8_t header[] = {DS3231_LINK_SYNC, DS3231_LINK_EXPORT_DATA, 0x00, 0x00, 40, 0x00};
+    put(header, sizeof(header));
+    put_frame(4, 12);
+    put_frame(5, 12);
+    uint8_t noise[30] = {0};
+    put(noise, sizeof(noise));
+    put_frame(6, 1);
+    uint16_t seqs[] = {4, 5, 6};
+    uint16_t lengths[] = {12, 12, 1};
+    parse(&parser, seqs, lengths, 3);
+    CHECK(parser.crc_errors == 0);
+    CHECK(parser.dropped == sizeof(header) + sizeof(noise));
+}
+
+/* A frame with a flipped payload bit is lost, the next one is not. */
+static void corrupted(void) {
+    ds3231_link_parser_t parser;
+    ds3231_link_parser_init(&parser);
+    put_frame(7, 20);
+    stream[10] ^= 0x10;
+    put_frame(8, 20);
+    uint16_t seqs[] = {8};
+    uint16_t lengths[] = {20};
+    parse(&parser, seqs, lengths, 1);
+    CHECK(parser.crc_errors == 1);
+    CHECK(parser.dropped == 28);
+}
+
+int main(void) {
+    stray_sync();
+    garbage();
+    false_length();
+    corrupted();
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
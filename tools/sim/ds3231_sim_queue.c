@@ -0,0 +1,162 @@
+/**
+ * @file    ds3231_sim_queue.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Checks ds3231_queue against the simulated DS3231: merged reads must need fewer
+ * transactions and deliver the same values as separate reads.
+ * Build and run on the host with:
+ *   cc -I tools/sim -I libraries/ds3231 -DDS3231_CONFIG_TRACE=0 -DDS3231_CONFIG_METRICS=0
+ *      -o ds3231_sim_queue tools/sim/ds3231_sim_queue.c tools/sim/ds3231_sim.c
+ *      libraries/ds3231/ds3231.c libraries/ds3231/ds3231_queue.c
+ *   ./ds3231_sim_queue
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_sim.h"
+#include "ds3231_queue.h"
+#include <stdio.h>
+
+static int failures;
+
+#define CHECK(condition) do { \
+    if(!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while(0)
+
+static void check_time(ds3231_t * rtc, const ds3231_data_t * data) {
+    ds3231_data_t expected;
+    ds3231_epoch_to_time(rtc, (uint32_t)(ds3231_sim_rtc_us() / 1000000), &expected);
+    CHECK(data->seconds == expected.seconds);
+    CHECK(data->minutes == expected.minutes);
+    CHECK(data->hours == expected.hours);
+    CHECK(data->date == expected.date);
+    CHECK(data->month == expected.month);
+    CHECK(data->year == expected.year);
+}
+
+/* Time 0x00 - 0x06 and status 0x0F, the reads of a typical superloop iteration. */
+static void time_and_status(void) {
+    ds3231_t rtc;
+    ds3231_queue_t queue;
+    ds3231_data_t time;
+    uint8_t status = 0;
+    ds3231_sim_init(746012345, 0, 0);
+    ds3231_init(&rtc, i2c0, 0, 0);
+    ds3231_queue_init(&queue, DS3231_QUEUE_DEFAULT_MERGE_GAP);
+
+    CHECK(ds3231_queue_read_current_time(&queue, &rtc, &time) == 0);
+    CHECK(ds3231_queue_read_status(&queue, &rtc, &status) == 0);
+    CHECK(ds3231_queue_execute(&queue) == 1);
+    CHECK(ds3231_sim.transactions == 1);
+    CHECK(status == 0x88);
+    check_time(&rtc, &time);
+}
+
+/* Time, status and temperature queued out of order still make one burst. */
+static void out_of_order(void) {
+    ds3231_t rtc;
+    ds3231_queue_t queue;
+    ds3231_data_t time;
+    uint8_t status = 0;
+    int16_t quarters = 0;
+    ds3231_sim_init(1000000, 0, 0);
+    ds3231_sim.regs[0x11] = 0xFE;   // -1.75 degrees.
+    ds3231_sim.regs[0x12] = 0x40;
+    ds3231_init(&rtc, i2c0, 0, 0);
+    ds3231_queue_init(&queue, DS3231_QUEUE_DEFAULT_MERGE_GAP);
+
+    CHECK(ds3231_queue_read_temperature_quarters(&queue, &rtc, &quarters) == 0);
+    CHECK(ds3231_queue_read_status(&queue, &rtc, &status) == 0);
+    CHECK(ds3231_queue_read_current_time(&queue, &rtc, &time) == 0);
+    CHECK(ds3231_queue_execute(&queue) == 1);
+    CHECK(quarters == -7);
+    CHECK(status == 0x88);
+    check_time(&rtc, &time);
+}
+
+/* Without a gap only touching ranges merge. */
+static void no_gap(void) {
+    ds3231_t rtc;
+    ds3231_queue_t queue;
+    ds3231_data_t time;
+    uint8_t status = 0;
+    ds3231_sim_init(1000000, 0, 0);
+    ds3231_init(&rtc, i2c0, 0, 0);
+    ds3231_queue_init(&queue, 0);
+
+    CHECK(ds3231_queue_read_current_time(&queue, &rtc, &time) == 0);
+    CHECK(ds3231_queue_read_status(&queue, &rtc, &status) == 0);
+    CHECK(ds3231_queue_execute(&queue) == 2);
+    CHECK(status == 0x88);
+    check_time(&rtc, &time);
+}
+
+/* Reads of two devices are grouped per device, whatever order they were queued in. */
+static void two_devices(void) {
+    ds3231_t first, second;
+    ds3231_queue_t queue;
+    uint8_t status[4] = {0};
+    ds3231_sim_init(1000000, 0, 0);
+    ds3231_init(&first, i2c0, 0, 0);
+    ds3231_init(&second, i2c1, 0, 0);
+    ds3231_queue_init(&queue, DS3231_QUEUE_DEFAULT_MERGE_GAP);
+
+    CHECK(ds3231_queue_read_status(&queue, &second, &status[0]) == 0);
+    CHECK(ds3231_queue_read_status(&queue, &first, &status[1]) == 0);
+    CHECK(ds3231_queue_read_status(&queue, &second, &status[2]) == 0);
+    CHECK(ds3231_queue_read_status(&queue, &first, &status[3]) == 0);
+    CHECK(ds3231_queue_execute(&queue) == 2);
+    for(int i = 0; i < 4; i++)
+        CHECK(status[i] == 0x88);
+}
+
+/* Two structs of the same DS3231 share its bursts. */
+static void same_device(void) {
+    ds3231_t first, second;
+    ds3231_queue_t queue;
+    ds3231_data_t time;
+    uint8_t status = 0;
+    ds3231_sim_init(1000000, 0, 0);
+    ds3231_init(&first, i2c0, 0, 0);
+    ds3231_init(&second, i2c0, 0, 0);
+    ds3231_queue_init(&queue, DS3231_QUEUE_DEFAULT_MERGE_GAP);
+
+    CHECK(ds3231_queue_read_status(&queue, &second, &status) == 0);
+    CHECK(ds3231_queue_read_current_time(&queue, &first, &time) == 0);
+    CHECK(ds3231_queue_execute(&queue) == 1);
+    CHECK(status == 0x88);
+    check_time(&first, &time);
+}
+
+/* A failed burst is reported and the queue is empty afterwards. */
+static void failure(void) {
+    ds3231_t rtc;
+    ds3231_queue_t queue;
+    uint8_t status = 0;
+    ds3231_sim_init(1000000, 0, 0);
+    ds3231_init(&rtc, i2c0, 0, 0);
+    ds3231_queue_init(&queue, DS3231_QUEUE_DEFAULT_MERGE_GAP);
+
+    ds3231_sim.fail = true;
+    CHECK(ds3231_queue_read_status(&queue, &rtc, &status) == 0);
+    CHECK(ds3231_queue_execute(&queue) == -1);
+    CHECK(queue.count == 0);
+    ds3231_sim.fail = false;
+    CHECK(ds3231_queue_execute(&queue) == 0);
+}
+
+int main(void) {
+    time_and_status();
+    out_of_order();
+    no_gap();
+    two_devices();
+    same_device();
+    failure();
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
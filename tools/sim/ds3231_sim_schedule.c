@@ -0,0 +1,190 @@
+/**
+ * @file    ds3231_sim_schedule.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Checks that ds3231_schedule survives resets: a save cut off after any program, or a
+ * corrupted copy, must bring back the last complete schedule, and the newest copy must win also
+ * after the sequence number wrapped. The schedule is armed on the simulated DS3231 at the end,
+ * unless the pin arbiter owns alarm 1.
+ * Build and run on the host with:
+ *   cc -I tools/sim -I libraries/ds3231 -DDS3231_CONFIG_TRACE=0 -DDS3231_CONFIG_METRICS=0
+ *      -o ds3231_sim_schedule tools/sim/ds3231_sim_schedule.c tools/sim/ds3231_sim.c
+ *      libraries/ds3231/ds3231.c libraries/ds3231/ds3231_schedule.c libraries/ds3231/ds3231_storage.c
+ *      libraries/ds3231/ds3231_link.c libraries/ds3231/ds3231_pin.c
+ *   ./ds3231_sim_schedule
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_sim.h"
+#include "ds3231_schedule.h"
+#include "ds3231_pin.h"
+#include <stdio.h>
+#include <string.h>
+
+/* AT24C32 geometry, the schedule starts at page 10. */
+#define EEPROM_PAGE_SIZE                32
+#define EEPROM_PAGE_COUNT               128
+#define FIRST_PAGE                      10
+#define EPOCH                           746012345
+
+static int failures;
+
+#define CHECK(condition) do { \
+    if(!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while(0)
+
+static uint8_t memory[EEPROM_PAGE_SIZE * EEPROM_PAGE_COUNT];
+static int programs_left;           // Programs until the simulated reset, -1 for no reset.
+
+static int eeprom_read(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data) {
+    memcpy(data, &memory[page * EEPROM_PAGE_SIZE + offset], length);
+    return 0;
+}
+
+static int eeprom_program(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data) {
+    if(!programs_left)
+        return -1;
+    if(programs_left > 0)
+        programs_left--;
+    memcpy(&memory[page * EEPROM_PAGE_SIZE + offset], data, length);
+    return 0;
+}
+
+static const ds3231_storage_ops_t eeprom_ops = {
+    .read = eeprom_read,
+    .program = eeprom_program,
+    .busy = NULL
+};
+
+static ds3231_storage_t eeprom = {
+    .ops = &eeprom_ops,
+    .page_size = EEPROM_PAGE_SIZE,
+    .page_count = EEPROM_PAGE_COUNT,
+    .erase_pages = 1,
+    .write_cycle_us = 0
+};
+
+static void erase(void) {
+    memset(memory, 0xFF, sizeof(memory));
+    programs_left = -1;
+}
+
+/* Next deadline of an alarm after a reboot, 0 if it is not scheduled. */
+static uint32_t deadline_of(uint8_t id) {
+    ds3231_schedule_t sched;
+    programs_left = -1;
+    CHECK(ds3231_schedule_init(&sched, &eeprom, FIRST_PAGE) == 0);
+    for(int i = 0; i < DS3231_SCHEDULE_MAX; i++) {
+        if(sched.entries[i].flags && sched.entries[i].id == id)
+            return sched.entries[i].next;
+    }
+    return 0;
+}
+
+static void reload(void) {
+    ds3231_schedule_t sched;
+    erase();
+    CHECK(ds3231_schedule_init(&sched, &eeprom, FIRST_PAGE) == 0);
+    CHECK(ds3231_schedule_add(&sched, 1, EPOCH + 60, 60, 0) == 0);
+    CHECK(ds3231_schedule_add(&sched, 2, EPOCH + 3600, 0, 0) == 0);
+    CHECK(deadline_of(1) == EPOCH + 60);
+    CHECK(deadline_of(2) == EPOCH + 3600);
+    /* Nothing beyond the two copies is touched. */
+    for(uint32_t i = (FIRST_PAGE + 6) * EEPROM_PAGE_SIZE; i < sizeof(memory); i++)
+        CHECK(memory[i] == 0xFF);
+}
+
+/* Cut a save off after every possible number of programs, the schedule is the old or the new one. */
+static void torn(void) {
+    for(int cut = 0; cut < 4; cut++) {
+        ds3231_schedule_t sched;
+        erase();
+        CHECK(ds3231_schedule_init(&sched, &eeprom, FIRST_PAGE) == 0);
+        CHECK(ds3231_schedule_add(&sched, 1, EPOCH + 60, 60, 0) == 0);
+        CHECK(ds3231_schedule_add(&sched, 3, EPOCH + 90, 0, 0) == 0);
+        programs_left = cut;
+        int result = ds3231_schedule_add(&sched, 1, EPOCH + 120, 60, 0);
+        uint32_t deadline = deadline_of(1);
+        if(result)
+            CHECK(deadline == EPOCH + 60);
+        else
+            CHECK(deadline == EPOCH + 120);
+        CHECK(deadline_of(3) == EPOCH + 90);
+    }
+}
+
+/* A flipped bit in the newer copy falls back to the older one. */
+static void corrupted(void) {
+    ds3231_schedule_t sched;
+    erase();
+    CHECK(ds3231_schedule_init(&sched, &eeprom, FIRST_PAGE) == 0);
+    CHECK(ds3231_schedule_add(&sched, 1, EPOCH + 60, 60, 0) == 0);
+    CHECK(ds3231_schedule_add(&sched, 1, EPOCH + 120, 60, 0) == 0);
+    uint32_t pages = (DS3231_SCHEDULE_IMAGE_SIZE + EEPROM_PAGE_SIZE - 1) / EEPROM_PAGE_SIZE;
+    memory[(FIRST_PAGE + sched.copy * pages) * EEPROM_PAGE_SIZE + 1] ^= 0x04;
+    CHECK(deadline_of(1) == EPOCH + 60);
+}
+
+static void count_call(void * ctx, uint8_t id, uint32_t deadline, uint32_t count) {
+    (*(uint32_t *)ctx) += count;
+}
+
+/* Hundreds of saves wrap the sequence number, the last one is still loaded. */
+static void wrapped(void) {
+    ds3231_schedule_t sched;
+    erase();
+    CHECK(ds3231_schedule_init(&sched, &eeprom, FIRST_PAGE) == 0);
+    CHECK(ds3231_schedule_add(&sched, 4, EPOCH + 1, 1, 0) == 0);
+    uint32_t dispatched = 0;
+    for(uint32_t now = EPOCH + 1; now < EPOCH + 600; now++)
+        CHECK(ds3231_schedule_run(&sched, now, count_call, &dispatched) == 1);
+    CHECK(dispatched == 599);
+    CHECK(deadline_of(4) == EPOCH + 600);
+}
+
+/* After a reboot the schedule catches up and arms alarm 1 of the DS3231. */
+static void arm(void) {
+    ds3231_t rtc;
+    ds3231_schedule_t sched;
+    uint32_t dispatched = 0;
+    erase();
+    ds3231_sim_init(EPOCH, 0, 0);
+    ds3231_init(&rtc, i2c0, 0, 0);
+    CHECK(ds3231_schedule_init(&sched, &eeprom, FIRST_PAGE) == 0);
+    CHECK(ds3231_schedule_add(&sched, 5, EPOCH + 10, 10, 0) == 0);
+    CHECK(ds3231_schedule_init(&sched, &eeprom, FIRST_PAGE) == 0);
+    CHECK(ds3231_schedule_run(&sched, EPOCH + 35, count_call, &dispatched) == 3);
+    CHECK(dispatched == 3);
+    CHECK(ds3231_schedule_arm(&sched, &rtc, EPOCH + 35) == 0);
+    /* Alarm 1 seconds register holds the seconds of EPOCH + 40 in BCD. */
+    ds3231_data_t expected;
+    ds3231_epoch_to_time(&rtc, EPOCH + 40, &expected);
+    CHECK(ds3231_sim.regs[0x07] == (((expected.seconds / 10) << 4) | (expected.seconds % 10)));
+    CHECK(deadline_of(5) == EPOCH + 40);
+
+    /* Alarm 1 belongs to the pin arbiter or a hybrid engine while one of them runs. */
+    ds3231_pin_t pin;
+    CHECK(ds3231_pin_init(&pin, &rtc, 2) == 0);
+    ds3231_sim.regs[0x07] = 0;
+    CHECK(ds3231_schedule_arm(&sched, &rtc, EPOCH + 35) == -1);
+    CHECK(ds3231_sim.regs[0x07] == 0);
+    CHECK(ds3231_pin_deinit(&pin) == 0);
+    CHECK(ds3231_schedule_arm(&sched, &rtc, EPOCH + 35) == 0);
+    CHECK(ds3231_sim.regs[0x07] != 0);
+}
+
+int main(void) {
+    reload();
+    torn();
+    corrupted();
+    wrapped();
+    arm();
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
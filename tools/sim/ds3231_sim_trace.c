@@ -0,0 +1,150 @@
+/**
+ * @file    ds3231_sim_trace.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Checks ds3231_trace against the simulated DS3231: a capture, also one that wrapped,
+ * replays with the bus failing and gives the captured values, and a driver that issues other
+ * transfers than the captured ones is caught.
+ * Build and run on the host with:
+ *   cc -I tools/sim -I libraries/ds3231 -DDS3231_CONFIG_TRACE=1 -DDS3231_CONFIG_METRICS=0
+ *      -o ds3231_sim_trace tools/sim/ds3231_sim_trace.c tools/sim/ds3231_sim.c
+ *      libraries/ds3231/ds3231.c libraries/ds3231/ds3231_trace.c
+ *   ./ds3231_sim_trace
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_sim.h"
+#include "ds3231_trace.h"
+#include <stdio.h>
+
+/* Every operation below is a register write and a read, two records. */
+#define OPERATIONS                      5
+
+static int failures;
+
+#define CHECK(condition) do { \
+    if(!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while(0)
+
+typedef struct values_t {
+    ds3231_data_t time;
+    uint8_t status;
+    int16_t quarters;
+    uint8_t control;
+} values_t;
+
+/* Operations in an order that only matches the records one way. */
+static int operation(ds3231_t * rtc, int index, values_t * values) {
+    switch(index % 4) {
+        case 0:
+            return ds3231_read_current_time(rtc, &values->time);
+        case 1:
+            return i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_STATUS_REG, 1, &values->status);
+        case 2:
+            return ds3231_read_temperature_quarters(rtc, &values->quarters);
+        default:
+            return i2c_read_reg(rtc->i2c, rtc->ds3231_addr, DS3231_CONTROL_REG, 1, &values->control);
+    }
+}
+
+static void capture(ds3231_t * rtc, ds3231_trace_t * trace, values_t * values) {
+    CHECK(ds3231_trace_start(trace, DS3231_TRACE_CAPTURE) == 0);
+    for(int i = 0; i < OPERATIONS; i++) {
+        ds3231_sim_advance_us(700000);
+        CHECK(operation(rtc, i, &values[i]) == 0);
+    }
+    CHECK(ds3231_trace_stop() == 0);
+}
+
+/* Replay the operations from first on without the bus and compare with the capture. */
+static void replay(ds3231_t * rtc, ds3231_trace_t * trace, const values_t * captured, int first) {
+    values_t values[OPERATIONS] = {0};
+    ds3231_sim.fail = true;
+    CHECK(ds3231_trace_start(trace, DS3231_TRACE_REPLAY) == 0);
+    for(int i = first; i < OPERATIONS; i++)
+        CHECK(operation(rtc, i, &values[i]) == 0);
+    CHECK(trace->mismatch == -1);
+    /* Nothing was captured after the last operation. */
+    CHECK(operation(rtc, 0, &values[0]) == -1);
+    CHECK(trace->mismatch == (int32_t)trace->count);
+    CHECK(ds3231_trace_stop() == 0);
+    ds3231_sim.fail = false;
+
+    for(int i = first; i < OPERATIONS; i++) {
+        CHECK(values[i].time.seconds == captured[i].time.seconds);
+        CHECK(values[i].time.minutes == captured[i].time.minutes);
+        CHECK(values[i].status == captured[i].status);
+        CHECK(values[i].quarters == captured[i].quarters);
+        CHECK(values[i].control == captured[i].control);
+    }
+}
+
+static void whole(void) {
+    ds3231_t rtc;
+    ds3231_trace_t trace;
+    ds3231_trace_record_t records[2 * OPERATIONS];
+    values_t captured[OPERATIONS] = {0};
+    ds3231_sim_init(746012345, 0, 0);
+    ds3231_sim.regs[0x11] = 0x19;
+    ds3231_sim.regs[0x12] = 0x80;
+    ds3231_init(&rtc, i2c0, 0, 0);
+    CHECK(ds3231_trace_init(&trace, records, 2 * OPERATIONS, 0) == 0);
+    capture(&rtc, &trace, captured);
+    CHECK(trace.count == 2 * OPERATIONS);
+    CHECK(captured[2].quarters == 25 * 4 + 2);
+    replay(&rtc, &trace, captured, 0);
+}
+
+/* Room for the last three operations only, replay starts at the oldest one kept. */
+static void wrapped(void) {
+    ds3231_t rtc;
+    ds3231_trace_t trace;
+    ds3231_trace_record_t records[6];
+    values_t captured[OPERATIONS] = {0};
+    ds3231_sim_init(746012345, 0, 0);
+    ds3231_init(&rtc, i2c0, 0, 0);
+    CHECK(ds3231_trace_init(&trace, records, 6, 0) == 0);
+    capture(&rtc, &trace, captured);
+    CHECK(trace.count == 6);
+    CHECK(ds3231_trace_get(&trace, 0)->data[0] == DS3231_TEMPERATURE_MSB_REG);
+    replay(&rtc, &trace, captured, OPERATIONS - 3);
+    /* Rotated once, a second replay starts from the same record. */
+    CHECK(ds3231_trace_get(&trace, 0)->data[0] == DS3231_TEMPERATURE_MSB_REG);
+    replay(&rtc, &trace, captured, OPERATIONS - 3);
+}
+
+/* A driver that reads something else than what was captured fails at that record. */
+static void mismatch(void) {
+    ds3231_t rtc;
+    ds3231_trace_t trace;
+    ds3231_trace_record_t records[2 * OPERATIONS];
+    values_t captured[OPERATIONS] = {0};
+    values_t values = {0};
+    ds3231_sim_init(746012345, 0, 0);
+    ds3231_init(&rtc, i2c0, 0, 0);
+    CHECK(ds3231_trace_init(&trace, records, 2 * OPERATIONS, 0) == 0);
+    capture(&rtc, &trace, captured);
+
+    CHECK(ds3231_trace_start(&trace, DS3231_TRACE_REPLAY) == 0);
+    CHECK(operation(&rtc, 0, &values) == 0);
+    CHECK(operation(&rtc, 2, &values) == -1);
+    CHECK(trace.mismatch == 2);
+    /* Everything after a mismatch fails too. */
+    CHECK(operation(&rtc, 1, &values) == -1);
+    CHECK(trace.mismatch == 2);
+    CHECK(ds3231_trace_stop() == 0);
+}
+
+int main(void) {
+    whole();
+    wrapped();
+    mismatch();
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,226 @@
+/**
+ * @file    ds3231_sim_writer.c
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Checks ds3231_writer on the virtual time of the simulation with a stand-in EEPROM that
+ * is busy for a write cycle after every program: a program into a full queue returns at once,
+ * the schedule hook drains the queue, failed writes are retried with growing delays and dropped
+ * after the last attempt.
+ * Build and run on the host with:
+ *   cc -I tools/sim -I libraries/ds3231 -o ds3231_sim_writer tools/sim/ds3231_sim_writer.c
+ *      tools/sim/ds3231_sim.c libraries/ds3231/ds3231_writer.c libraries/ds3231/ds3231_storage.c
+ *   ./ds3231_sim_writer
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ds3231_sim.h"
+#include "ds3231_writer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define EEPROM_PAGE_SIZE                32
+#define EEPROM_PAGE_COUNT               16
+#define EEPROM_WRITE_CYCLE_US           10000
+
+static int failures;
+
+#define CHECK(condition) do { \
+    if(!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while(0)
+
+static uint8_t memory[EEPROM_PAGE_SIZE * EEPROM_PAGE_COUNT];
+static uint64_t ready_us;           // End of the write cycle in progress.
+static int failing;                 // Programs that fail before the next one succeeds, -1 for all.
+static uint32_t programs;
+
+static int eeprom_read(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, uint8_t * data) {
+    if(time_us_64() < ready_us)
+        return -1;
+    memcpy(data, &memory[page * EEPROM_PAGE_SIZE + offset], length);
+    return 0;
+}
+
+static int eeprom_program(ds3231_storage_t * storage, uint32_t page, uint32_t offset, size_t length, const uint8_t * data) {
+    programs++;
+    if(time_us_64() < ready_us)
+        return -1;
+    if(failing) {
+        if(failing > 0)
+            failing--;
+        return -1;
+    }
+    memcpy(&memory[page * EEPROM_PAGE_SIZE + offset], data, length);
+    ready_us = time_us_64() + EEPROM_WRITE_CYCLE_US;
+    return 0;
+}
+
+static int eeprom_busy(ds3231_storage_t * storage) {
+    return time_us_64() < ready_us;
+}
+
+static const ds3231_storage_ops_t eeprom_ops = {
+    .read = eeprom_read,
+    .program = eeprom_program,
+    .busy = eeprom_busy
+};
+
+static ds3231_storage_t eeprom = {
+    .ops = &eeprom_ops,
+    .page_size = EEPROM_PAGE_SIZE,
+    .page_count = EEPROM_PAGE_COUNT,
+    .erase_pages = 1,
+    .write_cycle_us = EEPROM_WRITE_CYCLE_US
+};
+
+/* What a timer would do: remember when the next poll is due. */
+static uint64_t due_us;
+static uint32_t last_delay_us;
+static uint32_t scheduled;
+
+static void schedule(void * ctx, uint32_t delay_us) {
+    due_us = time_us_64() + delay_us;
+    last_delay_us = delay_us;
+    scheduled++;
+}
+
+static void setup(ds3231_writer_t * writer) {
+    ds3231_sim_init(746012345, 0, 0);
+    memset(memory, 0xFF, sizeof(memory));
+    ready_us = 0;
+    failing = 0;
+    programs = 0;
+    scheduled = 0;
+    CHECK(ds3231_writer_init(writer, &eeprom) == 0);
+}
+
+static void fill(uint8_t * data, uint32_t page) {
+    for(int i = 0; i < EEPROM_PAGE_SIZE; i++)
+        data[i] = page * 7 + i;
+}
+
+/* A program into a full queue is refused without any time passing, the queue drains later. */
+static void full(void) {
+    ds3231_writer_t writer;
+    uint8_t data[EEPROM_PAGE_SIZE];
+    setup(&writer);
+    /* The first program is issued at once, the device is busy for the others. */
+    for(uint32_t page = 0; page <= DS3231_WRITER_QUEUE_LENGTH; page++) {
+        fill(data, page);
+        CHECK(ds3231_storage_program(&writer.storage, page, 0, EEPROM_PAGE_SIZE, data) == 0);
+    }
+    CHECK(writer.count == DS3231_WRITER_QUEUE_LENGTH);
+    uint64_t before = ds3231_sim.now_us;
+    fill(data, DS3231_WRITER_QUEUE_LENGTH + 1);
+    CHECK(ds3231_storage_program(&writer.storage, DS3231_WRITER_QUEUE_LENGTH + 1, 0, EEPROM_PAGE_SIZE, data)
+        == DS3231_WRITER_FULL);
+    CHECK(ds3231_sim.now_us == before);
+    CHECK(writer.stalls == 1);
+
+    /* Queued data reads back before it reaches the device. */
+    uint8_t read[EEPROM_PAGE_SIZE];
+    CHECK(ds3231_storage_read(&writer.storage, 3, 0, EEPROM_PAGE_SIZE, read) == 0);
+    fill(data, 3);
+    CHECK(memcmp(read, data, EEPROM_PAGE_SIZE) == 0);
+
+    while(writer.count) {
+        ds3231_sim_advance_us(1000);
+        CHECK(ds3231_writer_poll(&writer) >= 0);
+    }
+    CHECK(writer.issued == DS3231_WRITER_QUEUE_LENGTH + 1);
+    for(uint32_t page = 0; page <= DS3231_WRITER_QUEUE_LENGTH; page++) {
+        fill(data, page);
+        CHECK(memcmp(&memory[page * EEPROM_PAGE_SIZE], data, EEPROM_PAGE_SIZE) == 0);
+    }
+}
+
+/* Polling only when the hook asked for it drains the queue one write cycle per write. */
+static void scheduled_drain(void) {
+    ds3231_writer_t writer;
+    uint8_t data[EEPROM_PAGE_SIZE];
+    setup(&writer);
+    ds3231_writer_set_schedule(&writer, schedule, NULL);
+    for(uint32_t page = 0; page < 4; page++) {
+        fill(data, page);
+        CHECK(ds3231_storage_program(&writer.storage, page, 0, EEPROM_PAGE_SIZE, data) == 0);
+    }
+    CHECK(scheduled > 0);
+    CHECK(last_delay_us == EEPROM_WRITE_CYCLE_US);
+    int polls = 0;
+    while(writer.count && polls < 20) {
+        ds3231_sim.now_us = due_us;
+        CHECK(ds3231_writer_poll(&writer) >= 0);
+        polls++;
+    }
+    CHECK(writer.count == 0);
+    CHECK(writer.issued == 4);
+    CHECK(polls == 3);
+    CHECK(ds3231_sim.now_us == 3 * EEPROM_WRITE_CYCLE_US);
+}
+
+/* A failing write waits longer before every retry and is written once the device recovers. */
+static void retry(void) {
+    ds3231_writer_t writer;
+    uint8_t data[EEPROM_PAGE_SIZE];
+    setup(&writer);
+    ds3231_writer_set_schedule(&writer, schedule, NULL);
+    failing = 2;
+    fill(data, 5);
+    CHECK(ds3231_storage_program(&writer.storage, 5, 0, EEPROM_PAGE_SIZE, data) == 0);
+    CHECK(writer.failures == 1);
+    CHECK(last_delay_us == DS3231_WRITER_RETRY_US);
+
+    /* Nothing is tried before the retry delay is over. */
+    ds3231_sim_advance_us(DS3231_WRITER_RETRY_US / 2);
+    CHECK(ds3231_writer_poll(&writer) == 1);
+    CHECK(programs == 1);
+
+    ds3231_sim.now_us = due_us;
+    CHECK(ds3231_writer_poll(&writer) == -1);
+    CHECK(last_delay_us == 2 * DS3231_WRITER_RETRY_US);
+    ds3231_sim.now_us = due_us;
+    CHECK(ds3231_writer_poll(&writer) == 0);
+    CHECK(writer.issued == 1);
+    CHECK(writer.failures == 2);
+    CHECK(writer.attempts == 0);
+    CHECK(memcmp(&memory[5 * EEPROM_PAGE_SIZE], data, EEPROM_PAGE_SIZE) == 0);
+}
+
+/* A write that never succeeds is dropped and reported, the writes behind it go on. */
+static void drop(void) {
+    ds3231_writer_t writer;
+    uint8_t data[EEPROM_PAGE_SIZE];
+    setup(&writer);
+    failing = DS3231_WRITER_ATTEMPTS;
+    fill(data, 6);
+    CHECK(ds3231_storage_program(&writer.storage, 6, 0, EEPROM_PAGE_SIZE, data) == 0);
+    fill(data, 7);
+    CHECK(ds3231_storage_program(&writer.storage, 7, 0, EEPROM_PAGE_SIZE, data) == 0);
+    int result = -1;
+    for(int i = 1; i < DS3231_WRITER_ATTEMPTS; i++) {
+        ds3231_sim_advance_us(DS3231_WRITER_RETRY_US << (i - 1));
+        result = ds3231_writer_poll(&writer);
+    }
+    CHECK(result == DS3231_WRITER_DROPPED);
+    CHECK(writer.dropped == 1);
+    CHECK(writer.dropped_page == 6);
+    CHECK(writer.failures == DS3231_WRITER_ATTEMPTS);
+    CHECK(writer.count == 1);
+    CHECK(ds3231_writer_flush(&writer) == 0);
+    CHECK(memcmp(&memory[7 * EEPROM_PAGE_SIZE], data, EEPROM_PAGE_SIZE) == 0);
+    CHECK(memory[6 * EEPROM_PAGE_SIZE] == 0xFF);
+}
+
+int main(void) {
+    full();
+    scheduled_drain();
+    retry();
+    drop();
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+/**
+ * @file    gpio.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Stand-in for the Pico SDK GPIO functions. The simulator has no pins, they do nothing.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "pico/types.h"
+
+#ifndef DS_3231_SIM_GPIO
+#define DS_3231_SIM_GPIO
+
+enum gpio_irq_level {
+    GPIO_IRQ_LEVEL_LOW = 0x1u,
+    GPIO_IRQ_LEVEL_HIGH = 0x2u,
+    GPIO_IRQ_EDGE_FALL = 0x4u,
+    GPIO_IRQ_EDGE_RISE = 0x8u
+};
+
+enum gpio_function {
+    GPIO_FUNC_I2C = 3
+};
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_pull_up(uint gpio);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback);
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled);
+
+#endif
@@ -0,0 +1,28 @@
+/**
+ * @file    i2c.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Stand-in for the Pico SDK I2C functions. Transfers go to the simulated DS3231.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "pico/types.h"
+
+#ifndef DS_3231_SIM_I2C
+#define DS_3231_SIM_I2C
+
+typedef struct i2c_inst i2c_inst_t;
+
+extern i2c_inst_t * i2c0;
+extern i2c_inst_t * i2c1;
+#define i2c_default                     i2c0
+
+uint i2c_init(i2c_inst_t * i2c, uint baudrate);
+uint i2c_hw_index(i2c_inst_t * i2c);
+int i2c_write_blocking(i2c_inst_t * i2c, uint8_t addr, const uint8_t * src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t * i2c, uint8_t addr, uint8_t * dst, size_t len, bool nostop);
+
+#endif
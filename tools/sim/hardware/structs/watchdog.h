@@ -0,0 +1,28 @@
+/**
+ * @file    watchdog.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Stand-in for the watchdog registers, so breadcrumbs can be checked on the host.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdint.h>
+
+#ifndef DS_3231_SIM_WATCHDOG_STRUCTS
+#define DS_3231_SIM_WATCHDOG_STRUCTS
+
+typedef struct {
+    volatile uint32_t ctrl;
+    volatile uint32_t load;
+    volatile uint32_t reason;
+    volatile uint32_t scratch[8];
+    volatile uint32_t tick;
+} watchdog_hw_t;
+
+extern watchdog_hw_t ds3231_sim_watchdog;
+#define watchdog_hw                     (&ds3231_sim_watchdog)
+
+#endif
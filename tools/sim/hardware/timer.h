@@ -0,0 +1,22 @@
+/**
+ * @file    timer.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Stand-in for the Pico SDK timer. Returns the local clock of the simulation, which runs
+ * at the rate set with ds3231_sim_init.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "pico/types.h"
+
+#ifndef DS_3231_SIM_TIMER
+#define DS_3231_SIM_TIMER
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+void busy_wait_us(uint64_t delay_us);
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * @file    types.h
+ * @author  Alper Tunga Güven (alperguven@std.iyte.edu.tr)
+ * @brief   Stand-in for the Pico SDK types, so the driver builds on the host against ds3231_sim.
+ * Only what the simulated modules use is declared.
+ * @version 0.1
+ * @date    2023-08-12
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef DS_3231_SIM_TYPES
+#define DS_3231_SIM_TYPES
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+
+#define PICO_ERROR_GENERIC              -1
+#define PICO_ERROR_TIMEOUT              -2
+
+#endif